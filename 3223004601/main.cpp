@@ -3,12 +3,14 @@
 #include <vector>
 #include <string>
 #include <algorithm>
-#include <unordered_set>
 #include <cstdint>
-#include <cstring>
 #include <iomanip>
 #include <memory>
 #include <stdexcept>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <utility>
 
 // Visual Studio 2017 兼容性宏
 #ifdef _MSC_VER
@@ -17,223 +19,814 @@
     #define _CRT_SECURE_NO_WARNINGS
 #endif
 
-// 判断是否为中日韩统一表意文字（CJK字符）
-bool is_cjk(uint32_t cp) {
-    // 检查Unicode码点是否在CJK字符范围内
-    if ((cp >= 0x4E00 && cp <= 0x9FFF) ||      // CJK统一表意文字
-        (cp >= 0x3400 && cp <= 0x4DBF) ||      // CJK扩展A
-        (cp >= 0xF900 && cp <= 0xFAFF) ||      // CJK兼容表意文字
-        (cp >= 0x20000 && cp <= 0x2A6DF) ||    // CJK扩展B
-        (cp >= 0x2A700 && cp <= 0x2B73F) ||    // CJK扩展C
-        (cp >= 0x2B740 && cp <= 0x2B81F) ||    // CJK扩展D
-        (cp >= 0x2B820 && cp <= 0x2CEAF) ||    // CJK扩展E
-        (cp >= 0x2CEB0 && cp <= 0x2EBEF)) return true;  // CJK扩展F
-    return false;
-}
-
-// 判断ASCII字符是否应该保留（字母和数字）
-bool is_keep_ascii(char c) {
-    if (c >= 'A' && c <= 'Z') return true;  // 大写字母
-    if (c >= 'a' && c <= 'z') return true;  // 小写字母
-    if (c >= '0' && c <= '9') return true;  // 数字
-    return false;  // 其他字符（标点、空格等）不保留
-}
-
-// 将ASCII大写字母转换为小写
-char to_lower_ascii(char c) {
-    if (c >= 'A' && c <= 'Z') return c - 'A' + 'a';
-    return c;  // 非大写字母直接返回
-}
-
-// UTF-8解码器：从字节流中读取下一个Unicode码点，并推进索引
-// 遇到无效字节时跳过（返回0表示跳过）
-uint32_t utf8_next(const std::vector<unsigned char>& bytes, size_t& i) {
-    if (i >= bytes.size()) return 0;  // 超出范围
-    unsigned char b0 = bytes[i];
-    
-    // 单字节字符（ASCII）
-    if (b0 < 0x80) {
-        i++;
-        return b0;
-    }
-    
-    // 确定多字节序列长度
-    int seqlen = 0;
-    uint32_t cp = 0;
-    if ((b0 & 0xE0) == 0xC0) { seqlen = 2; cp = b0 & 0x1F; }      // 2字节序列
-    else if ((b0 & 0xF0) == 0xE0) { seqlen = 3; cp = b0 & 0x0F; }  // 3字节序列
-    else if ((b0 & 0xF8) == 0xF0) { seqlen = 4; cp = b0 & 0x07; }  // 4字节序列
-    else { i++; return 0; }  // 无效的首字节
-    
-    // 检查是否有足够的字节
-    if (i + seqlen > bytes.size()) { i = bytes.size(); return 0; }
-    
-    // 读取后续字节
-    for (int k = 1; k < seqlen; ++k) {
-        unsigned char bx = bytes[i + k];
-        if ((bx & 0xC0) != 0x80) { i++; return 0; }  // 无效的后续字节
-        cp = (cp << 6) | (uint32_t)(bx & 0x3F);  // 组合码点
-    }
-    
-    // 检查过短编码（overlong encoding）
-    if (seqlen == 2 && cp < 0x80) { i++; return 0; }
-    if (seqlen == 3 && cp < 0x800) { i++; return 0; }
-    if (seqlen == 4 && cp < 0x10000) { i++; return 0; }
-    
-    // UTF-16代理对在UTF-8中无效
-    if (cp >= 0xD800 && cp <= 0xDFFF) { i++; return 0; }
-    
-    i += seqlen;
-    return cp;
-}
-
-// 将文件内容读取到字节向量
-std::vector<unsigned char> read_file_to_bytes(const std::string& path) {
-    std::ifstream file(path, std::ios::binary);
-    if (!file.is_open()) {
-        throw std::runtime_error("Failed to open file: " + path);
-    }
-    
-    // 获取文件大小
-    file.seekg(0, std::ios::end);
-    auto size = static_cast<size_t>(file.tellg());
-    if (size == 0) {
-        return {}; // 空文件
-    }
-    file.seekg(0, std::ios::beg);
-    
-    // 读取文件内容
-    std::vector<unsigned char> bytes(size);
-    file.read(reinterpret_cast<char*>(bytes.data()), static_cast<std::streamsize>(size));
-    
-    if (file.fail() && !file.eof()) {
-        throw std::runtime_error("Failed to read file: " + path);
-    }
-    
-    return bytes;
-}
-
-// 将UTF-8字节流转换为归一化的码点序列
-// 只保留字母、数字（转小写）和CJK字符，过滤标点符号和空白
-std::vector<uint32_t> normalize_to_codepoints(const std::vector<unsigned char>& bytes) {
-    std::vector<uint32_t> codepoints;
-    size_t i = 0;
-    
-    while (i < bytes.size()) {
-        uint32_t cp = utf8_next(bytes, i);
-        if (cp == 0) continue; // 跳过无效字符
-        
-        if (cp < 128) {  // ASCII字符
-            if (is_keep_ascii(static_cast<char>(cp))) {  // 只保留字母和数字
-                cp = to_lower_ascii(static_cast<char>(cp));  // 转换为小写
-                codepoints.push_back(cp);
-            }
-            // 其他ASCII字符（标点、空格等）直接丢弃
-        } else {  // 非ASCII字符
-            if (is_cjk(cp)) {  // 只保留CJK字符
-                codepoints.push_back(cp);
+#include "plagiarism_detector.h"
+
+using namespace pd;
+
+// 将缓存统计输出到标准错误
+void print_cache_stats(FingerprintCache& cache) {
+    FingerprintCacheStats stats = cache.stats();
+    std::cerr << "Fingerprint cache: " << stats.hits << " hits, " << stats.misses << " misses, "
+              << stats.evictions << " evicted, " << stats.bytes_in_use / 1024 << " KiB in use" << std::endl;
+}
+
+// 比较模式输出的相似度
+enum class ScoreMetric {
+    Jaccard,      // 集合Jaccard（默认）
+    Containment,  // 抄袭版有多大比例出现在原文中
+    Coverage,     // 原文有多大比例出现在抄袭版中
+    Weighted,     // 按出现次数的多重集合Jaccard
+    All,          // 以上四项，空格分隔
+    TfIdf         // 按文档频率表做TF-IDF加权的Jaccard，需要 --df
+};
+
+// 比较模式的检测引擎
+enum class MatchEngine {
+    KGram,  // k-gram指纹集合（默认）
+    Suffix  // 后缀数组上的精确公共子串，相似度为覆盖率
+};
+
+// 精确引擎的比较：统计长度不小于min_length的公共子串覆盖的码点，不经过指纹缓存
+// jaccard 输出两边合计的覆盖率，containment、coverage 分别输出抄袭版、原文被覆盖的比例
+int run_exact_compare(const std::string& path_orig, const std::string& path_plag, const std::string& path_out,
+                      NormalizationProfile profile, size_t min_length, ScoreMetric metric) {
+    if (metric == ScoreMetric::Weighted || metric == ScoreMetric::All || metric == ScoreMetric::TfIdf) {
+        throw std::runtime_error("--engine suffix supports --metric jaccard, containment or coverage");
+    }
+    std::vector<uint32_t> codepoints1, codepoints2;
+    {
+        InputSource orig(path_orig);
+        codepoints1 = normalize_to_codepoints(orig.bytes(), profile);
+    }
+    {
+        InputSource plag(path_plag);
+        codepoints2 = normalize_to_codepoints(plag.bytes(), profile);
+    }
+    CommonSubstringReport report = find_common_substrings(codepoints1, codepoints2, min_length);
+
+    std::ofstream fout(path_out, std::ios::binary);
+    if (!fout.is_open()) {
+        std::cerr << "Failed to open output: " << path_out << std::endl;
+        return 1;
+    }
+    fout << std::fixed << std::setprecision(2)
+         << (metric == ScoreMetric::Containment ? report.coverage_b
+             : metric == ScoreMetric::Coverage  ? report.coverage_a
+                                                : report.similarity);
+    return 0;
+}
+
+// 按--metric写出相似度（all时依次为jaccard、containment、coverage、weighted）
+void write_score(std::ostream& out, const SimilarityMetrics& metrics, ScoreMetric metric) {
+    switch (metric) {
+    case ScoreMetric::Jaccard: out << metrics.jaccard; break;
+    case ScoreMetric::Containment: out << metrics.containment_b; break;
+    case ScoreMetric::Coverage: out << metrics.containment_a; break;
+    case ScoreMetric::Weighted: out << metrics.weighted_jaccard; break;
+    case ScoreMetric::All:
+        out << metrics.jaccard << ' ' << metrics.containment_b << ' ' << metrics.containment_a << ' '
+            << metrics.weighted_jaccard;
+        break;
+    case ScoreMetric::TfIdf: break;  // 需要文档频率表，由run_compare单独输出
+    }
+}
+
+// 比较模式：原文与抄袭版一对一比较，输出两位小数的相似度
+// 全部相似度在同一次归并中得到；cache不为空时经过指纹缓存
+// frequencies不为空时先去掉文档频率超过max_df的停用k-gram（max_df为0时不去掉），并可输出TF-IDF加权相似度
+int run_compare(const std::string& path_orig, const std::string& path_plag, const std::string& path_out,
+                const FingerprintOptions& options, FingerprintCache* cache, ScoreMetric metric, size_t threads,
+                const DocumentFrequencyTable* frequencies, double max_df) {
+    SimilarityMetrics metrics;
+    double tfidf = 0.0;
+    if (frequencies) {
+        // TF-IDF需要出现次数，停用k-gram要从两份指纹中去掉，因此不经过缓存
+        CountedFingerprint counted1 = fingerprint_file_counted(path_orig, options);
+        CountedFingerprint counted2 = fingerprint_file_counted(path_plag, options);
+        if (max_df > 0.0) {
+            std::vector<uint64_t> stop = stop_grams(*frequencies, max_df);
+            remove_stop_grams(counted1, stop);
+            remove_stop_grams(counted2, stop);
+        }
+        metrics = similarity_metrics(counted1, counted2);
+        tfidf = tfidf_similarity(counted1, counted2, *frequencies);
+    } else if (metric == ScoreMetric::Weighted || metric == ScoreMetric::All) {
+        // 多重集合Jaccard需要出现次数，而指纹缓存只保存集合，因此不经过缓存
+        CountedFingerprint counted1 = fingerprint_file_counted(path_orig, options);
+        CountedFingerprint counted2 = fingerprint_file_counted(path_plag, options);
+        metrics = similarity_metrics(counted1, counted2);
+    } else if (!cache && threads > 1) {
+        // 两个文件同时处理，每个文件内部按UTF-8边界切段并行构建指纹，交集按哈希前缀分片并行计算
+        WorkStealingScheduler scheduler(threads);
+        std::vector<std::vector<uint64_t>> sets = fingerprint_files_parallel({path_orig, path_plag}, options, scheduler);
+        metrics = similarity_metrics_parallel(sets[0].data(), sets[0].size(), sets[1].data(), sets[1].size(), scheduler);
+    } else {
+        // 流式构建指纹集合（有序向量），路径为 "-" 时读取标准输入
+        Fingerprint hash_set1 = cache ? cache->fingerprint(path_orig, options)    // 原文的指纹集合
+                                      : Fingerprint(fingerprint_file(path_orig, options));
+        Fingerprint hash_set2 = cache ? cache->fingerprint(path_plag, options)    // 抄袭版的指纹集合
+                                      : Fingerprint(fingerprint_file(path_plag, options));
+        metrics = similarity_metrics(hash_set1.data(), nullptr, hash_set1.size(),
+                                     hash_set2.data(), nullptr, hash_set2.size());
+    }
+
+    // 将结果写入答案文件
+    std::ofstream fout(path_out, std::ios::binary);
+    if (!fout.is_open()) {
+        std::cerr << "Failed to open output: " << path_out << std::endl;
+        return 1;
+    }
+
+    // 输出相似度，保留两位小数
+    fout << std::fixed << std::setprecision(2);
+    if (metric == ScoreMetric::TfIdf) {
+        fout << tfidf;
+    } else {
+        write_score(fout, metrics, metric);
+    }
+    fout.close();
+
+    if (cache) print_cache_stats(*cache);
+    return 0;
+}
+
+// 把字符串写成JSON字符串字面量
+void write_json_string(std::ostream& out, const std::string& text) {
+    out << '"';
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (c < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out << escaped;
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+// 匹配片段报告：两个文件中归一化后相同的最长片段，以原始字节区间输出为JSON，供人工复核
+int run_span_report(const std::string& path_orig, const std::string& path_plag, const std::string& path_json,
+                    const FingerprintOptions& options, size_t min_span) {
+    if (path_orig == "-" || path_plag == "-") {
+        throw std::runtime_error("--spans needs regular files, not standard input");
+    }
+    InputSource orig(path_orig);
+    InputSource plag(path_plag);
+    LocatedText text_orig = normalize_with_offsets(orig.bytes(), options.normalization);
+    LocatedText text_plag = normalize_with_offsets(plag.bytes(), options.normalization);
+    std::vector<MatchedSpan> spans = find_matched_spans(text_orig, text_plag, options.k, options.hash_mode, min_span);
+
+    // 原文中的片段可能重叠，按区间并集统计字节数
+    std::vector<std::pair<size_t, size_t>> ranges;
+    size_t plag_bytes = 0;
+    for (const MatchedSpan& span : spans) {
+        ranges.emplace_back(span.a_start, span.a_end);
+        plag_bytes += span.b_end - span.b_start;
+    }
+    std::sort(ranges.begin(), ranges.end());
+    size_t orig_bytes = 0, reach = 0;
+    for (const auto& range : ranges) {
+        size_t start = std::max(range.first, reach);
+        if (range.second > start) orig_bytes += range.second - start;
+        reach = std::max(reach, range.second);
+    }
+
+    std::ofstream fout(path_json, std::ios::binary);
+    if (!fout.is_open()) {
+        std::cerr << "Failed to open output: " << path_json << std::endl;
+        return 1;
+    }
+    fout << "{\n  \"original\": ";
+    write_json_string(fout, path_orig);
+    fout << ",\n  \"plagiarized\": ";
+    write_json_string(fout, path_plag);
+    fout << ",\n  \"k\": " << options.k << ",\n  \"min_span\": " << std::max(min_span, options.k)
+         << ",\n  \"matched_bytes\": {\"original\": " << orig_bytes << ", \"plagiarized\": " << plag_bytes << "}"
+         << ",\n  \"spans\": [";
+    for (size_t s = 0; s < spans.size(); ++s) {
+        const MatchedSpan& span = spans[s];
+        fout << (s == 0 ? "\n" : ",\n") << "    {\"original\": {\"start\": " << span.a_start << ", \"end\": "
+             << span.a_end << ", \"length\": " << span.a_end - span.a_start << "}, \"plagiarized\": {\"start\": "
+             << span.b_start << ", \"end\": " << span.b_end << ", \"length\": " << span.b_end - span.b_start
+             << "}, \"codepoints\": " << span.codepoints << "}";
+    }
+    fout << (spans.empty() ? "]\n}\n" : "\n  ]\n}\n");
+    return 0;
+}
+
+// 建索引模式：读取文档列表，构建倒排索引并写入磁盘
+// frequencies不为空时每个文档先去掉文档频率超过max_df的停用k-gram，过滤条件记录在索引中，查询时同样去掉
+int run_build_index(const std::string& path_index, const std::string& path_list, const FingerprintOptions& options,
+                    const DocumentFrequencyTable* frequencies, double max_df) {
+    std::vector<std::string> doc_paths = read_path_list(path_list);
+    std::vector<uint64_t> stop;
+    if (frequencies) stop = stop_grams(*frequencies, max_df);
+    CorpusIndex index = build_corpus_index(doc_paths, options, stop, frequencies ? max_df : 0.0);
+    save_corpus_index(index, path_index);
+
+    std::cerr << "Indexed " << index.doc_paths.size() << " documents, "
+              << index.terms.size() << " distinct k-grams";
+    if (frequencies) std::cerr << ", dropped " << stop.size() << " stop-grams";
+    std::cerr << std::endl;
+    return 0;
+}
+
+// 文档频率模式：读取文档列表，流式统计每个k-gram出现在多少个文档中并写入磁盘
+int run_build_document_frequencies(const std::string& path_table, const std::string& path_list,
+                                   const FingerprintOptions& options) {
+    DocumentFrequencyTable table = build_document_frequencies(read_path_list(path_list), options);
+    save_document_frequencies(table, path_table);
+
+    std::cerr << "Counted " << table.hashes.size() << " distinct k-grams in " << table.documents << " documents"
+              << std::endl;
+    return 0;
+}
+
+// 查询模式：将一份待测文档与索引中的所有文档比较，指纹参数取自索引文件
+// 输出每个相似度大于0的文档一行：<文档路径>\t<相似度>，按相似度降序
+// top不为0时只输出最相似的top个，用前K查询剪掉大部分文档，并在stderr报告剪枝情况
+int run_query_index(const std::string& path_index, const std::string& path_plag, const std::string& path_out,
+                    size_t top) {
+    CorpusIndex index = load_corpus_index(path_index);
+    std::vector<uint64_t> hash_set = fingerprint_file(path_plag, index.options);
+
+    std::vector<RankedDocument> ranked;
+    if (top != 0) {
+        TopKStats stats;
+        ranked = query_corpus_top_k(index, hash_set, top, &stats);
+        std::cerr << "Top " << top << ": scanned " << stats.scanned_terms << " of " << stats.terms
+                  << " k-grams; of " << stats.documents << " documents, " << stats.documents - stats.candidates
+                  << " pruned by prefix, " << stats.size_pruned << " by size, " << stats.bound_pruned
+                  << " by upper bound, " << stats.verified << " fully counted" << std::endl;
+    } else {
+        std::vector<double> scores = query_corpus_index(index, hash_set);
+        for (size_t doc = 0; doc < scores.size(); ++doc) {
+            if (scores[doc] > 0.0) {
+                RankedDocument entry;
+                entry.doc = static_cast<uint32_t>(doc);
+                entry.score = scores[doc];
+                ranked.push_back(entry);
             }
-            // 其他非ASCII字符（如拉丁扩展字符）直接丢弃
         }
+        std::stable_sort(ranked.begin(), ranked.end(),
+                         [](const RankedDocument& a, const RankedDocument& b) { return a.score > b.score; });
+    }
+
+    std::ofstream fout(path_out, std::ios::binary);
+    if (!fout.is_open()) {
+        std::cerr << "Failed to open output: " << path_out << std::endl;
+        return 1;
+    }
+    fout << std::fixed << std::setprecision(2);
+    for (const RankedDocument& entry : ranked) {
+        fout << index.doc_paths[entry.doc] << '\t' << entry.score << '\n';
+    }
+    return 0;
+}
+
+// 归档模式：计算文档的指纹集合并以Elias–Fano压缩格式保存
+int run_save_fingerprint(const std::string& path_fingerprint, const std::string& path_doc,
+                         const FingerprintOptions& options, uint32_t hash_bits) {
+    std::vector<uint64_t> hashes = fingerprint_file(path_doc, options);
+    CompressedFingerprint fingerprint = compress_fingerprint(hashes, options, hash_bits);
+    save_compressed_fingerprint(fingerprint, path_fingerprint);
+
+    std::cerr << "Saved " << fingerprint.count << " fingerprints in " << fingerprint.payload_bytes() << " bytes ("
+              << std::fixed << std::setprecision(1)
+              << (fingerprint.count ? fingerprint.payload_bytes() * 8.0 / fingerprint.count : 0.0)
+              << " bits each)" << std::endl;
+    return 0;
+}
+
+// 比较两个归档的压缩指纹，直接在压缩流上求交集，输出两位小数的Jaccard相似度
+int run_compare_fingerprints(const std::string& path_a, const std::string& path_b, const std::string& path_out) {
+    double sim = jaccard_similarity_compressed(load_compressed_fingerprint(path_a), load_compressed_fingerprint(path_b));
+
+    std::ofstream fout(path_out, std::ios::binary);
+    if (!fout.is_open()) {
+        std::cerr << "Failed to open output: " << path_out << std::endl;
+        return 1;
+    }
+    fout << std::fixed << std::setprecision(2) << sim;
+    return 0;
+}
+
+// 建签名库模式：为文档列表中的每个文档计算MinHash签名并写入磁盘
+int run_build_signatures(const std::string& path_store, const std::string& path_list, const FingerprintOptions& options) {
+    SignatureStore store = build_signature_store(read_path_list(path_list), options);
+    save_signature_store(store, path_store);
+
+    std::cerr << "Signed " << store.doc_paths.size() << " documents, "
+              << store.num_hashes << " hashes each" << std::endl;
+    return 0;
+}
+
+// 修订稿模式：同一份待测文档的各个修订稿依次与原文列表中的每份原文比较
+// 第一稿完整计算k-gram多重集合，之后每一稿只按与上一稿不同的一段增量更新，并就地调整与各原文的计数
+// 输出每一稿与每份原文的相似度：<修订稿路径>\t<原文路径>\t<相似度>
+int run_revisions(const std::string& path_list, const std::string& path_out, const std::vector<std::string>& revisions,
+                  const FingerprintOptions& options, ScoreMetric metric) {
+    if (metric == ScoreMetric::TfIdf) {
+        throw std::runtime_error("--revisions does not support --metric tfidf");
+    }
+    std::vector<std::string> originals = read_path_list(path_list);
+    std::unique_ptr<IncrementalScorer> scorer;
+    {
+        InputSource first(revisions[0]);
+        scorer.reset(new IncrementalScorer(options, first.bytes()));
+    }
+    for (const std::string& original : originals) {
+        scorer->add_original(fingerprint_file_counted(original, options));
+    }
+
+    std::ofstream fout(path_out, std::ios::binary);
+    if (!fout.is_open()) {
+        std::cerr << "Failed to open output: " << path_out << std::endl;
+        return 1;
+    }
+    fout << std::fixed << std::setprecision(2);
+    for (size_t r = 0; r < revisions.size(); ++r) {
+        if (r > 0) {
+            InputSource revision(revisions[r]);
+            size_t changed = scorer->update(revision.bytes());
+            std::cerr << revisions[r] << ": " << changed << " bytes changed" << std::endl;
+        }
+        for (size_t o = 0; o < originals.size(); ++o) {
+            fout << revisions[r] << '\t' << originals[o] << '\t';
+            write_score(fout, scorer->metrics(o), metric);
+            fout << '\n';
+        }
+    }
+    return 0;
+}
+
+// 签名筛查模式：LSH只返回可能超过阈值的候选，再对候选逐个计算精确Jaccard
+// 输出精确相似度不低于阈值的文档：<文档路径>\t<相似度>，按相似度降序
+int run_query_signatures(const std::string& path_store, const std::string& path_plag, const std::string& path_out,
+                         double threshold) {
+    SignatureStore store = load_signature_store(path_store);
+    LshIndex lsh(store.signatures, store.num_hashes, choose_lsh_params(store.num_hashes, threshold));
+
+    std::vector<uint64_t> hash_set = fingerprint_file(path_plag, store.options);
+    std::vector<uint64_t> signature = minhash_signature(hash_set, store.num_hashes);
+
+    std::vector<std::pair<double, uint32_t>> matches;
+    std::vector<uint32_t> candidates = lsh.candidates(signature.data());
+    for (uint32_t doc : candidates) {
+        double sim = jaccard_similarity_sorted(hash_set, fingerprint_file(store.doc_paths[doc], store.options));
+        if (sim >= threshold) matches.emplace_back(sim, doc);
+    }
+    std::stable_sort(matches.begin(), matches.end(),
+                     [](const std::pair<double, uint32_t>& a, const std::pair<double, uint32_t>& b) {
+                         return a.first > b.first;
+                     });
+
+    std::ofstream fout(path_out, std::ios::binary);
+    if (!fout.is_open()) {
+        std::cerr << "Failed to open output: " << path_out << std::endl;
+        return 1;
+    }
+    fout << std::fixed << std::setprecision(2);
+    for (const auto& match : matches) {
+        fout << store.doc_paths[match.second] << '\t' << match.first << '\n';
     }
-    
-    return codepoints;
-}
-
-// 使用FNV-1a算法计算k-gram的64位哈希值
-uint64_t fnv1a64_hash_kgram(const std::vector<uint32_t>& codepoints, size_t start, size_t k) {
-    const uint64_t FNV_OFFSET = 1469598103934665603ULL;  // FNV-1a偏移量
-    const uint64_t FNV_PRIME = 1099511628211ULL;          // FNV-1a质数
-    uint64_t h = FNV_OFFSET;
-    
-    for (size_t i = 0; i < k; ++i) {
-        uint32_t cp = codepoints[start + i];
-        // 将码点的4个字节分别混合到哈希中
-        for (int b = 0; b < 4; ++b) {
-            unsigned char x = static_cast<unsigned char>((cp >> (b * 8)) & 0xFFu);
-            h ^= static_cast<uint64_t>(x);  // 异或操作
-            h *= FNV_PRIME;    // 乘法操作
+
+    std::cerr << candidates.size() << " of " << store.doc_paths.size() << " documents were LSH candidates, "
+              << matches.size() << " above threshold" << std::endl;
+    return 0;
+}
+
+// 批量模式：清单中每对文件输出一行两位小数的相似度，顺序与清单一致；出错的行输出 error
+int run_batch(const std::string& path_manifest, const std::string& path_out, const FingerprintOptions& options,
+              size_t threads, FingerprintCache* cache) {
+    std::vector<std::pair<std::string, std::string>> pairs = read_pair_manifest(path_manifest);
+    WorkStealingScheduler scheduler(threads);
+
+    auto start = std::chrono::steady_clock::now();
+    BatchResult result = score_batch(pairs, options, scheduler, cache);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::ofstream fout(path_out, std::ios::binary);
+    if (!fout.is_open()) {
+        std::cerr << "Failed to open output: " << path_out << std::endl;
+        return 1;
+    }
+    fout << std::fixed << std::setprecision(2);
+    size_t failures = 0;
+    for (size_t p = 0; p < pairs.size(); ++p) {
+        if (result.errors[p].empty()) {
+            fout << result.scores[p] << '\n';
+        } else {
+            fout << "error\n";
+            std::cerr << "Failed to score " << pairs[p].first << " / " << pairs[p].second << ": "
+                      << result.errors[p] << std::endl;
+            failures++;
         }
     }
-    return h;
-}
-
-// 构建k-gram哈希集合，生成所有k-gram的哈希值并去重
-std::unordered_set<uint64_t> build_kgram_set(const std::vector<uint32_t>& codepoints, size_t k) {
-    std::unordered_set<uint64_t> hash_set;
-    if (k == 0 || codepoints.size() < k) return hash_set;  // 参数无效或文本太短
-    
-    size_t num = codepoints.size() - k + 1;  // k-gram的总数量
-    
-    // 计算每个k-gram的哈希值并插入到集合中（自动去重）
-    for (size_t i = 0; i < num; ++i) {
-        uint64_t hash = fnv1a64_hash_kgram(codepoints, i, k);
-        hash_set.insert(hash);
-    }
-    
-    return hash_set;
-}
-
-// 计算Jaccard相似度：交集大小 / 并集大小
-double jaccard_similarity(const std::unordered_set<uint64_t>& set1, const std::unordered_set<uint64_t>& set2) {
-    if (set1.empty() && set2.empty()) return 0.0;  // 两个空集合
-    
-    // 计算交集大小
-    size_t intersection = 0;
-    for (const auto& hash : set1) {
-        if (set2.find(hash) != set2.end()) {
-            intersection++;
+
+    std::cerr << "Scored " << pairs.size() - failures << " of " << pairs.size() << " pairs ("
+              << result.distinct_originals << " distinct originals) on " << scheduler.threads()
+              << " threads in " << std::fixed << std::setprecision(2) << seconds << " s" << std::endl;
+    if (cache) print_cache_stats(*cache);
+    return failures == 0 ? 0 : 1;
+}
+
+// 服务模式下收到SIGINT/SIGTERM时通知事件循环退出
+ScoringServer* running_server = nullptr;
+
+extern "C" void handle_stop_signal(int) {
+    if (running_server) running_server->stop();
+}
+
+// 服务模式：加载文档列表中的参考文档，在Unix域套接字上常驻评分，直到收到SIGINT/SIGTERM
+int run_serve(const std::string& path_socket, const std::string& path_list, const FingerprintOptions& options,
+              const ScoringServerConfig& config) {
+    ScoringServer server(read_path_list(path_list), options, config);
+    server.listen(path_socket);
+
+    running_server = &server;
+    std::signal(SIGINT, handle_stop_signal);
+    std::signal(SIGTERM, handle_stop_signal);
+    std::cerr << "Serving " << server.reference_count() << " references on " << path_socket << " ("
+              << config.threads << " threads, batch window " << config.batch_window_us << " us)" << std::endl;
+    server.run();
+    std::signal(SIGINT, SIG_DFL);
+    std::signal(SIGTERM, SIG_DFL);
+    running_server = nullptr;
+
+    ScoringServerStats stats = server.stats();
+    std::cerr << "Served " << stats.requests << " requests (" << stats.errors << " errors) in " << stats.batches
+              << " batches, largest " << stats.largest_batch << ", on " << stats.connections << " connections"
+              << std::endl;
+    return 0;
+}
+
+// 负载生成模式：清单每行 "<参考文档>\t<待测文件>"，循环发送直到达到请求总数，输出吞吐量与延迟分位数
+// inline_text为真时读出文件内容作为TEXT请求发送，否则发送FILE请求由服务端读取
+int run_loadgen(const std::string& path_socket, const std::string& path_manifest, size_t total,
+                size_t connections, size_t depth, bool inline_text) {
+    std::vector<LoadRequest> requests;
+    for (const auto& pair : read_pair_manifest(path_manifest)) {
+        LoadRequest request;
+        request.reference = pair.first;
+        request.path = pair.second;
+        if (inline_text) {
+            InputSource source(pair.second);
+            ByteSpan bytes = source.bytes();
+            request.text.assign(reinterpret_cast<const char*>(bytes.data), bytes.size);
         }
+        requests.push_back(std::move(request));
     }
-    
-    // 计算并集大小
-    size_t union_size = set1.size() + set2.size() - intersection;
-    if (union_size == 0) return 0.0;  // 避免除零
-    
-    return static_cast<double>(intersection) / static_cast<double>(union_size);  // Jaccard相似度
+
+    LoadReport report = run_load_test(path_socket, requests, total, connections, depth);
+    std::cout << "Sent " << report.requests << " requests on " << connections << " connections (pipeline depth "
+              << depth << ") in " << std::fixed << std::setprecision(2) << report.seconds << " s: "
+              << std::setprecision(0) << report.requests / std::max(report.seconds, 1e-9) << " requests/s, "
+              << report.errors << " errors" << std::endl
+              << "Latency: p50 " << report.p50_us << " us, p99 " << report.p99_us << " us, max " << report.max_us
+              << " us" << std::endl;
+    return report.errors == 0 ? 0 : 1;
 }
 
-int main(int argc, char** argv) {
+// 打印命令行用法
+void print_usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [options] [--threads <n>] <orig_file> <plagiarized_file> <answer_file>" << std::endl
+              << "       " << prog << " [options] --build-index <index_file> <doc_list_file>" << std::endl
+              << "       " << prog << " [options] --build-df <df_file> <doc_list_file>" << std::endl
+              << "       " << prog << " [--top <n>] --query-index <index_file> <plagiarized_file> <answer_file>" << std::endl
+              << "       " << prog << " [options] [--hash-bits <b>] --save-fingerprint <fingerprint_file> <doc_file>" << std::endl
+              << "       " << prog << " --compare-fingerprints <fingerprint_file> <fingerprint_file> <answer_file>" << std::endl
+              << "       " << prog << " [options] --build-signatures <signature_file> <doc_list_file>" << std::endl
+              << "       " << prog << " [--threshold <t>] --query-signatures <signature_file> <plagiarized_file> <answer_file>" << std::endl
+              << "       " << prog << " [options] --revisions <orig_list_file> <answer_file> <revision_file>..." << std::endl
+              << "       " << prog << " [options] [--threads <n>] --batch <manifest_file> <answer_file>" << std::endl
+              << "       " << prog << " [options] [--threads <n>] [--batch-window <us>] --serve <socket> <doc_list_file>" << std::endl
+              << "       " << prog << " [--connections <n>] [--depth <n>] [--requests <n>] [--inline] --loadgen <socket> <manifest_file>" << std::endl
+              << "Options:" << std::endl
+              << "  --k <n>                 k-gram length (default " << DEFAULT_K << ")" << std::endl
+              << "  --hash <fnv|rolling>    k-gram hash function (default fnv)" << std::endl
+              << "  --profile <name>        normalization: default (ASCII letters and digits plus CJK ideographs)," << std::endl
+              << "                          cjk-only, unicode-letters (letters and digits of most scripts," << std::endl
+              << "                          case-folded) or full-width-folding (unicode-letters with full-width" << std::endl
+              << "                          ASCII and half-width kana folded); indexes and caches record it" << std::endl
+              << "  --winnow <w>            keep only the minimum hash of every w consecutive k-grams" << std::endl
+              << "  --min-match <t>         winnow so that shared runs of >= t codepoints are always detected" << std::endl
+              << "  --metric <name>         score written by compare mode: jaccard (default), containment" << std::endl
+              << "                          (share of the plagiarized file found in the original), coverage" << std::endl
+              << "                          (share of the original found in the plagiarized file), weighted" << std::endl
+              << "                          (Jaccard over k-gram counts), all (the four in that order) or tfidf" << std::endl
+              << "                          (weighted Jaccard with count * IDF weights; needs --df)" << std::endl
+              << "  --df <df_file>          compare mode and --build-index: document frequency table from --build-df" << std::endl
+              << "                          (same options)" << std::endl
+              << "  --max-df <r>            compare mode and --build-index: drop k-grams found in more than this share" << std::endl
+              << "                          of the --df documents (boilerplate) before scoring or indexing" << std::endl
+              << "  --engine <kgram|suffix> compare mode: hashed k-gram sets (default), or exact common substrings" << std::endl
+              << "                          found with a suffix array, scored by the share of codepoints they cover" << std::endl
+              << "  --spans <json_file>     compare mode: also write the matched passages as byte ranges to a JSON file" << std::endl
+              << "  --min-span <n>          shortest matched passage reported by --spans or counted by --engine suffix," << std::endl
+              << "                          in codepoints (default 8)" << std::endl
+              << "  --hash-bits <b>         --save-fingerprint: keep only the top b bits of each hash (default 64," << std::endl
+              << "                          lossless); 32 stores about 2 bytes per k-gram" << std::endl
+              << "  --threshold <t>         similarity threshold for signature screening (default 0.5)" << std::endl
+              << "  --top <n>               --query-index: write only the n most similar documents (default: all)" << std::endl
+              << "  --threads <n>           worker threads for --batch, --serve and compare (default: all hardware threads)" << std::endl
+              << "  --cache <dir>           cache fingerprints by file content in <dir> (compare and --batch)" << std::endl
+              << "  --cache-size <MiB>      evict least recently used cache entries above this size (default 256)" << std::endl
+              << "  --batch-window <us>     --serve: wait this long after a request to batch later ones (default 1000)" << std::endl
+              << "  --connections <n>       --loadgen: concurrent connections (default 1)" << std::endl
+              << "  --depth <n>             --loadgen: requests in flight per connection (default 1)" << std::endl
+              << "  --requests <n>          --loadgen: total requests to send (default 1000)" << std::endl
+              << "  --inline                --loadgen: send file contents inline instead of paths" << std::endl
+              << "  --stats                 print per-stage times and pipeline counters to stderr on exit" << std::endl
+              << "  --trace <json_file>     write per-stage spans as Chrome trace events (chrome://tracing, Perfetto)" << std::endl
+              << "The batch manifest has one <orig_file><TAB><plagiarized_file> pair per line." << std::endl
+              << "--revisions scores successive drafts of one document against every listed original;" << std::endl
+              << "each draft after the first is applied as an edit to the previous one (no --winnow)." << std::endl
+              << "The load manifest has one <reference_file><TAB><plagiarized_file> pair per line;" << std::endl
+              << "references must be listed in the server's doc list." << std::endl
+              << "An index built with --max-df keeps the dropped k-grams in its header and drops them from queries too." << std::endl
+              << "An input file of \"-\" reads from standard input (not allowed in manifests)." << std::endl;
+}
+
+// 解析后的命令行
+struct CommandLine {
+    std::vector<std::string> positional;  // 位置参数，包括 --build-index 等模式开关
+    FingerprintOptions fingerprint;
+    size_t min_match = 0;                 // --min-match，解析完成后换算为Winnowing窗口
+    uint32_t hash_bits = 64;              // 压缩指纹保留的哈希位数
+    double threshold = 0.5;               // 签名筛查的相似度阈值
+    std::string df_path;                  // 比较模式与建索引的文档频率表，为空时不使用
+    double max_df = 0.0;                  // 去掉文档频率超过该比例的k-gram，0表示不去掉
+    size_t top = 0;                       // 索引查询只输出最相似的top个，0表示全部
+    ScoreMetric metric = ScoreMetric::Jaccard;  // 比较模式输出的相似度
+    MatchEngine engine = MatchEngine::KGram;    // 比较模式的检测引擎
+    std::string spans_path;               // 比较模式的匹配片段报告，为空时不输出
+    size_t min_span = 8;                  // 报告的最短片段（码点数）
+    size_t threads = 0;                   // 批量、服务和单对比较的线程数，0表示全部硬件线程
+    std::string cache_dir;                // 指纹缓存目录，为空时不使用缓存
+    size_t cache_size_mb = 256;           // 指纹缓存大小上限（MiB）
+    size_t batch_window_us = 1000;        // 服务模式的批处理窗口（微秒）
+    size_t connections = 1;               // 负载生成的并发连接数
+    size_t depth = 1;                     // 负载生成每个连接的流水线深度
+    size_t requests = 1000;               // 负载生成的请求总数
+    bool inline_text = false;             // 负载生成是否发送内联文本
+    bool stats = false;                   // 退出时输出统计行
+    std::string trace_path;               // Chrome跟踪事件文件，为空时不记录
+};
+
+// 将选项值解析为正整数
+size_t parse_positive(const std::string& value, const std::string& name) {
+    size_t pos = 0;
+    unsigned long long n = 0;
+    try {
+        n = std::stoull(value, &pos);
+    } catch (const std::exception&) {
+        pos = 0;
+    }
+    if (pos != value.size() || n == 0) {
+        throw std::runtime_error("Invalid value for " + name + ": " + value);
+    }
+    return static_cast<size_t>(n);
+}
+
+// 将选项值解析为非负整数
+size_t parse_non_negative(const std::string& value, const std::string& name) {
+    return value == "0" ? 0 : parse_positive(value, name);
+}
+
+// 将选项值解析为 (0, 1] 内的相似度
+double parse_similarity(const std::string& value, const std::string& name) {
+    size_t pos = 0;
+    double x = 0.0;
     try {
-        // 检查命令行参数数量
-        if (argc != 4) {
-            std::cerr << "Usage: " << argv[0] << " <orig_file> <plagiarized_file> <answer_file>" << std::endl;
-            return 1;
+        x = std::stod(value, &pos);
+    } catch (const std::exception&) {
+        pos = 0;
+    }
+    if (pos != value.size() || !(x > 0.0 && x <= 1.0)) {
+        throw std::runtime_error("Invalid value for " + name + ": " + value);
+    }
+    return x;
+}
+
+// 解析哈希算法名称
+HashMode parse_hash_mode(const std::string& value) {
+    if (value == "fnv") return HashMode::Fnv;
+    if (value == "rolling") return HashMode::Rolling;
+    throw std::runtime_error("Unknown hash function: " + value);
+}
+
+// 解析相似度名称
+ScoreMetric parse_metric(const std::string& value) {
+    if (value == "jaccard") return ScoreMetric::Jaccard;
+    if (value == "containment") return ScoreMetric::Containment;
+    if (value == "coverage") return ScoreMetric::Coverage;
+    if (value == "weighted") return ScoreMetric::Weighted;
+    if (value == "all") return ScoreMetric::All;
+    if (value == "tfidf") return ScoreMetric::TfIdf;
+    throw std::runtime_error("Unknown metric: " + value);
+}
+
+// 解析检测引擎名称
+MatchEngine parse_engine(const std::string& value) {
+    if (value == "kgram") return MatchEngine::KGram;
+    if (value == "suffix") return MatchEngine::Suffix;
+    throw std::runtime_error("Unknown engine: " + value);
+}
+
+// 解析命令行：带值的选项被提取出来，其余参数按原顺序保留为位置参数
+CommandLine parse_command_line(int argc, char** argv) {
+    CommandLine cmd;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (arg == "--k" && has_value) {
+            cmd.fingerprint.k = parse_positive(argv[++i], arg);
+        } else if (arg == "--hash" && has_value) {
+            cmd.fingerprint.hash_mode = parse_hash_mode(argv[++i]);
+        } else if (arg == "--profile" && has_value) {
+            cmd.fingerprint.normalization = parse_normalization_profile(argv[++i]);
+        } else if (arg == "--winnow" && has_value) {
+            cmd.fingerprint.winnow_window = parse_positive(argv[++i], arg);
+        } else if (arg == "--min-match" && has_value) {
+            cmd.min_match = parse_positive(argv[++i], arg);
+        } else if (arg == "--metric" && has_value) {
+            cmd.metric = parse_metric(argv[++i]);
+        } else if (arg == "--engine" && has_value) {
+            cmd.engine = parse_engine(argv[++i]);
+        } else if (arg == "--spans" && has_value) {
+            cmd.spans_path = argv[++i];
+        } else if (arg == "--min-span" && has_value) {
+            cmd.min_span = parse_positive(argv[++i], arg);
+        } else if (arg == "--hash-bits" && has_value) {
+            size_t bits = parse_positive(argv[++i], arg);
+            if (bits > 64) throw std::runtime_error("Invalid value for --hash-bits: " + std::to_string(bits));
+            cmd.hash_bits = static_cast<uint32_t>(bits);
+        } else if (arg == "--threshold" && has_value) {
+            cmd.threshold = parse_similarity(argv[++i], arg);
+        } else if (arg == "--df" && has_value) {
+            cmd.df_path = argv[++i];
+        } else if (arg == "--max-df" && has_value) {
+            cmd.max_df = parse_similarity(argv[++i], arg);
+        } else if (arg == "--top" && has_value) {
+            cmd.top = parse_positive(argv[++i], arg);
+        } else if (arg == "--threads" && has_value) {
+            cmd.threads = parse_positive(argv[++i], arg);
+        } else if (arg == "--cache" && has_value) {
+            cmd.cache_dir = argv[++i];
+        } else if (arg == "--cache-size" && has_value) {
+            cmd.cache_size_mb = parse_positive(argv[++i], arg);
+        } else if (arg == "--batch-window" && has_value) {
+            cmd.batch_window_us = parse_non_negative(argv[++i], arg);
+        } else if (arg == "--connections" && has_value) {
+            cmd.connections = parse_positive(argv[++i], arg);
+        } else if (arg == "--depth" && has_value) {
+            cmd.depth = parse_positive(argv[++i], arg);
+        } else if (arg == "--requests" && has_value) {
+            cmd.requests = parse_positive(argv[++i], arg);
+        } else if (arg == "--inline") {
+            cmd.inline_text = true;
+        } else if (arg == "--stats") {
+            cmd.stats = true;
+        } else if (arg == "--trace" && has_value) {
+            cmd.trace_path = argv[++i];
+        } else {
+            cmd.positional.push_back(arg);
         }
-        
-        // 获取文件路径参数
-        std::string path_orig = argv[1];   // 原文文件路径
-        std::string path_plag = argv[2];   // 抄袭版文件路径
-        std::string path_out = argv[3];    // 答案文件路径
-
-        // 读取文件内容到字节向量
-        std::vector<unsigned char> bytes1 = read_file_to_bytes(path_orig);
-        std::vector<unsigned char> bytes2 = read_file_to_bytes(path_plag);
-
-        // 将文件内容转换为归一化的码点序列
-        std::vector<uint32_t> codepoints1 = normalize_to_codepoints(bytes1);  // 处理原文
-        std::vector<uint32_t> codepoints2 = normalize_to_codepoints(bytes2);  // 处理抄袭版
-
-        // 构建3-gram哈希集合（3-gram是文本相似度计算的常用方法）
-        constexpr size_t K = 3;
-        std::unordered_set<uint64_t> hash_set1 = build_kgram_set(codepoints1, K);  // 原文的k-gram集合
-        std::unordered_set<uint64_t> hash_set2 = build_kgram_set(codepoints2, K);  // 抄袭版的k-gram集合
-
-        // 计算Jaccard相似度
-        double sim = jaccard_similarity(hash_set1, hash_set2);
-
-        // 将结果写入答案文件
-        std::ofstream fout(path_out, std::ios::binary);
-        if (!fout.is_open()) {
-            std::cerr << "Failed to open output: " << path_out << std::endl;
-            return 1;
+    }
+
+    // 最短检测长度 t = w + k - 1，因此窗口 w = t - k + 1
+    if (cmd.min_match > 0) {
+        if (cmd.min_match < cmd.fingerprint.k) {
+            throw std::runtime_error("--min-match must not be smaller than k");
         }
-        
-        // 输出相似度，保留两位小数
-        fout << std::fixed << std::setprecision(2) << sim;
-        fout.close();
+        cmd.fingerprint.winnow_window = cmd.min_match - cmd.fingerprint.k + 1;
+    }
+    if (cmd.df_path.empty() && (cmd.metric == ScoreMetric::TfIdf || cmd.max_df > 0.0)) {
+        throw std::runtime_error("--metric tfidf and --max-df need --df");
+    }
+#ifndef PD_INSTRUMENTATION
+    if (cmd.stats || !cmd.trace_path.empty()) {
+        throw std::runtime_error("--stats and --trace need a build with instrumentation (-DPD_INSTRUMENTATION=ON)");
+    }
+#endif
+    return cmd;
+}
 
-        return 0;
+// 输出统计行与跟踪事件文件
+void write_instrumentation(const CommandLine& cmd) {
+    if (cmd.stats) {
+        std::cerr << format_stats_line(collect_stats()) << std::endl;
+    }
+    if (!cmd.trace_path.empty()) {
+        std::ofstream out(cmd.trace_path, std::ios::binary);
+        out << trace_events_json(collect_trace_events());
+        if (!out) {
+            throw std::runtime_error("Failed to write trace file: " + cmd.trace_path);
+        }
+    }
+}
+
+// 加载 --df 指定的文档频率表，未指定时为空
+// 文档频率表的指纹参数必须与本次使用的相同，否则哈希值对不上
+std::unique_ptr<DocumentFrequencyTable> load_frequencies(const CommandLine& cmd) {
+    std::unique_ptr<DocumentFrequencyTable> frequencies;
+    if (!cmd.df_path.empty()) {
+        frequencies.reset(new DocumentFrequencyTable(load_document_frequencies(cmd.df_path)));
+        const FingerprintOptions& built = frequencies->options;
+        if (built.k != cmd.fingerprint.k || built.hash_mode != cmd.fingerprint.hash_mode ||
+            built.winnow_window != cmd.fingerprint.winnow_window ||
+            built.normalization != cmd.fingerprint.normalization) {
+            throw std::runtime_error("Document frequency table was built with different fingerprint options");
+        }
+    }
+    return frequencies;
+}
+
+// 按位置参数选择运行模式
+int run_command(const CommandLine& cmd, const char* prog) {
+    const std::vector<std::string>& args = cmd.positional;
+    std::string mode = args.empty() ? "" : args[0];
+    std::unique_ptr<FingerprintCache> cache;
+    if (!cmd.cache_dir.empty()) {
+        cache.reset(new FingerprintCache(cmd.cache_dir, static_cast<uint64_t>(cmd.cache_size_mb) << 20));
+    }
+
+    if (mode == "--build-index" && args.size() == 3) {
+        if (!cmd.df_path.empty() && cmd.max_df == 0.0) {
+            throw std::runtime_error("--build-index uses --df only to drop stop-grams; give --max-df too");
+        }
+        std::unique_ptr<DocumentFrequencyTable> frequencies = load_frequencies(cmd);
+        return run_build_index(args[1], args[2], cmd.fingerprint, frequencies.get(), cmd.max_df);
+    }
+    if (mode == "--build-df" && args.size() == 3) {
+        return run_build_document_frequencies(args[1], args[2], cmd.fingerprint);
+    }
+    if (mode == "--query-index" && args.size() == 4) {
+        return run_query_index(args[1], args[2], args[3], cmd.top);
+    }
+    if (mode == "--save-fingerprint" && args.size() == 3) {
+        return run_save_fingerprint(args[1], args[2], cmd.fingerprint, cmd.hash_bits);
+    }
+    if (mode == "--compare-fingerprints" && args.size() == 4) {
+        return run_compare_fingerprints(args[1], args[2], args[3]);
+    }
+    if (mode == "--build-signatures" && args.size() == 3) {
+        return run_build_signatures(args[1], args[2], cmd.fingerprint);
+    }
+    if (mode == "--query-signatures" && args.size() == 4) {
+        return run_query_signatures(args[1], args[2], args[3], cmd.threshold);
+    }
+    if (mode == "--revisions" && args.size() >= 4) {
+        return run_revisions(args[1], args[2], std::vector<std::string>(args.begin() + 3, args.end()), cmd.fingerprint,
+                             cmd.metric);
+    }
+    if (mode == "--batch" && args.size() == 3) {
+        return run_batch(args[1], args[2], cmd.fingerprint, cmd.threads == 0 ? default_thread_count() : cmd.threads,
+                         cache.get());
+    }
+    if (mode == "--serve" && args.size() == 3) {
+        ScoringServerConfig config;
+        config.threads = cmd.threads == 0 ? default_thread_count() : cmd.threads;
+        config.batch_window_us = cmd.batch_window_us;
+        return run_serve(args[1], args[2], cmd.fingerprint, config);
+    }
+    if (mode == "--loadgen" && args.size() == 3) {
+        return run_loadgen(args[1], args[2], cmd.requests, cmd.connections, cmd.depth, cmd.inline_text);
+    }
+
+    // 检查命令行参数数量
+    if (args.size() != 3 || mode.compare(0, 2, "--") == 0) {
+        print_usage(prog);
+        return 1;
+    }
+
+    std::unique_ptr<DocumentFrequencyTable> frequencies = load_frequencies(cmd);
+
+    // 原文文件路径、抄袭版文件路径、答案文件路径
+    int status = cmd.engine == MatchEngine::Suffix
+                     ? run_exact_compare(args[0], args[1], args[2], cmd.fingerprint.normalization, cmd.min_span,
+                                         cmd.metric)
+                     : run_compare(args[0], args[1], args[2], cmd.fingerprint, cache.get(), cmd.metric,
+                                   cmd.threads == 0 ? default_thread_count() : cmd.threads, frequencies.get(),
+                                   cmd.max_df);
+    if (status == 0 && !cmd.spans_path.empty()) {
+        status = run_span_report(args[0], args[1], cmd.spans_path, cmd.fingerprint, cmd.min_span);
+    }
+    return status;
+}
+
+int main(int argc, char** argv) {
+    try {
+        CommandLine cmd = parse_command_line(argc, argv);
+        set_instrumentation((cmd.stats ? INSTRUMENT_STATS : 0) | (cmd.trace_path.empty() ? 0 : INSTRUMENT_TRACE));
+        int status = run_command(cmd, argv[0]);
+        write_instrumentation(cmd);
+        return status;
     }
     catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
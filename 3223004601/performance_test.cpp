@@ -8,300 +8,1662 @@
 #include <unordered_set>
 #include <cstdint>
 #include <iomanip>
+#include <cmath>
+#include <sstream>
+#include <iterator>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <exception>
+#include <cstring>
+#include <cstdio>
+#include <stdexcept>
+#include <new>
+#include <functional>
+#include <cstdlib>
 
-// 性能测试工具类
-class PerformanceProfiler {
+#include "plagiarism_detector.h"
+
+using namespace pd;
+
+// 堆分配计数：替换全局operator new，统计被测代码的分配次数
+// GCC把替换后的分配函数内联到调用处后会误报new与free不匹配，因此禁止内联
+#if defined(__GNUC__)
+    #define PD_NOINLINE __attribute__((noinline))
+#else
+    #define PD_NOINLINE
+#endif
+
+std::atomic<size_t> heap_allocations(0);
+
+PD_NOINLINE void* operator new(std::size_t size) {
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size == 0 ? 1 : size)) return p;
+    throw std::bad_alloc();
+}
+
+PD_NOINLINE void operator delete(void* p) noexcept { std::free(p); }
+PD_NOINLINE void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+// 写入基准测试的计算结果，防止编译器把被测代码优化掉
+volatile uint64_t benchmark_sink = 0;
+
+// 一个基准项的统计结果，时间均为单次调用的纳秒数
+struct BenchmarkResult {
+    std::string name;
+    size_t iterations = 0;       // 每个样本连续调用的次数
+    size_t samples = 0;
+    double median_ns = 0.0;
+    double p95_ns = 0.0;
+    double mean_ns = 0.0;
+    double stddev_ns = 0.0;
+    double min_ns = 0.0;
+    uint64_t bytes = 0;          // 每次调用处理的字节数，0表示不统计吞吐量
+    uint64_t pairs = 0;          // 每次调用比较的文档对数
+};
+
+// 基准测试套件：每项先预热，再把足够多次调用合成一个样本（样本不短于min_sample_ns，
+// 毫秒以下的操作也能测准），重复采样后取中位数、p95与标准差；结果可写成JSON，
+// 也可与之前保存的JSON比较，任一项的中位数变慢超过阈值即判为回归
+class BenchmarkSuite {
 private:
-    std::vector<std::pair<std::string, double>> timings;
-    
+    size_t repetitions;
+    uint64_t min_sample_ns;
+    std::vector<BenchmarkResult> results;
+
+    static uint64_t now_ns() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
 public:
-    void startTimer(const std::string& name) {
-        // 这里可以添加更复杂的性能分析代码
-        std::cout << "Starting timer for: " << name << std::endl;
+    explicit BenchmarkSuite(size_t repetitions = 15, uint64_t min_sample_ns = 2000000)
+        : repetitions(std::max<size_t>(repetitions, 3)), min_sample_ns(min_sample_ns) {}
+
+    // fn为一次被测调用，返回值写入benchmark_sink；bytes、pairs为每次调用的工作量
+    template <typename Fn>
+    const BenchmarkResult& run(const std::string& name, uint64_t bytes, uint64_t pairs, Fn&& fn) {
+        // 预热并标定：调用次数逐次翻倍，直到一个样本不短于min_sample_ns
+        size_t iterations = 1;
+        for (;;) {
+            uint64_t start = now_ns();
+            for (size_t i = 0; i < iterations; ++i) benchmark_sink = benchmark_sink + fn();
+            if (now_ns() - start >= min_sample_ns || iterations >= (size_t(1) << 30)) break;
+            iterations *= 2;
+        }
+
+        std::vector<double> samples;
+        for (size_t r = 0; r < repetitions; ++r) {
+            uint64_t start = now_ns();
+            for (size_t i = 0; i < iterations; ++i) benchmark_sink = benchmark_sink + fn();
+            samples.push_back(static_cast<double>(now_ns() - start) / iterations);
+        }
+        std::sort(samples.begin(), samples.end());
+
+        BenchmarkResult result;
+        result.name = name;
+        result.iterations = iterations;
+        result.samples = samples.size();
+        size_t mid = samples.size() / 2;
+        result.median_ns = samples.size() % 2 ? samples[mid] : (samples[mid - 1] + samples[mid]) / 2;
+        result.p95_ns = samples[static_cast<size_t>(std::ceil(0.95 * samples.size())) - 1];  // 最近秩
+        double sum = 0.0, squares = 0.0;
+        for (double s : samples) sum += s;
+        result.mean_ns = sum / samples.size();
+        for (double s : samples) squares += (s - result.mean_ns) * (s - result.mean_ns);
+        result.stddev_ns = std::sqrt(squares / (samples.size() - 1));
+        result.min_ns = samples.front();
+        result.bytes = bytes;
+        result.pairs = pairs;
+        results.push_back(result);
+        print_row(results.back());
+        return results.back();
+    }
+
+    static void print_header() {
+        std::cout << std::left << std::setw(34) << "benchmark" << std::setw(14) << "median" << std::setw(14) << "p95"
+                  << std::setw(10) << "stddev" << std::setw(12) << "MB/s" << "pairs/s" << std::endl;
+    }
+
+    static std::string format_ns(double ns) {
+        std::ostringstream text;
+        text << std::fixed << std::setprecision(ns < 1e6 ? 1 : 2);
+        if (ns < 1e3) text << ns << " ns";
+        else if (ns < 1e6) text << ns / 1e3 << " us";
+        else if (ns < 1e9) text << ns / 1e6 << " ms";
+        else text << ns / 1e9 << " s";
+        return text.str();
+    }
+
+    static void print_row(const BenchmarkResult& r) {
+        std::cout << std::left << std::setw(34) << r.name << std::setw(14) << format_ns(r.median_ns) << std::setw(14)
+                  << format_ns(r.p95_ns) << std::setw(10) << std::fixed << std::setprecision(1)
+                  << (std::to_string(static_cast<int>(100.0 * r.stddev_ns / r.mean_ns + 0.5)) + "%")
+                  << std::setw(12);
+        if (r.bytes) std::cout << r.bytes * 1e3 / r.median_ns;
+        else std::cout << "-";
+        if (r.pairs) std::cout << std::setprecision(0) << r.pairs * 1e9 / r.median_ns;
+        else std::cout << "-";
+        std::cout << std::endl;
+    }
+
+    // 每项一行，baseline模式按行读取
+    void write_json(const std::string& path, uint64_t seed) const {
+        std::ofstream out(path, std::ios::binary);
+        if (!out.is_open()) {
+            throw std::runtime_error("Failed to open benchmark output: " + path);
+        }
+        out << "{\n  \"seed\": " << seed << ",\n  \"benchmarks\": [\n" << std::setprecision(17);
+        for (size_t i = 0; i < results.size(); ++i) {
+            const BenchmarkResult& r = results[i];
+            out << "    {\"name\": \"" << r.name << "\", \"iterations\": " << r.iterations
+                << ", \"samples\": " << r.samples << ", \"median_ns\": " << r.median_ns << ", \"p95_ns\": " << r.p95_ns
+                << ", \"mean_ns\": " << r.mean_ns << ", \"stddev_ns\": " << r.stddev_ns << ", \"min_ns\": " << r.min_ns
+                << ", \"bytes_per_second\": " << (r.bytes ? r.bytes * 1e9 / r.median_ns : 0.0)
+                << ", \"pairs_per_second\": " << (r.pairs ? r.pairs * 1e9 / r.median_ns : 0.0) << "}"
+                << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        out << "  ]\n}\n";
+        if (!out) {
+            throw std::runtime_error("Failed to write benchmark output: " + path);
+        }
     }
+
+    // 读取write_json写出的文件：基准项名称 -> 中位数
+    static std::unordered_map<std::string, double> load_baseline(const std::string& path) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in.is_open()) {
+            throw std::runtime_error("Failed to open baseline: " + path);
+        }
+        std::unordered_map<std::string, double> medians;
+        std::string line;
+        const std::string name_key = "\"name\": \"", median_key = "\"median_ns\": ";
+        while (std::getline(in, line)) {
+            size_t name_pos = line.find(name_key), median_pos = line.find(median_key);
+            if (name_pos == std::string::npos || median_pos == std::string::npos) continue;
+            name_pos += name_key.size();
+            std::string name = line.substr(name_pos, line.find('"', name_pos) - name_pos);
+            medians[name] = std::strtod(line.c_str() + median_pos + median_key.size(), nullptr);
+        }
+        if (medians.empty()) {
+            throw std::runtime_error("No benchmarks in baseline: " + path);
+        }
+        return medians;
+    }
+
+    // 与基准文件比较中位数，返回回归超过max_regression_percent的项数；基准中没有的项只列出、不判定
+    size_t compare_with_baseline(const std::string& path, double max_regression_percent) const {
+        std::unordered_map<std::string, double> baseline = load_baseline(path);
+        std::cout << "\n--- Comparison with " << path << " (limit +" << max_regression_percent << "%) ---" << std::endl;
+        std::cout << std::left << std::setw(34) << "benchmark" << std::setw(14) << "baseline" << std::setw(14)
+                  << "current" << "change" << std::endl;
+        size_t regressions = 0;
+        for (const BenchmarkResult& r : results) {
+            auto it = baseline.find(r.name);
+            std::cout << std::left << std::setw(34) << r.name;
+            if (it == baseline.end() || it->second <= 0.0) {
+                std::cout << std::setw(14) << "-" << std::setw(14) << format_ns(r.median_ns) << "new" << std::endl;
+                continue;
+            }
+            double change = (r.median_ns / it->second - 1.0) * 100.0;
+            bool regressed = change > max_regression_percent;
+            regressions += regressed;
+            std::cout << std::setw(14) << format_ns(it->second) << std::setw(14) << format_ns(r.median_ns)
+                      << std::showpos << std::fixed << std::setprecision(1) << change << "%" << std::noshowpos
+                      << (regressed ? "  REGRESSION" : "") << std::endl;
+        }
+        return regressions;
+    }
+};
+
+// 哈希集合形式的Winnowing指纹，用于和精确k-gram集合对比偏差
+std::unordered_set<uint64_t> build_winnowed_set(const std::vector<uint32_t>& codepoints, size_t k, size_t window) {
+    std::unordered_set<uint64_t> hash_set;
+    Winnower winnower(window);
+    auto insert = [&hash_set](uint64_t hash) { hash_set.insert(hash); };
+    for_each_kgram_hash(codepoints, k, HashMode::Fnv,
+                        [&winnower, &insert](uint64_t hash) { winnower.push(hash, insert); });
+    winnower.finish(insert);
+    return hash_set;
+}
+
+// 测试数据的随机数种子（--seed），同一种子在每次运行中生成完全相同的数据
+uint64_t corpus_seed = 42;
+std::mt19937_64 corpus_gen(corpus_seed);
+
+// 生成测试数据：可打印ASCII字符，每10个字符中有一个中文字符（3字节UTF-8）
+std::vector<unsigned char> generateTestData(size_t size, std::mt19937_64& gen, bool include_chinese = true) {
+    std::vector<unsigned char> data;
+    data.reserve(size + size / 5);
+    
+    std::uniform_int_distribution<int> ascii_dist(32, 126);
+    std::uniform_int_distribution<uint32_t> chinese_dist(0x4E00, 0x9FFF);
     
-    void endTimer(const std::string& name, double duration) {
-        timings.push_back({name, duration});
-        std::cout << "Timer " << name << " completed in " << duration << " ms" << std::endl;
+    for (size_t i = 0; i < size; ++i) {
+        if (include_chinese && i % 10 == 0) {
+            // 转换为UTF-8字节
+            uint32_t chinese_char = chinese_dist(gen);
+            data.push_back(static_cast<unsigned char>(0xE0 | (chinese_char >> 12)));
+            data.push_back(static_cast<unsigned char>(0x80 | ((chinese_char >> 6) & 0x3F)));
+            data.push_back(static_cast<unsigned char>(0x80 | (chinese_char & 0x3F)));
+        } else {
+            data.push_back(static_cast<unsigned char>(ascii_dist(gen)));
+        }
     }
     
-    void printReport() {
-        std::cout << "\n=== Performance Report ===" << std::endl;
-        std::cout << std::left << std::setw(30) << "Operation" << std::setw(15) << "Time (ms)" << std::endl;
-        std::cout << std::string(45, '-') << std::endl;
+    return data;
+}
+
+// 从全局数据流生成：各项报告按固定顺序调用，因此整次运行可复现
+std::vector<unsigned char> generateTestData(size_t size, bool include_chinese = true) {
+    return generateTestData(size, corpus_gen, include_chinese);
+}
+
+// 基准测试套件：各阶段在不同规模下的耗时，语料只由种子和规模决定，与是否运行其他报告无关
+void runBenchmarkSuite(BenchmarkSuite& suite) {
+    std::cout << "=== Plagiarism Detector Benchmark Suite ===" << std::endl;
+    BenchmarkSuite::print_header();
+    
+    FingerprintOptions options;
+    for (size_t size : {1000u, 10000u, 100000u, 1000000u}) {
+        std::mt19937_64 gen(corpus_seed ^ size);
+        std::vector<unsigned char> data1 = generateTestData(size, gen);
+        std::vector<unsigned char> data2 = generateTestData(size, gen);
+        std::vector<uint32_t> codepoints1 = normalize_to_codepoints(data1);
+        std::vector<uint32_t> codepoints2 = normalize_to_codepoints(data2);
+        std::unordered_set<uint64_t> set1 = build_kgram_set(codepoints1, DEFAULT_K);
+        std::unordered_set<uint64_t> set2 = build_kgram_set(codepoints2, DEFAULT_K);
+        std::vector<uint64_t> sorted1 = build_kgram_vector(codepoints1, DEFAULT_K);
+        std::vector<uint64_t> sorted2 = build_kgram_vector(codepoints2, DEFAULT_K);
+        FlatHashSet flat1 = build_kgram_flat_set(codepoints1, DEFAULT_K);
+        FlatHashSet flat2 = build_kgram_flat_set(codepoints2, DEFAULT_K);
+        ByteSpan span1, span2;
+        span1.data = data1.data();
+        span1.size = data1.size();
+        span2.data = data2.data();
+        span2.size = data2.size();
+        FingerprintWorkspace workspace(options);
+        const std::string suffix = "/" + std::to_string(size);
+        
+        suite.run("normalize" + suffix, data1.size(), 0,
+                  [&] { return static_cast<uint64_t>(normalize_to_codepoints(data1).size()); });
+        suite.run("kgram_set" + suffix, data1.size(), 0,
+                  [&] { return static_cast<uint64_t>(build_kgram_set(codepoints1, DEFAULT_K).size()); });
+        suite.run("kgram_flat_set" + suffix, data1.size(), 0,
+                  [&] { return static_cast<uint64_t>(build_kgram_flat_set(codepoints1, DEFAULT_K).size()); });
+        suite.run("kgram_vector" + suffix, data1.size(), 0,
+                  [&] { return static_cast<uint64_t>(build_kgram_vector(codepoints1, DEFAULT_K).size()); });
+        suite.run("jaccard_set" + suffix, 0, 1,
+                  [&] { return static_cast<uint64_t>(jaccard_similarity(set1, set2) * 1e9); });
+        suite.run("jaccard_flat" + suffix, 0, 1,
+                  [&] { return static_cast<uint64_t>(jaccard_similarity(flat1, flat2) * 1e9); });
+        suite.run("jaccard_sorted" + suffix, 0, 1,
+                  [&] { return static_cast<uint64_t>(jaccard_similarity_sorted(sorted1, sorted2) * 1e9); });
+        // 端到端：两份文档的字节到指纹（复用工作区）再到相似度
+        suite.run("compare_pair" + suffix, data1.size() + data2.size(), 1, [&] {
+            std::vector<uint64_t> fingerprint1 = workspace.fingerprint_bytes(span1);
+            return static_cast<uint64_t>(jaccard_similarity_sorted(fingerprint1, workspace.fingerprint_bytes(span2)) * 1e9);
+        });
         
-        for (const auto& timing : timings) {
-            std::cout << std::left << std::setw(30) << timing.first 
-                      << std::setw(15) << std::fixed << std::setprecision(2) << timing.second << std::endl;
+        if (jaccard_similarity(set1, set2) != jaccard_similarity_sorted(sorted1, sorted2)) {
+            std::cout << "Similarity MISMATCH between hash set and sorted vector at " << size << " bytes" << std::endl;
+        }
+        if (jaccard_similarity(set1, set2) != jaccard_similarity(flat1, flat2)) {
+            std::cout << "Similarity MISMATCH between hash set and flat set at " << size << " bytes" << std::endl;
         }
     }
-};
-
-// 包含核心算法（复制自主程序）
-bool is_cjk(uint32_t cp) {
-    if ((cp >= 0x4E00 && cp <= 0x9FFF) ||
-        (cp >= 0x3400 && cp <= 0x4DBF) ||
-        (cp >= 0xF900 && cp <= 0xFAFF) ||
-        (cp >= 0x20000 && cp <= 0x2A6DF) ||
-        (cp >= 0x2A700 && cp <= 0x2B73F) ||
-        (cp >= 0x2B740 && cp <= 0x2B81F) ||
-        (cp >= 0x2B820 && cp <= 0x2CEAF) ||
-        (cp >= 0x2CEB0 && cp <= 0x2EBEF)) return true;
-    return false;
+    
+    // 单个k-gram的FNV哈希（O(k)）
+    std::mt19937_64 gen(corpus_seed);
+    std::vector<uint32_t> codepoints = normalize_to_codepoints(generateTestData(100000, gen));
+    size_t position = 0;
+    suite.run("fnv_kgram_hash/k3", 0, 0, [&] {
+        position = position + 1 < codepoints.size() - 2 ? position + 1 : 0;
+        return fnv1a64_hash_kgram(codepoints, position, 3);
+    });
 }
 
-bool is_keep_ascii(char c) {
-    if (c >= 'A' && c <= 'Z') return true;
-    if (c >= 'a' && c <= 'z') return true;
-    if (c >= '0' && c <= '9') return true;
-    return false;
+// 内存占用分析
+void runMemoryUsageReport() {
+    std::cout << "\n--- Memory Usage Analysis ---" << std::endl;
+    std::vector<unsigned char> large_data = generateTestData(1000000);
+    std::vector<uint32_t> codepoints = normalize_to_codepoints(large_data);
+    std::unordered_set<uint64_t> kgram_set = build_kgram_set(codepoints, 3);
+    
+    std::cout << "Original data size: " << large_data.size() << " bytes" << std::endl;
+    std::cout << "Normalized codepoints: " << codepoints.size() << " * 4 = " 
+              << codepoints.size() * 4 << " bytes" << std::endl;
+    std::cout << "K-gram set size: " << kgram_set.size() << " * 8 = " 
+              << kgram_set.size() * 8 << " bytes" << std::endl;
+    std::cout << "Total memory usage: " 
+              << large_data.size() + codepoints.size() * 4 + kgram_set.size() * 8 
+              << " bytes" << std::endl;
+    
+    // 哈希集合的实际占用：每个元素一个节点（值 + next指针 + 分配器开销约16字节）加桶数组
+    size_t hash_set_bytes = kgram_set.size() * (sizeof(uint64_t) + sizeof(void*) + 16)
+                          + kgram_set.bucket_count() * sizeof(void*);
+    std::vector<uint64_t> sorted_set = build_kgram_vector(codepoints, 3);
+    size_t sorted_bytes = sorted_set.capacity() * sizeof(uint64_t);
+    std::cout << "std::unordered_set footprint: ~" << hash_set_bytes << " bytes" << std::endl;
+    std::cout << "Sorted vector footprint: " << sorted_bytes << " bytes ("
+              << std::fixed << std::setprecision(1) << double(hash_set_bytes) / sorted_bytes << "x smaller)" << std::endl;
+    for (size_t window : {4, 8, 16}) {
+        std::unordered_set<uint64_t> winnowed = build_winnowed_set(codepoints, 3, window);
+        std::cout << "Winnowed set (w=" << window << "): " << winnowed.size() << " * 8 = "
+                  << winnowed.size() * 8 << " bytes (" << std::fixed << std::setprecision(1)
+                  << 100.0 * winnowed.size() / kgram_set.size() << "% of full set)" << std::endl;
+    }
 }
 
-char to_lower_ascii(char c) {
-    if (c >= 'A' && c <= 'Z') return c - 'A' + 'a';
-    return c;
+// 读取测试样例文件，不存在时返回空
+std::vector<unsigned char> readFixture(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<unsigned char>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
 }
 
-uint32_t utf8_next(const std::vector<unsigned char>& bytes, size_t& i) {
-    if (i >= bytes.size()) return 0;
-    unsigned char b0 = bytes[i];
+// Winnowing相似度与精确Jaccard的偏差（使用 test/ 下的样例，需在项目目录下运行）
+void runWinnowingDriftReport() {
+    std::cout << "\n--- Winnowing Drift vs Exact Jaccard ---" << std::endl;
+    std::vector<uint32_t> orig = normalize_to_codepoints(readFixture("test/orig.txt"));
+    if (orig.empty()) {
+        std::cout << "test/orig.txt not found, skipped" << std::endl;
+        return;
+    }
     
-    if (b0 < 0x80) {
-        i++;
-        return b0;
+    std::vector<std::string> names = {"add", "del", "dis_1", "dis_10", "dis_15"};
+    std::vector<size_t> windows = {4, 8, 16};
+    std::cout << std::left << std::setw(10) << "fixture" << std::setw(10) << "exact";
+    for (size_t w : windows) std::cout << std::setw(18) << ("w=" + std::to_string(w) + " (diff)");
+    std::cout << std::endl;
+    
+    std::unordered_set<uint64_t> orig_full = build_kgram_set(orig, 3);
+    for (const std::string& name : names) {
+        std::vector<uint32_t> plag = normalize_to_codepoints(readFixture("test/orig_0.8_" + name + ".txt"));
+        double exact = jaccard_similarity(orig_full, build_kgram_set(plag, 3));
+        std::cout << std::left << std::setw(10) << name << std::setw(10) << std::fixed << std::setprecision(4) << exact;
+        for (size_t w : windows) {
+            double approx = jaccard_similarity(build_winnowed_set(orig, 3, w), build_winnowed_set(plag, 3, w));
+            std::ostringstream cell;
+            cell << std::fixed << std::setprecision(4) << approx << " (" << std::showpos << approx - exact << ")";
+            std::cout << std::setw(18) << cell.str();
+        }
+        std::cout << std::endl;
     }
+}
+
+// MinHash + LSH筛查相对精确Jaccard全量扫描的召回率与精确率
+// 语料由若干篇随机中文文本及其不同程度改写的变体组成，相似度分布覆盖0到1
+void runLshRecallReport() {
+    std::cout << "\n--- MinHash/LSH Recall & Precision vs Exact Scan ---" << std::endl;
     
-    int seqlen = 0;
-    uint32_t cp = 0;
-    if ((b0 & 0xE0) == 0xC0) { seqlen = 2; cp = b0 & 0x1F; }
-    else if ((b0 & 0xF0) == 0xE0) { seqlen = 3; cp = b0 & 0x0F; }
-    else if ((b0 & 0xF8) == 0xF0) { seqlen = 4; cp = b0 & 0x07; }
-    else { i++; return 0; }
+    const size_t num_bases = 50, variants = 10, doc_len = 1500, num_queries = 100;
+    std::mt19937 gen(12345);
+    std::uniform_int_distribution<uint32_t> char_dist(0x4E00, 0x4FFF);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
     
-    if (i + seqlen > bytes.size()) { i = bytes.size(); return 0; }
+    std::vector<std::vector<uint64_t>> sets;
+    for (size_t b = 0; b < num_bases; ++b) {
+        std::vector<uint32_t> base(doc_len);
+        for (auto& cp : base) cp = char_dist(gen);
+        for (size_t v = 0; v < variants; ++v) {
+            // 第v个变体随机替换约 v/(2*variants) 比例的字符
+            std::vector<uint32_t> doc = base;
+            double rate = static_cast<double>(v) / (2.0 * variants);
+            for (auto& cp : doc) {
+                if (unit(gen) < rate) cp = char_dist(gen);
+            }
+            sets.push_back(build_kgram_vector(doc, 3));
+        }
+    }
+    
+    std::vector<uint64_t> signatures;
+    for (const auto& set : sets) {
+        std::vector<uint64_t> sig = minhash_signature(set);
+        signatures.insert(signatures.end(), sig.begin(), sig.end());
+    }
     
-    for (int k = 1; k < seqlen; ++k) {
-        unsigned char bx = bytes[i + k];
-        if ((bx & 0xC0) != 0x80) { i++; return 0; }
-        cp = (cp << 6) | (uint32_t)(bx & 0x3F);
+    std::cout << std::left << std::setw(11) << "threshold" << std::setw(10) << "bands" << std::setw(10) << "recall"
+              << std::setw(12) << "precision" << std::setw(13) << "candidates" << std::setw(15) << "LSH (μs/q)"
+              << std::setw(15) << "exact (μs/q)" << std::endl;
+    for (double threshold : {0.3, 0.5, 0.7}) {
+        LshParams params = choose_lsh_params(MINHASH_SIZE, threshold);
+        LshIndex lsh(signatures, MINHASH_SIZE, params);
+        
+        size_t truth = 0, hits = 0, candidates_total = 0;
+        long long lsh_us = 0, exact_us = 0;
+        for (size_t q = 0; q < num_queries; ++q) {
+            size_t query = (q * 7919) % sets.size();
+            
+            auto start = std::chrono::high_resolution_clock::now();
+            std::vector<double> exact(sets.size());
+            for (size_t d = 0; d < sets.size(); ++d) exact[d] = jaccard_similarity_sorted(sets[query], sets[d]);
+            auto end = std::chrono::high_resolution_clock::now();
+            exact_us += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+            
+            start = std::chrono::high_resolution_clock::now();
+            std::vector<uint32_t> candidates = lsh.candidates(signatures.data() + query * MINHASH_SIZE);
+            for (uint32_t d : candidates) {
+                if (jaccard_similarity_sorted(sets[query], sets[d]) >= threshold) hits++;
+            }
+            end = std::chrono::high_resolution_clock::now();
+            lsh_us += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+            
+            for (double e : exact) if (e >= threshold) truth++;
+            candidates_total += candidates.size();
+        }
+        
+        std::cout << std::left << std::setw(11) << std::fixed << std::setprecision(1) << threshold
+                  << std::setw(10) << (std::to_string(params.bands) + "x" + std::to_string(params.rows))
+                  << std::setw(10) << std::setprecision(3) << (truth ? double(hits) / truth : 1.0)
+                  << std::setw(12) << (candidates_total ? double(hits) / candidates_total : 1.0)
+                  << std::setw(13) << std::setprecision(1) << double(candidates_total) / num_queries
+                  << std::setw(15) << lsh_us / num_queries << std::setw(15) << exact_us / num_queries << std::endl;
     }
+    std::cout << "(corpus: " << sets.size() << " documents, " << num_queries << " queries)" << std::endl;
+}
+
+// 前K查询相对全量倒排表计数的耗时与剪枝比例
+// 语料由随机中文基础文本及其改写变体组成，字频服从Zipf分布，常用字组成的k-gram出现在大量文档中；
+// 一组查询是语料中某篇的改写（有相近文档），另一组是与语料无关的新文本（前K名得分都很低，难以剪枝）
+void runTopKQueryReport() {
+    std::cout << "\n--- Top-K Query with Early Termination vs Full Index Scan ---" << std::endl;
     
-    if (seqlen == 2 && cp < 0x80) { i++; return 0; }
-    if (seqlen == 3 && cp < 0x800) { i++; return 0; }
-    if (seqlen == 4 && cp < 0x10000) { i++; return 0; }
+    const size_t num_bases = 400, variants = 10, doc_len = 1500, num_queries = 50, alphabet = 3000;
+    std::mt19937 gen(54321);
+    std::vector<double> weights(alphabet);
+    for (size_t i = 0; i < alphabet; ++i) weights[i] = 1.0 / (i + 1);
+    std::discrete_distribution<uint32_t> char_dist(weights.begin(), weights.end());
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    auto random_char = [&] { return 0x4E00 + char_dist(gen); };
+    auto random_text = [&] {
+        std::vector<uint32_t> text(doc_len);
+        for (auto& cp : text) cp = random_char();
+        return text;
+    };
+    auto rewrite = [&](std::vector<uint32_t> text, double rate) {
+        for (auto& cp : text) {
+            if (unit(gen) < rate) cp = random_char();
+        }
+        return text;
+    };
     
-    if (cp >= 0xD800 && cp <= 0xDFFF) { i++; return 0; }
+    std::vector<std::vector<uint32_t>> bases;
+    CorpusIndexBuilder builder(FingerprintOptions{});
+    for (size_t b = 0; b < num_bases; ++b) {
+        bases.push_back(random_text());
+        for (size_t v = 0; v < variants; ++v) {
+            builder.add_document("doc", build_kgram_vector(rewrite(bases.back(), v / (2.0 * variants)), DEFAULT_K));
+        }
+    }
+    CorpusIndex index = builder.finish();
     
-    i += seqlen;
-    return cp;
+    std::vector<std::vector<uint64_t>> related, unrelated;
+    for (size_t q = 0; q < num_queries; ++q) {
+        related.push_back(build_kgram_vector(rewrite(bases[(q * 7919) % num_bases], 0.1), DEFAULT_K));
+        unrelated.push_back(build_kgram_vector(random_text(), DEFAULT_K));
+    }
+    
+    std::cout << std::left << std::setw(11) << "queries" << std::setw(5) << "K" << std::setw(13) << "full (us/q)"
+              << std::setw(13) << "top-K (us/q)" << std::setw(10) << "scanned" << std::setw(10) << "prefix"
+              << std::setw(10) << "size" << std::setw(10) << "bound" << std::setw(10) << "counted" << "match"
+              << std::endl;
+    for (int kind = 0; kind < 2; ++kind) {
+        const std::vector<std::vector<uint64_t>>& queries = kind == 0 ? related : unrelated;
+        for (size_t k : {1u, 10u, 100u}) {
+            double full_us = 0, top_us = 0;
+            TopKStats total;
+            bool match = true;
+            for (const std::vector<uint64_t>& query : queries) {
+                auto start = std::chrono::high_resolution_clock::now();
+                std::vector<double> scores = query_corpus_index(index, query);
+                std::vector<uint32_t> order;
+                for (uint32_t doc = 0; doc < scores.size(); ++doc) {
+                    if (scores[doc] > 0.0) order.push_back(doc);
+                }
+                std::stable_sort(order.begin(), order.end(),
+                                 [&scores](uint32_t a, uint32_t b) { return scores[a] > scores[b]; });
+                auto end = std::chrono::high_resolution_clock::now();
+                full_us += std::chrono::duration<double, std::micro>(end - start).count();
+                
+                TopKStats stats;
+                start = std::chrono::high_resolution_clock::now();
+                std::vector<RankedDocument> top = query_corpus_top_k(index, query, k, &stats);
+                end = std::chrono::high_resolution_clock::now();
+                top_us += std::chrono::duration<double, std::micro>(end - start).count();
+                
+                match = match && top.size() == std::min(k, order.size());
+                for (size_t r = 0; match && r < top.size(); ++r) match = top[r].doc == order[r];
+                total.documents += stats.documents;
+                total.terms += stats.terms;
+                total.scanned_terms += stats.scanned_terms;
+                total.candidates += stats.candidates;
+                total.size_pruned += stats.size_pruned;
+                total.bound_pruned += stats.bound_pruned;
+                total.verified += stats.verified;
+            }
+            // 剪枝比例都以文档数为分母
+            auto percent = [&total](size_t n) {
+                std::ostringstream cell;
+                cell << std::fixed << std::setprecision(1) << 100.0 * n / std::max<size_t>(total.documents, 1) << "%";
+                return cell.str();
+            };
+            std::ostringstream scanned;
+            scanned << std::fixed << std::setprecision(1) << 100.0 * total.scanned_terms / std::max<size_t>(total.terms, 1)
+                    << "%";
+            std::cout << std::left << std::setw(11) << (kind == 0 ? "related" : "unrelated") << std::setw(5) << k
+                      << std::fixed << std::setprecision(1) << std::setw(13) << full_us / queries.size() << std::setw(13)
+                      << top_us / queries.size() << std::setw(10) << scanned.str() << std::setw(10)
+                      << percent(total.documents - total.candidates) << std::setw(10) << percent(total.size_pruned)
+                      << std::setw(10) << percent(total.bound_pruned) << std::setw(10) << percent(total.verified)
+                      << (match ? "yes" : "MISMATCH") << std::endl;
+        }
+    }
+    std::cout << "(corpus: " << index.doc_paths.size() << " documents; scanned = share of query k-grams whose "
+              << "postings were read in full; prefix/size/bound = documents pruned by each filter, counted = "
+              << "documents whose intersection was counted in full)" << std::endl;
 }
 
-std::vector<uint32_t> normalize_to_codepoints(const std::vector<unsigned char>& bytes) {
-    std::vector<uint32_t> codepoints;
-    codepoints.reserve(bytes.size()); // 预分配内存以提高性能
+// 文档频率表：去掉高频停用k-gram后集合、倒排索引、两两交集与索引查询的缩减，以及模板文本对相似度的抬高
+// 每篇文档由三种课程模板之一的页眉、一段共用的引用格式和正文组成；同一基础正文的改写为相关文档
+void runDocumentFrequencyReport() {
+    std::cout << "\n--- Document Frequency Table: Stop-Grams and TF-IDF ---" << std::endl;
+    
+    const size_t num_bases = 100, variants = 5, body_len = 1200, template_len = 400, num_pairs = 2000;
+    std::mt19937 gen(777);
+    std::uniform_int_distribution<uint32_t> char_dist(0x4E00, 0x4FFF);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    auto random_text = [&](size_t length) {
+        std::vector<uint32_t> text(length);
+        for (auto& cp : text) cp = char_dist(gen);
+        return text;
+    };
+    std::vector<std::vector<uint32_t>> templates;
+    for (int t = 0; t < 3; ++t) templates.push_back(random_text(template_len));
+    std::vector<uint32_t> citation = random_text(template_len / 2);
+    
+    std::vector<CountedFingerprint> docs;
+    std::vector<size_t> base_of;
+    for (size_t b = 0; b < num_bases; ++b) {
+        std::vector<uint32_t> body = random_text(body_len);
+        for (size_t v = 0; v < variants; ++v) {
+            std::vector<uint32_t> doc = templates[(b + v) % templates.size()];
+            for (uint32_t cp : body) doc.push_back(unit(gen) < 0.1 * v ? char_dist(gen) : cp);
+            doc.insert(doc.end(), citation.begin(), citation.end());
+            CountedFingerprint counted;
+            std::unordered_map<uint64_t, uint32_t> counts;
+            KGramHasher hasher(DEFAULT_K, HashMode::Fnv);
+            for (uint32_t cp : doc) hasher.push(cp, [&counts](uint64_t hash) { counts[hash]++; });
+            std::vector<std::pair<uint64_t, uint32_t>> entries(counts.begin(), counts.end());
+            std::sort(entries.begin(), entries.end());
+            for (const auto& entry : entries) {
+                counted.hashes.push_back(entry.first);
+                counted.counts.push_back(entry.second);
+            }
+            docs.push_back(std::move(counted));
+            base_of.push_back(b);
+        }
+    }
+    
+    auto start = std::chrono::high_resolution_clock::now();
+    DocumentFrequencyBuilder builder(FingerprintOptions{});
+    for (const CountedFingerprint& doc : docs) builder.add_document(doc.hashes);
+    DocumentFrequencyTable table = builder.finish();
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << "Counted " << table.hashes.size() << " distinct k-grams in " << docs.size() << " documents in "
+              << std::fixed << std::setprecision(1) << std::chrono::duration<double, std::milli>(end - start).count()
+              << " ms" << std::endl;
     
-    size_t i = 0;
-    while (i < bytes.size()) {
-        uint32_t cp = utf8_next(bytes, i);
-        if (cp == 0) continue;
+    std::vector<std::pair<size_t, size_t>> related, unrelated;
+    for (size_t i = 0; related.size() < num_pairs || unrelated.size() < num_pairs; ++i) {
+        size_t x = gen() % docs.size(), y = gen() % docs.size();
+        if (x == y) continue;
+        if (base_of[x] == base_of[y]) {
+            if (related.size() < num_pairs) related.emplace_back(x, y);
+        } else if (unrelated.size() < num_pairs) {
+            unrelated.emplace_back(x, y);
+        }
+    }
+    
+    std::cout << std::left << std::setw(9) << "max df" << std::setw(12) << "stop-grams" << std::setw(11) << "set size"
+              << std::setw(11) << "postings" << std::setw(17) << "jaccard (ns/pr)" << std::setw(13) << "query (us)"
+              << std::setw(20)
+              << "unrelated J/TFIDF" << "related J/TFIDF" << std::endl;
+    for (double max_df : {1.0, 0.5, 0.2, 0.05}) {
+        std::vector<uint64_t> stop = stop_grams(table, max_df);
+        std::vector<CountedFingerprint> filtered = docs;
+        std::vector<std::vector<uint64_t>> sets;
+        for (CountedFingerprint& doc : filtered) {
+            remove_stop_grams(doc, stop);
+            sets.push_back(doc.hashes);
+        }
         
-        if (cp < 128) {
-            if (is_keep_ascii(static_cast<char>(cp))) {
-                cp = to_lower_ascii(static_cast<char>(cp));
-                codepoints.push_back(cp);
+        // 建索引时去掉停用k-gram，查询用未过滤的集合（由索引按记录的过滤条件去掉）
+        CorpusIndexBuilder index_builder(FingerprintOptions{}, stop, max_df);
+        for (const CountedFingerprint& doc : docs) index_builder.add_document("doc", doc.hashes);
+        CorpusIndex index = index_builder.finish();
+        const size_t num_queries = 100;
+        double query_us = 0.0;
+        for (int round = 0; round < 3; ++round) {
+            double sink = 0.0;
+            start = std::chrono::high_resolution_clock::now();
+            for (size_t q = 0; q < num_queries; ++q) sink += query_corpus_index(index, docs[q * 5].hashes)[q * 5];
+            end = std::chrono::high_resolution_clock::now();
+            benchmark_sink = benchmark_sink + sink;
+            double round_us = std::chrono::duration<double, std::micro>(end - start).count() / num_queries;
+            if (round == 0 || round_us < query_us) query_us = round_us;
+        }
+        
+        // 取五轮中最快的一轮
+        double ns = 0.0;
+        for (int round = 0; round < 5; ++round) {
+            double sink = 0.0;
+            start = std::chrono::high_resolution_clock::now();
+            for (const auto& pair : unrelated) sink += jaccard_similarity_sorted(sets[pair.first], sets[pair.second]);
+            end = std::chrono::high_resolution_clock::now();
+            benchmark_sink = benchmark_sink + sink;
+            double round_ns = std::chrono::duration<double, std::nano>(end - start).count() / unrelated.size();
+            if (round == 0 || round_ns < ns) ns = round_ns;
+        }
+        
+        auto mean = [&](const std::vector<std::pair<size_t, size_t>>& pairs, bool tfidf) {
+            double sum = 0.0;
+            for (const auto& pair : pairs) {
+                sum += tfidf ? tfidf_similarity(filtered[pair.first], filtered[pair.second], table)
+                             : jaccard_similarity_sorted(sets[pair.first], sets[pair.second]);
             }
+            return sum / pairs.size();
+        };
+        std::ostringstream unrelated_cell, related_cell;
+        unrelated_cell << std::fixed << std::setprecision(3) << mean(unrelated, false) << " / " << mean(unrelated, true);
+        related_cell << std::fixed << std::setprecision(3) << mean(related, false) << " / " << mean(related, true);
+        std::cout << std::left << std::setw(9) << std::setprecision(2) << max_df << std::setw(12) << stop.size()
+                  << std::setw(11) << std::setprecision(0) << double(index.postings.size()) / docs.size() << std::setw(11)
+                  << index.postings.size() << std::setw(17) << std::setprecision(0) << ns << std::setw(13)
+                  << std::setprecision(1) << query_us << std::setw(20) << unrelated_cell.str()
+                  << related_cell.str() << std::endl;
+    }
+    std::cout << "(set size = average k-grams per document; postings = entries in the inverted index built with "
+              << "these stop-grams; query = one document against the whole index)" << std::endl;
+}
+
+// 标量与向量化归一化内核的吞吐量对比（每种输入约8 MiB，取三次中的最好成绩）
+void runNormalizeKernelReport() {
+    std::cout << "\n--- Scalar vs Vectorized Normalization ---" << std::endl;
+#ifdef PD_X86_SIMD
+    std::cout << "AVX2: " << (cpu_has_avx2() ? "available" : "not available, both rows use the scalar kernel") << std::endl;
+#endif
+    
+    std::mt19937 gen(4242);
+    std::uniform_int_distribution<uint32_t> cjk_dist(0x4E00, 0x9FA5);
+    auto append_utf8 = [](std::vector<unsigned char>& out, uint32_t cp) {
+        if (cp < 0x80) {
+            out.push_back(static_cast<unsigned char>(cp));
         } else {
-            if (is_cjk(cp)) {
-                codepoints.push_back(cp);
-            }
+            out.push_back(static_cast<unsigned char>(0xE0 | (cp >> 12)));
+            out.push_back(static_cast<unsigned char>(0x80 | ((cp >> 6) & 0x3F)));
+            out.push_back(static_cast<unsigned char>(0x80 | (cp & 0x3F)));
         }
+    };
+    
+    const size_t target = 8 << 20;
+    std::vector<std::pair<std::string, std::vector<unsigned char>>> inputs(3);
+    inputs[0].first = "Chinese";
+    inputs[1].first = "ASCII";
+    inputs[2].first = "Mixed";
+    for (size_t n = 0; inputs[0].second.size() < target; ++n) {
+        // 中文为主，夹杂中文标点和换行
+        uint32_t cp = (n % 41 == 40) ? '\n' : (n % 13 == 12) ? 0xFF0C : cjk_dist(gen);
+        append_utf8(inputs[0].second, cp);
+    }
+    for (size_t n = 0; inputs[1].second.size() < target; ++n) {
+        append_utf8(inputs[1].second, (n % 7 == 6) ? ' ' : 'a' + gen() % 26);
+    }
+    for (size_t n = 0; inputs[2].second.size() < target; ++n) {
+        uint32_t cp = (n % 5 < 3) ? cjk_dist(gen) : (n % 5 == 3) ? 'A' + gen() % 26 : ' ';
+        append_utf8(inputs[2].second, cp);
     }
     
-    return codepoints;
+    std::cout << std::left << std::setw(10) << "input" << std::setw(16) << "scalar (MB/s)"
+              << std::setw(16) << "dispatch (MB/s)" << "speedup" << std::endl;
+    for (const auto& input : inputs) {
+        const std::vector<unsigned char>& bytes = input.second;
+        std::vector<uint32_t> scalar_out(bytes.size()), vector_out(bytes.size());
+        size_t scalar_count = 0, vector_count = 0;
+        long long scalar_best = -1, vector_best = -1;
+        for (int round = 0; round < 3; ++round) {
+            size_t i = 0;
+            auto start = std::chrono::high_resolution_clock::now();
+            scalar_count = normalize_utf8_scalar(bytes.data(), bytes.size(), i, bytes.size(), scalar_out.data());
+            auto end = std::chrono::high_resolution_clock::now();
+            long long us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+            if (scalar_best < 0 || us < scalar_best) scalar_best = us;
+            
+            i = 0;
+            start = std::chrono::high_resolution_clock::now();
+            vector_count = normalize_utf8(bytes.data(), bytes.size(), i, bytes.size(), vector_out.data());
+            end = std::chrono::high_resolution_clock::now();
+            us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+            if (vector_best < 0 || us < vector_best) vector_best = us;
+        }
+        bool identical = scalar_count == vector_count &&
+                         std::equal(scalar_out.begin(), scalar_out.begin() + scalar_count, vector_out.begin());
+        double scalar_mbps = static_cast<double>(bytes.size()) / std::max(1LL, scalar_best);
+        double vector_mbps = static_cast<double>(bytes.size()) / std::max(1LL, vector_best);
+        std::cout << std::left << std::setw(10) << input.first << std::fixed << std::setprecision(0)
+                  << std::setw(16) << scalar_mbps << std::setw(16) << vector_mbps
+                  << std::setprecision(2) << vector_mbps / scalar_mbps << "x"
+                  << (identical ? "" : " (MISMATCH)") << std::endl;
+    }
 }
 
-uint64_t fnv1a64_hash_kgram(const std::vector<uint32_t>& codepoints, size_t start, size_t k) {
-    const uint64_t FNV_OFFSET = 1469598103934665603ULL;
-    const uint64_t FNV_PRIME = 1099511628211ULL;
-    uint64_t h = FNV_OFFSET;
+// 各归一化配置的吞吐量与分类表大小：多文种混排文本（中文、假名、谚文、西里尔、拉丁、全角），
+// 并对比默认配置下逐码点查表与原先逐段区间比较的标量解码，取三次中的最好成绩
+void runNormalizationProfileReport() {
+    std::cout << "\n--- Normalization Profiles ---" << std::endl;
     
-    for (size_t i = 0; i < k; ++i) {
-        uint32_t cp = codepoints[start + i];
-        for (int b = 0; b < 4; ++b) {
-            unsigned char x = static_cast<unsigned char>((cp >> (b * 8)) & 0xFFu);
-            h ^= static_cast<uint64_t>(x);
-            h *= FNV_PRIME;
+    const uint32_t ranges[][2] = {{0x4E00, 0x9FFF}, {0x3041, 0x3096}, {0x30A1, 0x30FA}, {0xAC00, 0xD7A3},
+                                  {0x0410, 0x044F}, {'a', 'z'}, {'A', 'Z'}, {0xFF21, 0xFF3A}, {' ', ' '}};
+    std::mt19937 gen(42);
+    std::vector<unsigned char> bytes;
+    while (bytes.size() < (8u << 20)) {
+        const uint32_t* range = ranges[gen() % (sizeof(ranges) / sizeof(ranges[0]))];
+        uint32_t cp = range[0] + gen() % (range[1] - range[0] + 1);
+        if (cp < 0x80) {
+            bytes.push_back(static_cast<unsigned char>(cp));
+        } else if (cp < 0x800) {
+            bytes.push_back(static_cast<unsigned char>(0xC0 | (cp >> 6)));
+            bytes.push_back(static_cast<unsigned char>(0x80 | (cp & 0x3F)));
+        } else {
+            bytes.push_back(static_cast<unsigned char>(0xE0 | (cp >> 12)));
+            bytes.push_back(static_cast<unsigned char>(0x80 | ((cp >> 6) & 0x3F)));
+            bytes.push_back(static_cast<unsigned char>(0x80 | (cp & 0x3F)));
+        }
+    }
+    auto best_ms = [](const std::function<void()>& work) {
+        double best = 1e30;
+        for (int round = 0; round < 3; ++round) {
+            auto start = std::chrono::high_resolution_clock::now();
+            work();
+            auto end = std::chrono::high_resolution_clock::now();
+            best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
         }
+        return best;
+    };
+    std::vector<uint32_t> out(bytes.size());
+    
+    std::cout << std::left << std::setw(20) << "profile" << std::setw(12) << "table KiB" << std::setw(16)
+              << "scalar (MB/s)" << std::setw(16) << "dispatch (MB/s)" << "kept" << std::endl;
+    const NormalizationProfile profiles[] = {NormalizationProfile::Default, NormalizationProfile::CjkOnly,
+                                             NormalizationProfile::UnicodeLetters,
+                                             NormalizationProfile::FullWidthFolding};
+    for (NormalizationProfile profile : profiles) {
+        size_t kept = 0;
+        double scalar_ms = best_ms([&] {
+            size_t i = 0;
+            kept = normalize_utf8_scalar(bytes.data(), bytes.size(), i, bytes.size(), out.data(), profile);
+        });
+        double dispatch_ms = best_ms([&] {
+            size_t i = 0;
+            normalize_utf8(bytes.data(), bytes.size(), i, bytes.size(), out.data(), profile);
+        });
+        std::cout << std::left << std::setw(20) << normalization_profile_name(profile) << std::fixed
+                  << std::setprecision(1) << std::setw(12) << codepoint_classifier(profile).table_bytes() / 1024.0
+                  << std::setprecision(0) << std::setw(16) << bytes.size() / scalar_ms / 1000.0 << std::setw(16)
+                  << bytes.size() / dispatch_ms / 1000.0 << std::setprecision(1)
+                  << 100.0 * kept / bytes.size() << "% of bytes" << std::endl;
     }
-    return h;
+    
+    size_t compare_kept = 0, table_kept = 0;
+    double compare_ms = best_ms([&] {
+        size_t i = 0, n = 0;
+        while (i < bytes.size()) {
+            uint32_t cp = normalize_codepoint(utf8_next(bytes.data(), bytes.size(), i));
+            out[n] = cp;
+            n += (cp != 0);
+        }
+        compare_kept = n;
+    });
+    double table_ms = best_ms([&] {
+        size_t i = 0;
+        table_kept = normalize_utf8_scalar(bytes.data(), bytes.size(), i, bytes.size(), out.data());
+    });
+    std::cout << "Default scalar: range compares " << std::setprecision(0) << bytes.size() / compare_ms / 1000.0
+              << " MB/s, lookup table " << bytes.size() / table_ms / 1000.0 << " MB/s"
+              << (compare_kept == table_kept ? "" : " (MISMATCH)") << std::endl;
 }
 
-std::unordered_set<uint64_t> build_kgram_set(const std::vector<uint32_t>& codepoints, size_t k) {
-    std::unordered_set<uint64_t> hash_set;
-    if (k == 0 || codepoints.size() < k) return hash_set;
+// 缓冲读取与内存映射两种输入路径的对比（读入+归一化，取三次中的最好成绩）
+void runInputPathReport() {
+    std::cout << "\n--- Buffered Read vs Memory-Mapped Input ---" << std::endl;
     
-    size_t num = codepoints.size() - k + 1;
-    hash_set.reserve(num); // 预分配内存以提高性能
+    const std::string path = "perf_input_source.tmp";
+    std::vector<unsigned char> block = generateTestData(1 << 20);
+    {
+        std::ofstream out(path, std::ios::binary);
+        for (int i = 0; i < 64; ++i) {
+            out.write(reinterpret_cast<const char*>(block.data()), static_cast<std::streamsize>(block.size()));
+        }
+    }
     
-    for (size_t i = 0; i < num; ++i) {
-        uint64_t hash = fnv1a64_hash_kgram(codepoints, i, k);
-        hash_set.insert(hash);
+    long long buffered_best = -1, mapped_best = -1;
+    size_t buffered_count = 0, mapped_count = 0;
+    for (int round = 0; round < 3; ++round) {
+        auto start = std::chrono::high_resolution_clock::now();
+        buffered_count = normalize_to_codepoints(read_file_to_bytes(path)).size();
+        auto end = std::chrono::high_resolution_clock::now();
+        long long us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+        if (buffered_best < 0 || us < buffered_best) buffered_best = us;
+        
+        start = std::chrono::high_resolution_clock::now();
+        {
+            InputSource input(path);
+            mapped_count = normalize_to_codepoints(input.bytes()).size();
+        }
+        end = std::chrono::high_resolution_clock::now();
+        us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+        if (mapped_best < 0 || us < mapped_best) mapped_best = us;
     }
     
-    return hash_set;
+    // 流式流水线：分块读取，不保存完整的字节和码点序列
+    long long streaming_best = -1, in_memory_best = -1;
+    bool identical = true;
+    FingerprintOptions options;
+    for (int round = 0; round < 3; ++round) {
+        auto start = std::chrono::high_resolution_clock::now();
+        std::vector<uint64_t> in_memory = build_kgram_vector(normalize_to_codepoints(read_file_to_bytes(path)), options.k);
+        auto end = std::chrono::high_resolution_clock::now();
+        long long us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+        if (in_memory_best < 0 || us < in_memory_best) in_memory_best = us;
+        
+        start = std::chrono::high_resolution_clock::now();
+        std::ifstream in(path, std::ios::binary);
+        StreamingFingerprinter fingerprinter(options);
+        std::vector<char> chunk(STREAM_CHUNK_SIZE);
+        while (in.read(chunk.data(), static_cast<std::streamsize>(chunk.size())) || in.gcount() > 0) {
+            fingerprinter.feed(reinterpret_cast<const unsigned char*>(chunk.data()), static_cast<size_t>(in.gcount()));
+        }
+        std::vector<uint64_t> streamed = fingerprinter.finish();
+        end = std::chrono::high_resolution_clock::now();
+        us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+        if (streaming_best < 0 || us < streaming_best) streaming_best = us;
+        identical = identical && streamed == in_memory;
+    }
+    std::remove(path.c_str());
+    
+    std::cout << "Input size: " << (block.size() * 64 >> 20) << " MiB" << std::endl;
+    std::cout << "Buffered read + normalize: " << buffered_best / 1000 << " ms" << std::endl;
+    std::cout << "Mapped input + normalize:  " << mapped_best / 1000 << " ms"
+              << (buffered_count == mapped_count ? " (identical)" : " (MISMATCH)") << std::endl;
+    std::cout << "In-memory fingerprint:     " << in_memory_best / 1000 << " ms (working buffers "
+              << (block.size() * 64 * 5 >> 20) << " MiB)" << std::endl;
+    std::cout << "Streaming fingerprint:     " << streaming_best / 1000 << " ms (working buffers "
+              << (STREAM_CHUNK_SIZE >> 10) << " KiB)" << (identical ? " (identical)" : " (MISMATCH)") << std::endl;
 }
 
-double jaccard_similarity(const std::unordered_set<uint64_t>& set1, const std::unordered_set<uint64_t>& set2) {
-    if (set1.empty() && set2.empty()) return 0.0;
+// 批量评分的多线程扩展性：固定的一组文档对，在不同线程数下计算指纹并比较
+// 原文只计算一次指纹并共享，与 --batch 的处理方式相同
+void runBatchScalingReport() {
+    std::cout << "\n--- Batch Scoring Thread Scaling ---" << std::endl;
     
-    size_t intersection = 0;
-    // 优化：遍历较小的集合
-    if (set1.size() <= set2.size()) {
-        for (const auto& hash : set1) {
-            if (set2.find(hash) != set2.end()) {
-                intersection++;
-            }
-        }
-    } else {
-        for (const auto& hash : set2) {
-            if (set1.find(hash) != set1.end()) {
-                intersection++;
-            }
+    const size_t num_originals = 32, pairs_per_original = 8, doc_size = 200000;
+    std::vector<std::vector<unsigned char>> originals, suspects;
+    for (size_t o = 0; o < num_originals; ++o) {
+        originals.push_back(generateTestData(doc_size));
+        for (size_t s = 0; s < pairs_per_original; ++s) {
+            suspects.push_back(generateTestData(doc_size / 2 + (o * 7919 + s * 104729) % doc_size));
         }
     }
     
-    size_t union_size = set1.size() + set2.size() - intersection;
-    if (union_size == 0) return 0.0;
+    FingerprintOptions options;
+    auto fingerprint = [&options](const std::vector<unsigned char>& bytes) {
+        StreamingFingerprinter fingerprinter(options);
+        fingerprinter.feed(bytes.data(), bytes.size());
+        return fingerprinter.finish();
+    };
+    
+    size_t hardware = default_thread_count();
+    std::cout << "Hardware threads: " << hardware << ", pairs: " << suspects.size() << std::endl;
+    std::cout << std::left << std::setw(10) << "threads" << std::setw(14) << "time (ms)"
+              << std::setw(14) << "pairs/s" << "speedup" << std::endl;
     
-    return static_cast<double>(intersection) / static_cast<double>(union_size);
+    double baseline_ms = 0;
+    std::vector<double> baseline_scores;
+    for (size_t threads = 1; threads <= std::max<size_t>(hardware, 4); threads *= 2) {
+        WorkStealingScheduler scheduler(threads);
+        std::vector<std::vector<uint64_t>> original_sets(num_originals);
+        std::vector<double> scores(suspects.size());
+        
+        auto start = std::chrono::high_resolution_clock::now();
+        scheduler.parallel_for(num_originals, [&](size_t o) { original_sets[o] = fingerprint(originals[o]); });
+        scheduler.parallel_for(suspects.size(), [&](size_t s) {
+            scores[s] = jaccard_similarity_sorted(original_sets[s / pairs_per_original], fingerprint(suspects[s]));
+        });
+        auto end = std::chrono::high_resolution_clock::now();
+        double ms = std::chrono::duration<double, std::milli>(end - start).count();
+        
+        if (threads == 1) {
+            baseline_ms = ms;
+            baseline_scores = scores;
+        }
+        std::cout << std::left << std::setw(10) << threads << std::fixed << std::setprecision(1)
+                  << std::setw(14) << ms << std::setw(14) << suspects.size() * 1000.0 / ms
+                  << std::setprecision(2) << baseline_ms / ms << "x"
+                  << (scores == baseline_scores ? "" : " (MISMATCH)")
+                  << (threads > hardware ? " (oversubscribed)" : "") << std::endl;
+    }
 }
 
-// 生成测试数据
-std::vector<unsigned char> generateTestData(size_t size, bool include_chinese = true) {
-    std::vector<unsigned char> data;
-    data.reserve(size);
+// 开放寻址指纹集合与std::unordered_set的插入、查找开销（均预先reserve）
+// 随机64位键模拟已充分混合的k-gram哈希；查找一半命中、一半不命中
+void runFlatHashSetReport() {
+    std::cout << "\n--- Flat Hash Set vs std::unordered_set ---" << std::endl;
+    std::cout << std::left << std::setw(10) << "n" << std::setw(20) << "insert (ns/op)" << std::setw(20)
+              << "lookup (ns/op)" << "bytes/elem" << std::endl;
+    std::cout << std::left << std::setw(10) << "" << std::setw(20) << "unordered / flat" << std::setw(20)
+              << "unordered / flat" << "unordered / flat" << std::endl;
     
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> ascii_dist(32, 126);
-    std::uniform_int_distribution<> chinese_dist(0x4E00, 0x9FFF);
+    std::mt19937_64 gen(corpus_seed);
+    for (size_t n : {1000u, 10000u, 100000u, 1000000u}) {
+        std::vector<uint64_t> keys(n), probes(n);
+        for (uint64_t& key : keys) key = gen();
+        for (size_t i = 0; i < n; ++i) probes[i] = i % 2 == 0 ? keys[(i * 7919) % n] : gen();
+        size_t rounds = std::max<size_t>(1, 2000000 / n);
+        
+        auto time_ns = [&](const std::function<size_t()>& fn) {
+            double best = 1e30;
+            for (int repeat = 0; repeat < 3; ++repeat) {
+                auto start = std::chrono::high_resolution_clock::now();
+                for (size_t round = 0; round < rounds; ++round) benchmark_sink = benchmark_sink + fn();
+                auto end = std::chrono::high_resolution_clock::now();
+                best = std::min(best, std::chrono::duration<double, std::nano>(end - start).count() / rounds / n);
+            }
+            return best;
+        };
+        
+        double node_insert = time_ns([&] {
+            std::unordered_set<uint64_t> set;
+            set.reserve(n);
+            for (uint64_t key : keys) set.insert(key);
+            return set.size();
+        });
+        double flat_insert = time_ns([&] {
+            FlatHashSet set(n);
+            for (uint64_t key : keys) set.insert(key);
+            return set.size();
+        });
+        std::unordered_set<uint64_t> node_set(keys.begin(), keys.end());
+        FlatHashSet flat_set(n);
+        for (uint64_t key : keys) flat_set.insert(key);
+        double node_lookup = time_ns([&] {
+            size_t hits = 0;
+            for (uint64_t probe : probes) hits += node_set.count(probe);
+            return hits;
+        });
+        double flat_lookup = time_ns([&] {
+            size_t hits = 0;
+            for (uint64_t probe : probes) hits += flat_set.contains(probe);
+            return hits;
+        });
+        // 节点：next指针+键，连同malloc的块头约32字节；外加每个桶一个指针
+        double node_bytes = 32.0 + node_set.bucket_count() * sizeof(void*) / double(n);
+        
+        std::cout << std::left << std::setw(10) << n << std::fixed << std::setprecision(1) << std::setw(8)
+                  << node_insert << " / " << std::setw(9) << flat_insert << std::setw(8) << node_lookup << " / "
+                  << std::setw(9) << flat_lookup << node_bytes << " / " << flat_set.memory_bytes() / double(n)
+                  << std::endl;
+    }
+}
+
+// 修订稿增量评分：修改一段约200字节后，与4份原文重新评分的耗时
+// 对比全文重新计算计数指纹再逐一比较，以及按字节区间修改（replace）和给出整篇新稿（update，需先比对前后缀）
+void runIncrementalRescoreReport() {
+    std::cout << "\n--- Incremental Re-scoring After an Edit ---" << std::endl;
+    std::cout << std::left << std::setw(12) << "doc bytes" << std::setw(16) << "full (ms)" << std::setw(16)
+              << "replace (us)" << std::setw(16) << "update (us)" << "match" << std::endl;
     
-    for (size_t i = 0; i < size; ++i) {
-        if (include_chinese && i % 10 == 0) {
-            // 每10个字符插入一个中文字符
-            uint32_t chinese_char = chinese_dist(gen);
-            // 转换为UTF-8字节
-            if (chinese_char < 0x800) {
-                data.push_back(0xE0 | (chinese_char >> 12));
-                data.push_back(0x80 | ((chinese_char >> 6) & 0x3F));
-                data.push_back(0x80 | (chinese_char & 0x3F));
+    FingerprintOptions options;
+    std::mt19937_64 gen(corpus_seed);
+    auto counted = [&options](const std::vector<unsigned char>& bytes) {
+        StreamingFingerprinter fingerprinter(options, true);
+        fingerprinter.feed(bytes.data(), bytes.size());
+        CountedFingerprint result;
+        result.hashes = fingerprinter.finish_in_place();
+        result.counts = fingerprinter.counts_in_place();
+        return result;
+    };
+    auto span_of = [](const std::vector<unsigned char>& bytes) {
+        ByteSpan span;
+        span.data = bytes.data();
+        span.size = bytes.size();
+        return span;
+    };
+    
+    for (size_t size : {100000u, 1000000u, 8000000u}) {
+        std::vector<unsigned char> document = generateTestData(size, gen);
+        std::vector<CountedFingerprint> originals;
+        for (int o = 0; o < 4; ++o) {
+            std::vector<unsigned char> original = generateTestData(size, gen);
+            // 原文与文档共享前一半，相似度不为0
+            std::copy(document.begin(), document.begin() + static_cast<std::ptrdiff_t>(size / 2), original.begin());
+            originals.push_back(counted(original));
+        }
+        IncrementalScorer scorer(options, span_of(document));
+        for (const CountedFingerprint& original : originals) scorer.add_original(original);
+        
+        const size_t edits = 50;
+        std::vector<unsigned char> replacement = generateTestData(200, gen);
+        double replace_us = 0, update_us = 0, full_ms = 0;
+        bool match = true;
+        for (size_t e = 0; e < edits; ++e) {
+            size_t offset = static_cast<size_t>(gen() % (document.size() - 300));
+            auto start = std::chrono::high_resolution_clock::now();
+            scorer.replace(offset, 180, span_of(replacement));
+            for (size_t o = 0; o < originals.size(); ++o) benchmark_sink = benchmark_sink + scorer.metrics(o).jaccard * 1e9;
+            auto end = std::chrono::high_resolution_clock::now();
+            replace_us += std::chrono::duration<double, std::micro>(end - start).count();
+            document.erase(document.begin() + static_cast<std::ptrdiff_t>(offset),
+                           document.begin() + static_cast<std::ptrdiff_t>(offset + 180));
+            document.insert(document.begin() + static_cast<std::ptrdiff_t>(offset), replacement.begin(), replacement.end());
+            
+            // 同一位置换回另一段，作为整篇新稿交给update
+            std::vector<unsigned char> revision = document;
+            std::copy(replacement.rbegin(), replacement.rend(), revision.begin() + static_cast<std::ptrdiff_t>(offset));
+            start = std::chrono::high_resolution_clock::now();
+            scorer.update(span_of(revision));
+            for (size_t o = 0; o < originals.size(); ++o) benchmark_sink = benchmark_sink + scorer.metrics(o).jaccard * 1e9;
+            end = std::chrono::high_resolution_clock::now();
+            update_us += std::chrono::duration<double, std::micro>(end - start).count();
+            document.swap(revision);
+            
+            if (e % 10 == 0) {
+                start = std::chrono::high_resolution_clock::now();
+                CountedFingerprint full = counted(document);
+                for (size_t o = 0; o < originals.size(); ++o) {
+                    SimilarityMetrics metrics = similarity_metrics(originals[o], full);
+                    match = match && metrics.weighted_jaccard == scorer.metrics(o).weighted_jaccard &&
+                            metrics.jaccard == scorer.metrics(o).jaccard;
+                }
+                end = std::chrono::high_resolution_clock::now();
+                full_ms += std::chrono::duration<double, std::milli>(end - start).count();
             }
+        }
+        std::cout << std::left << std::setw(12) << size << std::fixed << std::setprecision(2) << std::setw(16)
+                  << full_ms / (edits / 10) << std::setprecision(1) << std::setw(16) << replace_us / edits
+                  << std::setw(16) << update_us / edits << (match ? "yes" : "MISMATCH") << std::endl;
+    }
+}
+
+// 单对大文件的线程扩展：两个文件同时处理，文件内按UTF-8边界切段，并集与交集按哈希前缀分片
+// 1线程一行是串行路径（fingerprint_bytes + similarity_metrics），其余各行须与它的结果完全相同
+void runSinglePairScalingReport() {
+    std::cout << "\n--- Single Pair Thread Scaling ---" << std::endl;
+    
+    const size_t doc_size = 32 << 20;
+    std::vector<unsigned char> original = generateTestData(doc_size);
+    std::vector<unsigned char> suspect = generateTestData(doc_size);
+    std::vector<ByteSpan> documents(2);
+    documents[0].data = original.data();
+    documents[0].size = original.size();
+    documents[1].data = suspect.data();
+    documents[1].size = suspect.size();
+    FingerprintOptions options;
+    
+    size_t hardware = default_thread_count();
+    std::cout << "Hardware threads: " << hardware << ", 2 x " << (doc_size >> 20) << " MB" << std::endl;
+    std::cout << std::left << std::setw(10) << "threads" << std::setw(14) << "time (ms)"
+              << std::setw(14) << "MB/s" << "speedup" << std::endl;
+    
+    double baseline_ms = 0;
+    SimilarityMetrics baseline;
+    for (size_t threads = 1; threads <= std::max<size_t>(hardware, 4); threads *= 2) {
+        WorkStealingScheduler scheduler(threads);
+        SimilarityMetrics metrics;
+        auto start = std::chrono::high_resolution_clock::now();
+        if (threads == 1) {
+            std::vector<uint64_t> a = fingerprint_bytes(documents[0], options);
+            std::vector<uint64_t> b = fingerprint_bytes(documents[1], options);
+            metrics = similarity_metrics(a.data(), nullptr, a.size(), b.data(), nullptr, b.size());
         } else {
-            data.push_back(static_cast<unsigned char>(ascii_dist(gen)));
+            std::vector<std::vector<uint64_t>> sets = fingerprint_documents_parallel(documents, options, scheduler);
+            metrics = similarity_metrics_parallel(sets[0].data(), sets[0].size(), sets[1].data(), sets[1].size(), scheduler);
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        double ms = std::chrono::duration<double, std::milli>(end - start).count();
+        
+        if (threads == 1) {
+            baseline_ms = ms;
+            baseline = metrics;
         }
+        bool same = metrics.jaccard == baseline.jaccard && metrics.containment_a == baseline.containment_a &&
+                    metrics.containment_b == baseline.containment_b;
+        std::cout << std::left << std::setw(10) << threads << std::fixed << std::setprecision(1)
+                  << std::setw(14) << ms << std::setw(14) << 2.0 * doc_size / (1 << 20) * 1000.0 / ms
+                  << std::setprecision(2) << baseline_ms / ms << "x" << (same ? "" : " (MISMATCH)")
+                  << (threads > hardware ? " (oversubscribed)" : "") << std::endl;
     }
+}
+
+// 每次比较的堆分配次数：原文指纹预先算好，只统计处理一份抄袭版并与原文比较的开销
+// 对比最初的做法（整体读入、逐个push_back的码点序列、哈希集合）、每次新建流式流水线、复用指纹工作区
+void runAllocationReport() {
+    std::cout << "\n--- Heap Allocations per Comparison ---" << std::endl;
     
-    return data;
+    const size_t num_suspects = 16;
+    std::vector<std::string> paths;
+    for (size_t s = 0; s < num_suspects; ++s) {
+        paths.push_back("perf_alloc_" + std::to_string(s) + ".tmp");
+        std::vector<unsigned char> bytes = generateTestData(50000 + s * 7919);
+        std::ofstream out(paths.back(), std::ios::binary);
+        out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    }
+    FingerprintOptions options;
+    std::vector<unsigned char> original = generateTestData(100000);
+    std::unordered_set<uint64_t> original_set = build_kgram_set(normalize_to_codepoints(original), options.k);
+    std::vector<uint64_t> original_vector = build_kgram_vector(normalize_to_codepoints(original), options.k);
+    
+    std::vector<double> hash_set_scores, fresh_scores, workspace_scores;
+    auto hash_set_compare = [&](const std::string& path) {
+        std::unordered_set<uint64_t> set = build_kgram_set(normalize_to_codepoints(read_file_to_bytes(path)), options.k);
+        hash_set_scores.push_back(jaccard_similarity(original_set, set));
+    };
+    auto fresh_compare = [&](const std::string& path) {
+        InputSource input(path);
+        StreamingFingerprinter fingerprinter(options);
+        ByteSpan bytes = input.bytes();
+        for (size_t offset = 0; offset < bytes.size; offset += STREAM_CHUNK_SIZE) {
+            fingerprinter.feed(bytes.data + offset, std::min(STREAM_CHUNK_SIZE, bytes.size - offset));
+        }
+        fresh_scores.push_back(jaccard_similarity_sorted(original_vector, fingerprinter.finish()));
+    };
+    FingerprintWorkspace workspace(options);
+    auto workspace_compare = [&](const std::string& path) {
+        workspace_scores.push_back(jaccard_similarity_sorted(original_vector, workspace.fingerprint_file(path)));
+    };
+    
+    // 每种做法先完整运行一轮预热（工作区的缓冲区在此增长到位），再统计一轮
+    auto measure = [&](const char* name, const std::function<void(const std::string&)>& compare,
+                       std::vector<double>& scores) {
+        for (const std::string& path : paths) compare(path);
+        scores.clear();
+        scores.reserve(paths.size());
+        size_t before = heap_allocations.load();
+        auto start = std::chrono::high_resolution_clock::now();
+        for (const std::string& path : paths) compare(path);
+        auto end = std::chrono::high_resolution_clock::now();
+        size_t allocations = heap_allocations.load() - before;
+        double us = std::chrono::duration<double, std::micro>(end - start).count();
+        std::cout << std::left << std::setw(34) << name << std::fixed << std::setprecision(1)
+                  << std::setw(16) << static_cast<double>(allocations) / paths.size()
+                  << us / paths.size() << std::endl;
+    };
+    
+    std::cout << std::left << std::setw(34) << "method" << std::setw(16) << "allocs/cmp" << "us/cmp" << std::endl;
+    measure("hash set (read + push_back)", hash_set_compare, hash_set_scores);
+    measure("streaming, fresh buffers", fresh_compare, fresh_scores);
+    measure("streaming, reused workspace", workspace_compare, workspace_scores);
+    std::cout << "Scores " << (fresh_scores == hash_set_scores && workspace_scores == hash_set_scores
+                               ? "identical" : "MISMATCH") << std::endl;
+    
+    for (const std::string& path : paths) std::remove(path.c_str());
 }
 
-// 性能测试函数
-void runPerformanceTests() {
-    PerformanceProfiler profiler;
+// 一次归并得到全部相似度的开销：只求Jaccard（不计数）对比统计出现次数并计算全部相似度
+// 每次比较包括为抄袭版计算指纹（复用工作区），原文指纹预先算好；取三次中的最好成绩
+void runMetricsCostReport() {
+    std::cout << "\n--- Similarity Metrics Cost ---" << std::endl;
     
-    std::cout << "=== Plagiarism Detector Performance Test ===" << std::endl;
+    const size_t num_suspects = 64;
+    std::vector<std::vector<unsigned char>> suspects;
+    for (size_t s = 0; s < num_suspects; ++s) {
+        suspects.push_back(generateTestData(20000 + s * 1543));
+    }
+    std::vector<unsigned char> original = generateTestData(100000);
+    ByteSpan original_span;
+    original_span.data = original.data();
+    original_span.size = original.size();
     
-    // 测试不同大小的数据
-    std::vector<size_t> test_sizes = {1000, 10000, 100000, 1000000};
+    FingerprintOptions options;
+    FingerprintWorkspace plain(options), counted(options, true);
+    std::vector<uint64_t> original_plain = plain.fingerprint_bytes(original_span);
+    CountedFingerprint original_counted;
+    original_counted.hashes = counted.fingerprint_bytes(original_span);
+    original_counted.counts = counted.counts();
     
-    for (size_t size : test_sizes) {
-        std::cout << "\n--- Testing with " << size << " bytes ---" << std::endl;
-        
-        // 生成测试数据
+    double jaccard_ms = 1e30, metrics_ms = 1e30;
+    bool identical = true;
+    for (int round = 0; round < 3; ++round) {
+        std::vector<double> jaccard_scores;
         auto start = std::chrono::high_resolution_clock::now();
-        std::vector<unsigned char> data1 = generateTestData(size);
-        std::vector<unsigned char> data2 = generateTestData(size);
+        for (const std::vector<unsigned char>& bytes : suspects) {
+            ByteSpan span;
+            span.data = bytes.data();
+            span.size = bytes.size();
+            jaccard_scores.push_back(jaccard_similarity_sorted(original_plain, plain.fingerprint_bytes(span)));
+        }
+        auto mid = std::chrono::high_resolution_clock::now();
+        std::vector<double> metric_scores;
+        for (const std::vector<unsigned char>& bytes : suspects) {
+            ByteSpan span;
+            span.data = bytes.data();
+            span.size = bytes.size();
+            const std::vector<uint64_t>& hashes = counted.fingerprint_bytes(span);
+            SimilarityMetrics m = similarity_metrics(original_counted.hashes.data(), original_counted.counts.data(),
+                                                     original_counted.hashes.size(), hashes.data(),
+                                                     counted.counts().data(), hashes.size());
+            metric_scores.push_back(m.jaccard);
+        }
         auto end = std::chrono::high_resolution_clock::now();
-        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
-        profiler.endTimer("Data Generation (" + std::to_string(size) + " bytes)", duration.count());
-        
-        // 测试文本归一化性能
-        start = std::chrono::high_resolution_clock::now();
-        std::vector<uint32_t> codepoints1 = normalize_to_codepoints(data1);
-        std::vector<uint32_t> codepoints2 = normalize_to_codepoints(data2);
-        end = std::chrono::high_resolution_clock::now();
-        duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
-        profiler.endTimer("Text Normalization (" + std::to_string(size) + " bytes)", duration.count());
+        jaccard_ms = std::min(jaccard_ms, std::chrono::duration<double, std::milli>(mid - start).count());
+        metrics_ms = std::min(metrics_ms, std::chrono::duration<double, std::milli>(end - mid).count());
+        identical = identical && metric_scores == jaccard_scores;
+    }
+    std::cout << "Jaccard only:                 " << std::fixed << std::setprecision(1) << jaccard_ms << " ms" << std::endl;
+    std::cout << "Counts + all four metrics:    " << metrics_ms << " ms (" << std::showpos
+              << (metrics_ms / jaccard_ms - 1.0) * 100.0 << std::noshowpos << "%, Jaccard "
+              << (identical ? "identical" : "MISMATCH") << ")" << std::endl;
+    
+    // test/ 下的样例：摘抄式改写（add/del）在两个方向上的包含度差别明显
+    if (readFixture("test/orig.txt").empty()) return;
+    CountedFingerprint orig = fingerprint_file_counted("test/orig.txt", options);
+    std::cout << std::left << std::setw(10) << "fixture" << std::setw(10) << "jaccard" << std::setw(14) << "containment"
+              << std::setw(10) << "coverage" << "weighted" << std::endl;
+    std::vector<std::string> names = {"add", "del", "dis_1", "dis_10", "dis_15"};
+    for (const std::string& name : names) {
+        SimilarityMetrics m = similarity_metrics(orig, fingerprint_file_counted("test/orig_0.8_" + name + ".txt", options));
+        std::cout << std::left << std::setw(10) << name << std::setprecision(4) << std::setw(10) << m.jaccard
+                  << std::setw(14) << m.containment_b << std::setw(10) << m.containment_a << m.weighted_jaccard
+                  << std::endl;
+    }
+}
+
+// 匹配片段定位的耗时随输入规模的变化（含带偏移的归一化），验证接近线性
+// 抄袭版由原文的部分段落打乱顺序后与新文本交替拼接而成
+void runSpanLocalizationReport() {
+    std::cout << "\n--- Matched Span Localization ---" << std::endl;
+    std::cout << std::left << std::setw(12) << "size (KiB)" << std::setw(12) << "time (ms)" << std::setw(12) << "MB/s"
+              << std::setw(10) << "spans" << "matched" << std::endl;
+    
+    std::mt19937 gen(42);
+    for (size_t size : {256u << 10, 512u << 10, 1u << 20, 2u << 20}) {
+        std::vector<unsigned char> original = generateTestData(size);
+        const size_t blocks = 64, block_size = original.size() / blocks;
+        std::vector<size_t> order(blocks);
+        for (size_t i = 0; i < blocks; ++i) order[i] = i;
+        std::shuffle(order.begin(), order.end(), gen);
+        std::vector<unsigned char> suspect;
+        for (size_t i = 0; i < blocks; ++i) {
+            if (i % 5 < 3) {
+                auto begin = original.begin() + static_cast<std::ptrdiff_t>(order[i] * block_size);
+                suspect.insert(suspect.end(), begin, begin + static_cast<std::ptrdiff_t>(block_size));
+            } else {
+                std::vector<unsigned char> fresh = generateTestData(block_size);
+                suspect.insert(suspect.end(), fresh.begin(), fresh.end());
+            }
+        }
         
-        // 测试k-gram构建性能
-        start = std::chrono::high_resolution_clock::now();
-        std::unordered_set<uint64_t> set1 = build_kgram_set(codepoints1, 3);
-        std::unordered_set<uint64_t> set2 = build_kgram_set(codepoints2, 3);
-        end = std::chrono::high_resolution_clock::now();
-        duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
-        profiler.endTimer("K-gram Building (" + std::to_string(size) + " bytes)", duration.count());
+        ByteSpan a, b;
+        a.data = original.data();
+        a.size = original.size();
+        b.data = suspect.data();
+        b.size = suspect.size();
+        double best_ms = 1e30;
+        std::vector<MatchedSpan> spans;
+        for (int round = 0; round < 3; ++round) {
+            auto start = std::chrono::high_resolution_clock::now();
+            LocatedText text_a = normalize_with_offsets(a), text_b = normalize_with_offsets(b);
+            spans = find_matched_spans(text_a, text_b, DEFAULT_K, HashMode::Fnv, 8);
+            auto end = std::chrono::high_resolution_clock::now();
+            best_ms = std::min(best_ms, std::chrono::duration<double, std::milli>(end - start).count());
+        }
+        size_t matched = 0;
+        for (const MatchedSpan& span : spans) matched += span.b_end - span.b_start;
+        std::cout << std::left << std::setw(12) << (size >> 10) << std::fixed << std::setprecision(1)
+                  << std::setw(12) << best_ms << std::setw(12) << (a.size + b.size) / best_ms / 1000.0
+                  << std::setw(10) << spans.size() << std::setprecision(0)
+                  << 100.0 * matched / suspect.size() << "%" << std::endl;
+    }
+}
+
+// 后缀数组精确匹配的耗时随码点数的变化，最大到1M码点；倍增的轮数取决于最长重复子串，
+// 因此另测一组全部相同码点的文本作为最坏情况。抄袭版的构造与匹配片段定位相同
+void runExactMatchReport() {
+    std::cout << "\n--- Exact Common Substrings (suffix array) ---" << std::endl;
+    std::cout << std::left << std::setw(14) << "codepoints" << std::setw(12) << "time (ms)" << std::setw(14)
+              << "worst (ms)" << std::setw(12) << "substrings" << "similarity" << std::endl;
+    
+    std::mt19937 gen(42);
+    for (size_t size : {128000u, 256000u, 512000u, 1000000u}) {
+        std::vector<uint32_t> original;
+        while (original.size() < size) {
+            std::vector<uint32_t> chunk = normalize_to_codepoints(generateTestData(size));
+            original.insert(original.end(), chunk.begin(), chunk.end());
+        }
+        original.resize(size);
+        const size_t blocks = 64, block_size = size / blocks;
+        std::vector<size_t> order(blocks);
+        for (size_t i = 0; i < blocks; ++i) order[i] = i;
+        std::shuffle(order.begin(), order.end(), gen);
+        std::vector<uint32_t> suspect;
+        for (size_t i = 0; i < blocks; ++i) {
+            if (i % 5 < 3) {
+                auto begin = original.begin() + static_cast<std::ptrdiff_t>(order[i] * block_size);
+                suspect.insert(suspect.end(), begin, begin + static_cast<std::ptrdiff_t>(block_size));
+            } else {
+                std::vector<uint32_t> fresh = normalize_to_codepoints(generateTestData(block_size * 2));
+                fresh.resize(std::min(fresh.size(), block_size));
+                suspect.insert(suspect.end(), fresh.begin(), fresh.end());
+            }
+        }
         
-        // 测试相似度计算性能
-        start = std::chrono::high_resolution_clock::now();
-        double similarity = jaccard_similarity(set1, set2);
-        end = std::chrono::high_resolution_clock::now();
-        duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
-        profiler.endTimer("Similarity Calculation (" + std::to_string(size) + " bytes)", duration.count());
+        double best_ms = 1e30;
+        CommonSubstringReport report;
+        for (int round = 0; round < 3; ++round) {
+            auto start = std::chrono::high_resolution_clock::now();
+            report = find_common_substrings(original, suspect, 8);
+            auto end = std::chrono::high_resolution_clock::now();
+            best_ms = std::min(best_ms, std::chrono::duration<double, std::milli>(end - start).count());
+        }
+        std::vector<uint32_t> repeated(size, 'a');
+        auto start = std::chrono::high_resolution_clock::now();
+        find_common_substrings(repeated, std::vector<uint32_t>(size / 2, 'a'), 8);
+        auto end = std::chrono::high_resolution_clock::now();
+        double worst_ms = std::chrono::duration<double, std::milli>(end - start).count();
         
-        std::cout << "Similarity: " << std::fixed << std::setprecision(4) << similarity << std::endl;
+        std::cout << std::left << std::setw(14) << size << std::fixed << std::setprecision(1) << std::setw(12) << best_ms
+                  << std::setw(14) << worst_ms << std::setw(12) << report.substrings.size() << std::setprecision(4)
+                  << report.similarity << std::endl;
     }
+}
+
+// 压缩指纹：不同集合大小与哈希位数下每个元素的位数，以及直接在压缩流上求交集
+// 与有序向量归并的耗时对比（两边大小相近，以及1000对n的不对称情形）
+void runCompressedFingerprintReport() {
+    std::cout << "\n--- Compressed Fingerprints (Elias-Fano) ---" << std::endl;
+    std::cout << std::left << std::setw(10) << "n" << std::setw(8) << "bits" << std::setw(14) << "bits/elem"
+              << std::setw(14) << "encode (ms)" << std::setw(16) << "sorted (us)" << std::setw(18) << "compressed (us)"
+              << std::setw(16) << "1k vs n sorted" << "1k vs n compressed" << std::endl;
     
-    // 内存使用分析
-    std::cout << "\n--- Memory Usage Analysis ---" << std::endl;
-    std::vector<unsigned char> large_data = generateTestData(1000000);
-    std::vector<uint32_t> codepoints = normalize_to_codepoints(large_data);
-    std::unordered_set<uint64_t> kgram_set = build_kgram_set(codepoints, 3);
+    FingerprintOptions options;
+    std::mt19937_64 gen(corpus_seed);
+    auto random_set = [&gen](size_t n) {
+        std::vector<uint64_t> values(n);
+        for (uint64_t& value : values) value = gen();
+        sort_unique_hashes(values);
+        return values;
+    };
+    auto time_us = [](const std::function<size_t()>& fn) {
+        double best = 1e30;
+        for (int round = 0; round < 5; ++round) {
+            auto start = std::chrono::high_resolution_clock::now();
+            benchmark_sink = benchmark_sink + fn();
+            auto end = std::chrono::high_resolution_clock::now();
+            best = std::min(best, std::chrono::duration<double, std::micro>(end - start).count());
+        }
+        return best;
+    };
     
-    std::cout << "Original data size: " << large_data.size() << " bytes" << std::endl;
-    std::cout << "Normalized codepoints: " << codepoints.size() << " * 4 = " 
-              << codepoints.size() * 4 << " bytes" << std::endl;
-    std::cout << "K-gram set size: " << kgram_set.size() << " * 8 = " 
-              << kgram_set.size() * 8 << " bytes" << std::endl;
-    std::cout << "Total memory usage: " 
-              << large_data.size() + codepoints.size() * 4 + kgram_set.size() * 8 
-              << " bytes" << std::endl;
+    for (size_t n : {10000u, 100000u, 1000000u}) {
+        // 两个集合共享一半元素
+        std::vector<uint64_t> a = random_set(n), b = random_set(n / 2), small = random_set(1000);
+        b.insert(b.end(), a.begin(), a.begin() + static_cast<std::ptrdiff_t>(n / 2));
+        small.insert(small.end(), a.begin(), a.begin() + 100);
+        sort_unique_hashes(b);
+        sort_unique_hashes(small);
+        for (uint32_t bits : {64u, 32u}) {
+            auto start = std::chrono::high_resolution_clock::now();
+            CompressedFingerprint ca = compress_fingerprint(a, options, bits);
+            double encode_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+            CompressedFingerprint cb = compress_fingerprint(b, options, bits);
+            CompressedFingerprint cs = compress_fingerprint(small, options, bits);
+            std::vector<uint64_t> da = ca.decode(), db = cb.decode(), ds = cs.decode();
+            
+            double sorted_us = time_us([&] { return intersection_count_sorted(da.data(), da.size(), db.data(), db.size()); });
+            double compressed_us = time_us([&] { return intersection_count_compressed(ca, cb); });
+            double small_sorted_us = time_us([&] { return intersection_count_sorted(ds.data(), ds.size(), da.data(), da.size()); });
+            double small_compressed_us = time_us([&] { return intersection_count_compressed(cs, ca); });
+            
+            std::cout << std::left << std::setw(10) << n << std::setw(8) << bits << std::fixed << std::setprecision(1)
+                      << std::setw(14) << ca.payload_bytes() * 8.0 / ca.count << std::setprecision(2) << std::setw(14)
+                      << encode_ms << std::setprecision(1) << std::setw(16) << sorted_us << std::setw(18)
+                      << compressed_us << std::setw(16) << small_sorted_us << small_compressed_us << std::endl;
+        }
+    }
+}
+
+// 埋点开销：同一对文档的端到端比较，分别在埋点关闭、只统计计数、统计加跟踪三种模式下测量
+// 小文档每次比较的工作量少，最能体现按块和按调用埋点的固定开销
+void runInstrumentationReport() {
+    std::cout << "\n--- Instrumentation Overhead ---" << std::endl;
+#ifndef PD_INSTRUMENTATION
+    std::cout << "Skipped: built with -DPD_INSTRUMENTATION=OFF" << std::endl;
+#else
+    const uint32_t modes[] = {0, INSTRUMENT_STATS, INSTRUMENT_STATS | INSTRUMENT_TRACE};
+    const char* mode_names[] = {"off", "stats", "stats+trace"};
+    BenchmarkSuite suite(9);
+    BenchmarkSuite::print_header();
+    FingerprintOptions options;
+    for (size_t size : {10000u, 1000000u}) {
+        std::mt19937_64 gen(corpus_seed ^ size);
+        std::vector<unsigned char> data1 = generateTestData(size, gen);
+        std::vector<unsigned char> data2 = generateTestData(size, gen);
+        ByteSpan span1, span2;
+        span1.data = data1.data();
+        span1.size = data1.size();
+        span2.data = data2.data();
+        span2.size = data2.size();
+        FingerprintWorkspace workspace(options);
+        double off_ns = 0.0;
+        for (size_t m = 0; m < 3; ++m) {
+            reset_instrumentation();
+            set_instrumentation(modes[m]);
+            const BenchmarkResult& result =
+                suite.run("compare_pair/" + std::string(mode_names[m]) + "/" + std::to_string(size),
+                          data1.size() + data2.size(), 1, [&] {
+                              std::vector<uint64_t> fingerprint1 = workspace.fingerprint_bytes(span1);
+                              return static_cast<uint64_t>(
+                                  jaccard_similarity_sorted(fingerprint1, workspace.fingerprint_bytes(span2)) * 1e9);
+                          });
+            set_instrumentation(0);
+            if (m == 0) {
+                off_ns = result.median_ns;
+            } else {
+                std::cout << "  overhead vs off: " << std::fixed << std::setprecision(1)
+                          << (result.median_ns / off_ns - 1.0) * 100.0 << "%" << std::endl;
+            }
+        }
+    }
     
-    profiler.printReport();
+    // 一次1 MB文档对比较的统计行
+    reset_instrumentation();
+    set_instrumentation(INSTRUMENT_STATS);
+    std::mt19937_64 gen(corpus_seed);
+    std::vector<unsigned char> data1 = generateTestData(1000000, gen);
+    std::vector<unsigned char> data2 = generateTestData(1000000, gen);
+    FingerprintWorkspace workspace(options);
+    ByteSpan span1, span2;
+    span1.data = data1.data();
+    span1.size = data1.size();
+    span2.data = data2.data();
+    span2.size = data2.size();
+    std::vector<uint64_t> fingerprint1 = workspace.fingerprint_bytes(span1);
+    benchmark_sink = benchmark_sink + static_cast<uint64_t>(
+        jaccard_similarity_sorted(fingerprint1, workspace.fingerprint_bytes(span2)) * 1e9);
+    set_instrumentation(0);
+    std::cout << format_stats_line(collect_stats()) << std::endl;
+    reset_instrumentation();
+#endif
 }
 
-// 基准测试
-void runBenchmarkTests() {
-    std::cout << "\n=== Benchmark Tests ===" << std::endl;
+// 常驻评分服务在负载下的延迟：短文（约3 KB）与常驻内存的参考文档比较，服务与负载生成在同一进程的不同线程中
+// 对比不同的并发连接数、流水线深度与批处理窗口，以及FILE（服务端读文件）与TEXT（内联文本）两种请求
+void runServerLatencyReport() {
+    std::cout << "\n--- Scoring Server Latency ---" << std::endl;
+#ifdef _WIN32
+    std::cout << "Skipped: Unix domain sockets are not available" << std::endl;
+#else
+    const size_t num_essays = 32, total = 2000;
+    const std::string reference = "perf_server_ref.tmp", socket_path = "perf_server.sock";
+    std::vector<std::string> paths = {reference};
+    std::vector<unsigned char> reference_bytes = generateTestData(20000);
+    std::ofstream(reference, std::ios::binary)
+        .write(reinterpret_cast<const char*>(reference_bytes.data()), static_cast<std::streamsize>(reference_bytes.size()));
+    std::vector<LoadRequest> file_requests, text_requests;
+    for (size_t e = 0; e < num_essays; ++e) {
+        paths.push_back("perf_server_" + std::to_string(e) + ".tmp");
+        std::vector<unsigned char> bytes = generateTestData(2000 + e * 97);
+        std::ofstream(paths.back(), std::ios::binary)
+            .write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+        LoadRequest request;
+        request.reference = reference;
+        request.path = paths.back();
+        file_requests.push_back(request);
+        request.text.assign(bytes.begin(), bytes.end());
+        text_requests.push_back(request);
+    }
+    
+    struct Setup {
+        const char* request_kind;
+        size_t connections, depth, window_us;
+    };
+    const Setup setups[] = {
+        {"file", 1, 1, 0}, {"file", 1, 1, 1000}, {"file", 4, 8, 0}, {"file", 4, 8, 1000},
+        {"text", 1, 1, 0}, {"text", 4, 8, 1000}
+    };
+    std::cout << "Requests per run: " << total << ", threads: " << default_thread_count() << std::endl;
+    std::cout << std::left << std::setw(8) << "request" << std::setw(8) << "conns" << std::setw(8) << "depth"
+              << std::setw(12) << "window us" << std::setw(12) << "req/s" << std::setw(12) << "p50 us"
+              << std::setw(12) << "p99 us" << "batch" << std::endl;
+    for (const Setup& setup : setups) {
+        ScoringServerConfig config;
+        config.threads = default_thread_count();
+        config.batch_window_us = setup.window_us;
+        ScoringServer server({reference}, FingerprintOptions(), config);
+        server.listen(socket_path);
+        std::thread loop([&server]() { server.run(); });
+        LoadReport report;
+        try {
+            const std::vector<LoadRequest>& requests =
+                std::string(setup.request_kind) == "file" ? file_requests : text_requests;
+            report = run_load_test(socket_path, requests, total, setup.connections, setup.depth);
+        } catch (...) {
+            server.stop();
+            loop.join();
+            throw;
+        }
+        server.stop();
+        loop.join();
+        ScoringServerStats stats = server.stats();
+        std::cout << std::left << std::setw(8) << setup.request_kind << std::setw(8) << setup.connections
+                  << std::setw(8) << setup.depth << std::setw(12) << setup.window_us << std::fixed
+                  << std::setprecision(0) << std::setw(12) << report.requests / report.seconds
+                  << std::setw(12) << report.p50_us << std::setw(12) << report.p99_us << std::setprecision(1)
+                  << static_cast<double>(stats.requests) / std::max<uint64_t>(stats.batches, 1)
+                  << (report.errors == 0 ? "" : " (ERRORS)") << std::endl;
+    }
+    
+    for (const std::string& path : paths) std::remove(path.c_str());
+#endif
+}
+
+// k值对哈希耗时的影响
+void runKValueReport() {
+    std::cout << "\n--- K-gram Length vs Hash Cost ---" << std::endl;
     
-    // 测试不同k值的影响
     std::vector<unsigned char> test_data = generateTestData(100000);
     std::vector<uint32_t> codepoints = normalize_to_codepoints(test_data);
     
+    // 只计时哈希本身（结果累加防止被优化掉），FNV随k线性增长，滚动哈希应基本不变
     std::cout << "Testing different k values:" << std::endl;
-    for (int k = 1; k <= 5; ++k) {
+    std::cout << std::left << std::setw(6) << "k" << std::setw(12) << "k-grams"
+              << std::setw(14) << "FNV (μs)" << std::setw(14) << "Rolling (μs)" << std::endl;
+    for (size_t k : {1, 2, 3, 4, 5, 8, 16, 32}) {
+        uint64_t checksum = 0;
         auto start = std::chrono::high_resolution_clock::now();
-        std::unordered_set<uint64_t> kgram_set = build_kgram_set(codepoints, k);
+        for_each_kgram_hash(codepoints, k, HashMode::Fnv, [&checksum](uint64_t h) { checksum += h; });
         auto end = std::chrono::high_resolution_clock::now();
-        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+        auto fnv_us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
         
-        std::cout << "k=" << k << ": " << kgram_set.size() << " k-grams, " 
-                  << duration.count() << " μs" << std::endl;
-    }
-    
-    // 测试哈希函数性能
-    std::cout << "\nTesting hash function performance:" << std::endl;
-    auto start = std::chrono::high_resolution_clock::now();
-    for (int i = 0; i < 1000000; ++i) {
-        fnv1a64_hash_kgram(codepoints, i % (codepoints.size() - 2), 3);
+        start = std::chrono::high_resolution_clock::now();
+        for_each_kgram_hash(codepoints, k, HashMode::Rolling, [&checksum](uint64_t h) { checksum ^= h; });
+        end = std::chrono::high_resolution_clock::now();
+        auto rolling_us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+        
+        std::unordered_set<uint64_t> kgram_set = build_kgram_set(codepoints, k, HashMode::Rolling);
+        std::cout << std::left << std::setw(6) << k << std::setw(12) << kgram_set.size()
+                  << std::setw(14) << fnv_us << std::setw(14) << rolling_us << std::endl;
+        benchmark_sink = checksum;
     }
-    auto end = std::chrono::high_resolution_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
-    std::cout << "1,000,000 hash calculations: " << duration.count() << " ms" << std::endl;
 }
 
-int main() {
+void printUsage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [options]" << std::endl
+              << "  --suite-only              run only the benchmark suite, not the reports" << std::endl
+              << "  --json <file>             write the suite results as JSON" << std::endl
+              << "  --baseline <file>         compare medians with an earlier --json file and exit with" << std::endl
+              << "                            status 3 if any benchmark regressed beyond --max-regression" << std::endl
+              << "  --max-regression <pct>    allowed slowdown of a median, in percent (default 10)" << std::endl
+              << "  --repetitions <n>         samples per benchmark (default 15, at least 3)" << std::endl
+              << "  --seed <n>                seed for the generated corpora (default 42)" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    std::string json_path, baseline_path;
+    double max_regression = 10.0;
+    size_t repetitions = 15;
+    bool suite_only = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--suite-only") {
+            suite_only = true;
+        } else if (arg == "--json" && has_value) {
+            json_path = argv[++i];
+        } else if (arg == "--baseline" && has_value) {
+            baseline_path = argv[++i];
+        } else if (arg == "--max-regression" && has_value) {
+            max_regression = std::atof(argv[++i]);
+        } else if (arg == "--repetitions" && has_value) {
+            repetitions = static_cast<size_t>(std::strtoull(argv[++i], nullptr, 10));
+        } else if (arg == "--seed" && has_value) {
+            corpus_seed = std::strtoull(argv[++i], nullptr, 10);
+            corpus_gen.seed(corpus_seed);
+        } else {
+            printUsage(argv[0]);
+            return 2;
+        }
+    }
+    
     try {
-        runPerformanceTests();
-        runBenchmarkTests();
+        BenchmarkSuite suite(repetitions);
+        runBenchmarkSuite(suite);
+        if (!json_path.empty()) suite.write_json(json_path, corpus_seed);
+        size_t regressions = baseline_path.empty() ? 0 : suite.compare_with_baseline(baseline_path, max_regression);
+        if (regressions > 0) {
+            std::cerr << regressions << " benchmark(s) regressed by more than " << max_regression << "%" << std::endl;
+            return 3;
+        }
+        if (suite_only) return 0;
+        
+        runMemoryUsageReport();
+        runFlatHashSetReport();
+        runKValueReport();
+        runWinnowingDriftReport();
+        runLshRecallReport();
+        runTopKQueryReport();
+        runDocumentFrequencyReport();
+        runNormalizeKernelReport();
+        runNormalizationProfileReport();
+        runInputPathReport();
+        runBatchScalingReport();
+        runSinglePairScalingReport();
+        runIncrementalRescoreReport();
+        runAllocationReport();
+        runMetricsCostReport();
+        runSpanLocalizationReport();
+        runExactMatchReport();
+        runCompressedFingerprintReport();
+        runInstrumentationReport();
+        runServerLatencyReport();
         
         std::cout << "\n=== Performance Test Completed ===" << std::endl;
         return 0;
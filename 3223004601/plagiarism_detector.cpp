@@ -0,0 +1,4325 @@
+// Visual Studio 2017 兼容性宏
+#ifdef _MSC_VER
+    #pragma warning(push)
+    #pragma warning(disable: 4996) // 禁用不安全函数警告
+    #define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include "plagiarism_detector.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+// 内存映射文件与Unix域套接字所需的系统头文件
+#ifdef _WIN32
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+    #include <io.h>
+    #include <fcntl.h>
+    #include <direct.h>
+#else
+    #include <fcntl.h>
+    #include <poll.h>
+    #include <sys/mman.h>
+    #include <sys/socket.h>
+    #include <sys/stat.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+#endif
+
+#ifdef PD_X86_SIMD
+    #include <immintrin.h>
+    #ifdef _MSC_VER
+        #include <intrin.h>
+    #endif
+#endif
+
+namespace pd {
+
+// ==================== 埋点统计与跟踪 ====================
+
+const char* stage_name(Stage stage) {
+    switch (stage) {
+        case Stage::Read: return "read";
+        case Stage::Decode: return "decode";
+        case Stage::Hash: return "hash";
+        case Stage::Sort: return "sort";
+        case Stage::Intersect: return "intersect";
+    }
+    return "unknown";
+}
+
+void PipelineStats::add(const PipelineStats& other) {
+    for (size_t i = 0; i < STAGE_COUNT; ++i) stage_ns[i] += other.stage_ns[i];
+    bytes_in += other.bytes_in;
+    codepoints_decoded += other.codepoints_decoded;
+    codepoints_kept += other.codepoints_kept;
+    invalid_sequences += other.invalid_sequences;
+    kgrams += other.kgrams;
+    unique_kgrams += other.unique_kgrams;
+    compactions += other.compactions;
+    rehashes += other.rehashes;
+    comparisons += other.comparisons;
+}
+
+// 一个线程的计数与阶段区间，首次使用时登记，线程结束时并入全局汇总
+struct ThreadInstrumentation {
+    PipelineStats stats;
+    std::vector<TraceEvent> events;
+    uint64_t inner_ns = 0;  // 已结束阶段的耗时之和（只计最外层），用于从外层阶段中扣除
+    uint32_t tid = 0;
+
+    ThreadInstrumentation();
+    ~ThreadInstrumentation();
+};
+
+// 全局汇总；有意不析构，线程局部对象在进程退出时析构仍可访问
+struct InstrumentationRegistry {
+    std::mutex mutex;
+    std::vector<ThreadInstrumentation*> live;
+    PipelineStats retired;
+    std::vector<TraceEvent> retired_events;
+    uint32_t next_tid = 0;
+};
+
+static InstrumentationRegistry& instrumentation_registry() {
+    static InstrumentationRegistry* registry = new InstrumentationRegistry();
+    return *registry;
+}
+
+static std::atomic<uint32_t> active_instrumentation{0};
+
+ThreadInstrumentation::ThreadInstrumentation() {
+    InstrumentationRegistry& registry = instrumentation_registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    tid = registry.next_tid++;
+    registry.live.push_back(this);
+}
+
+ThreadInstrumentation::~ThreadInstrumentation() {
+    InstrumentationRegistry& registry = instrumentation_registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.retired.add(stats);
+    registry.retired_events.insert(registry.retired_events.end(), events.begin(), events.end());
+    registry.live.erase(std::find(registry.live.begin(), registry.live.end(), this));
+}
+
+static ThreadInstrumentation& thread_instrumentation() {
+    thread_local ThreadInstrumentation local;
+    return local;
+}
+
+void set_instrumentation(uint32_t mode) {
+#ifdef PD_INSTRUMENTATION
+    active_instrumentation.store(mode, std::memory_order_relaxed);
+#else
+    (void)mode;
+#endif
+}
+
+uint32_t instrumentation_mode() {
+    return active_instrumentation.load(std::memory_order_relaxed);
+}
+
+PipelineStats& thread_stats() {
+    return thread_instrumentation().stats;
+}
+
+PipelineStats collect_stats() {
+    thread_instrumentation();  // 确保当前线程已登记
+    InstrumentationRegistry& registry = instrumentation_registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    PipelineStats total = registry.retired;
+    for (const ThreadInstrumentation* local : registry.live) total.add(local->stats);
+    return total;
+}
+
+std::vector<TraceEvent> collect_trace_events() {
+    thread_instrumentation();
+    InstrumentationRegistry& registry = instrumentation_registry();
+    std::vector<TraceEvent> events;
+    {
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        events = registry.retired_events;
+        for (const ThreadInstrumentation* local : registry.live) {
+            events.insert(events.end(), local->events.begin(), local->events.end());
+        }
+    }
+    std::sort(events.begin(), events.end(), [](const TraceEvent& a, const TraceEvent& b) {
+        return a.start_ns != b.start_ns ? a.start_ns < b.start_ns : a.end_ns > b.end_ns;  // 外层在前
+    });
+    return events;
+}
+
+void reset_instrumentation() {
+    thread_instrumentation();
+    InstrumentationRegistry& registry = instrumentation_registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.retired = PipelineStats();
+    registry.retired_events.clear();
+    for (ThreadInstrumentation* local : registry.live) {
+        local->stats = PipelineStats();
+        local->events.clear();
+    }
+}
+
+std::string format_stats_line(const PipelineStats& stats) {
+    std::ostringstream line;
+    line << "stats";
+    char ms[32];
+    for (size_t i = 0; i < STAGE_COUNT; ++i) {
+        std::snprintf(ms, sizeof(ms), "%.3f", static_cast<double>(stats.stage_ns[i]) / 1e6);
+        line << ' ' << stage_name(static_cast<Stage>(i)) << "_ms=" << ms;
+    }
+    line << " bytes_in=" << stats.bytes_in
+         << " decoded=" << stats.codepoints_decoded
+         << " kept=" << stats.codepoints_kept
+         << " dropped=" << stats.codepoints_dropped()
+         << " invalid=" << stats.invalid_sequences
+         << " kgrams=" << stats.kgrams
+         << " unique=" << stats.unique_kgrams
+         << " compactions=" << stats.compactions
+         << " rehashes=" << stats.rehashes
+         << " comparisons=" << stats.comparisons;
+    return line.str();
+}
+
+std::string trace_events_json(const std::vector<TraceEvent>& events) {
+    uint64_t origin = UINT64_MAX;
+    for (const TraceEvent& event : events) origin = std::min(origin, event.start_ns);
+
+    std::ostringstream out;
+    out << "{\"traceEvents\":[";
+    char times[64];
+    for (size_t i = 0; i < events.size(); ++i) {
+        const TraceEvent& event = events[i];
+        std::snprintf(times, sizeof(times), "\"ts\":%.3f,\"dur\":%.3f",
+                      static_cast<double>(event.start_ns - origin) / 1e3,
+                      static_cast<double>(event.end_ns - event.start_ns) / 1e3);
+        out << (i == 0 ? "\n" : ",\n")
+            << "{\"name\":\"" << stage_name(event.stage) << "\",\"cat\":\"pd\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+            << event.tid << ',' << times << '}';
+    }
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    return out.str();
+}
+
+uint64_t instrumentation_now_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+uint64_t stage_begin() {
+    return thread_instrumentation().inner_ns;
+}
+
+void stage_end(Stage stage, uint64_t start_ns, uint64_t inner_before, uint32_t mode) {
+    uint64_t end_ns = instrumentation_now_ns();
+    ThreadInstrumentation& local = thread_instrumentation();
+    uint64_t elapsed = end_ns - start_ns;
+    uint64_t inner = local.inner_ns - inner_before;
+    if (mode & INSTRUMENT_STATS) {
+        local.stats.stage_ns[static_cast<size_t>(stage)] += elapsed > inner ? elapsed - inner : 0;
+    }
+    if (mode & INSTRUMENT_TRACE) {
+        TraceEvent event;
+        event.stage = stage;
+        event.tid = local.tid;
+        event.start_ns = start_ns;
+        event.end_ns = end_ns;
+        local.events.push_back(event);
+    }
+    local.inner_ns = inner_before + elapsed;  // 外层只需扣除本阶段，内层已包含在其中
+}
+
+bool is_cjk(uint32_t cp) {
+    // 检查Unicode码点是否在CJK字符范围内
+    if ((cp >= 0x4E00 && cp <= 0x9FFF) ||      // CJK统一表意文字
+        (cp >= 0x3400 && cp <= 0x4DBF) ||      // CJK扩展A
+        (cp >= 0xF900 && cp <= 0xFAFF) ||      // CJK兼容表意文字
+        (cp >= 0x20000 && cp <= 0x2A6DF) ||    // CJK扩展B
+        (cp >= 0x2A700 && cp <= 0x2B73F) ||    // CJK扩展C
+        (cp >= 0x2B740 && cp <= 0x2B81F) ||    // CJK扩展D
+        (cp >= 0x2B820 && cp <= 0x2CEAF) ||    // CJK扩展E
+        (cp >= 0x2CEB0 && cp <= 0x2EBEF)) return true;  // CJK扩展F
+    return false;
+}
+
+bool is_keep_ascii(char c) {
+    if (c >= 'A' && c <= 'Z') return true;  // 大写字母
+    if (c >= 'a' && c <= 'z') return true;  // 小写字母
+    if (c >= '0' && c <= '9') return true;  // 数字
+    return false;  // 其他字符（标点、空格等）不保留
+}
+
+char to_lower_ascii(char c) {
+    if (c >= 'A' && c <= 'Z') return c - 'A' + 'a';
+    return c;  // 非大写字母直接返回
+}
+
+// ==================== 归一化配置与码点分类表 ====================
+
+const char* normalization_profile_name(NormalizationProfile profile) {
+    switch (profile) {
+        case NormalizationProfile::CjkOnly: return "cjk-only";
+        case NormalizationProfile::UnicodeLetters: return "unicode-letters";
+        case NormalizationProfile::FullWidthFolding: return "full-width-folding";
+        default: return "default";
+    }
+}
+
+NormalizationProfile parse_normalization_profile(const std::string& name) {
+    if (name == "default") return NormalizationProfile::Default;
+    if (name == "cjk-only") return NormalizationProfile::CjkOnly;
+    if (name == "unicode-letters") return NormalizationProfile::UnicodeLetters;
+    if (name == "full-width-folding") return NormalizationProfile::FullWidthFolding;
+    throw std::runtime_error("Unknown normalization profile: " + name);
+}
+
+// 大小写成对排列的区段：upper_even为true时偶数码点是大写、其后一个是对应的小写，否则奇数码点是大写
+static uint32_t fold_case_pair(uint32_t cp, bool upper_even) {
+    return ((cp & 1) == 0) == upper_even ? cp + 1 : cp;
+}
+
+// 半角谚文字母 U+FFA1..U+FFDC 分为5段，每段连续对应一段兼容字母（U+3131起）
+static const uint32_t HALFWIDTH_HANGUL[5][3] = {
+    {0xFFA1, 0xFFBE, 0x3131}, {0xFFC2, 0xFFC7, 0x314F}, {0xFFCA, 0xFFCF, 0x3155},
+    {0xFFD2, 0xFFD7, 0x315B}, {0xFFDA, 0xFFDC, 0x3161}};
+
+// 半角片假名 U+FF66..U+FF9F 对应的全角片假名，浊点与半浊点对应U+309B、U+309C
+static const uint16_t HALFWIDTH_KATAKANA[58] = {
+    0x30F2, 0x30A1, 0x30A3, 0x30A5, 0x30A7, 0x30A9, 0x30E3, 0x30E5, 0x30E7, 0x30C3,  // ｦｧｨｩｪｫｬｭｮｯ
+    0x30FC, 0x30A2, 0x30A4, 0x30A6, 0x30A8, 0x30AA, 0x30AB, 0x30AD, 0x30AF, 0x30B1,  // ｰｱｲｳｴｵｶｷｸｹ
+    0x30B3, 0x30B5, 0x30B7, 0x30B9, 0x30BB, 0x30BD, 0x30BF, 0x30C1, 0x30C4, 0x30C6,  // ｺｻｼｽｾｿﾀﾁﾂﾃ
+    0x30C8, 0x30CA, 0x30CB, 0x30CC, 0x30CD, 0x30CE, 0x30CF, 0x30D2, 0x30D5, 0x30D8,  // ﾄﾅﾆﾇﾈﾉﾊﾋﾌﾍ
+    0x30DB, 0x30DE, 0x30DF, 0x30E0, 0x30E1, 0x30E2, 0x30E4, 0x30E6, 0x30E8, 0x30E9,  // ﾎﾏﾐﾑﾒﾓﾔﾕﾖﾗ
+    0x30EA, 0x30EB, 0x30EC, 0x30ED, 0x30EF, 0x30F3, 0x309B, 0x309C};                 // ﾘﾙﾚﾛﾜﾝﾞﾟ
+
+// 其他文字的十进制数字折叠为ASCII数字
+static uint32_t fold_digit(uint32_t cp, uint32_t zero) {
+    return cp - zero + '0';
+}
+
+// UnicodeLetters：各文字的字母与数字，大小写折叠为小写；组合附加符号（分解形式的重音）被丢弃，
+// 希腊文扩展与拉丁扩展B只保留、不折叠
+static uint32_t normalize_unicode_letter(uint32_t cp) {
+    if (cp < 0x80) return normalize_codepoint(cp);
+    if (cp < 0x100) {  // 拉丁字母补充1：乘号、除号之外的字母
+        if (cp < 0xC0 || cp == 0xD7 || cp == 0xF7) return 0;
+        return cp <= 0xDE ? cp + 0x20 : cp;
+    }
+    if (cp < 0x180) {  // 拉丁扩展A：大小写成对，中间两处奇偶交替
+        if (cp == 0x130) return 'i';   // İ
+        if (cp == 0x178) return 0xFF;  // Ÿ
+        if (cp == 0x131 || cp == 0x138 || cp == 0x149 || cp == 0x17F) return cp;
+        if (cp < 0x138 || (cp > 0x149 && cp < 0x178)) return fold_case_pair(cp, true);
+        return fold_case_pair(cp, false);
+    }
+    if (cp < 0x2B0) return cp;  // 拉丁扩展B、国际音标
+    if (cp < 0x370) return 0;   // 修饰字母、组合附加符号
+    if (cp < 0x400) {           // 希腊字母，词尾sigma折叠为σ
+        if (cp == 0x386) return 0x3AC;
+        if (cp >= 0x388 && cp <= 0x38A) return cp + 37;
+        if (cp == 0x38C) return 0x3CC;
+        if (cp == 0x38E || cp == 0x38F) return cp + 63;
+        if (cp >= 0x391 && cp <= 0x3AB && cp != 0x3A2) return cp + 32;
+        if (cp == 0x3C2) return 0x3C3;
+        if (cp == 0x390 || (cp >= 0x3AC && cp <= 0x3CE)) return cp;
+        return 0;
+    }
+    if (cp < 0x530) {  // 西里尔字母及其补充
+        if (cp < 0x410) return cp + 80;
+        if (cp < 0x430) return cp + 32;
+        if (cp < 0x460) return cp;
+        if (cp >= 0x482 && cp <= 0x489) return 0;  // 符号与组合记号
+        if (cp == 0x4C0) return 0x4CF;
+        if (cp == 0x4CF) return cp;
+        if (cp >= 0x4C1 && cp <= 0x4CE) return fold_case_pair(cp, false);
+        return fold_case_pair(cp, true);
+    }
+    if (cp < 0x590) {  // 亚美尼亚字母
+        if (cp >= 0x531 && cp <= 0x556) return cp + 48;
+        return cp >= 0x560 && cp <= 0x588 ? cp : 0;
+    }
+    if (cp < 0x600) {  // 希伯来字母，不含元音点
+        return (cp >= 0x5D0 && cp <= 0x5EA) || (cp >= 0x5EF && cp <= 0x5F2) ? cp : 0;
+    }
+    if (cp < 0x700) {  // 阿拉伯字母，不含元音符号
+        if (cp >= 0x660 && cp <= 0x669) return fold_digit(cp, 0x660);
+        if (cp >= 0x6F0 && cp <= 0x6F9) return fold_digit(cp, 0x6F0);
+        if ((cp >= 0x620 && cp <= 0x64A) || cp == 0x66E || cp == 0x66F || (cp >= 0x671 && cp <= 0x6D3) ||
+            cp == 0x6D5 || cp == 0x6EE || cp == 0x6EF || (cp >= 0x6FA && cp <= 0x6FC) || cp == 0x6FF) {
+            return cp;
+        }
+        return 0;
+    }
+    if (cp >= 0x900 && cp < 0x980) {  // 天城文：元音符号是字的一部分，予以保留；丢弃句读
+        if (cp >= 0x966 && cp <= 0x96F) return fold_digit(cp, 0x966);
+        return cp == 0x964 || cp == 0x965 || cp == 0x970 ? 0 : cp;
+    }
+    if (cp >= 0xE00 && cp < 0xE80) {  // 泰文
+        if (cp >= 0xE50 && cp <= 0xE59) return fold_digit(cp, 0xE50);
+        return (cp >= 0xE01 && cp <= 0xE3A) || (cp >= 0xE40 && cp <= 0xE4E) ? cp : 0;
+    }
+    if (cp >= 0x1100 && cp < 0x1200) return cp;  // 谚文字母
+    if (cp >= 0x1E00 && cp < 0x1F00) {           // 拉丁扩展附加
+        if (cp == 0x1E9E) return 0xDF;           // ẞ
+        if (cp >= 0x1E96 && cp <= 0x1E9F) return cp;
+        return fold_case_pair(cp, true);
+    }
+    if (cp >= 0x1F00 && cp < 0x2000) {  // 希腊文扩展，丢弃单独的重音符号
+        if (cp == 0x1FBD || (cp >= 0x1FBF && cp <= 0x1FC1) || (cp >= 0x1FCD && cp <= 0x1FCF) ||
+            (cp >= 0x1FDD && cp <= 0x1FDF) || (cp >= 0x1FED && cp <= 0x1FEF) || cp >= 0x1FFD) {
+            return 0;
+        }
+        return cp;
+    }
+    if (cp == 0x3005 || cp == 0x3007) return cp;  // 々 〇
+    if ((cp >= 0x3041 && cp <= 0x3096) || (cp >= 0x3099 && cp <= 0x309F) ||  // 平假名
+        (cp >= 0x30A1 && cp <= 0x30FA) || (cp >= 0x30FC && cp <= 0x30FF) ||  // 片假名
+        (cp >= 0x31F0 && cp <= 0x31FF) || (cp >= 0x3131 && cp <= 0x318E) ||  // 片假名扩展、谚文兼容字母
+        (cp >= 0xAC00 && cp <= 0xD7A3)) {                                    // 谚文音节
+        return cp;
+    }
+    if (is_cjk(cp) || (cp >= 0x30000 && cp <= 0x323AF)) return cp;  // 含CJK扩展G、H
+    if (cp >= 0xFF00 && cp < 0xFFF0) {  // 全角与半角形式：保留原样，只做大小写折叠
+        if (cp >= 0xFF21 && cp <= 0xFF3A) return cp + 32;
+        if ((cp >= 0xFF10 && cp <= 0xFF19) || (cp >= 0xFF41 && cp <= 0xFF5A) || (cp >= 0xFF66 && cp <= 0xFF9F)) {
+            return cp;
+        }
+        for (const uint32_t* range : HALFWIDTH_HANGUL) {
+            if (cp >= range[0] && cp <= range[1]) return cp;
+        }
+    }
+    return 0;
+}
+
+// FullWidthFolding：全角ASCII折叠为半角，半角片假名与谚文折叠为全角，其余同UnicodeLetters
+static uint32_t normalize_full_width(uint32_t cp) {
+    if (cp >= 0xFF10 && cp <= 0xFF19) return fold_digit(cp, 0xFF10);
+    if (cp >= 0xFF21 && cp <= 0xFF3A) return cp - 0xFF21 + 'a';
+    if (cp >= 0xFF41 && cp <= 0xFF5A) return cp - 0xFF41 + 'a';
+    if (cp >= 0xFF66 && cp <= 0xFF9F) return HALFWIDTH_KATAKANA[cp - 0xFF66];
+    for (const uint32_t* range : HALFWIDTH_HANGUL) {
+        if (cp >= range[0] && cp <= range[1]) return cp - range[0] + range[2];
+    }
+    return normalize_unicode_letter(cp);
+}
+
+uint32_t normalize_codepoint(uint32_t cp, NormalizationProfile profile) {
+    switch (profile) {
+        case NormalizationProfile::CjkOnly: return is_cjk(cp) ? cp : 0;
+        case NormalizationProfile::UnicodeLetters: return normalize_unicode_letter(cp);
+        case NormalizationProfile::FullWidthFolding: return normalize_full_width(cp);
+        default: return normalize_codepoint(cp);
+    }
+}
+
+CodepointClassifier::CodepointClassifier(NormalizationProfile profile) : index(1 << 13) {
+    // 块内容 -> 块号；0x40000以上全部丢弃，不必逐个调用参考实现
+    std::map<std::vector<uint32_t>, uint16_t> block_ids;
+    std::vector<uint32_t> block(256);
+    for (uint32_t hi = 0; hi < index.size(); ++hi) {
+        for (uint32_t lo = 0; lo < 256; ++lo) {
+            uint32_t cp = (hi << 8) | lo;
+            uint32_t folded = cp < 0x40000 ? normalize_codepoint(cp, profile) : 0;
+            block[lo] = folded == 0 ? 0 : ((folded - cp) << 1) | 1;
+        }
+        auto inserted = block_ids.insert(std::make_pair(block, static_cast<uint16_t>(block_ids.size())));
+        if (inserted.second) blocks.insert(blocks.end(), block.begin(), block.end());
+        index[hi] = inserted.first->second;
+    }
+}
+
+const CodepointClassifier& codepoint_classifier(NormalizationProfile profile) {
+    // 局部静态变量的初始化是线程安全的
+    switch (profile) {
+        case NormalizationProfile::CjkOnly: {
+            static const CodepointClassifier classifier(NormalizationProfile::CjkOnly);
+            return classifier;
+        }
+        case NormalizationProfile::UnicodeLetters: {
+            static const CodepointClassifier classifier(NormalizationProfile::UnicodeLetters);
+            return classifier;
+        }
+        case NormalizationProfile::FullWidthFolding: {
+            static const CodepointClassifier classifier(NormalizationProfile::FullWidthFolding);
+            return classifier;
+        }
+        default: {
+            static const CodepointClassifier classifier(NormalizationProfile::Default);
+            return classifier;
+        }
+    }
+}
+
+bool cpu_has_avx2() {
+#if defined(PD_X86_SIMD) && defined(_MSC_VER)
+    static const bool supported = [] {
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7) return false;
+        __cpuid(info, 1);
+        bool os_avx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0;  // OSXSAVE + AVX
+        if (!os_avx || (_xgetbv(0) & 0x6) != 0x6) return false;                  // 操作系统保存YMM寄存器
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;                                         // AVX2
+    }();
+    return supported;
+#elif defined(PD_X86_SIMD)
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+#else
+    return false;
+#endif
+}
+
+// 32位整数末尾0的个数（x不能为0）
+inline unsigned trailing_zeros32(uint32_t x) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, x);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctz(x));
+#endif
+}
+
+// 64位整数末尾0的个数（x不能为0）
+inline unsigned trailing_zeros64(uint64_t x) {
+#ifdef _MSC_VER
+    uint32_t lo = static_cast<uint32_t>(x);
+    return lo != 0 ? trailing_zeros32(lo) : 32 + trailing_zeros32(static_cast<uint32_t>(x >> 32));
+#else
+    return static_cast<unsigned>(__builtin_ctzll(x));
+#endif
+}
+
+// 64位整数中1的个数
+inline unsigned popcount64(uint64_t x) {
+#ifdef _MSC_VER
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return static_cast<unsigned>((x * 0x0101010101010101ULL) >> 56);
+#else
+    return static_cast<unsigned>(__builtin_popcountll(x));
+#endif
+}
+
+// 提前把p所在的缓存行取入缓存，不支持的编译器上为空操作
+inline void prefetch(const void* p) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(p);
+#elif defined(PD_X86_SIMD)
+    _mm_prefetch(static_cast<const char*>(p), _MM_HINT_T0);
+#else
+    (void)p;
+#endif
+}
+
+uint32_t utf8_next(const unsigned char* data, size_t size, size_t& i) {
+    if (i >= size) return 0;  // 超出范围
+    unsigned char b0 = data[i];
+    
+    // 单字节字符（ASCII）
+    if (b0 < 0x80) {
+        i++;
+        return b0;
+    }
+    
+    // 确定多字节序列长度
+    int seqlen = 0;
+    uint32_t cp = 0;
+    if ((b0 & 0xE0) == 0xC0) { seqlen = 2; cp = b0 & 0x1F; }      // 2字节序列
+    else if ((b0 & 0xF0) == 0xE0) { seqlen = 3; cp = b0 & 0x0F; }  // 3字节序列
+    else if ((b0 & 0xF8) == 0xF0) { seqlen = 4; cp = b0 & 0x07; }  // 4字节序列
+    else { i++; return 0; }  // 无效的首字节
+    
+    // 检查是否有足够的字节
+    if (i + seqlen > size) { i = size; return 0; }
+    
+    // 读取后续字节
+    for (int k = 1; k < seqlen; ++k) {
+        unsigned char bx = data[i + k];
+        if ((bx & 0xC0) != 0x80) { i++; return 0; }  // 无效的后续字节
+        cp = (cp << 6) | (uint32_t)(bx & 0x3F);  // 组合码点
+    }
+    
+    // 检查过短编码（overlong encoding）
+    if (seqlen == 2 && cp < 0x80) { i++; return 0; }
+    if (seqlen == 3 && cp < 0x800) { i++; return 0; }
+    if (seqlen == 4 && cp < 0x10000) { i++; return 0; }
+    
+    // UTF-16代理对在UTF-8中无效
+    if (cp >= 0xD800 && cp <= 0xDFFF) { i++; return 0; }
+    
+    i += seqlen;
+    return cp;
+}
+
+uint32_t utf8_next(const std::vector<unsigned char>& bytes, size_t& i) {
+    return utf8_next(bytes.data(), bytes.size(), i);
+}
+
+std::vector<unsigned char> read_file_to_bytes(const std::string& path) {
+    StageTimer timer(Stage::Read);
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open file: " + path);
+    }
+    
+    // 获取文件大小
+    file.seekg(0, std::ios::end);
+    auto size = static_cast<size_t>(file.tellg());
+    if (size == 0) {
+        return {}; // 空文件
+    }
+    file.seekg(0, std::ios::beg);
+    
+    // 读取文件内容
+    std::vector<unsigned char> bytes(size);
+    file.read(reinterpret_cast<char*>(bytes.data()), static_cast<std::streamsize>(size));
+    
+    if (file.fail() && !file.eof()) {
+        throw std::runtime_error("Failed to read file: " + path);
+    }
+    PD_COUNT(bytes_in, size);
+    
+    return bytes;
+}
+
+void set_stdin_binary() {
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+#endif
+}
+
+std::vector<unsigned char> read_stream_to_bytes(std::istream& in) {
+    std::vector<unsigned char> bytes;
+    char buffer[1 << 16];
+    while (in.read(buffer, sizeof(buffer)) || in.gcount() > 0) {
+        bytes.insert(bytes.end(), buffer, buffer + in.gcount());
+    }
+    if (in.bad()) {
+        throw std::runtime_error("Failed to read input stream");
+    }
+    return bytes;
+}
+
+InputSource::InputSource(const std::string& path) {
+    StageTimer timer(Stage::Read);
+    if (path == "-") {
+        set_stdin_binary();
+        buffer = read_stream_to_bytes(std::cin);
+        span.data = buffer.data();
+        span.size = buffer.size();
+    } else {
+        open_file(path);
+    }
+    PD_COUNT(bytes_in, span.size);
+}
+
+InputSource::~InputSource() {
+    if (mapped == nullptr) return;
+#ifdef _WIN32
+    UnmapViewOfFile(mapped);
+#else
+    munmap(mapped, mapped_size);
+#endif
+}
+
+#ifdef _WIN32
+void InputSource::open_file(const std::string& path) {
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("Failed to open file: " + path);
+    }
+
+    LARGE_INTEGER size;
+    bool is_disk_file = GetFileType(file) == FILE_TYPE_DISK && GetFileSizeEx(file, &size);
+    if (is_disk_file && size.QuadPart == 0) {  // 空文件
+        CloseHandle(file);
+        return;
+    }
+    if (is_disk_file) {
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping != nullptr) {
+            mapped = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping);
+        }
+    }
+    CloseHandle(file);
+
+    if (mapped != nullptr) {
+        mapped_size = static_cast<size_t>(size.QuadPart);
+        span.data = static_cast<const unsigned char*>(mapped);
+        span.size = mapped_size;
+        return;
+    }
+
+    // 无法映射（如命名管道）：缓冲读取
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) {
+        throw std::runtime_error("Failed to open file: " + path);
+    }
+    buffer = read_stream_to_bytes(in);
+    span.data = buffer.data();
+    span.size = buffer.size();
+}
+#else
+void InputSource::open_file(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open file: " + path);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        size_t size = static_cast<size_t>(st.st_size);
+        if (size == 0) {  // 空文件
+            ::close(fd);
+            return;
+        }
+
+        // 预先建立全部页表项，并提示内核按顺序预读
+        int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+        flags |= MAP_POPULATE;
+#endif
+        void* addr = mmap(nullptr, size, PROT_READ, flags, fd, 0);
+        if (addr != MAP_FAILED) {
+            madvise(addr, size, MADV_SEQUENTIAL);
+            ::close(fd);
+            mapped = addr;
+            mapped_size = size;
+            span.data = static_cast<const unsigned char*>(addr);
+            span.size = size;
+            return;
+        }
+    }
+
+    // 管道、FIFO等无法映射的输入：从同一个描述符缓冲读取
+    unsigned char chunk[1 << 16];
+    for (;;) {
+        ssize_t n = ::read(fd, chunk, sizeof(chunk));
+        if (n == 0) break;
+        if (n < 0) {
+            ::close(fd);
+            throw std::runtime_error("Failed to read file: " + path);
+        }
+        buffer.insert(buffer.end(), chunk, chunk + n);
+    }
+    ::close(fd);
+    span.data = buffer.data();
+    span.size = buffer.size();
+}
+#endif
+
+// 标量解码，每个码点查一次分类表
+// 解码计数，由各解码内核在返回前一次性计入线程统计
+struct DecodeTally {
+    size_t decoded = 0;
+    size_t invalid = 0;
+};
+
+static size_t normalize_utf8_table(const unsigned char* data, size_t size, size_t& i, size_t stop, uint32_t* out,
+                                   const CodepointClassifier& classifier, DecodeTally& tally) {
+    size_t n = 0;
+    while (i < stop) {
+        uint32_t cp = utf8_next(data, size, i);
+        if (cp == 0) {  // 跳过无效字符；U+0000本身是合法字符，同样不保留
+            if (data[i - 1] == 0) tally.decoded++;
+            else tally.invalid++;
+            continue;
+        }
+        tally.decoded++;
+
+        cp = classifier.normalize(cp);
+        out[n] = cp;
+        n += (cp != 0);
+    }
+    return n;
+}
+
+size_t normalize_utf8_scalar(const unsigned char* data, size_t size, size_t& i, size_t stop, uint32_t* out,
+                             NormalizationProfile profile) {
+    DecodeTally tally;
+    size_t n = normalize_utf8_table(data, size, i, stop, out, codepoint_classifier(profile), tally);
+    PD_COUNT(codepoints_decoded, tally.decoded);
+    PD_COUNT(invalid_sequences, tally.invalid);
+    PD_COUNT(codepoints_kept, n);
+    return n;
+}
+
+#ifdef PD_X86_SIMD
+// 每个32位通道是否落在 [lo, hi] 内
+PD_TARGET_AVX2
+inline __m256i in_range_epi32(__m256i values, int lo, int hi) {
+    return _mm256_and_si256(_mm256_cmpgt_epi32(values, _mm256_set1_epi32(lo - 1)),
+                            _mm256_cmpgt_epi32(_mm256_set1_epi32(hi + 1), values));
+}
+
+PD_TARGET_AVX2
+size_t normalize_utf8_avx2(const unsigned char* data, size_t size, size_t& i, size_t stop, uint32_t* out,
+                           NormalizationProfile profile) {
+    const CodepointClassifier& classifier = codepoint_classifier(profile);
+    const bool keep_ascii = classifier.normalize('a') != 0;  // 各配置对ASCII要么保留字母数字，要么全部丢弃
+    const __m256i case_bit = _mm256_set1_epi8(0x20);
+    const __m256i before_a = _mm256_set1_epi8('a' - 1), after_z = _mm256_set1_epi8('z' + 1);
+    const __m256i before_0 = _mm256_set1_epi8('0' - 1), after_9 = _mm256_set1_epi8('9' + 1);
+    // 每个32位通道放入一个3字节序列：(b0 << 16) | (b1 << 8) | b2
+    const __m256i gather3 = _mm256_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1,
+                                             2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+    const __m256i seq_mask = _mm256_set1_epi32(0x00F0C0C0), seq_bits = _mm256_set1_epi32(0x00E08080);
+
+    alignas(32) unsigned char lowered[32];
+    alignas(32) uint32_t lanes[8];
+    DecodeTally tally;
+    size_t n = 0;
+    while (i < stop && i + 32 <= size) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        uint32_t non_ascii = static_cast<uint32_t>(_mm256_movemask_epi8(v));
+
+        if ((non_ascii & 1) == 0) {
+            size_t run = non_ascii == 0 ? 32 : trailing_zeros32(non_ascii);
+            run = std::min(run, stop - i);
+            tally.decoded += run;
+            if (!keep_ascii) {
+                i += run;
+                continue;
+            }
+            __m256i lower = _mm256_or_si256(v, case_bit);
+            __m256i alpha = _mm256_and_si256(_mm256_cmpgt_epi8(lower, before_a), _mm256_cmpgt_epi8(after_z, lower));
+            __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(v, before_0), _mm256_cmpgt_epi8(after_9, v));
+            uint32_t keep = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(alpha, digit)));
+            _mm256_store_si256(reinterpret_cast<__m256i*>(lowered), _mm256_blendv_epi8(v, lower, alpha));
+            for (size_t j = 0; j < run; ++j) {
+                out[n] = lowered[j];
+                n += (keep >> j) & 1;
+            }
+            i += run;
+            continue;
+        }
+
+        __m256i raw = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i))),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 12)), 1);
+        __m256i packed = _mm256_shuffle_epi8(raw, gather3);
+        __m256i cp = _mm256_or_si256(
+            _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(packed, 4), _mm256_set1_epi32(0xF000)),
+                            _mm256_and_si256(_mm256_srli_epi32(packed, 2), _mm256_set1_epi32(0x0FC0))),
+            _mm256_and_si256(packed, _mm256_set1_epi32(0x3F)));
+        __m256i valid = _mm256_cmpeq_epi32(_mm256_and_si256(packed, seq_mask), seq_bits);
+        valid = _mm256_and_si256(valid, _mm256_cmpgt_epi32(cp, _mm256_set1_epi32(0x7FF)));   // 过长编码
+        valid = _mm256_andnot_si256(in_range_epi32(cp, 0xD800, 0xDFFF), valid);                    // 代理码点
+        uint32_t valid_mask = static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(valid)));
+        size_t count = valid_mask == 0xFF ? 8 : trailing_zeros32(~valid_mask);
+        count = std::min(count, (stop - i + 2) / 3);  // 只解码起始位置在stop之前的序列
+
+        if (count == 0) {
+            n += normalize_utf8_table(data, size, i, i + 1, out + n, classifier, tally);
+            continue;
+        }
+        tally.decoded += count;
+
+        if (profile != NormalizationProfile::Default) {
+            _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), cp);
+            for (size_t j = 0; j < count; ++j) {
+                out[n] = classifier.normalize(lanes[j]);
+                n += (out[n] != 0);
+            }
+            i += 3 * count;
+            continue;
+        }
+        __m256i cjk = _mm256_or_si256(_mm256_or_si256(in_range_epi32(cp, 0x4E00, 0x9FFF), in_range_epi32(cp, 0x3400, 0x4DBF)),
+                                      in_range_epi32(cp, 0xF900, 0xFAFF));
+        uint32_t cjk_mask = static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(cjk)));
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), cp);
+        for (size_t j = 0; j < count; ++j) {
+            out[n] = lanes[j];
+            n += (cjk_mask >> j) & 1;
+        }
+        i += 3 * count;
+    }
+    n += normalize_utf8_table(data, size, i, stop, out + n, classifier, tally);
+    PD_COUNT(codepoints_decoded, tally.decoded);
+    PD_COUNT(invalid_sequences, tally.invalid);
+    PD_COUNT(codepoints_kept, n);
+    return n;
+}
+#endif
+
+size_t normalize_utf8(const unsigned char* data, size_t size, size_t& i, size_t stop, uint32_t* out,
+                      NormalizationProfile profile) {
+    StageTimer timer(Stage::Decode);
+#ifdef PD_X86_SIMD
+    if (cpu_has_avx2()) return normalize_utf8_avx2(data, size, i, stop, out, profile);
+#endif
+    return normalize_utf8_scalar(data, size, i, stop, out, profile);
+}
+
+std::vector<uint32_t> normalize_to_codepoints(ByteSpan bytes, NormalizationProfile profile) {
+    std::vector<uint32_t> codepoints(bytes.size);  // 码点数不会超过字节数
+    size_t i = 0;
+    codepoints.resize(normalize_utf8(bytes.data, bytes.size, i, bytes.size, codepoints.data(), profile));
+    if (codepoints.size() < codepoints.capacity() / 2) {
+        codepoints.shrink_to_fit();  // 中文每字3字节，多数容量用不上
+    }
+    return codepoints;
+}
+
+std::vector<uint32_t> normalize_to_codepoints(const std::vector<unsigned char>& bytes, NormalizationProfile profile) {
+    ByteSpan span;
+    span.data = bytes.data();
+    span.size = bytes.size();
+    return normalize_to_codepoints(span, profile);
+}
+
+bool Utf8StreamDecoder::is_truncated(const unsigned char* data, size_t size, size_t i) {
+    unsigned char b0 = data[i];
+    size_t seqlen = 0;
+    if ((b0 & 0xE0) == 0xC0) seqlen = 2;
+    else if ((b0 & 0xF0) == 0xE0) seqlen = 3;
+    else if ((b0 & 0xF8) == 0xF0) seqlen = 4;
+    return seqlen != 0 && i + seqlen > size;
+}
+
+void Utf8StreamDecoder::feed(const unsigned char* data, size_t size, std::vector<uint32_t>& out) {
+    size_t start = 0;
+    if (carry_size > 0) {
+        // 暂存字节与新块开头最多4字节拼接，足以补齐任何跨块序列
+        size_t take = std::min<size_t>(size, 4);
+        std::memcpy(carry + carry_size, data, take);
+        size_t joined = carry_size + take;
+        size_t i = 0;
+        while (i < carry_size) {
+            if (is_truncated(carry, joined, i)) {  // 新块太短，仍不完整
+                std::memmove(carry, carry + i, joined - i);
+                carry_size = joined - i;
+                return;
+            }
+            uint32_t cp = utf8_next(carry, joined, i);
+            PD_COUNT(codepoints_decoded, cp != 0);
+            PD_COUNT(invalid_sequences, cp == 0);
+            cp = classifier->normalize(cp);
+            PD_COUNT(codepoints_kept, cp != 0);
+            if (cp != 0) out.push_back(cp);
+        }
+        start = i - carry_size;
+        carry_size = 0;
+    }
+
+    // 只有块尾3字节内的序列可能被截断，从第一个被截断的位置起暂存
+    // 该位置是起始字节，之前的序列不会跨过它，因此解码恰好停在这里
+    size_t split = size;
+    for (size_t p = std::max(start, size >= 3 ? size - 3 : 0); p < size; ++p) {
+        if (is_truncated(data, size, p)) {
+            split = p;
+            break;
+        }
+    }
+    size_t base = out.size();
+    out.resize(base + (split - start));
+    size_t i = start;
+    out.resize(base + normalize_utf8(data, size, i, split, out.data() + base, profile));
+    carry_size = size - split;
+    std::memcpy(carry, data + split, carry_size);
+}
+
+uint64_t fnv1a64_hash_codepoints(const uint32_t* codepoints, size_t k) {
+    const uint64_t FNV_OFFSET = 1469598103934665603ULL;  // FNV-1a偏移量
+    const uint64_t FNV_PRIME = 1099511628211ULL;          // FNV-1a质数
+    uint64_t h = FNV_OFFSET;
+    
+    for (size_t i = 0; i < k; ++i) {
+        uint32_t cp = codepoints[i];
+        // 将码点的4个字节分别混合到哈希中
+        for (int b = 0; b < 4; ++b) {
+            unsigned char x = static_cast<unsigned char>((cp >> (b * 8)) & 0xFFu);
+            h ^= static_cast<uint64_t>(x);  // 异或操作
+            h *= FNV_PRIME;    // 乘法操作
+        }
+    }
+    return h;
+}
+
+uint64_t fnv1a64_hash_kgram(const std::vector<uint32_t>& codepoints, size_t start, size_t k) {
+    return fnv1a64_hash_codepoints(codepoints.data() + start, k);
+}
+
+uint64_t rolling_hash_kgram(const std::vector<uint32_t>& codepoints, size_t start, size_t k) {
+    RollingHash rh(k);
+    for (size_t i = 0; i < k; ++i) {
+        rh.append(codepoints[start + i]);
+    }
+    return rh.value();
+}
+
+std::unordered_set<uint64_t> build_kgram_set(const std::vector<uint32_t>& codepoints, size_t k,
+                                             HashMode mode) {
+    std::unordered_set<uint64_t> hash_set;
+    if (k == 0 || codepoints.size() < k) return hash_set;
+
+    StageTimer timer(Stage::Hash);
+    hash_set.reserve(codepoints.size() - k + 1);  // 预分配内存以提高性能，此后插入不再重排
+    size_t buckets = hash_set.bucket_count();
+
+    // 计算每个k-gram的哈希值并插入到集合中（自动去重）
+    for_each_kgram_hash(codepoints, k, mode, [&hash_set](uint64_t hash) { hash_set.insert(hash); });
+    PD_COUNT(rehashes, hash_set.bucket_count() != buckets);  // 预分配后仍发生的重排
+    PD_COUNT(kgrams, codepoints.size() - k + 1);
+    PD_COUNT(unique_kgrams, hash_set.size());
+    
+    return hash_set;
+}
+
+size_t winnow_guarantee(size_t k, size_t window) {
+    return window == 0 ? k : window + k - 1;
+}
+
+double jaccard_similarity(const std::unordered_set<uint64_t>& set1, const std::unordered_set<uint64_t>& set2) {
+    StageTimer timer(Stage::Intersect);
+    PD_COUNT(comparisons, 1);
+    if (set1.empty() && set2.empty()) return 0.0;  // 两个空集合
+    
+    // 计算交集大小：遍历较小的集合
+    const std::unordered_set<uint64_t>& smaller = set1.size() <= set2.size() ? set1 : set2;
+    const std::unordered_set<uint64_t>& larger = set1.size() <= set2.size() ? set2 : set1;
+    size_t intersection = 0;
+    for (const auto& hash : smaller) {
+        if (larger.find(hash) != larger.end()) {
+            intersection++;
+        }
+    }
+    
+    // 计算并集大小
+    size_t union_size = set1.size() + set2.size() - intersection;
+    if (union_size == 0) return 0.0;  // 避免除零
+    
+    return static_cast<double>(intersection) / static_cast<double>(union_size);  // Jaccard相似度
+}
+
+// ==================== 开放寻址指纹集合 ====================
+
+const uint8_t FlatHashSet::EMPTY;
+const size_t FlatHashSet::GROUP_SIZE;
+
+// 一组16个控制字节中等于byte的位置，第i位对应组内第i个槽位
+static inline uint32_t group_match(const uint8_t* group, uint8_t byte) {
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    __m128i ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+    return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(static_cast<char>(byte)))));
+#else
+    uint32_t mask = 0;
+    for (size_t i = 0; i < FlatHashSet::GROUP_SIZE; ++i) {
+        mask |= static_cast<uint32_t>(group[i] == byte) << i;
+    }
+    return mask;
+#endif
+}
+
+void FlatHashSet::reserve(size_t expected) {
+    size_t groups = 2;
+    while (groups * GROUP_SIZE * 7 / 8 < expected) groups *= 2;
+    if (groups * GROUP_SIZE > slots.size()) rehash(groups);
+}
+
+void FlatHashSet::rehash(size_t groups) {
+    PD_COUNT(rehashes, !slots.empty());
+    std::vector<uint8_t> old_ctrl;
+    std::vector<uint64_t> old_slots;
+    old_ctrl.swap(ctrl);
+    old_slots.swap(slots);
+    ctrl.assign(groups * GROUP_SIZE, EMPTY);
+    slots.assign(groups * GROUP_SIZE, 0);
+    group_mask = groups - 1;
+    shift = 64;
+    for (size_t g = groups; g > 1; g /= 2) shift--;
+    count = 0;
+    for (size_t i = 0; i < old_slots.size(); ++i) {
+        if (old_ctrl[i] != EMPTY) insert(old_slots[i]);
+    }
+}
+
+bool FlatHashSet::insert(uint64_t hash) {
+    if ((count + 1) * 8 > slots.size() * 7) rehash(slots.empty() ? 2 : (group_mask + 1) * 2);
+
+    uint8_t tag = tag_of(hash);
+    // 三角数探测：依次访问 g, g+1, g+3, g+6 ...组，组数为2的幂时遍历全部组
+    for (size_t g = group_of(hash), step = 1;; g = (g + step++) & group_mask) {
+        const uint8_t* group = &ctrl[g * GROUP_SIZE];
+        for (uint32_t match = group_match(group, tag); match != 0; match &= match - 1) {
+            if (slots[g * GROUP_SIZE + trailing_zeros32(match)] == hash) return false;
+        }
+        uint32_t empty = group_match(group, EMPTY);
+        if (empty != 0) {  // 组内有空位说明元素不在更后面的组中（没有删除，空位不会被跳过）
+            size_t slot = g * GROUP_SIZE + trailing_zeros32(empty);
+            ctrl[slot] = tag;
+            slots[slot] = hash;
+            count++;
+            return true;
+        }
+    }
+}
+
+bool FlatHashSet::contains(uint64_t hash) const {
+    if (count == 0) return false;
+    uint8_t tag = tag_of(hash);
+    for (size_t g = group_of(hash), step = 1;; g = (g + step++) & group_mask) {
+        const uint8_t* group = &ctrl[g * GROUP_SIZE];
+        for (uint32_t match = group_match(group, tag); match != 0; match &= match - 1) {
+            if (slots[g * GROUP_SIZE + trailing_zeros32(match)] == hash) return true;
+        }
+        if (group_match(group, EMPTY) != 0) return false;
+    }
+}
+
+FlatHashSet build_kgram_flat_set(const std::vector<uint32_t>& codepoints, size_t k, HashMode mode) {
+    FlatHashSet hash_set;
+    if (k == 0 || codepoints.size() < k) return hash_set;
+
+    StageTimer timer(Stage::Hash);
+    hash_set.reserve(codepoints.size() - k + 1);
+    for_each_kgram_hash(codepoints, k, mode, [&hash_set](uint64_t hash) { hash_set.insert(hash); });
+    PD_COUNT(kgrams, codepoints.size() - k + 1);
+    PD_COUNT(unique_kgrams, hash_set.size());
+    return hash_set;
+}
+
+double jaccard_similarity(const FlatHashSet& set1, const FlatHashSet& set2) {
+    StageTimer timer(Stage::Intersect);
+    PD_COUNT(comparisons, 1);
+    if (set1.empty() && set2.empty()) return 0.0;  // 两个空集合
+
+    // 计算交集大小：遍历较小集合的槽位，在较大集合中查找
+    const FlatHashSet& smaller = set1.size() <= set2.size() ? set1 : set2;
+    const FlatHashSet& larger = set1.size() <= set2.size() ? set2 : set1;
+    size_t intersection = 0;
+    smaller.for_each([&larger, &intersection](uint64_t hash) { intersection += larger.contains(hash); });
+
+    size_t union_size = set1.size() + set2.size() - intersection;
+    if (union_size == 0) return 0.0;  // 避免除零
+
+    return static_cast<double>(intersection) / static_cast<double>(union_size);
+}
+
+// ==================== 有序向量集合 ====================
+
+void radix_sort_u64(std::vector<uint64_t>& values, std::vector<uint64_t>& scratch) {
+    size_t n = values.size();
+    if (n < 256) {  // 小数组直接比较排序
+        std::sort(values.begin(), values.end());
+        return;
+    }
+
+    size_t histogram[8 * 256] = {};  // 16KB，放在栈上，排序本身不分配堆内存（scratch已足够大时）
+    for (uint64_t v : values) {
+        for (int b = 0; b < 8; ++b) {
+            histogram[b * 256 + ((v >> (b * 8)) & 0xFF)]++;
+        }
+    }
+
+    scratch.resize(n);
+    uint64_t* src = values.data();
+    uint64_t* dst = scratch.data();
+    for (int b = 0; b < 8; ++b) {
+        size_t* count = histogram + b * 256;
+        if (count[(src[0] >> (b * 8)) & 0xFF] == n) continue;  // 该字节全部相同
+
+        // 前缀和得到每个桶的起始位置
+        size_t offset = 0;
+        for (int d = 0; d < 256; ++d) {
+            size_t c = count[d];
+            count[d] = offset;
+            offset += c;
+        }
+        for (size_t i = 0; i < n; ++i) {
+            uint64_t v = src[i];
+            dst[count[(v >> (b * 8)) & 0xFF]++] = v;
+        }
+        std::swap(src, dst);
+    }
+    if (src != values.data()) values.swap(scratch);
+}
+
+void radix_sort_u64(std::vector<uint64_t>& values) {
+    std::vector<uint64_t> scratch;
+    radix_sort_u64(values, scratch);
+}
+
+void sort_unique_hashes(std::vector<uint64_t>& hashes, std::vector<uint64_t>& scratch) {
+    StageTimer timer(Stage::Sort);
+    radix_sort_u64(hashes, scratch);
+    hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+}
+
+void sort_unique_hashes(std::vector<uint64_t>& hashes) {
+    std::vector<uint64_t> scratch;
+    sort_unique_hashes(hashes, scratch);
+    if (hashes.size() < hashes.capacity() / 2) hashes.shrink_to_fit();
+}
+
+std::vector<uint64_t> build_kgram_vector(const std::vector<uint32_t>& codepoints, size_t k,
+                                         HashMode mode) {
+    std::vector<uint64_t> hashes;
+    if (k > 0 && codepoints.size() >= k) hashes.reserve(codepoints.size() - k + 1);
+    {
+        StageTimer timer(Stage::Hash);
+        for_each_kgram_hash(codepoints, k, mode, [&hashes](uint64_t hash) { hashes.push_back(hash); });
+    }
+    PD_COUNT(kgrams, hashes.size());
+    sort_unique_hashes(hashes);
+    PD_COUNT(unique_kgrams, hashes.size());
+    return hashes;
+}
+
+size_t intersection_count_scalar(const uint64_t* a, size_t na, const uint64_t* b, size_t nb) {
+    size_t i = 0, j = 0, count = 0;
+    while (i < na && j < nb) {
+        uint64_t x = a[i], y = b[j];
+        count += (x == y);
+        i += (x <= y);
+        j += (y <= x);
+    }
+    return count;
+}
+
+#ifdef PD_X86_SIMD
+PD_TARGET_AVX2
+size_t intersection_count_avx2(const uint64_t* a, size_t na, const uint64_t* b, size_t nb) {
+    static const unsigned char bits[16] = {0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4};
+    size_t i = 0, j = 0, count = 0;
+    while (i + 4 <= na && j + 4 <= nb) {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + j));
+        __m256i eq = _mm256_cmpeq_epi64(va, vb);
+        eq = _mm256_or_si256(eq, _mm256_cmpeq_epi64(va, _mm256_permute4x64_epi64(vb, 0x39)));
+        eq = _mm256_or_si256(eq, _mm256_cmpeq_epi64(va, _mm256_permute4x64_epi64(vb, 0x4E)));
+        eq = _mm256_or_si256(eq, _mm256_cmpeq_epi64(va, _mm256_permute4x64_epi64(vb, 0x93)));
+        count += bits[_mm256_movemask_pd(_mm256_castsi256_pd(eq))];
+
+        uint64_t amax = a[i + 3], bmax = b[j + 3];
+        i += (amax <= bmax) ? 4 : 0;
+        j += (bmax <= amax) ? 4 : 0;
+    }
+    return count + intersection_count_scalar(a + i, na - i, b + j, nb - j);
+}
+#endif
+
+size_t intersection_count_sorted(const uint64_t* a, size_t na, const uint64_t* b, size_t nb) {
+    StageTimer timer(Stage::Intersect);
+    PD_COUNT(comparisons, 1);
+#ifdef PD_X86_SIMD
+    if (cpu_has_avx2()) return intersection_count_avx2(a, na, b, nb);
+#endif
+    return intersection_count_scalar(a, na, b, nb);
+}
+
+double jaccard_similarity_sorted(const uint64_t* a, size_t na, const uint64_t* b, size_t nb) {
+    if (na == 0 && nb == 0) return 0.0;  // 两个空集合
+
+    size_t intersection = intersection_count_sorted(a, na, b, nb);
+    size_t union_size = na + nb - intersection;
+    if (union_size == 0) return 0.0;  // 避免除零
+
+    return static_cast<double>(intersection) / static_cast<double>(union_size);
+}
+
+double jaccard_similarity_sorted(const std::vector<uint64_t>& set1, const std::vector<uint64_t>& set2) {
+    return jaccard_similarity_sorted(set1.data(), set1.size(), set2.data(), set2.size());
+}
+
+// 由交集大小、集合大小和次数之和得到各项相似度
+static SimilarityMetrics metrics_from_counts(size_t intersection, size_t na, size_t nb,
+                                             uint64_t min_sum, uint64_t total_a, uint64_t total_b) {
+    SimilarityMetrics metrics;
+    size_t union_size = na + nb - intersection;
+    uint64_t max_sum = total_a + total_b - min_sum;
+    if (union_size > 0) metrics.jaccard = static_cast<double>(intersection) / static_cast<double>(union_size);
+    if (na > 0) metrics.containment_a = static_cast<double>(intersection) / static_cast<double>(na);
+    if (nb > 0) metrics.containment_b = static_cast<double>(intersection) / static_cast<double>(nb);
+    if (max_sum > 0) metrics.weighted_jaccard = static_cast<double>(min_sum) / static_cast<double>(max_sum);
+    return metrics;
+}
+
+SimilarityMetrics similarity_metrics(const uint64_t* a, const uint32_t* ca, size_t na,
+                                     const uint64_t* b, const uint32_t* cb, size_t nb) {
+    size_t intersection = 0;
+    uint64_t min_sum = 0;  // 交集中每个元素较小的次数之和
+    if (ca && cb) {
+        StageTimer timer(Stage::Intersect);
+        PD_COUNT(comparisons, 1);
+        size_t i = 0, j = 0;
+        while (i < na && j < nb) {
+            uint64_t x = a[i], y = b[j];
+            uint64_t equal = (x == y);
+            intersection += equal;
+            min_sum += equal * std::min(ca[i], cb[j]);
+            i += (x <= y);
+            j += (y <= x);
+        }
+    } else {
+        intersection = intersection_count_sorted(a, na, b, nb);
+        min_sum = intersection;
+    }
+
+    // 次数总和：Σmax = Σca + Σcb - Σmin
+    uint64_t total_a = na, total_b = nb;
+    if (ca && cb) {
+        total_a = 0;
+        total_b = 0;
+        for (size_t i = 0; i < na; ++i) total_a += ca[i];
+        for (size_t j = 0; j < nb; ++j) total_b += cb[j];
+    }
+    return metrics_from_counts(intersection, na, nb, min_sum, total_a, total_b);
+}
+
+std::vector<uint64_t> build_fingerprint_vector(const std::vector<uint32_t>& codepoints,
+                                               const FingerprintOptions& options) {
+    if (options.winnow_window == 0) {
+        return build_kgram_vector(codepoints, options.k, options.hash_mode);
+    }
+
+    std::vector<uint64_t> hashes;
+    Winnower winnower(options.winnow_window);
+    auto select = [&hashes](uint64_t hash) { hashes.push_back(hash); };
+    {
+        StageTimer timer(Stage::Hash);
+        for_each_kgram_hash(codepoints, options.k, options.hash_mode,
+                            [&winnower, &select](uint64_t hash) { winnower.push(hash, select); });
+        winnower.finish(select);
+    }
+    if (options.k > 0 && codepoints.size() >= options.k) PD_COUNT(kgrams, codepoints.size() - options.k + 1);
+    sort_unique_hashes(hashes);
+    PD_COUNT(unique_kgrams, hashes.size());
+    return hashes;
+}
+
+void StreamingFingerprinter::add_hash(uint64_t hash) {
+    hashes.push_back(hash);
+    if (hashes.size() >= compact_at) {
+        compact();
+        compact_at = std::max(compact_at, hashes.size() * 2);
+    }
+}
+
+void StreamingFingerprinter::compact() {
+    PD_COUNT(compactions, 1);
+    if (!with_counts) {
+        sort_unique_hashes(hashes, scratch);
+        return;
+    }
+    StageTimer timer(Stage::Sort);
+
+    if (counted == 0) {  // 还没有已计数的前缀（短文本的常见情况）：原地排序后按游程计数
+        radix_sort_u64(hashes, scratch);
+        counts.clear();
+        size_t n = 0;
+        for (size_t i = 0, j = 0; i < hashes.size(); i = j) {
+            for (j = i + 1; j < hashes.size() && hashes[j] == hashes[i]; ++j) {
+            }
+            hashes[n++] = hashes[i];
+            counts.push_back(static_cast<uint32_t>(j - i));
+        }
+        hashes.resize(n);
+        counted = n;
+        return;
+    }
+
+    tail.assign(hashes.begin() + static_cast<std::ptrdiff_t>(counted), hashes.end());
+    radix_sort_u64(tail, scratch);
+    merged.clear();
+    merged_counts.clear();
+    size_t i = 0, j = 0;
+    while (i < counted || j < tail.size()) {
+        uint64_t hash;
+        uint32_t count = 0;
+        if (j == tail.size() || (i < counted && hashes[i] <= tail[j])) {
+            hash = hashes[i];
+            count = counts[i++];
+        } else {
+            hash = tail[j];
+        }
+        for (; j < tail.size() && tail[j] == hash; ++j) count++;  // 新哈希中相同的一段
+        merged.push_back(hash);
+        merged_counts.push_back(count);
+    }
+    hashes.swap(merged);
+    counts.swap(merged_counts);
+    counted = hashes.size();
+}
+
+void StreamingFingerprinter::reset() {
+    decoder.finish();
+    hasher.reset();
+    winnower.reset();
+    hashes.clear();
+    counts.clear();
+    counted = 0;
+    compact_at = STREAM_CHUNK_SIZE;
+    fed = 0;
+}
+
+void StreamingFingerprinter::feed(const unsigned char* data, size_t size) {
+    auto on_hash = [this](uint64_t hash) {
+        if (options.winnow_window == 0) {
+            add_hash(hash);
+        } else {
+            winnower.push(hash, [this](uint64_t selected) { add_hash(selected); });
+        }
+    };
+    codepoints.clear();
+    decoder.feed(data, size, codepoints);
+    fed += codepoints.size();
+    StageTimer timer(Stage::Hash);
+    for (uint32_t cp : codepoints) {
+        hasher.push(cp, on_hash);
+    }
+}
+
+const std::vector<uint64_t>& StreamingFingerprinter::finish_in_place(bool document_end) {
+    if (document_end) {
+        decoder.finish();
+    } else {
+        decoder.discard();
+    }
+    if (options.winnow_window != 0 && document_end) {
+        winnower.finish([this](uint64_t selected) { hashes.push_back(selected); });
+    }
+    compact();
+    if (options.k > 0 && fed >= options.k) PD_COUNT(kgrams, fed - options.k + 1);
+    PD_COUNT(unique_kgrams, hashes.size());
+    return hashes;
+}
+
+std::vector<uint64_t> StreamingFingerprinter::finish() {
+    finish_in_place();
+    if (hashes.size() < hashes.capacity() / 2) hashes.shrink_to_fit();
+    return std::move(hashes);
+}
+
+std::vector<uint64_t> fingerprint_stream(std::istream& in, const FingerprintOptions& options) {
+    StreamingFingerprinter fingerprinter(options);
+    std::vector<char> chunk(STREAM_CHUNK_SIZE);
+    while (in.read(chunk.data(), static_cast<std::streamsize>(chunk.size())) || in.gcount() > 0) {
+        fingerprinter.feed(reinterpret_cast<const unsigned char*>(chunk.data()), static_cast<size_t>(in.gcount()));
+    }
+    if (in.bad()) {
+        throw std::runtime_error("Failed to read input stream");
+    }
+    return fingerprinter.finish();
+}
+
+std::vector<uint64_t> fingerprint_bytes(ByteSpan bytes, const FingerprintOptions& options) {
+    StreamingFingerprinter fingerprinter(options);
+    for (size_t offset = 0; offset < bytes.size; offset += STREAM_CHUNK_SIZE) {
+        fingerprinter.feed(bytes.data + offset, std::min(STREAM_CHUNK_SIZE, bytes.size - offset));
+    }
+    return fingerprinter.finish();
+}
+
+std::vector<uint64_t> fingerprint_file(const std::string& path, const FingerprintOptions& options) {
+    if (path == "-") {
+        set_stdin_binary();
+        return fingerprint_stream(std::cin, options);
+    }
+
+    InputSource input(path);
+    return fingerprint_bytes(input.bytes(), options);
+}
+
+const std::vector<uint64_t>& FingerprintWorkspace::fingerprint_bytes(ByteSpan bytes) {
+    fingerprinter.reset();
+    for (size_t offset = 0; offset < bytes.size; offset += STREAM_CHUNK_SIZE) {
+        fingerprinter.feed(bytes.data + offset, std::min(STREAM_CHUNK_SIZE, bytes.size - offset));
+    }
+    return fingerprinter.finish_in_place();
+}
+
+const std::vector<uint64_t>& FingerprintWorkspace::fingerprint_stream(std::istream& in) {
+    fingerprinter.reset();
+    chunk.resize(STREAM_CHUNK_SIZE);
+    while (in.read(chunk.data(), static_cast<std::streamsize>(chunk.size())) || in.gcount() > 0) {
+        fingerprinter.feed(reinterpret_cast<const unsigned char*>(chunk.data()), static_cast<size_t>(in.gcount()));
+    }
+    if (in.bad()) {
+        throw std::runtime_error("Failed to read input stream");
+    }
+    return fingerprinter.finish_in_place();
+}
+
+const std::vector<uint64_t>& FingerprintWorkspace::fingerprint_file(const std::string& path) {
+    if (path == "-") {
+        set_stdin_binary();
+        return fingerprint_stream(std::cin);
+    }
+
+    InputSource input(path);
+    return fingerprint_bytes(input.bytes());
+}
+
+CountedFingerprint fingerprint_file_counted(const std::string& path, const FingerprintOptions& options) {
+    FingerprintWorkspace workspace(options, true);
+    CountedFingerprint result;
+    result.hashes = workspace.fingerprint_file(path);
+    result.counts = workspace.counts();
+    return result;
+}
+
+SimilarityMetrics similarity_metrics(const CountedFingerprint& a, const CountedFingerprint& b) {
+    return similarity_metrics(a.hashes.data(), a.counts.data(), a.hashes.size(),
+                              b.hashes.data(), b.counts.data(), b.hashes.size());
+}
+
+// ==================== 增量评分（修订稿） ====================
+
+IncrementalScorer::IncrementalScorer(const FingerprintOptions& options, ByteSpan document)
+    : options(options), size(document.size) {
+    if (options.winnow_window != 0) {
+        throw std::runtime_error("Incremental scoring does not support winnowing");
+    }
+    if (options.k == 0) {
+        throw std::runtime_error("k must be positive");
+    }
+    blocks = make_blocks(std::vector<unsigned char>(document.data, document.data + document.size), ByteSpan());
+    size_t end = 0;
+    for (const Block& block : blocks) {
+        end += block.bytes.size();
+        block_ends.push_back(end);
+    }
+
+    std::vector<uint32_t> codepoints;
+    for (const Block& block : blocks) {
+        codepoints.insert(codepoints.end(), block.codepoints.begin(), block.codepoints.end());
+    }
+    kgrams.reserve(codepoints.size());
+    adjust_range(codepoints, 0, codepoints.size(), 1);
+}
+
+std::vector<IncrementalScorer::Block> IncrementalScorer::make_blocks(const std::vector<unsigned char>& bytes,
+                                                                     ByteSpan lookahead) const {
+    // 到文档末尾时，最后3个字节内不能切块（末尾被截断的序列会吞掉其后的字节）；也不留下不到半块的尾块
+    size_t n = bytes.size();
+    size_t cut_limit = lookahead.size != 0 ? n : (n >= UTF8_TAIL_GUARD ? n - UTF8_TAIL_GUARD + 1 : 0);
+    cut_limit = std::min(cut_limit, n > INCREMENTAL_BLOCK_SIZE / 2 ? n - INCREMENTAL_BLOCK_SIZE / 2 + 1 : 0);
+    std::vector<unsigned char> padded(bytes);
+    padded.insert(padded.end(), lookahead.data, lookahead.data + lookahead.size);
+    ByteSpan all;
+    all.data = padded.data();
+    all.size = n;
+
+    std::vector<Block> result;
+    for (size_t start = 0; start < n;) {
+        size_t end = n;
+        if (start + INCREMENTAL_BLOCK_SIZE < n) {
+            end = utf8_sync_point(all, start + INCREMENTAL_BLOCK_SIZE);
+            if (end >= cut_limit) end = n;
+        }
+
+        // 多解码块尾之后的最多3个字节再截掉：块尾被截断的序列按真实的后续字节处理，与全文解码一致
+        ByteSpan span;
+        span.data = padded.data() + start;
+        span.size = std::min(end + UTF8_TAIL_GUARD - 1, padded.size()) - start;
+        LocatedText located = normalize_with_offsets(span, options.normalization);
+        size_t kept = static_cast<size_t>(std::lower_bound(located.starts.begin(), located.starts.end(),
+                                                           static_cast<uint32_t>(end - start)) - located.starts.begin());
+        located.codepoints.resize(kept);
+
+        Block block;
+        block.bytes.assign(bytes.begin() + static_cast<std::ptrdiff_t>(start), bytes.begin() + static_cast<std::ptrdiff_t>(end));
+        block.codepoints.swap(located.codepoints);
+        result.push_back(std::move(block));
+        start = end;
+    }
+    return result;
+}
+
+size_t IncrementalScorer::block_at(size_t pos, size_t& block_start) const {
+    size_t b = static_cast<size_t>(std::upper_bound(block_ends.begin(), block_ends.end(), pos) - block_ends.begin());
+    block_start = b == 0 ? 0 : block_ends[b - 1];
+    return b;
+}
+
+void IncrementalScorer::adjust(uint64_t hash, int delta) {
+    uint32_t& count = kgrams[hash];
+    uint32_t before = count;
+    uint32_t after = before + static_cast<uint32_t>(delta);
+    if (after == 0) {
+        kgrams.erase(hash);
+    } else {
+        count = after;
+    }
+    total += static_cast<uint64_t>(static_cast<int64_t>(delta));
+
+    for (Original& original : originals) {
+        auto it = original.counts.find(hash);
+        if (it == original.counts.end()) continue;
+        uint32_t theirs = it->second;
+        original.shared += (before == 0);
+        original.shared -= (after == 0);
+        original.min_sum = original.min_sum + std::min(after, theirs) - std::min(before, theirs);
+    }
+}
+
+void IncrementalScorer::adjust_range(const std::vector<uint32_t>& seq, size_t begin, size_t end, int delta) {
+    StageTimer timer(Stage::Hash);
+    KGramHasher hasher(options.k, options.hash_mode);
+    size_t last = std::min(seq.size(), end + options.k - 1);  // 起点在end之前的k-gram最多用到这里
+    for (size_t i = begin; i < last; ++i) {
+        hasher.push(seq[i], [this, delta](uint64_t hash) { adjust(hash, delta); });
+    }
+}
+
+size_t IncrementalScorer::add_original(const CountedFingerprint& fingerprint) {
+    Original original;
+    original.counts.reserve(fingerprint.hashes.size());
+    for (size_t i = 0; i < fingerprint.hashes.size(); ++i) {
+        original.counts.emplace(fingerprint.hashes[i], fingerprint.counts[i]);
+        original.total += fingerprint.counts[i];
+        auto it = kgrams.find(fingerprint.hashes[i]);
+        if (it != kgrams.end()) {
+            original.shared++;
+            original.min_sum += std::min(fingerprint.counts[i], it->second);
+        }
+    }
+    originals.push_back(std::move(original));
+    return originals.size() - 1;
+}
+
+void IncrementalScorer::replace(size_t offset, size_t erase, ByteSpan replacement) {
+    if (offset > size || erase > size - offset) {
+        throw std::runtime_error("Edit range outside the document");
+    }
+
+    // 重新解码的块 [first, last)：起点在修改处之前（块边界都是同步点，其前的解码不受影响），
+    // 且离修改前后两个版本的末尾都至少UTF8_TAIL_GUARD个字节；修改处离末尾太近时一直到最后一块
+    size_t new_size = size - erase + replacement.size;
+    size_t smaller = std::min(size, new_size);
+    size_t anchor = std::min(offset, smaller >= UTF8_TAIL_GUARD ? smaller - UTF8_TAIL_GUARD + 1 : 0);
+    size_t region_start = 0, unused = 0;
+    size_t first = anchor == 0 ? 0 : block_at(anchor - 1, region_start);
+    size_t last = size - (offset + erase) < UTF8_TAIL_GUARD ? blocks.size()
+                                                             : block_at(std::max<size_t>(offset + erase, 1) - 1, unused) + 1;
+    last = std::max(last, std::min(first + 1, blocks.size()));
+
+    std::vector<unsigned char> bytes;
+    std::vector<uint32_t> old_seq, new_seq;  // 前文k-1个码点 + 这些块的码点 + 后文k-1个码点
+    for (size_t b = first; b < last; ++b) {
+        bytes.insert(bytes.end(), blocks[b].bytes.begin(), blocks[b].bytes.end());
+    }
+    size_t at = offset - region_start;
+    bytes.erase(bytes.begin() + static_cast<std::ptrdiff_t>(at), bytes.begin() + static_cast<std::ptrdiff_t>(at + erase));
+    bytes.insert(bytes.begin() + static_cast<std::ptrdiff_t>(at), replacement.data, replacement.data + replacement.size);
+    // 修改后太短的一段并入后一块，避免块越切越碎
+    while (bytes.size() < INCREMENTAL_BLOCK_SIZE / 2 && last < blocks.size()) {
+        bytes.insert(bytes.end(), blocks[last].bytes.begin(), blocks[last].bytes.end());
+        last++;
+    }
+
+    unsigned char ahead[UTF8_TAIL_GUARD];
+    ByteSpan lookahead;
+    lookahead.data = ahead;
+    for (size_t b = last; b < blocks.size() && lookahead.size < UTF8_TAIL_GUARD - 1; ++b) {
+        for (size_t i = 0; i < blocks[b].bytes.size() && lookahead.size < UTF8_TAIL_GUARD - 1; ++i) {
+            ahead[lookahead.size++] = blocks[b].bytes[i];
+        }
+    }
+    std::vector<Block> rebuilt = make_blocks(bytes, lookahead);
+
+    // 前后文：修改区之前、之后各最多k-1个码点，跨修改区边界的k-gram因此都在序列中
+    std::vector<uint32_t> before, after;
+    for (size_t b = first; b > 0 && before.size() + 1 < options.k; --b) {
+        const std::vector<uint32_t>& cps = blocks[b - 1].codepoints;
+        for (size_t i = cps.size(); i > 0 && before.size() + 1 < options.k; --i) before.push_back(cps[i - 1]);
+    }
+    std::reverse(before.begin(), before.end());
+    for (size_t b = last; b < blocks.size() && after.size() + 1 < options.k; ++b) {
+        const std::vector<uint32_t>& cps = blocks[b].codepoints;
+        for (size_t i = 0; i < cps.size() && after.size() + 1 < options.k; ++i) after.push_back(cps[i]);
+    }
+    old_seq = before;
+    new_seq = before;
+    for (size_t b = first; b < last; ++b) {
+        old_seq.insert(old_seq.end(), blocks[b].codepoints.begin(), blocks[b].codepoints.end());
+    }
+    for (const Block& block : rebuilt) {
+        new_seq.insert(new_seq.end(), block.codepoints.begin(), block.codepoints.end());
+    }
+    old_seq.insert(old_seq.end(), after.begin(), after.end());
+    new_seq.insert(new_seq.end(), after.begin(), after.end());
+
+    // 只增删新旧序列中不同的一段所涉及的k-gram：完全落在公共前缀或公共后缀中的k-gram不变
+    size_t common = std::min(old_seq.size(), new_seq.size());
+    size_t prefix = static_cast<size_t>(
+        std::mismatch(old_seq.begin(), old_seq.begin() + static_cast<std::ptrdiff_t>(common), new_seq.begin()).first -
+        old_seq.begin());
+    size_t suffix = static_cast<size_t>(
+        std::mismatch(old_seq.rbegin(), old_seq.rbegin() + static_cast<std::ptrdiff_t>(common - prefix), new_seq.rbegin())
+            .first - old_seq.rbegin());
+    size_t from = prefix >= options.k - 1 ? prefix - (options.k - 1) : 0;
+    adjust_range(old_seq, from, old_seq.size() - suffix, -1);
+    adjust_range(new_seq, from, new_seq.size() - suffix, 1);
+
+    std::vector<size_t> rebuilt_ends;
+    size_t end = region_start;
+    for (const Block& block : rebuilt) {
+        end += block.bytes.size();
+        rebuilt_ends.push_back(end);
+    }
+    blocks.erase(blocks.begin() + static_cast<std::ptrdiff_t>(first), blocks.begin() + static_cast<std::ptrdiff_t>(last));
+    blocks.insert(blocks.begin() + static_cast<std::ptrdiff_t>(first), std::make_move_iterator(rebuilt.begin()),
+                  std::make_move_iterator(rebuilt.end()));
+    block_ends.erase(block_ends.begin() + static_cast<std::ptrdiff_t>(first),
+                     block_ends.begin() + static_cast<std::ptrdiff_t>(last));
+    block_ends.insert(block_ends.begin() + static_cast<std::ptrdiff_t>(first), rebuilt_ends.begin(), rebuilt_ends.end());
+    for (size_t b = first + rebuilt_ends.size(); b < block_ends.size(); ++b) {
+        block_ends[b] = block_ends[b] - size + new_size;  // 其后各块整体平移
+    }
+    size = new_size;
+}
+
+size_t IncrementalScorer::update(ByteSpan revision) {
+    // 逐块比较公共前缀和公共后缀
+    size_t common = std::min(size, revision.size);
+    size_t prefix = 0;
+    for (size_t b = 0; b < blocks.size() && prefix < common; ++b) {
+        const std::vector<unsigned char>& bytes = blocks[b].bytes;
+        size_t n = std::min(bytes.size(), common - prefix);
+        size_t same = static_cast<size_t>(
+            std::mismatch(bytes.begin(), bytes.begin() + static_cast<std::ptrdiff_t>(n), revision.data + prefix).first -
+            bytes.begin());
+        prefix += same;
+        if (same < bytes.size()) break;
+    }
+    size_t suffix = 0;
+    for (size_t b = blocks.size(); b > 0 && suffix < common - prefix; --b) {
+        const std::vector<unsigned char>& bytes = blocks[b - 1].bytes;
+        size_t n = std::min(bytes.size(), common - prefix - suffix);
+        size_t same = static_cast<size_t>(
+            std::mismatch(bytes.rbegin(), bytes.rbegin() + static_cast<std::ptrdiff_t>(n),
+                          std::reverse_iterator<const unsigned char*>(revision.data + revision.size - suffix))
+                .first - bytes.rbegin());
+        suffix += same;
+        if (same < bytes.size()) break;
+    }
+
+    size_t erase = size - prefix - suffix;
+    ByteSpan replacement;
+    replacement.data = revision.data + prefix;
+    replacement.size = revision.size - prefix - suffix;
+    if (erase != 0 || replacement.size != 0) replace(prefix, erase, replacement);
+    return std::max(erase, replacement.size);
+}
+
+SimilarityMetrics IncrementalScorer::metrics(size_t original) const {
+    const Original& o = originals.at(original);
+    return metrics_from_counts(o.shared, o.counts.size(), kgrams.size(), o.min_sum, o.total, total);
+}
+
+std::vector<unsigned char> IncrementalScorer::contents() const {
+    std::vector<unsigned char> result;
+    result.reserve(size);
+    for (const Block& block : blocks) {
+        result.insert(result.end(), block.bytes.begin(), block.bytes.end());
+    }
+    return result;
+}
+
+CountedFingerprint IncrementalScorer::fingerprint() const {
+    std::vector<std::pair<uint64_t, uint32_t>> entries(kgrams.begin(), kgrams.end());
+    std::sort(entries.begin(), entries.end());
+    CountedFingerprint result;
+    for (const auto& entry : entries) {
+        result.hashes.push_back(entry.first);
+        result.counts.push_back(entry.second);
+    }
+    return result;
+}
+
+// ==================== 匹配片段定位 ====================
+
+LocatedText normalize_with_offsets(ByteSpan bytes, NormalizationProfile profile) {
+    if (bytes.size >= UINT32_MAX) {
+        throw std::runtime_error("Input too large for span matching");
+    }
+
+    // 按码点数的上限（字节数）一次分配，最后截断，避免逐个push_back的检查与扩容
+    LocatedText text;
+    text.codepoints.resize(bytes.size);
+    text.starts.resize(bytes.size);
+    text.ends.resize(bytes.size);
+    const CodepointClassifier& classifier = codepoint_classifier(profile);
+    size_t n = 0, i = 0;
+    while (i < bytes.size) {
+        size_t start = i;
+        uint32_t cp = classifier.normalize(bytes.data[i] < 0x80 ? bytes.data[i++]  // ASCII不必走完整解码
+                                                                 : utf8_next(bytes.data, bytes.size, i));
+        text.codepoints[n] = cp;
+        text.starts[n] = static_cast<uint32_t>(start);
+        text.ends[n] = static_cast<uint32_t>(i);
+        n += (cp != 0);  // 无效字节或被过滤的字符不计入
+    }
+    text.codepoints.resize(n);
+    text.starts.resize(n);
+    text.ends.resize(n);
+    return text;
+}
+
+std::vector<MatchedSpan> find_matched_spans(const LocatedText& a, const LocatedText& b, size_t k, HashMode mode,
+                                            size_t min_codepoints) {
+    std::vector<MatchedSpan> spans;
+    const std::vector<uint32_t>& ca = a.codepoints;
+    const std::vector<uint32_t>& cb = b.codepoints;
+    if (k == 0) return spans;
+    min_codepoints = std::max(min_codepoints, k);
+    // 按种子而不是k-gram查表：够长的片段必以一个完整的种子开头，短种子在普通文本中大量重复，
+    // 未被抄袭的位置会把候选次数耗尽在注定达不到min_codepoints的位置上
+    const size_t seed = std::min(min_codepoints, std::max(k, MAX_SPAN_SEED));
+    if (ca.size() < seed || cb.size() < seed) return spans;
+
+    // A的种子哈希表（开放寻址）：每个哈希记录最早的出现位置，其余位置按升序经next串联
+    // 表通常远大于缓存，哈希与链头放在同一个槽位里，一次查找只触及一条缓存行
+    struct Slot {
+        uint64_t hash;
+        uint32_t head;
+    };
+    const uint32_t NONE = UINT32_MAX;
+    std::vector<uint64_t> hashes;
+    hashes.reserve(ca.size() - seed + 1);
+    for_each_kgram_hash(ca, seed, mode, [&hashes](uint64_t hash) { hashes.push_back(hash); });
+    size_t capacity = 16;
+    while (capacity < hashes.size() * 2) capacity <<= 1;
+    std::vector<Slot> table(capacity, Slot{0, NONE});
+    std::vector<uint32_t> next(hashes.size(), NONE);
+    // 哈希值事先全部算好，提前PREFETCH个位置取入将要查找的槽位，把缓存未命中的等待重叠起来
+    const size_t PREFETCH = 16;
+    auto home = [&](uint64_t hash) { return static_cast<size_t>(mix64(hash)) & (capacity - 1); };
+    auto find_slot = [&](uint64_t hash) {
+        size_t slot = home(hash);
+        while (table[slot].head != NONE && table[slot].hash != hash) slot = (slot + 1) & (capacity - 1);
+        return slot;
+    };
+    for (size_t i = hashes.size(); i-- > 0;) {
+        if (i >= PREFETCH) prefetch(&table[home(hashes[i - PREFETCH])]);
+        Slot& slot = table[find_slot(hashes[i])];
+        slot.hash = hashes[i];
+        next[i] = slot.head;
+        slot.head = static_cast<uint32_t>(i);
+    }
+
+    hashes.clear();
+    for_each_kgram_hash(cb, seed, mode, [&hashes](uint64_t hash) { hashes.push_back(hash); });
+    size_t covered = 0;  // B中 [0, covered) 已属于输出的片段
+    size_t j = 0;
+    while (j < hashes.size()) {
+        if (j + PREFETCH < hashes.size()) prefetch(&table[home(hashes[j + PREFETCH])]);
+        size_t best_i = 0, best_length = 0;
+        uint32_t i = table[find_slot(hashes[j])].head;
+        for (size_t tried = 0; i != NONE && tried < MAX_SPAN_CANDIDATES; i = next[i], ++tried) {
+            size_t limit = std::min(ca.size() - i, cb.size() - j);
+            size_t length = 0;
+            while (length < limit && ca[i + length] == cb[j + length]) ++length;
+            if (length > best_length) {
+                best_length = length;
+                best_i = i;
+            }
+        }
+        if (best_length < seed) {  // 没有共有的种子，或只是哈希冲突
+            ++j;
+            continue;
+        }
+
+        size_t back = 0;
+        while (back < best_i && j - back > covered && ca[best_i - back - 1] == cb[j - back - 1]) ++back;
+        size_t a0 = best_i - back, b0 = j - back, length = best_length + back;
+        if (length < min_codepoints) {
+            ++j;
+            continue;
+        }
+
+        MatchedSpan span;
+        span.a_start = a.starts[a0];
+        span.a_end = a.ends[a0 + length - 1];
+        span.b_start = b.starts[b0];
+        span.b_end = b.ends[b0 + length - 1];
+        span.codepoints = length;
+        spans.push_back(span);
+        covered = b0 + length;
+        j = covered;
+    }
+    return spans;
+}
+
+// ==================== 精确公共子串（后缀数组） ====================
+
+std::vector<uint32_t> build_suffix_array(const std::vector<uint32_t>& text) {
+    const size_t n = text.size();
+    if (n >= UINT32_MAX) {
+        throw std::runtime_error("Text too long for a suffix array");
+    }
+    std::vector<uint32_t> sa(n), rank(n), tmp(n);
+    if (n == 0) return sa;
+
+    // 初始顺序：按码点做两趟16位的LSD基数排序
+    std::vector<uint32_t> count(1 << 16);
+    for (size_t i = 0; i < n; ++i) tmp[i] = static_cast<uint32_t>(i);
+    for (int shift = 0; shift < 32; shift += 16) {
+        std::fill(count.begin(), count.end(), 0);
+        for (size_t i = 0; i < n; ++i) count[(text[i] >> shift) & 0xFFFF]++;
+        uint32_t sum = 0;
+        for (uint32_t& c : count) {
+            uint32_t c0 = c;
+            c = sum;
+            sum += c0;
+        }
+        for (size_t r = 0; r < n; ++r) {
+            uint32_t p = tmp[r];
+            sa[count[(text[p] >> shift) & 0xFFFF]++] = p;
+        }
+        std::swap(sa, tmp);
+    }
+    std::swap(sa, tmp);
+    rank[sa[0]] = 0;
+    for (size_t r = 1; r < n; ++r) {
+        rank[sa[r]] = rank[sa[r - 1]] + (text[sa[r]] != text[sa[r - 1]]);
+    }
+    size_t classes = rank[sa[n - 1]] + 1;
+
+    // 倍增：已按前h个码点排好，再按 (rank[i], rank[i+h]) 排序得到前2h个码点的顺序
+    for (size_t h = 1; classes < n; h <<= 1) {
+        // 第二关键字：i+h越界的后缀最小，其余沿用上一轮的顺序
+        size_t m = 0;
+        for (size_t i = n - h; i < n; ++i) tmp[m++] = static_cast<uint32_t>(i);
+        for (size_t r = 0; r < n; ++r) {
+            if (sa[r] >= h) tmp[m++] = static_cast<uint32_t>(sa[r] - h);
+        }
+        // 第一关键字：稳定的计数排序
+        count.assign(classes, 0);
+        for (size_t i = 0; i < n; ++i) count[rank[i]]++;
+        uint32_t sum = 0;
+        for (uint32_t& c : count) {
+            uint32_t c0 = c;
+            c = sum;
+            sum += c0;
+        }
+        for (size_t r = 0; r < n; ++r) {
+            uint32_t p = tmp[r];
+            sa[count[rank[p]]++] = p;
+        }
+        // 重新编号，越界的第二关键字视为最小
+        auto second = [&rank, n, h](uint32_t p) { return p + h < n ? static_cast<int64_t>(rank[p + h]) : -1; };
+        tmp[sa[0]] = 0;
+        for (size_t r = 1; r < n; ++r) {
+            uint32_t p = sa[r], q = sa[r - 1];
+            bool same = rank[p] == rank[q] && second(p) == second(q);
+            tmp[p] = tmp[q] + !same;
+        }
+        std::swap(rank, tmp);
+        classes = rank[sa[n - 1]] + 1;
+    }
+    return sa;
+}
+
+std::vector<uint32_t> build_lcp_array(const std::vector<uint32_t>& text, const std::vector<uint32_t>& sa) {
+    const size_t n = text.size();
+    std::vector<uint32_t> lcp(n, 0), rank(n);
+    for (size_t r = 0; r < n; ++r) rank[sa[r]] = static_cast<uint32_t>(r);
+    // 后缀i+1与其前驱的公共前缀至少为 h-1，h总共只增加O(n)次
+    size_t h = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (rank[i] == 0) {
+            h = 0;
+            continue;
+        }
+        size_t j = sa[rank[i] - 1];
+        while (i + h < n && j + h < n && text[i + h] == text[j + h]) ++h;
+        lcp[rank[i]] = static_cast<uint32_t>(h);
+        if (h > 0) --h;
+    }
+    return lcp;
+}
+
+CommonSubstringReport find_common_substrings(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b,
+                                             size_t min_length) {
+    CommonSubstringReport report;
+    report.length_a = a.size();
+    report.length_b = b.size();
+    if (a.empty() || b.empty()) return report;
+    min_length = std::max<size_t>(min_length, 1);
+
+    // 分隔符在两份文本中都不出现，A的后缀与B的后缀的公共前缀不会越过A的末尾
+    const size_t na = a.size(), offset_b = na + 1;
+    std::vector<uint32_t> text;
+    text.reserve(offset_b + b.size());
+    text.insert(text.end(), a.begin(), a.end());
+    text.push_back(UINT32_MAX);
+    text.insert(text.end(), b.begin(), b.end());
+    const size_t n = text.size();
+    std::vector<uint32_t> sa = build_suffix_array(text);
+    std::vector<uint32_t> lcp = build_lcp_array(text, sa);
+
+    // match[p]：位置p的后缀与另一份文本中任一后缀的最长公共前缀，partner[p] 为取到它的后缀
+    // 与另一份文本最长的公共前缀必然来自后缀数组中上方或下方最近的那个后缀，两遍扫描即可
+    std::vector<uint32_t> match(n, 0), partner(n, 0);
+    const uint32_t NONE = UINT32_MAX;
+    auto doc_of = [na](uint32_t p) { return p < na ? 0 : (p > na ? 1 : 2); };
+    auto visit = [&](uint32_t p, uint32_t* last, uint32_t* run) {
+        int doc = doc_of(p);
+        if (doc == 2) return;
+        int other = 1 - doc;
+        if (last[other] != NONE && run[other] > match[p]) {
+            match[p] = run[other];
+            partner[p] = last[other];
+        }
+        last[doc] = p;
+        run[doc] = NONE;  // 与自身的公共前缀视为无限长，随后由LCP截断
+    };
+    uint32_t last[2] = {NONE, NONE}, run[2] = {0, 0};
+    for (size_t r = 0; r < n; ++r) {
+        run[0] = std::min(run[0], lcp[r]);
+        run[1] = std::min(run[1], lcp[r]);
+        visit(sa[r], last, run);
+    }
+    last[0] = last[1] = NONE;
+    for (size_t r = n; r-- > 0;) {
+        if (r + 1 < n) {
+            run[0] = std::min(run[0], lcp[r + 1]);
+            run[1] = std::min(run[1], lcp[r + 1]);
+        }
+        visit(sa[r], last, run);
+    }
+
+    // 位置p-1的匹配若比p的长，p处的匹配只是它的后缀；分隔符处match为0，B的开头总会被检查
+    for (size_t p = offset_b; p < n; ++p) {
+        if (match[p] >= min_length && match[p - 1] <= match[p]) {
+            CommonSubstring substring;
+            substring.a_start = partner[p];
+            substring.b_start = p - offset_b;
+            substring.length = match[p];
+            report.substrings.push_back(substring);
+        }
+    }
+    // 覆盖的码点：区间 [p, p + match[p]) 的并集，起点递增，记录已覆盖到的位置即可
+    auto covered = [&match, min_length](size_t begin, size_t end) {
+        size_t total = 0, reach = begin;
+        for (size_t p = begin; p < end; ++p) {
+            if (match[p] < min_length) continue;
+            size_t stop = p + match[p];
+            if (stop > reach) {
+                total += stop - std::max(p, reach);
+                reach = stop;
+            }
+        }
+        return total;
+    };
+    report.covered_a = covered(0, na);
+    report.covered_b = covered(offset_b, n);
+    report.coverage_a = static_cast<double>(report.covered_a) / report.length_a;
+    report.coverage_b = static_cast<double>(report.covered_b) / report.length_b;
+    report.similarity = static_cast<double>(report.covered_a + report.covered_b) / (report.length_a + report.length_b);
+    return report;
+}
+
+// ==================== 语料库模式（倒排索引） ====================
+
+// 索引文件格式标识与版本号
+const char CORPUS_INDEX_MAGIC[8] = {'P', 'D', 'I', 'D', 'X', '1', 0, 0};
+
+const uint32_t CORPUS_INDEX_VERSION = 5;
+
+std::vector<std::string> read_path_list(const std::string& list_path) {
+    std::ifstream file(list_path);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open list file: " + list_path);
+    }
+
+    std::vector<std::string> paths;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();  // 兼容Windows换行
+        if (!line.empty()) paths.push_back(line);
+    }
+    return paths;
+}
+
+uint32_t CorpusIndexBuilder::add_document(const std::string& doc_path, const std::vector<uint64_t>& hashes) {
+    uint32_t doc = static_cast<uint32_t>(index.doc_paths.size());
+    index.doc_paths.push_back(doc_path);
+
+    // 跳过停用k-gram（两个有序向量求差），集合大小按去掉之后计
+    uint64_t kept = 0;
+    auto stop = index.stop_grams.begin();
+    for (uint64_t hash : hashes) {
+        while (stop != index.stop_grams.end() && *stop < hash) ++stop;
+        if (stop != index.stop_grams.end() && *stop == hash) continue;
+        pairs.emplace_back(hash, doc);
+        kept++;
+    }
+    index.doc_set_sizes.push_back(kept);
+    return doc;
+}
+
+CorpusIndex CorpusIndexBuilder::finish() {
+    std::sort(pairs.begin(), pairs.end());
+
+    index.terms.clear();
+    index.offsets.clear();
+    index.postings.clear();
+    index.postings.reserve(pairs.size());
+    for (size_t i = 0; i < pairs.size(); ++i) {
+        if (i == 0 || pairs[i].first != pairs[i - 1].first) {
+            index.terms.push_back(pairs[i].first);
+            index.offsets.push_back(index.postings.size());
+        }
+        index.postings.push_back(pairs[i].second);
+    }
+    index.offsets.push_back(index.postings.size());
+
+    pairs.clear();
+    pairs.shrink_to_fit();
+    return std::move(index);
+}
+
+CorpusIndex build_corpus_index(const std::vector<std::string>& doc_paths, const FingerprintOptions& options) {
+    return build_corpus_index(doc_paths, options, std::vector<uint64_t>(), 0.0);
+}
+
+CorpusIndex build_corpus_index(const std::vector<std::string>& doc_paths, const FingerprintOptions& options,
+                               const std::vector<uint64_t>& stop_grams, double max_df) {
+    CorpusIndexBuilder builder(options, stop_grams, max_df);
+    for (const std::string& doc_path : doc_paths) {
+        builder.add_document(doc_path, fingerprint_file(doc_path, options));
+    }
+    return builder.finish();
+}
+
+// 向输出流写入一个定长整数（按本机字节序）
+template <typename T>
+void write_pod(std::ofstream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// 向输出流写入一个定长整数数组
+template <typename T>
+void write_pod_array(std::ofstream& out, const std::vector<T>& values) {
+    if (values.empty()) return;
+    out.write(reinterpret_cast<const char*>(values.data()),
+              static_cast<std::streamsize>(values.size() * sizeof(T)));
+}
+
+// 写入带长度前缀的字符串
+static void write_string(std::ofstream& out, const std::string& value) {
+    write_pod(out, static_cast<uint32_t>(value.size()));
+    out.write(value.data(), static_cast<std::streamsize>(value.size()));
+}
+
+// 写入指纹参数，读取方必须用相同参数处理查询文档
+static void write_fingerprint_options(std::ofstream& out, const FingerprintOptions& options) {
+    write_pod(out, static_cast<uint32_t>(options.k));
+    write_pod(out, static_cast<uint32_t>(options.hash_mode));
+    write_pod(out, static_cast<uint32_t>(options.winnow_window));
+    write_pod(out, static_cast<uint32_t>(options.normalization));
+}
+
+void save_corpus_index(const CorpusIndex& index, const std::string& path) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open()) {
+        throw std::runtime_error("Failed to open index for writing: " + path);
+    }
+
+    out.write(CORPUS_INDEX_MAGIC, sizeof(CORPUS_INDEX_MAGIC));
+    write_pod(out, CORPUS_INDEX_VERSION);
+    write_fingerprint_options(out, index.options);
+
+    // 停用k-gram过滤，查询时要同样处理
+    write_pod(out, index.max_df);
+    write_pod(out, static_cast<uint64_t>(index.stop_grams.size()));
+    write_pod_array(out, index.stop_grams);
+
+    // 文档表
+    write_pod(out, static_cast<uint32_t>(index.doc_paths.size()));
+    for (size_t doc = 0; doc < index.doc_paths.size(); ++doc) {
+        write_string(out, index.doc_paths[doc]);
+        write_pod(out, index.doc_set_sizes[doc]);
+    }
+
+    // 词典与倒排表
+    write_pod(out, static_cast<uint64_t>(index.terms.size()));
+    write_pod_array(out, index.terms);
+    write_pod_array(out, index.offsets);
+    write_pod_array(out, index.postings);
+
+    if (!out) {
+        throw std::runtime_error("Failed to write index: " + path);
+    }
+}
+
+// 从字节缓冲区中顺序读取数据的辅助类，越界时抛出异常
+class ByteReader {
+private:
+    const std::vector<unsigned char>& buf;
+    size_t pos = 0;
+
+public:
+    explicit ByteReader(const std::vector<unsigned char>& b) : buf(b) {}
+
+    void read_raw(void* dst, size_t n) {
+        if (n > buf.size() - pos) {
+            throw std::runtime_error("Corrupted file: unexpected end of file");
+        }
+        if (n > 0) std::memcpy(dst, buf.data() + pos, n);
+        pos += n;
+    }
+
+    template <typename T>
+    T read() {
+        T value;
+        read_raw(&value, sizeof(T));
+        return value;
+    }
+
+    template <typename T>
+    void read_array(std::vector<T>& values, size_t count) {
+        if (count > (buf.size() - pos) / sizeof(T)) {
+            throw std::runtime_error("Corrupted file: unexpected end of file");
+        }
+        values.resize(count);
+        read_raw(values.data(), count * sizeof(T));
+    }
+
+    std::string read_string() {
+        std::vector<char> chars;
+        read_array(chars, read<uint32_t>());
+        return std::string(chars.begin(), chars.end());
+    }
+
+    bool at_end() const { return pos == buf.size(); }
+};
+
+// 读取write_fingerprint_options写入的指纹参数
+static FingerprintOptions read_fingerprint_options(ByteReader& reader, const std::string& path) {
+    FingerprintOptions options;
+    options.k = reader.read<uint32_t>();
+    uint32_t hash_mode = reader.read<uint32_t>();
+    if (hash_mode > static_cast<uint32_t>(HashMode::Rolling)) {
+        throw std::runtime_error("Unknown hash function in " + path);
+    }
+    options.hash_mode = static_cast<HashMode>(hash_mode);
+    options.winnow_window = reader.read<uint32_t>();
+    uint32_t normalization = reader.read<uint32_t>();
+    if (normalization > static_cast<uint32_t>(NormalizationProfile::FullWidthFolding)) {
+        throw std::runtime_error("Unknown normalization profile in " + path);
+    }
+    options.normalization = static_cast<NormalizationProfile>(normalization);
+    return options;
+}
+
+CorpusIndex load_corpus_index(const std::string& path) {
+    std::vector<unsigned char> bytes = read_file_to_bytes(path);
+    ByteReader reader(bytes);
+
+    char magic[sizeof(CORPUS_INDEX_MAGIC)];
+    reader.read_raw(magic, sizeof(magic));
+    if (std::memcmp(magic, CORPUS_INDEX_MAGIC, sizeof(magic)) != 0) {
+        throw std::runtime_error("Not a corpus index file: " + path);
+    }
+    if (reader.read<uint32_t>() != CORPUS_INDEX_VERSION) {
+        throw std::runtime_error("Unsupported corpus index version: " + path);
+    }
+
+    CorpusIndex index;
+    index.options = read_fingerprint_options(reader, path);
+    index.max_df = reader.read<double>();
+    reader.read_array(index.stop_grams, static_cast<size_t>(reader.read<uint64_t>()));
+
+    uint32_t doc_count = reader.read<uint32_t>();
+    for (uint32_t doc = 0; doc < doc_count; ++doc) {
+        index.doc_paths.push_back(reader.read_string());
+        index.doc_set_sizes.push_back(reader.read<uint64_t>());
+    }
+
+    uint64_t term_count = reader.read<uint64_t>();
+    reader.read_array(index.terms, static_cast<size_t>(term_count));
+    reader.read_array(index.offsets, static_cast<size_t>(term_count + 1));
+    if (index.offsets.empty() || index.offsets.front() != 0) {
+        throw std::runtime_error("Corrupted corpus index: " + path);
+    }
+    reader.read_array(index.postings, static_cast<size_t>(index.offsets.back()));
+
+    // 查询直接以倒排表中的文档ID为下标，偏移递减或文档ID越界的文件不能使用
+    for (size_t t = 0; t < index.terms.size(); ++t) {
+        if (index.offsets[t + 1] < index.offsets[t] || (t > 0 && index.terms[t] <= index.terms[t - 1])) {
+            throw std::runtime_error("Corrupted corpus index: " + path);
+        }
+    }
+    for (uint32_t doc : index.postings) {
+        if (doc >= doc_count) {
+            throw std::runtime_error("Corrupted corpus index: " + path);
+        }
+    }
+    if (!reader.at_end()) {
+        throw std::runtime_error("Corrupted corpus index: " + path);
+    }
+
+    return index;
+}
+
+// 查询集合去掉索引的停用k-gram；索引没有停用k-gram时直接返回原集合，不复制
+static const std::vector<uint64_t>& without_stop_grams(const CorpusIndex& index, const std::vector<uint64_t>& query_set,
+                                                       std::vector<uint64_t>& storage) {
+    if (index.stop_grams.empty()) return query_set;
+    storage = query_set;
+    remove_stop_grams(storage, index.stop_grams);
+    return storage;
+}
+
+std::vector<double> query_corpus_index(const CorpusIndex& index, const std::vector<uint64_t>& raw_query) {
+    std::vector<uint64_t> storage;
+    const std::vector<uint64_t>& query_set = without_stop_grams(index, raw_query, storage);
+    std::vector<uint32_t> intersections(index.doc_paths.size(), 0);
+
+    // 查询集合与词典都升序，每次只需在上一次命中位置之后查找
+    auto it = index.terms.begin();
+    for (uint64_t hash : query_set) {
+        it = std::lower_bound(it, index.terms.end(), hash);
+        if (it == index.terms.end()) break;
+        if (*it != hash) continue;  // 语料库中没有该k-gram
+
+        size_t t = static_cast<size_t>(it - index.terms.begin());
+        for (uint64_t p = index.offsets[t]; p < index.offsets[t + 1]; ++p) {
+            intersections[index.postings[p]]++;
+        }
+    }
+
+    // 与jaccard_similarity保持相同的计算方式，保证结果一致
+    std::vector<double> scores(index.doc_paths.size(), 0.0);
+    for (size_t doc = 0; doc < scores.size(); ++doc) {
+        uint64_t union_size = query_set.size() + index.doc_set_sizes[doc] - intersections[doc];
+        if (union_size == 0) continue;
+        scores[doc] = static_cast<double>(intersections[doc]) / static_cast<double>(union_size);
+    }
+    return scores;
+}
+
+// 相似度 intersection / (a + b - intersection)，与query_corpus_index的计算方式相同
+static double jaccard_from_counts(uint64_t intersection, uint64_t a, uint64_t b) {
+    uint64_t union_size = a + b - intersection;
+    return union_size == 0 ? 0.0 : static_cast<double>(intersection) / static_cast<double>(union_size);
+}
+
+// 输出顺序：得分高者在前，相同时文档ID小者在前
+static bool ranks_before(const RankedDocument& x, const RankedDocument& y) {
+    return x.score != y.score ? x.score > y.score : x.doc < y.doc;
+}
+
+std::vector<RankedDocument> query_corpus_top_k(const CorpusIndex& index, const std::vector<uint64_t>& raw_query,
+                                               size_t k, TopKStats* stats) {
+    std::vector<uint64_t> storage;
+    const std::vector<uint64_t>& query_set = without_stop_grams(index, raw_query, storage);
+    TopKStats local;
+    local.documents = index.doc_paths.size();
+
+    // 查询中语料库里有的k-gram对应的词项，按倒排表长度升序（最稀有的在前）
+    std::vector<std::pair<uint64_t, size_t>> by_length;  // (倒排表长度, 词项编号)
+    auto it = index.terms.begin();
+    for (uint64_t hash : query_set) {
+        it = std::lower_bound(it, index.terms.end(), hash);
+        if (it == index.terms.end()) break;
+        if (*it != hash) continue;
+        size_t t = static_cast<size_t>(it - index.terms.begin());
+        by_length.emplace_back(index.offsets[t + 1] - index.offsets[t], t);
+    }
+    std::sort(by_length.begin(), by_length.end());
+    std::vector<size_t> order(by_length.size());
+    for (size_t i = 0; i < by_length.size(); ++i) order[i] = by_length[i].second;
+    local.terms = order.size();
+    if (k == 0) {
+        if (stats) *stats = local;
+        return std::vector<RankedDocument>();
+    }
+
+    const uint32_t pruned = UINT32_MAX;
+    const uint64_t a = query_set.size();
+    const size_t m = order.size();
+    std::vector<uint32_t> counts(index.doc_paths.size(), 0);  // 在已处理的倒排表中出现的次数，0表示还未出现过
+    std::vector<uint32_t> candidates;                         // 仍在计数的文档
+    std::vector<double> lower;
+    double threshold = 0.0;  // 第K名得分的下界，上界低于它的文档不可能进入前K
+
+    // 已知次数c给出相似度下界 c/(a+b-c)，第K大的下界即第K名得分的下界
+    // 每次重新计算的开销与候选数成正比（每个候选一次除法），因此只在上次之后处理的倒排表项数
+    // 达到候选数的8倍时才计算，只占扫描本身的一小部分
+    // K占文档数的比例较大时第K名得分很低，剪枝几乎不起作用，下界保持为0即退化为全量计数
+    const bool full_scan = k * TOP_K_FULL_SCAN_SHARE >= index.doc_paths.size();
+    uint64_t work = 0;
+    auto refresh = [&]() {
+        if (full_scan || work < 8 * candidates.size() || candidates.size() < k) return;
+        work = 0;
+        lower.clear();
+        for (uint32_t doc : candidates) lower.push_back(jaccard_from_counts(counts[doc], a, index.doc_set_sizes[doc]));
+        std::nth_element(lower.begin(), lower.begin() + static_cast<std::ptrdiff_t>(k - 1), lower.end(),
+                         std::greater<double>());
+        threshold = std::max(threshold, lower[k - 1]);
+    };
+    // 还有remaining个词项未处理时，交集最多再增加remaining；上界低于t的文档不再计数
+    auto prune = [&](size_t remaining) {
+        size_t kept = 0;
+        for (uint32_t doc : candidates) {
+            uint64_t b = index.doc_set_sizes[doc];
+            if (jaccard_from_counts(std::min<uint64_t>(counts[doc] + remaining, b), a, b) < threshold) {
+                counts[doc] = pruned;
+                local.bound_pruned++;
+            } else {
+                candidates[kept++] = doc;
+            }
+        }
+        candidates.resize(kept);
+    };
+
+    // 前缀：从最稀有的词项开始扫描倒排表，文档第一次出现时按集合大小过滤
+    size_t scanned = 0;
+    for (; scanned < m; ++scanned) {
+        // 之后才出现的文档交集不超过剩余的词项数，不可能进入前K时停止接纳新文档
+        size_t remaining = m - scanned;
+        if (jaccard_from_counts(remaining, a, remaining) < threshold) break;
+
+        size_t t = order[scanned];
+        for (uint64_t p = index.offsets[t]; p < index.offsets[t + 1]; ++p) {
+            uint32_t doc = index.postings[p];
+            uint32_t& count = counts[doc];
+            if (count == 0) {
+                local.candidates++;
+                uint64_t b = index.doc_set_sizes[doc];
+                if (jaccard_from_counts(std::min(a, b), a, b) < threshold) {
+                    local.size_pruned++;
+                    count = pruned;
+                    continue;
+                }
+                candidates.push_back(doc);
+            }
+            count += count != pruned;
+        }
+        work += index.offsets[t + 1] - index.offsets[t];
+        refresh();
+    }
+    local.scanned_terms = scanned;
+
+    // 剩下的词项只为仍可能进入前K的文档计数：文档少时在倒排表中二分查找，否则照常扫描
+    for (size_t j = scanned; j < m; ++j) {
+        prune(m - j);
+        size_t t = order[j];
+        uint64_t length = index.offsets[t + 1] - index.offsets[t];
+        uint64_t log_length = 1;
+        while ((uint64_t(1) << log_length) < length) ++log_length;
+        if (candidates.size() * log_length < length) {
+            auto first = index.postings.begin() + static_cast<std::ptrdiff_t>(index.offsets[t]);
+            auto last = index.postings.begin() + static_cast<std::ptrdiff_t>(index.offsets[t + 1]);
+            for (uint32_t doc : candidates) counts[doc] += std::binary_search(first, last, doc);
+            work += candidates.size() * log_length;
+        } else {
+            // 从未出现过的文档不是候选，它们的计数不再被读取
+            for (uint64_t p = index.offsets[t]; p < index.offsets[t + 1]; ++p) {
+                uint32_t& count = counts[index.postings[p]];
+                count += count != pruned;
+            }
+            work += length;
+        }
+        refresh();
+    }
+
+    // 剩下的文档交集都已算全，得分与query_corpus_index相同
+    std::vector<RankedDocument> ranked;
+    for (uint32_t doc : candidates) {
+        RankedDocument entry;
+        entry.doc = doc;
+        entry.score = jaccard_from_counts(counts[doc], a, index.doc_set_sizes[doc]);
+        ranked.push_back(entry);
+    }
+    local.verified = ranked.size();
+    size_t n = std::min(k, ranked.size());
+    std::partial_sort(ranked.begin(), ranked.begin() + static_cast<std::ptrdiff_t>(n), ranked.end(), ranks_before);
+    ranked.resize(n);
+    if (stats) *stats = local;
+    return ranked;
+}
+
+// ==================== MinHash签名与LSH候选检索 ====================
+
+// 第i个哈希函数的种子
+inline uint64_t minhash_seed(size_t i) {
+    return mix64(0x2545F4914F6CDD1DULL * (i + 1));
+}
+
+std::vector<uint64_t> minhash_signature(const std::vector<uint64_t>& hash_set, size_t num_hashes) {
+    std::vector<uint64_t> seeds(num_hashes);
+    for (size_t i = 0; i < num_hashes; ++i) seeds[i] = minhash_seed(i);
+
+    std::vector<uint64_t> signature(num_hashes, UINT64_MAX);
+    for (uint64_t hash : hash_set) {
+        for (size_t i = 0; i < num_hashes; ++i) {
+            uint64_t h = mix64(hash ^ seeds[i]);
+            if (h < signature[i]) signature[i] = h;
+        }
+    }
+    return signature;
+}
+
+double minhash_similarity(const uint64_t* sig1, const uint64_t* sig2, size_t num_hashes) {
+    size_t equal = 0;
+    size_t both_empty = 0;
+    for (size_t i = 0; i < num_hashes; ++i) {
+        if (sig1[i] != sig2[i]) continue;
+        if (sig1[i] == UINT64_MAX) both_empty++;  // 两个空集合，与jaccard_similarity一致记为0
+        else equal++;
+    }
+    if (both_empty == num_hashes) return 0.0;
+    return static_cast<double>(equal) / static_cast<double>(num_hashes);
+}
+
+LshParams choose_lsh_params(size_t num_hashes, double threshold) {
+    LshParams best;
+    double best_t = -1.0;
+    for (size_t rows = 1; rows <= num_hashes; ++rows) {
+        if (num_hashes % rows != 0) continue;
+        size_t bands = num_hashes / rows;
+        double t = std::pow(1.0 / static_cast<double>(bands), 1.0 / static_cast<double>(rows));
+        if (t <= threshold && t > best_t) {
+            best_t = t;
+            best.bands = bands;
+            best.rows = rows;
+        }
+    }
+    if (best.bands == 0) {  // 阈值过低：每段一个值，候选最多
+        best.bands = num_hashes;
+        best.rows = 1;
+    }
+    return best;
+}
+
+// 一段签名的桶键
+inline uint64_t lsh_band_key(const uint64_t* signature, size_t band, size_t rows) {
+    uint64_t key = band;
+    for (size_t r = 0; r < rows; ++r) {
+        key = mix64(key ^ signature[band * rows + r]);
+    }
+    return key;
+}
+
+LshIndex::LshIndex(const std::vector<uint64_t>& signatures, size_t num_hashes, LshParams p)
+    : params(p), tables(p.bands) {
+    size_t doc_count = num_hashes == 0 ? 0 : signatures.size() / num_hashes;
+    for (size_t band = 0; band < params.bands; ++band) {
+        std::vector<std::pair<uint64_t, uint32_t>>& table = tables[band];
+        table.reserve(doc_count);
+        for (size_t doc = 0; doc < doc_count; ++doc) {
+            const uint64_t* sig = signatures.data() + doc * num_hashes;
+            if (sig[0] == UINT64_MAX) continue;  // 空文档不参与检索
+            table.emplace_back(lsh_band_key(sig, band, params.rows), static_cast<uint32_t>(doc));
+        }
+        std::sort(table.begin(), table.end());
+    }
+}
+
+std::vector<uint32_t> LshIndex::candidates(const uint64_t* signature) const {
+    std::vector<uint32_t> result;
+    if (signature[0] == UINT64_MAX) return result;
+    for (size_t band = 0; band < params.bands; ++band) {
+        const std::vector<std::pair<uint64_t, uint32_t>>& table = tables[band];
+        uint64_t key = lsh_band_key(signature, band, params.rows);
+        auto it = std::lower_bound(table.begin(), table.end(), std::make_pair(key, uint32_t(0)));
+        for (; it != table.end() && it->first == key; ++it) {
+            result.push_back(it->second);
+        }
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+// 签名库文件格式标识与版本号
+const char SIGNATURE_STORE_MAGIC[8] = {'P', 'D', 'S', 'I', 'G', '1', 0, 0};
+
+const uint32_t SIGNATURE_STORE_VERSION = 2;
+
+SignatureStore build_signature_store(const std::vector<std::string>& doc_paths, const FingerprintOptions& options) {
+    SignatureStore store;
+    store.options = options;
+    store.doc_paths = doc_paths;
+    store.signatures.reserve(doc_paths.size() * store.num_hashes);
+    for (const std::string& doc_path : doc_paths) {
+        std::vector<uint64_t> signature = minhash_signature(fingerprint_file(doc_path, options), store.num_hashes);
+        store.signatures.insert(store.signatures.end(), signature.begin(), signature.end());
+    }
+    return store;
+}
+
+void save_signature_store(const SignatureStore& store, const std::string& path) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open()) {
+        throw std::runtime_error("Failed to open signature store for writing: " + path);
+    }
+
+    out.write(SIGNATURE_STORE_MAGIC, sizeof(SIGNATURE_STORE_MAGIC));
+    write_pod(out, SIGNATURE_STORE_VERSION);
+    write_fingerprint_options(out, store.options);
+    write_pod(out, store.num_hashes);
+    write_pod(out, static_cast<uint32_t>(store.doc_paths.size()));
+    for (const std::string& doc_path : store.doc_paths) {
+        write_string(out, doc_path);
+    }
+    write_pod_array(out, store.signatures);
+
+    if (!out) {
+        throw std::runtime_error("Failed to write signature store: " + path);
+    }
+}
+
+SignatureStore load_signature_store(const std::string& path) {
+    std::vector<unsigned char> bytes = read_file_to_bytes(path);
+    ByteReader reader(bytes);
+
+    char magic[sizeof(SIGNATURE_STORE_MAGIC)];
+    reader.read_raw(magic, sizeof(magic));
+    if (std::memcmp(magic, SIGNATURE_STORE_MAGIC, sizeof(magic)) != 0) {
+        throw std::runtime_error("Not a signature store file: " + path);
+    }
+    if (reader.read<uint32_t>() != SIGNATURE_STORE_VERSION) {
+        throw std::runtime_error("Unsupported signature store version: " + path);
+    }
+
+    SignatureStore store;
+    store.options = read_fingerprint_options(reader, path);
+    store.num_hashes = reader.read<uint32_t>();
+    if (store.num_hashes == 0) {
+        throw std::runtime_error("Corrupted signature store: " + path);
+    }
+    uint32_t doc_count = reader.read<uint32_t>();
+    for (uint32_t doc = 0; doc < doc_count; ++doc) {
+        store.doc_paths.push_back(reader.read_string());
+    }
+    reader.read_array(store.signatures, static_cast<size_t>(doc_count) * store.num_hashes);
+    return store;
+}
+
+// ==================== 文档频率表（模板文本降权） ====================
+
+// 文档频率表文件格式标识与版本号
+const char DOCUMENT_FREQUENCY_MAGIC[8] = {'P', 'D', 'D', 'F', '1', 0, 0, 0};
+const uint32_t DOCUMENT_FREQUENCY_VERSION = 1;
+
+uint32_t DocumentFrequencyTable::frequency(uint64_t hash) const {
+    auto it = std::lower_bound(hashes.begin(), hashes.end(), hash);
+    if (it == hashes.end() || *it != hash) return 0;
+    return counts[static_cast<size_t>(it - hashes.begin())];
+}
+
+// 缓冲区攒够这么多个哈希时并入表中
+const size_t DOCUMENT_FREQUENCY_BATCH = 1 << 20;
+
+void DocumentFrequencyBuilder::add_document(const std::vector<uint64_t>& hash_set) {
+    pending.insert(pending.end(), hash_set.begin(), hash_set.end());
+    table.documents++;
+    if (pending.size() >= DOCUMENT_FREQUENCY_BATCH) flush();
+}
+
+void DocumentFrequencyBuilder::flush() {
+    std::sort(pending.begin(), pending.end());
+
+    // 两个有序序列归并，相同哈希的次数相加
+    std::vector<uint64_t> hashes;
+    std::vector<uint32_t> counts;
+    hashes.reserve(table.hashes.size() + pending.size());
+    counts.reserve(table.hashes.size() + pending.size());
+    size_t i = 0, j = 0;
+    while (i < table.hashes.size() || j < pending.size()) {
+        if (j == pending.size() || (i < table.hashes.size() && table.hashes[i] < pending[j])) {
+            hashes.push_back(table.hashes[i]);
+            counts.push_back(table.counts[i++]);
+            continue;
+        }
+        uint64_t hash = pending[j];
+        uint32_t count = 0;
+        while (j < pending.size() && pending[j] == hash) {
+            count++;
+            j++;
+        }
+        if (i < table.hashes.size() && table.hashes[i] == hash) count += table.counts[i++];
+        hashes.push_back(hash);
+        counts.push_back(count);
+    }
+    hashes.shrink_to_fit();
+    counts.shrink_to_fit();
+    table.hashes.swap(hashes);
+    table.counts.swap(counts);
+    pending.clear();
+}
+
+DocumentFrequencyTable DocumentFrequencyBuilder::finish() {
+    flush();
+    pending.shrink_to_fit();
+    return std::move(table);
+}
+
+DocumentFrequencyTable build_document_frequencies(const std::vector<std::string>& doc_paths,
+                                                  const FingerprintOptions& options) {
+    DocumentFrequencyBuilder builder(options);
+    for (const std::string& doc_path : doc_paths) {
+        builder.add_document(fingerprint_file(doc_path, options));
+    }
+    return builder.finish();
+}
+
+DocumentFrequencyTable document_frequencies(const CorpusIndex& index) {
+    DocumentFrequencyTable table;
+    table.options = index.options;
+    table.documents = index.doc_paths.size();
+    table.hashes = index.terms;
+    table.counts.reserve(index.terms.size());
+    for (size_t t = 0; t < index.terms.size(); ++t) {
+        table.counts.push_back(static_cast<uint32_t>(index.offsets[t + 1] - index.offsets[t]));
+    }
+    return table;
+}
+
+void save_document_frequencies(const DocumentFrequencyTable& table, const std::string& path) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open()) {
+        throw std::runtime_error("Failed to open document frequency table for writing: " + path);
+    }
+
+    out.write(DOCUMENT_FREQUENCY_MAGIC, sizeof(DOCUMENT_FREQUENCY_MAGIC));
+    write_pod(out, DOCUMENT_FREQUENCY_VERSION);
+    write_fingerprint_options(out, table.options);
+    write_pod(out, table.documents);
+    write_pod(out, static_cast<uint64_t>(table.hashes.size()));
+    write_pod_array(out, table.hashes);
+    write_pod_array(out, table.counts);
+
+    if (!out) {
+        throw std::runtime_error("Failed to write document frequency table: " + path);
+    }
+}
+
+DocumentFrequencyTable load_document_frequencies(const std::string& path) {
+    std::vector<unsigned char> bytes = read_file_to_bytes(path);
+    ByteReader reader(bytes);
+
+    char magic[sizeof(DOCUMENT_FREQUENCY_MAGIC)];
+    reader.read_raw(magic, sizeof(magic));
+    if (std::memcmp(magic, DOCUMENT_FREQUENCY_MAGIC, sizeof(magic)) != 0) {
+        throw std::runtime_error("Not a document frequency table: " + path);
+    }
+    if (reader.read<uint32_t>() != DOCUMENT_FREQUENCY_VERSION) {
+        throw std::runtime_error("Unsupported document frequency table version: " + path);
+    }
+
+    DocumentFrequencyTable table;
+    table.options = read_fingerprint_options(reader, path);
+    table.documents = reader.read<uint64_t>();
+    uint64_t count = reader.read<uint64_t>();
+    reader.read_array(table.hashes, static_cast<size_t>(count));
+    reader.read_array(table.counts, static_cast<size_t>(count));
+    return table;
+}
+
+std::vector<uint64_t> stop_grams(const DocumentFrequencyTable& table, double max_ratio) {
+    std::vector<uint64_t> stop;
+    double limit = max_ratio * static_cast<double>(table.documents);
+    for (size_t i = 0; i < table.hashes.size(); ++i) {
+        if (table.counts[i] > limit) stop.push_back(table.hashes[i]);
+    }
+    return stop;
+}
+
+void remove_stop_grams(std::vector<uint64_t>& hash_set, const std::vector<uint64_t>& stop) {
+    // 原地求差：写指针不会超过读指针
+    size_t kept = 0;
+    auto it = stop.begin();
+    for (uint64_t hash : hash_set) {
+        while (it != stop.end() && *it < hash) ++it;
+        if (it == stop.end() || *it != hash) hash_set[kept++] = hash;
+    }
+    hash_set.resize(kept);
+}
+
+void remove_stop_grams(CountedFingerprint& fingerprint, const std::vector<uint64_t>& stop) {
+    size_t kept = 0;
+    auto it = stop.begin();
+    for (size_t i = 0; i < fingerprint.hashes.size(); ++i) {
+        uint64_t hash = fingerprint.hashes[i];
+        while (it != stop.end() && *it < hash) ++it;
+        if (it != stop.end() && *it == hash) continue;
+        fingerprint.hashes[kept] = hash;
+        fingerprint.counts[kept] = fingerprint.counts[i];
+        kept++;
+    }
+    fingerprint.hashes.resize(kept);
+    fingerprint.counts.resize(kept);
+}
+
+double inverse_document_frequency(const DocumentFrequencyTable& table, uint64_t hash) {
+    return std::log((static_cast<double>(table.documents) + 1.0) / (static_cast<double>(table.frequency(hash)) + 1.0));
+}
+
+double tfidf_similarity(const CountedFingerprint& a, const CountedFingerprint& b, const DocumentFrequencyTable& table) {
+    // 三个有序序列同时归并：两份指纹的并集按哈希升序走一遍，文档频率表只需向前查找
+    double shared = 0.0, total = 0.0;
+    double documents = static_cast<double>(table.documents) + 1.0;
+    auto it = table.hashes.begin();
+    size_t i = 0, j = 0;
+    while (i < a.hashes.size() || j < b.hashes.size()) {
+        uint64_t hash;
+        uint32_t count_a = 0, count_b = 0;
+        if (j == b.hashes.size() || (i < a.hashes.size() && a.hashes[i] < b.hashes[j])) {
+            hash = a.hashes[i];
+            count_a = a.counts[i++];
+        } else if (i == a.hashes.size() || b.hashes[j] < a.hashes[i]) {
+            hash = b.hashes[j];
+            count_b = b.counts[j++];
+        } else {
+            hash = a.hashes[i];
+            count_a = a.counts[i++];
+            count_b = b.counts[j++];
+        }
+
+        it = std::lower_bound(it, table.hashes.end(), hash);
+        uint32_t frequency = 0;
+        if (it != table.hashes.end() && *it == hash) frequency = table.counts[static_cast<size_t>(it - table.hashes.begin())];
+        double idf = std::log(documents / (static_cast<double>(frequency) + 1.0));
+        shared += std::min(count_a, count_b) * idf;
+        total += std::max(count_a, count_b) * idf;
+    }
+    return total > 0.0 ? shared / total : 0.0;
+}
+
+// ==================== 指纹缓存 ====================
+
+// 缓存文件格式标识与版本号
+const char FINGERPRINT_CACHE_MAGIC[8] = {'P', 'D', 'F', 'P', '1', 0, 0, 0};
+
+const uint32_t FINGERPRINT_CACHE_VERSION = 2;
+
+ContentHash content_hash(ByteSpan bytes) {
+    uint64_t a = 0x243F6A8885A308D3ULL ^ bytes.size;
+    uint64_t b = 0x13198A2E03707344ULL + bytes.size;
+    size_t i = 0;
+    for (; i + 8 <= bytes.size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes.data + i, 8);
+        a = mix64(a ^ word);
+        b = (b ^ word) * 0x9FB21C651E98DF25ULL;
+        b ^= b >> 29;
+    }
+    uint64_t tail = 0;
+    if (bytes.size > i) std::memcpy(&tail, bytes.data + i, bytes.size - i);  // 空文件没有映射，data为空指针
+    ContentHash hash;
+    hash.lo = mix64(a ^ tail);
+    hash.hi = mix64(b ^ mix64(tail + 0x452821E638D01377ULL));
+    return hash;
+}
+
+double jaccard_similarity_sorted(const Fingerprint& set1, const Fingerprint& set2) {
+    return jaccard_similarity_sorted(set1.data(), set1.size(), set2.data(), set2.size());
+}
+
+std::string FingerprintCache::to_hex(uint64_t value) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(16, '0');
+    for (int i = 15; i >= 0; --i, value >>= 4) hex[i] = digits[value & 0xF];
+    return hex;
+}
+
+std::string FingerprintCache::entry_name(const ContentHash& key, const FingerprintOptions& options) {
+    return to_hex(key.hi) + to_hex(key.lo) + "-k" + std::to_string(options.k) +
+           "-h" + std::to_string(static_cast<uint32_t>(options.hash_mode)) +
+           "-w" + std::to_string(options.winnow_window) + "-" + normalization_profile_name(options.normalization) +
+           "-n" + std::to_string(NORMALIZATION_VERSION) + ".fp";
+}
+
+bool FingerprintCache::load_entry(const std::string& path, const ContentHash& key, const FingerprintOptions& options,
+                                  Fingerprint& result) {
+    std::unique_ptr<InputSource> source;
+    try {
+        source.reset(new InputSource(path));
+    } catch (const std::runtime_error&) {
+        return false;  // 缓存文件不存在
+    }
+    ByteSpan bytes = source->bytes();
+    if (bytes.size < FINGERPRINT_CACHE_HEADER_SIZE ||
+        std::memcmp(bytes.data, FINGERPRINT_CACHE_MAGIC, sizeof(FINGERPRINT_CACHE_MAGIC)) != 0) {
+        return false;
+    }
+    uint32_t header[6];
+    uint64_t stored_key[2], count;
+    std::memcpy(header, bytes.data + 8, sizeof(header));
+    std::memcpy(stored_key, bytes.data + 32, sizeof(stored_key));
+    std::memcpy(&count, bytes.data + 48, sizeof(count));
+    if (header[0] != FINGERPRINT_CACHE_VERSION || header[1] != options.k ||
+        header[2] != static_cast<uint32_t>(options.hash_mode) || header[3] != options.winnow_window ||
+        header[4] != static_cast<uint32_t>(options.normalization) || header[5] != NORMALIZATION_VERSION ||
+        stored_key[0] != key.lo || stored_key[1] != key.hi ||
+        count != (bytes.size - FINGERPRINT_CACHE_HEADER_SIZE) / sizeof(uint64_t) ||
+        (bytes.size - FINGERPRINT_CACHE_HEADER_SIZE) % sizeof(uint64_t) != 0) {
+        return false;
+    }
+    const uint64_t* hashes = reinterpret_cast<const uint64_t*>(bytes.data + FINGERPRINT_CACHE_HEADER_SIZE);
+    result = Fingerprint(std::move(source), hashes, static_cast<size_t>(count));
+    return true;
+}
+
+bool FingerprintCache::store_entry(const std::string& name, const ContentHash& key,
+                                   const FingerprintOptions& options, const std::vector<uint64_t>& hashes) {
+    std::string path = dir + "/" + name;
+    std::string temp_path;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // 计数器区分本进程内的线程，时钟区分同时写同一目录的多个进程
+        temp_path = path + ".tmp" + std::to_string(temp_counter++) + "-" +
+                    std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+    }
+    {
+        std::ofstream out(temp_path, std::ios::binary);
+        if (!out.is_open()) return false;
+        out.write(FINGERPRINT_CACHE_MAGIC, sizeof(FINGERPRINT_CACHE_MAGIC));
+        write_pod(out, FINGERPRINT_CACHE_VERSION);
+        write_fingerprint_options(out, options);
+        write_pod(out, NORMALIZATION_VERSION);
+        write_pod(out, key.lo);
+        write_pod(out, key.hi);
+        write_pod(out, static_cast<uint64_t>(hashes.size()));
+        write_pod_array(out, hashes);
+        if (!out) {
+            out.close();
+            std::remove(temp_path.c_str());
+            return false;
+        }
+    }
+#ifdef _WIN32
+    std::remove(path.c_str());  // Windows下rename不会覆盖已有文件
+#endif
+    if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        std::remove(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+void FingerprintCache::touch_locked(const std::string& name, uint64_t size) {
+    Entry& entry = entries[name];
+    total_bytes += size - entry.size;
+    entry.size = size;
+    entry.last_used = ++clock;
+}
+
+void FingerprintCache::evict_locked(const std::string& keep) {
+    if (total_bytes <= max_bytes) return;
+    std::vector<std::pair<uint64_t, std::string>> order;
+    for (const auto& item : entries) {
+        if (item.first != keep) order.emplace_back(item.second.last_used, item.first);
+    }
+    std::sort(order.begin(), order.end());
+    for (const auto& victim : order) {
+        if (total_bytes <= max_bytes) break;
+        std::remove((dir + "/" + victim.second).c_str());  // 文件可能正被映射，POSIX下仍可删除
+        total_bytes -= entries[victim.second].size;
+        entries.erase(victim.second);
+        counters.evictions++;
+    }
+}
+
+// 是否为entry_name生成的条目名 <32位十六进制>-k<n>-h<n>-w<n>-<归一化配置>-n<n>.fp
+// 索引文件可能被改坏或改写，其他名字一律不认，以免淘汰时删除缓存目录之外的文件（如 "../x"）
+static bool is_cache_entry_name(const std::string& name) {
+    size_t pos = 0;
+    while (pos < name.size() && ((name[pos] >= '0' && name[pos] <= '9') || (name[pos] >= 'a' && name[pos] <= 'f'))) pos++;
+    if (pos != 32) return false;
+    auto number_field = [&name, &pos](const char* tag) {
+        if (name.compare(pos, 2, tag) != 0) return false;
+        size_t start = pos += 2;
+        while (pos < name.size() && name[pos] >= '0' && name[pos] <= '9') pos++;
+        return pos > start;
+    };
+    if (!number_field("-k") || !number_field("-h") || !number_field("-w")) return false;
+
+    // 归一化配置名只含小写字母和连字符，其后是 -n<版本>.fp
+    size_t version = name.rfind("-n");
+    if (version == std::string::npos || version <= pos + 1 || name[pos] != '-') return false;
+    for (size_t i = pos + 1; i < version; ++i) {
+        if (!((name[i] >= 'a' && name[i] <= 'z') || name[i] == '-')) return false;
+    }
+    pos = version;
+    return number_field("-n") && name.compare(pos, std::string::npos, ".fp") == 0;
+}
+
+void FingerprintCache::load_index() {
+    std::ifstream file(index_path());
+    std::string line;
+    if (!std::getline(file, line) || line != "PDFPIDX1") return;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        std::string name;
+        Entry entry;
+        if (!(fields >> name >> entry.size >> entry.last_used) || !is_cache_entry_name(name)) continue;
+        total_bytes += entry.size;
+        clock = std::max(clock, entry.last_used);
+        entries[name] = entry;
+    }
+}
+
+FingerprintCache::FingerprintCache(const std::string& directory, uint64_t max_bytes)
+    : dir(directory), max_bytes(max_bytes) {
+#ifdef _WIN32
+    _mkdir(dir.c_str());
+#else
+    mkdir(dir.c_str(), 0755);
+#endif
+    load_index();
+    std::lock_guard<std::mutex> lock(mutex);
+    evict_locked("");
+}
+
+FingerprintCache::~FingerprintCache() {
+    try {
+        save_index();
+    } catch (...) {
+        // 析构时不抛出异常，索引丢失只会让旧条目不再参与淘汰
+    }
+}
+
+Fingerprint FingerprintCache::fingerprint(const std::string& path, const FingerprintOptions& options) {
+    if (path == "-") return Fingerprint(fingerprint_file(path, options));
+
+    InputSource input(path);
+    ContentHash key = content_hash(input.bytes());
+    std::string name = entry_name(key, options);
+
+    Fingerprint cached;
+    if (load_entry(dir + "/" + name, key, options, cached)) {
+        std::lock_guard<std::mutex> lock(mutex);
+        counters.hits++;
+        touch_locked(name, FINGERPRINT_CACHE_HEADER_SIZE + cached.size() * sizeof(uint64_t));
+        return cached;
+    }
+
+    std::vector<uint64_t> hashes = fingerprint_bytes(input.bytes(), options);
+    bool stored = store_entry(name, key, options, hashes);
+    std::lock_guard<std::mutex> lock(mutex);
+    counters.misses++;
+    if (stored) {
+        touch_locked(name, FINGERPRINT_CACHE_HEADER_SIZE + hashes.size() * sizeof(uint64_t));
+        evict_locked(name);
+    }
+    return Fingerprint(std::move(hashes));
+}
+
+FingerprintCacheStats FingerprintCache::stats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    FingerprintCacheStats result = counters;
+    result.bytes_in_use = total_bytes;
+    return result;
+}
+
+void FingerprintCache::save_index() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string temp_path = index_path() + ".tmp";
+    {
+        std::ofstream out(temp_path, std::ios::binary);
+        if (!out.is_open()) return;
+        out << "PDFPIDX1\n";
+        for (const auto& item : entries) {
+            out << item.first << ' ' << item.second.size << ' ' << item.second.last_used << '\n';
+        }
+    }
+#ifdef _WIN32
+    std::remove(index_path().c_str());
+#endif
+    std::rename(temp_path.c_str(), index_path().c_str());
+}
+
+// ==================== 压缩指纹（Elias–Fano） ====================
+
+const char COMPRESSED_FINGERPRINT_MAGIC[8] = {'P', 'D', 'F', 'Z', '1', 0, 0, 0};
+
+const uint32_t COMPRESSED_FINGERPRINT_VERSION = 1;
+
+// 把value写入位数组的 [offset, offset + width) 位（width < 64，目标位原为0）
+static void write_bits(std::vector<uint64_t>& words, uint64_t offset, uint32_t width, uint64_t value) {
+    if (width == 0) return;
+    size_t word = static_cast<size_t>(offset / 64);
+    unsigned shift = static_cast<unsigned>(offset % 64);
+    words[word] |= value << shift;
+    if (shift + width > 64) words[word + 1] |= value >> (64 - shift);
+}
+
+CompressedFingerprint compress_fingerprint(const std::vector<uint64_t>& hashes, const FingerprintOptions& options,
+                                           uint32_t hash_bits) {
+    if (hash_bits == 0 || hash_bits > 64) {
+        throw std::runtime_error("Hash bits must be between 1 and 64");
+    }
+    CompressedFingerprint fingerprint;
+    fingerprint.options = options;
+    fingerprint.hash_bits = hash_bits;
+
+    // 右移保持有序，截断后相同的值只会相邻
+    std::vector<uint64_t> truncated;
+    const std::vector<uint64_t>* values = &hashes;
+    if (hash_bits < 64) {
+        truncated.reserve(hashes.size());
+        for (uint64_t hash : hashes) {
+            uint64_t value = hash >> (64 - hash_bits);
+            if (truncated.empty() || truncated.back() != value) truncated.push_back(value);
+        }
+        values = &truncated;
+    }
+    uint64_t n = values->size();
+    fingerprint.count = n;
+    fingerprint.low.assign(1, 0);  // 空集合也保留末尾的0字，与保存、加载时的长度一致
+    if (n == 0) return fingerprint;
+
+    // l = floor(log2(2^b / n))，此时高位桶数不超过2n；最多取63位，移位不越界
+    uint32_t log2_n = 0;
+    while (log2_n < 64 && (uint64_t(1) << log2_n) < n) ++log2_n;
+    fingerprint.low_bits = std::min<uint32_t>(hash_bits > log2_n ? hash_bits - log2_n : 0, 63);
+    const uint32_t l = fingerprint.low_bits;
+    fingerprint.high_bit_count = n + (values->back() >> l);
+    fingerprint.low.assign(static_cast<size_t>((n * l + 63) / 64 + 1), 0);
+    fingerprint.high.assign(static_cast<size_t>((fingerprint.high_bit_count + 63) / 64), 0);
+    const uint64_t mask = (uint64_t(1) << l) - 1;
+    for (uint64_t i = 0; i < n; ++i) {
+        uint64_t value = (*values)[static_cast<size_t>(i)];
+        write_bits(fingerprint.low, i * l, l, value & mask);
+        uint64_t position = (value >> l) + i;
+        fingerprint.high[static_cast<size_t>(position / 64)] |= uint64_t(1) << (position % 64);
+    }
+    return fingerprint;
+}
+
+std::vector<uint64_t> CompressedFingerprint::decode() const {
+    std::vector<uint64_t> values;
+    values.reserve(static_cast<size_t>(count));
+    for (EliasFanoReader reader(*this); reader.valid(); reader.next()) {
+        values.push_back(reader.value());
+    }
+    return values;
+}
+
+// 低位为0位时低位数组只有末尾的一个0字，而解码总是读取相邻两字，改为指向这两个0字
+static const uint64_t EMPTY_LOW_WORDS[2] = {0, 0};
+
+EliasFanoReader::EliasFanoReader(const CompressedFingerprint& fingerprint)
+    : low(fingerprint.low_bits == 0 ? EMPTY_LOW_WORDS : fingerprint.low.data()), high(fingerprint.high.data()), high_words(fingerprint.high.size()),
+      count(fingerprint.count), low_bits(fingerprint.low_bits), low_mask((uint64_t(1) << fingerprint.low_bits) - 1) {
+    seek_high(0);
+}
+
+void EliasFanoReader::decode_current() {
+    uint64_t position = static_cast<uint64_t>(word) * 64 + trailing_zeros64(bits);
+    // 低位可能跨两个字：无分支地拼接相邻两字（低位数组末尾的0字保证不越界）
+    uint64_t offset = index * low_bits;
+    size_t w = static_cast<size_t>(offset / 64);
+    unsigned shift = static_cast<unsigned>(offset % 64);
+    uint64_t value = (low[w] >> shift) | ((low[w + 1] << 1) << (63 - shift));
+    current = ((position - index) << low_bits) | (value & low_mask);
+}
+
+void EliasFanoReader::seek_high(uint64_t from) {
+    if (index >= count) return;
+    word = static_cast<size_t>(from / 64);
+    if (word >= high_words) {
+        index = count;
+        return;
+    }
+    bits = high[word] & (~uint64_t(0) << (from % 64));
+    while (bits == 0) {
+        if (++word == high_words) {
+            index = count;
+            return;
+        }
+        bits = high[word];
+    }
+    decode_current();
+}
+
+void EliasFanoReader::next() {
+    if (++index >= count) return;
+    bits &= bits - 1;
+    while (bits == 0) bits = high[++word];  // 高位位向量恰好有count个1，不会越界
+    decode_current();
+}
+
+size_t EliasFanoReader::read(uint64_t* out, size_t max) {
+    // 与逐个next相同，但状态放在局部变量里，低位偏移逐个累加
+    if (max == 0 || index >= count) return 0;
+    out[0] = current;
+    size_t n = 1;
+    uint64_t i = index, b = bits, offset = index * low_bits;
+    size_t w = word;
+    while (n < max && ++i < count) {
+        b &= b - 1;
+        while (b == 0) b = high[++w];
+        offset += low_bits;
+        size_t lw = static_cast<size_t>(offset / 64);
+        unsigned shift = static_cast<unsigned>(offset % 64);
+        uint64_t value = (low[lw] >> shift) | ((low[lw + 1] << 1) << (63 - shift));
+        out[n++] = ((static_cast<uint64_t>(w) * 64 + trailing_zeros64(b) - i) << low_bits) | (value & low_mask);
+    }
+    index = i;
+    word = w;
+    bits = b;
+    if (n == max) next();  // 读满时当前元素已输出，前进到下一个
+    return n;
+}
+
+void EliasFanoReader::skip_to(uint64_t target) {
+    if (!valid() || current >= target) return;
+    uint64_t position = static_cast<uint64_t>(word) * 64 + trailing_zeros64(bits);
+    uint64_t bucket = target >> low_bits;
+    uint64_t current_bucket = position - index;  // 当前元素之前的0的个数
+    if (bucket > current_bucket + 8) {  // 平均每桶不到两个元素，近处的目标逐个前进更快
+        // 越过 bucket - current_bucket 个0，期间经过的1都是被跳过的元素
+        uint64_t zeros = bucket - current_bucket;
+        uint64_t from = position + 1;
+        uint64_t skipped = 1;  // 当前元素
+        for (;;) {
+            size_t w = static_cast<size_t>(from / 64);
+            if (w >= high_words) {
+                index = count;
+                return;
+            }
+            unsigned shift = static_cast<unsigned>(from % 64);
+            uint64_t rest = high[w] >> shift;
+            unsigned width = 64 - shift;
+            uint64_t zero_bits = ~rest & (width == 64 ? ~uint64_t(0) : (uint64_t(1) << width) - 1);
+            unsigned zero_count = popcount64(zero_bits);
+            if (zero_count < zeros) {
+                zeros -= zero_count;
+                skipped += width - zero_count;
+                from += width;
+                continue;
+            }
+            for (uint64_t z = 1; z < zeros; ++z) zero_bits &= zero_bits - 1;  // 去掉之前的0
+            unsigned offset = trailing_zeros64(zero_bits);
+            skipped += popcount64(rest & ((uint64_t(1) << offset) - 1));
+            index += skipped;
+            seek_high(from + offset + 1);
+            break;
+        }
+    }
+    while (valid() && current < target) next();
+}
+
+// 两个压缩指纹的参数必须相同，截断位数不同的哈希无法比较
+static void check_comparable(const CompressedFingerprint& a, const CompressedFingerprint& b) {
+    if (a.hash_bits != b.hash_bits || a.options.k != b.options.k || a.options.hash_mode != b.options.hash_mode ||
+        a.options.winnow_window != b.options.winnow_window || a.options.normalization != b.options.normalization ||
+        a.normalization_version != b.normalization_version) {
+        throw std::runtime_error("Compressed fingerprints were built with different parameters");
+    }
+}
+
+size_t intersection_count_compressed(const CompressedFingerprint& a, const CompressedFingerprint& b) {
+    check_comparable(a, b);
+    StageTimer timer(Stage::Intersect);
+    PD_COUNT(comparisons, 1);
+    size_t count = 0;
+    if (a.count / 16 > b.count || b.count / 16 > a.count) {
+        // 大小悬殊：逐个取小的一侧，大的一侧只跳转，不解码中间的元素
+        EliasFanoReader small(a.count < b.count ? a : b), large(a.count < b.count ? b : a);
+        for (; small.valid() && large.valid(); small.next()) {
+            large.skip_to(small.value());
+            count += (large.valid() && large.value() == small.value());
+        }
+        return count;
+    }
+
+    const size_t BLOCK = 64;
+    uint64_t block_a[BLOCK], block_b[BLOCK];
+    EliasFanoReader x(a), y(b);
+    size_t na = 0, nb = 0, i = 0, j = 0;
+    for (;;) {
+        if (i == na) {
+            if (j < nb) x.skip_to(block_b[j]);
+            na = x.read(block_a, BLOCK);
+            i = 0;
+            if (na == 0) break;
+        }
+        if (j == nb) {
+            y.skip_to(block_a[i]);
+            nb = y.read(block_b, BLOCK);
+            j = 0;
+            if (nb == 0) break;
+        }
+        while (i < na && j < nb) {
+            uint64_t u = block_a[i], v = block_b[j];
+            count += (u == v);
+            i += (u <= v);
+            j += (v <= u);
+        }
+    }
+    return count;
+}
+
+double jaccard_similarity_compressed(const CompressedFingerprint& a, const CompressedFingerprint& b) {
+    if (a.count == 0 && b.count == 0) {
+        check_comparable(a, b);
+        return 0.0;  // 两个空集合
+    }
+
+    size_t intersection = intersection_count_compressed(a, b);
+    uint64_t union_size = a.count + b.count - intersection;
+    return static_cast<double>(intersection) / static_cast<double>(union_size);
+}
+
+void save_compressed_fingerprint(const CompressedFingerprint& fingerprint, const std::string& path) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open()) {
+        throw std::runtime_error("Failed to open fingerprint file for writing: " + path);
+    }
+
+    out.write(COMPRESSED_FINGERPRINT_MAGIC, sizeof(COMPRESSED_FINGERPRINT_MAGIC));
+    write_pod(out, COMPRESSED_FINGERPRINT_VERSION);
+    write_fingerprint_options(out, fingerprint.options);
+    write_pod(out, fingerprint.normalization_version);
+    write_pod(out, fingerprint.hash_bits);
+    write_pod(out, fingerprint.low_bits);
+    write_pod(out, fingerprint.count);
+    write_pod(out, fingerprint.high_bit_count);
+    write_pod_array(out, fingerprint.low);
+    write_pod_array(out, fingerprint.high);
+
+    if (!out) {
+        throw std::runtime_error("Failed to write fingerprint file: " + path);
+    }
+}
+
+CompressedFingerprint load_compressed_fingerprint(const std::string& path) {
+    std::vector<unsigned char> bytes = read_file_to_bytes(path);
+    ByteReader reader(bytes);
+
+    char magic[sizeof(COMPRESSED_FINGERPRINT_MAGIC)];
+    reader.read_raw(magic, sizeof(magic));
+    if (std::memcmp(magic, COMPRESSED_FINGERPRINT_MAGIC, sizeof(magic)) != 0) {
+        throw std::runtime_error("Not a compressed fingerprint file: " + path);
+    }
+    if (reader.read<uint32_t>() != COMPRESSED_FINGERPRINT_VERSION) {
+        throw std::runtime_error("Unsupported compressed fingerprint version: " + path);
+    }
+
+    CompressedFingerprint fingerprint;
+    fingerprint.options = read_fingerprint_options(reader, path);
+    fingerprint.normalization_version = reader.read<uint32_t>();
+    fingerprint.hash_bits = reader.read<uint32_t>();
+    fingerprint.low_bits = reader.read<uint32_t>();
+    fingerprint.count = reader.read<uint64_t>();
+    fingerprint.high_bit_count = reader.read<uint64_t>();
+
+    // 每个元素在高位位向量中至少占一位，先用文件大小约束元素数，再计算各段长度
+    const uint32_t l = fingerprint.low_bits;
+    const uint64_t n = fingerprint.count;
+    if (fingerprint.hash_bits == 0 || fingerprint.hash_bits > 64 || l > 63 || l > fingerprint.hash_bits ||
+        fingerprint.high_bit_count < n || fingerprint.high_bit_count > static_cast<uint64_t>(bytes.size()) * 8) {
+        throw std::runtime_error("Corrupted compressed fingerprint: " + path);
+    }
+    reader.read_array(fingerprint.low, static_cast<size_t>((n * l + 63) / 64 + 1));
+    reader.read_array(fingerprint.high, static_cast<size_t>((fingerprint.high_bit_count + 63) / 64));
+    if (!reader.at_end()) {
+        throw std::runtime_error("Corrupted compressed fingerprint: " + path);
+    }
+
+    // 高位位向量恰好有count个1，且有效长度之后全为0，读取器因此不会越界
+    uint64_t ones = 0;
+    for (uint64_t word : fingerprint.high) ones += popcount64(word);
+    uint64_t tail = fingerprint.high_bit_count % 64;
+    if (ones != n || (tail != 0 && (fingerprint.high.back() >> tail) != 0) || fingerprint.low.back() != 0) {
+        throw std::runtime_error("Corrupted compressed fingerprint: " + path);
+    }
+    return fingerprint;
+}
+
+// ==================== 批量模式（多线程） ====================
+
+bool WorkStealingScheduler::next_task(WorkRange* ranges, size_t workers, size_t self, size_t& index) {
+    {
+        std::lock_guard<std::mutex> lock(ranges[self].mutex);
+        if (ranges[self].begin < ranges[self].end) {
+            index = ranges[self].begin++;
+            return true;
+        }
+    }
+    for (size_t step = 1; step < workers; ++step) {
+        WorkRange& victim = ranges[(self + step) % workers];
+        size_t begin, end;
+        {
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.begin >= victim.end) continue;
+            begin = victim.begin + (victim.end - victim.begin) / 2;
+            end = victim.end;
+            victim.end = begin;
+        }
+        std::lock_guard<std::mutex> lock(ranges[self].mutex);
+        index = begin;
+        ranges[self].begin = begin + 1;
+        ranges[self].end = end;
+        return true;
+    }
+    return false;
+}
+
+// 当前线程正在执行的调度器，用于发现任务中对同一调度器的嵌套调用
+static thread_local const WorkStealingScheduler* active_scheduler = nullptr;
+
+WorkStealingScheduler::~WorkStealingScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& thread : pool) {
+        thread.join();
+    }
+}
+
+void WorkStealingScheduler::worker_loop(size_t self, uint64_t seen) {
+    active_scheduler = this;
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        wake.wait(lock, [&]() { return stopping || generation != seen; });
+        if (stopping) return;
+        seen = generation;
+        if (self >= job_workers) continue;  // 本次调用的任务数少于线程数，不参与
+        const std::function<void(size_t)>& body = *job;
+        lock.unlock();
+        body(self);
+        lock.lock();
+        if (--busy == 0) done.notify_one();
+    }
+}
+
+void WorkStealingScheduler::run_workers(size_t workers, const std::function<void(size_t)>& body) {
+    if (active_scheduler == this) {
+        throw std::runtime_error("A scheduler task cannot start another parallel loop on the same scheduler");
+    }
+    std::lock_guard<std::mutex> dispatch(dispatch_mutex);
+    if (workers > 1) {
+        std::lock_guard<std::mutex> lock(mutex);
+        while (pool.size() + 1 < workers) {
+            pool.emplace_back(&WorkStealingScheduler::worker_loop, this, pool.size() + 1, generation);
+        }
+        job = &body;
+        job_workers = workers;
+        busy = workers - 1;
+        generation++;
+    }
+    wake.notify_all();
+
+    active_scheduler = this;
+    body(0);
+    active_scheduler = nullptr;
+
+    if (workers > 1) {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this]() { return busy == 0; });
+        job = nullptr;
+    }
+}
+
+size_t default_thread_count() {
+    unsigned n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : n;
+}
+
+std::vector<std::pair<std::string, std::string>> read_pair_manifest(const std::string& manifest_path) {
+    std::ifstream file(manifest_path);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open manifest: " + manifest_path);
+    }
+
+    std::vector<std::pair<std::string, std::string>> pairs;
+    std::string line;
+    size_t line_number = 0;
+    while (std::getline(file, line)) {
+        line_number++;
+        if (!line.empty() && line.back() == '\r') line.pop_back();  // 兼容Windows换行
+        if (line.empty()) continue;
+
+        size_t tab = line.find('\t');
+        if (tab == 0 || tab == std::string::npos || tab + 1 == line.size()) {
+            throw std::runtime_error("Invalid manifest line " + std::to_string(line_number) +
+                                     ": expected <orig_file>\\t<plagiarized_file>");
+        }
+        std::string first = line.substr(0, tab), second = line.substr(tab + 1);
+        // 清单中的各行由多个线程并发读取，标准输入只能被读一次
+        if (first == "-" || second == "-") {
+            throw std::runtime_error("Invalid manifest line " + std::to_string(line_number) +
+                                     ": standard input (\"-\") cannot be used in a manifest");
+        }
+        pairs.emplace_back(std::move(first), std::move(second));
+    }
+    return pairs;
+}
+
+BatchResult score_batch(const std::vector<std::pair<std::string, std::string>>& pairs,
+                        const FingerprintOptions& options, WorkStealingScheduler& scheduler,
+                        FingerprintCache* cache) {
+    for (const auto& pair : pairs) {
+        if (pair.first == "-" || pair.second == "-") {
+            throw std::runtime_error("Batch scoring cannot read standard input (\"-\")");
+        }
+    }
+
+    std::vector<FingerprintWorkspace> workspaces;
+    workspaces.reserve(scheduler.threads());
+    for (size_t w = 0; w < scheduler.threads(); ++w) {
+        workspaces.emplace_back(options);
+    }
+
+    std::vector<std::string> originals;
+    std::vector<size_t> original_of(pairs.size());
+    std::unordered_map<std::string, size_t> original_ids;
+    for (size_t p = 0; p < pairs.size(); ++p) {
+        auto inserted = original_ids.emplace(pairs[p].first, originals.size());
+        if (inserted.second) originals.push_back(pairs[p].first);
+        original_of[p] = inserted.first->second;
+    }
+
+    std::vector<Fingerprint> original_sets(originals.size());
+    std::vector<std::string> original_errors(originals.size());
+    scheduler.parallel_for_workers(originals.size(), [&](size_t o, size_t worker) {
+        try {
+            if (cache) {
+                original_sets[o] = cache->fingerprint(originals[o], options);
+            } else {
+                // 原文指纹在整个批次中共享，从工作区复制出一份独立保存
+                const std::vector<uint64_t>& set = workspaces[worker].fingerprint_file(originals[o]);
+                original_sets[o] = Fingerprint(std::vector<uint64_t>(set));
+            }
+        } catch (const std::exception& e) {
+            original_errors[o] = e.what();
+        }
+    });
+
+    BatchResult result;
+    result.scores.assign(pairs.size(), 0.0);
+    result.errors.assign(pairs.size(), std::string());
+    result.distinct_originals = originals.size();
+    scheduler.parallel_for_workers(pairs.size(), [&](size_t p, size_t worker) {
+        size_t o = original_of[p];
+        if (!original_errors[o].empty()) {
+            result.errors[p] = original_errors[o];
+            return;
+        }
+        try {
+            const Fingerprint& original = original_sets[o];
+            if (cache) {
+                result.scores[p] = jaccard_similarity_sorted(original, cache->fingerprint(pairs[p].second, options));
+            } else {
+                const std::vector<uint64_t>& suspect = workspaces[worker].fingerprint_file(pairs[p].second);
+                result.scores[p] =
+                    jaccard_similarity_sorted(original.data(), original.size(), suspect.data(), suspect.size());
+            }
+        } catch (const std::exception& e) {
+            result.errors[p] = e.what();
+        }
+    });
+    return result;
+}
+
+// ==================== 单文档并行指纹 ====================
+
+size_t utf8_sync_point(ByteSpan bytes, size_t pos) {
+    while (pos < bytes.size && (bytes.data[pos] & 0xC0) == 0x80) pos++;
+    return pos;
+}
+
+std::vector<size_t> split_utf8_segments(ByteSpan bytes, size_t parts, size_t min_segment) {
+    parts = std::max<size_t>(1, std::min(parts, bytes.size / std::max<size_t>(min_segment, 1)));
+    std::vector<size_t> starts(1, 0);
+    for (size_t i = 1; i < parts; ++i) {
+        size_t pos = utf8_sync_point(bytes, bytes.size / parts * i);
+        if (pos > starts.back() && pos + UTF8_TAIL_GUARD <= bytes.size) starts.push_back(pos);
+    }
+    return starts;
+}
+
+// 值域分片的位数：分片数取线程数的4倍左右，便于工作窃取均衡负载
+static unsigned shard_bits(size_t threads) {
+    unsigned bits = 0;
+    while ((size_t(1) << bits) < threads * 4 && bits < 10) bits++;
+    return bits;
+}
+
+// 有序集合中第一个落在分片shard（哈希最高bits位等于shard）及其后分片的位置
+static size_t shard_lower(const uint64_t* data, size_t n, size_t shard, unsigned bits) {
+    if (shard == 0) return 0;
+    if (shard >> bits) return n;
+    return static_cast<size_t>(std::lower_bound(data, data + n, static_cast<uint64_t>(shard) << (64 - bits)) - data);
+}
+
+std::vector<uint64_t> parallel_union(const std::vector<std::vector<uint64_t>>& sets, WorkStealingScheduler& scheduler) {
+    if (sets.empty()) return std::vector<uint64_t>();
+    if (sets.size() == 1) return sets[0];
+
+    unsigned bits = scheduler.threads() > 1 ? shard_bits(scheduler.threads()) : 0;
+    size_t shards = size_t(1) << bits;
+    std::vector<std::vector<uint64_t>> parts(shards);
+    scheduler.parallel_for(shards, [&](size_t s) {
+        // 各集合在本分片中的区间都已有序，两两归并，共需 log2(集合数) 轮
+        std::vector<std::vector<uint64_t>> runs;
+        for (const std::vector<uint64_t>& set : sets) {
+            size_t begin = shard_lower(set.data(), set.size(), s, bits);
+            size_t end = shard_lower(set.data(), set.size(), s + 1, bits);
+            if (begin < end) runs.emplace_back(set.begin() + static_cast<std::ptrdiff_t>(begin),
+                                               set.begin() + static_cast<std::ptrdiff_t>(end));
+        }
+        while (runs.size() > 1) {
+            std::vector<std::vector<uint64_t>> next;
+            for (size_t i = 0; i + 1 < runs.size(); i += 2) {
+                std::vector<uint64_t> merged(runs[i].size() + runs[i + 1].size());
+                merged.erase(std::set_union(runs[i].begin(), runs[i].end(), runs[i + 1].begin(), runs[i + 1].end(),
+                                            merged.begin()),
+                             merged.end());
+                next.push_back(std::move(merged));
+            }
+            if (runs.size() % 2 == 1) next.push_back(std::move(runs.back()));
+            runs.swap(next);
+        }
+        if (!runs.empty()) parts[s].swap(runs[0]);
+    });
+
+    // 各分片的值域互不相交且按顺序排列，直接拼接即为有序去重的并集
+    std::vector<size_t> offsets(shards + 1, 0);
+    for (size_t s = 0; s < shards; ++s) offsets[s + 1] = offsets[s] + parts[s].size();
+    std::vector<uint64_t> result(offsets[shards]);
+    scheduler.parallel_for(shards, [&](size_t s) {
+        std::copy(parts[s].begin(), parts[s].end(), result.begin() + static_cast<std::ptrdiff_t>(offsets[s]));
+        std::vector<uint64_t>().swap(parts[s]);
+    });
+    return result;
+}
+
+size_t intersection_count_parallel(const uint64_t* a, size_t na, const uint64_t* b, size_t nb,
+                                   WorkStealingScheduler& scheduler) {
+    if (scheduler.threads() == 1) return intersection_count_sorted(a, na, b, nb);
+
+    unsigned bits = shard_bits(scheduler.threads());
+    size_t shards = size_t(1) << bits;
+    std::vector<size_t> counts(shards, 0);
+    scheduler.parallel_for(shards, [&](size_t s) {
+        size_t a_begin = shard_lower(a, na, s, bits), a_end = shard_lower(a, na, s + 1, bits);
+        size_t b_begin = shard_lower(b, nb, s, bits), b_end = shard_lower(b, nb, s + 1, bits);
+        counts[s] = intersection_count_sorted(a + a_begin, a_end - a_begin, b + b_begin, b_end - b_begin);
+    });
+    size_t total = 0;
+    for (size_t count : counts) total += count;
+    return total;
+}
+
+SimilarityMetrics similarity_metrics_parallel(const uint64_t* a, size_t na, const uint64_t* b, size_t nb,
+                                              WorkStealingScheduler& scheduler) {
+    size_t intersection = intersection_count_parallel(a, na, b, nb, scheduler);
+    return metrics_from_counts(intersection, na, nb, intersection, na, nb);
+}
+
+// 计算文档中 [begin, end) 一段的局部指纹集合
+// 段尾之后继续读入，直到多得到 k-1+w 个码点：起点在本段的k-gram和窗口因此都完整，
+// 第一段若没有读到文档末尾，说明文档至少有w个k-gram，串行路径在末尾也不会按短文本规则选取
+static std::vector<uint64_t> fingerprint_segment(ByteSpan bytes, size_t begin, size_t end, bool first,
+                                                 const FingerprintOptions& options) {
+    StreamingFingerprinter fingerprinter(options);
+    for (size_t offset = begin; offset < end; offset += STREAM_CHUNK_SIZE) {
+        fingerprinter.feed(bytes.data + offset, std::min(STREAM_CHUNK_SIZE, end - offset));
+    }
+
+    const size_t overrun_step = 256;  // 越过段尾时每次读入的字节数，多读的部分只产生重复哈希
+    uint64_t target = fingerprinter.codepoints_fed() + (options.k > 0 ? options.k - 1 : 0) + options.winnow_window;
+    size_t pos = end;
+    // 至少越过段尾一次：段尾被截断的序列（其中可能夹着ASCII字节）要看到真实的后续字节，才能按串行的方式解码
+    while (pos < bytes.size && (pos == end || fingerprinter.codepoints_fed() < target)) {
+        size_t n = std::min(overrun_step, bytes.size - pos);
+        fingerprinter.feed(bytes.data + pos, n);
+        pos += n;
+    }
+    return fingerprinter.finish_in_place(first && pos == bytes.size);
+}
+
+std::vector<std::vector<uint64_t>> fingerprint_documents_parallel(const std::vector<ByteSpan>& documents,
+                                                                  const FingerprintOptions& options,
+                                                                  WorkStealingScheduler& scheduler,
+                                                                  size_t min_segment) {
+    struct Segment {
+        size_t doc;
+        size_t begin;
+        size_t end;
+    };
+    std::vector<Segment> segments;
+    std::vector<size_t> first_segment(documents.size() + 1, 0);
+    for (size_t d = 0; d < documents.size(); ++d) {
+        first_segment[d] = segments.size();
+        std::vector<size_t> starts = split_utf8_segments(documents[d], scheduler.threads(), min_segment);
+        for (size_t i = 0; i < starts.size(); ++i) {
+            size_t end = i + 1 < starts.size() ? starts[i + 1] : documents[d].size;
+            segments.push_back(Segment{d, starts[i], end});
+        }
+    }
+    first_segment[documents.size()] = segments.size();
+
+    // 所有文档的所有段一起调度，多篇文档同时处理
+    std::vector<std::vector<uint64_t>> partial(segments.size());
+    scheduler.parallel_for(segments.size(), [&](size_t s) {
+        const Segment& segment = segments[s];
+        partial[s] = fingerprint_segment(documents[segment.doc], segment.begin, segment.end,
+                                         s == first_segment[segment.doc], options);
+    });
+
+    std::vector<std::vector<uint64_t>> results(documents.size());
+    for (size_t d = 0; d < documents.size(); ++d) {
+        size_t begin = first_segment[d], end = first_segment[d + 1];
+        if (end - begin == 1) {
+            results[d] = std::move(partial[begin]);
+            continue;
+        }
+        std::vector<std::vector<uint64_t>> sets(std::make_move_iterator(partial.begin() + static_cast<std::ptrdiff_t>(begin)),
+                                                std::make_move_iterator(partial.begin() + static_cast<std::ptrdiff_t>(end)));
+        results[d] = parallel_union(sets, scheduler);
+    }
+    return results;
+}
+
+std::vector<std::vector<uint64_t>> fingerprint_files_parallel(const std::vector<std::string>& paths,
+                                                              const FingerprintOptions& options,
+                                                              WorkStealingScheduler& scheduler) {
+    std::vector<std::unique_ptr<InputSource>> inputs;
+    std::vector<ByteSpan> documents;
+    std::vector<size_t> document_of(paths.size(), SIZE_MAX);
+    for (size_t p = 0; p < paths.size(); ++p) {
+        if (paths[p] == "-") continue;
+        inputs.emplace_back(new InputSource(paths[p]));
+        document_of[p] = documents.size();
+        documents.push_back(inputs.back()->bytes());
+    }
+
+    std::vector<std::vector<uint64_t>> sets = fingerprint_documents_parallel(documents, options, scheduler);
+    std::vector<std::vector<uint64_t>> results(paths.size());
+    for (size_t p = 0; p < paths.size(); ++p) {
+        results[p] = document_of[p] == SIZE_MAX ? fingerprint_file(paths[p], options) : std::move(sets[document_of[p]]);
+    }
+    return results;
+}
+
+// ==================== 常驻评分服务（Unix域套接字） ====================
+
+static const size_t MAX_REQUEST_LINE = 64 << 10;  // 请求头一行的上限
+
+static ByteSpan string_span(const std::string& text) {
+    ByteSpan span;
+    span.data = reinterpret_cast<const unsigned char*>(text.data());
+    span.size = text.size();
+    return span;
+}
+
+// 协议字段以制表符和换行分隔，字段内不能出现这两个字符
+static void check_protocol_field(const std::string& field) {
+    if (field.find_first_of("\t\n") != std::string::npos) {
+        throw std::runtime_error("Request field contains a tab or newline: " + field);
+    }
+}
+
+// 按制表符拆分请求头
+static std::vector<std::string> split_tabs(const std::string& line) {
+    std::vector<std::string> fields;
+    size_t start = 0;
+    for (;;) {
+        size_t tab = line.find('\t', start);
+        fields.push_back(line.substr(start, tab == std::string::npos ? std::string::npos : tab - start));
+        if (tab == std::string::npos) break;
+        start = tab + 1;
+    }
+    return fields;
+}
+
+// 解析TEXT请求的字节数，只接受十进制数字
+static bool parse_text_length(const std::string& value, size_t& length) {
+    if (value.empty() || value.size() > 19) return false;
+    uint64_t n = 0;
+    for (char c : value) {
+        if (c < '0' || c > '9') return false;
+        n = n * 10 + static_cast<uint64_t>(c - '0');
+    }
+    length = static_cast<size_t>(n);
+    return true;
+}
+
+#ifndef _WIN32
+
+#ifndef MSG_NOSIGNAL
+    #define MSG_NOSIGNAL 0  // macOS没有此标志，改用套接字选项SO_NOSIGPIPE
+#endif
+
+static void set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+// 对端关闭后写入不触发SIGPIPE，改为返回错误
+static void disable_sigpipe(int fd) {
+#ifdef SO_NOSIGPIPE
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#else
+    (void)fd;
+#endif
+}
+
+static sockaddr_un unix_address(const std::string& path) {
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+        throw std::runtime_error("Invalid socket path: " + path);
+    }
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return addr;
+}
+
+#endif
+
+ScoringServer::ScoringServer(const std::vector<std::string>& reference_paths, const FingerprintOptions& options,
+                             const ScoringServerConfig& config)
+    : options(options), config(config), scheduler(config.threads), stopping(false) {
+    workspaces.reserve(scheduler.threads());
+    for (size_t w = 0; w < scheduler.threads(); ++w) {
+        workspaces.emplace_back(options);
+    }
+
+    references.resize(reference_paths.size());
+    scheduler.parallel_for_workers(reference_paths.size(), [&](size_t r, size_t worker) {
+        const std::vector<uint64_t>& set = workspaces[worker].fingerprint_file(reference_paths[r]);
+        references[r] = Fingerprint(std::vector<uint64_t>(set));
+    });
+    for (size_t r = 0; r < reference_paths.size(); ++r) {
+        reference_ids.emplace(reference_paths[r], r);
+    }
+}
+
+ScoringServer::~ScoringServer() {
+#ifndef _WIN32
+    for (auto& entry : connections) {
+        close(entry.second.fd);
+    }
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        unlink(socket_path.c_str());
+    }
+    for (int fd : wake_fds) {
+        if (fd >= 0) close(fd);
+    }
+#endif
+}
+
+void ScoringServer::listen(const std::string& path) {
+#ifdef _WIN32
+    (void)path;
+    throw std::runtime_error("The scoring server needs Unix domain sockets and is not supported on Windows");
+#else
+    sockaddr_un addr = unix_address(path);
+
+    // 上次未清理的套接字文件：没有服务在监听时才替换
+    struct stat st;
+    if (lstat(path.c_str(), &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            throw std::runtime_error("Not a socket, refusing to replace: " + path);
+        }
+        int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        bool live = probe >= 0 && connect(probe, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+        if (probe >= 0) close(probe);
+        if (live) {
+            throw std::runtime_error("Another server is already listening on " + path);
+        }
+        unlink(path.c_str());
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        throw std::runtime_error(std::string("Failed to create socket: ") + std::strerror(errno));
+    }
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(fd, SOMAXCONN) != 0) {
+        int err = errno;
+        close(fd);
+        throw std::runtime_error("Failed to listen on " + path + ": " + std::strerror(err));
+    }
+    if (wake_fds[0] < 0 && pipe(wake_fds) != 0) {
+        int err = errno;
+        close(fd);
+        unlink(path.c_str());
+        throw std::runtime_error(std::string("Failed to create pipe: ") + std::strerror(err));
+    }
+    set_nonblocking(fd);
+    set_nonblocking(wake_fds[0]);
+    set_nonblocking(wake_fds[1]);
+    listen_fd = fd;
+    socket_path = path;
+#endif
+}
+
+void ScoringServer::run() {
+#ifdef _WIN32
+    throw std::runtime_error("The scoring server needs Unix domain sockets and is not supported on Windows");
+#else
+    if (listen_fd < 0) {
+        throw std::runtime_error("ScoringServer::run() called before listen()");
+    }
+
+    typedef std::chrono::steady_clock Clock;
+    const std::chrono::microseconds window(config.batch_window_us);
+    Clock::time_point batch_start;  // 当前批次第一个请求到达的时间
+    std::vector<pollfd> fds;
+    std::vector<uint64_t> ids;
+
+    while (!stopping.load()) {
+        fds.clear();
+        ids.clear();
+        fds.push_back(pollfd{listen_fd, POLLIN, 0});
+        fds.push_back(pollfd{wake_fds[0], POLLIN, 0});
+        for (auto& entry : connections) {
+            const Connection& conn = entry.second;
+            short events = 0;
+            if (!conn.peer_closed && !conn.broken) events |= POLLIN;
+            if (!conn.output.empty()) events |= POLLOUT;
+            fds.push_back(pollfd{events != 0 ? conn.fd : -1, events, 0});  // 负数fd被poll忽略
+            ids.push_back(entry.first);
+        }
+
+        // 有待评分的请求时，最多等到批处理窗口结束
+        int timeout_ms = -1;
+        if (!pending.empty()) {
+            long long remaining =
+                std::chrono::duration_cast<std::chrono::microseconds>(batch_start + window - Clock::now()).count();
+            timeout_ms = remaining <= 0 ? 0 : static_cast<int>((remaining + 999) / 1000);
+        }
+        if (poll(fds.data(), static_cast<nfds_t>(fds.size()), timeout_ms) < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("poll failed: ") + std::strerror(errno));
+        }
+
+        if (fds[1].revents != 0) {
+            char drain[64];
+            while (read(wake_fds[0], drain, sizeof(drain)) > 0) {
+            }
+        }
+        if (fds[0].revents & POLLIN) {
+            accept_connections();
+        }
+        for (size_t i = 0; i < ids.size(); ++i) {
+            short revents = fds[i + 2].revents;
+            if (revents == 0) continue;
+            auto it = connections.find(ids[i]);
+            bool was_idle = pending.empty();
+            if ((revents & (POLLIN | POLLHUP | POLLERR)) && !read_connection(ids[i], it->second)) {
+                close_connection(ids[i]);
+                continue;
+            }
+            if (was_idle && !pending.empty()) batch_start = Clock::now();
+            if ((revents & POLLOUT) && !flush_connection(it->second)) {
+                close_connection(ids[i]);
+            }
+        }
+
+        if (!pending.empty() && (pending.size() >= scheduler.threads() || Clock::now() >= batch_start + window)) {
+            score_pending();
+        }
+
+        // 对端已关闭或协议出错、且响应都已发出的连接
+        std::vector<uint64_t> finished;
+        for (auto& entry : connections) {
+            const Connection& conn = entry.second;
+            if ((conn.peer_closed || conn.broken) && conn.in_flight == 0 && conn.output.empty()) {
+                finished.push_back(entry.first);
+            }
+        }
+        for (uint64_t id : finished) {
+            close_connection(id);
+        }
+    }
+
+    // 处理完已收到的请求，尽量发出响应后关闭
+    if (!pending.empty()) score_pending();
+    while (!connections.empty()) {
+        close_connection(connections.begin()->first);
+    }
+    close(listen_fd);
+    listen_fd = -1;
+    unlink(socket_path.c_str());
+#endif
+}
+
+void ScoringServer::stop() {
+    stopping.store(true);
+#ifndef _WIN32
+    if (wake_fds[1] >= 0) {
+        char byte = 0;
+        ssize_t written = write(wake_fds[1], &byte, 1);
+        (void)written;  // 管道已满时事件循环必然会被唤醒
+    }
+#endif
+}
+
+void ScoringServer::accept_connections() {
+#ifndef _WIN32
+    for (;;) {
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            break;  // EAGAIN：暂时没有新连接
+        }
+        set_nonblocking(fd);
+        disable_sigpipe(fd);
+        Connection conn;
+        conn.fd = fd;
+        connections.emplace(next_connection++, std::move(conn));
+        counters.connections++;
+    }
+#endif
+}
+
+bool ScoringServer::read_connection(uint64_t id, Connection& conn) {
+#ifdef _WIN32
+    (void)id;
+    (void)conn;
+    return false;
+#else
+    char buffer[1 << 16];
+    for (;;) {
+        ssize_t n = recv(conn.fd, buffer, sizeof(buffer), 0);
+        if (n > 0) {
+            conn.input.append(buffer, static_cast<size_t>(n));
+        } else if (n == 0) {
+            conn.peer_closed = true;
+            break;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        } else {
+            return false;
+        }
+    }
+    parse_requests(id, conn);
+    return true;
+#endif
+}
+
+// FILE请求能否读取：不接受 "-"（会读取服务进程自己的标准输入），也不接受管道、设备、目录等
+// 非普通文件，它们可能阻塞整个事件循环；文件不存在时照常交给读取过程报错
+static bool readable_request_path(const std::string& path) {
+    if (path == "-") return false;
+#ifdef _WIN32
+    return true;
+#else
+    struct stat st;
+    return stat(path.c_str(), &st) != 0 || S_ISREG(st.st_mode);
+#endif
+}
+
+void ScoringServer::parse_requests(uint64_t id, Connection& conn) {
+    size_t pos = 0;
+    while (!conn.broken) {
+        size_t eol = conn.input.find('\n', pos);
+        if (eol == std::string::npos) {
+            if (conn.input.size() - pos <= MAX_REQUEST_LINE) break;  // 请求头未收全
+            eol = conn.input.size();
+        }
+
+        Request request;
+        request.connection = id;
+        size_t next = eol + 1;
+        std::vector<std::string> fields;
+        if (eol - pos > MAX_REQUEST_LINE) {
+            request.error = "request line too long";
+            conn.broken = true;
+        } else {
+            fields = split_tabs(conn.input.substr(pos, eol - pos));
+            if (fields.size() == 3 && fields[0] == "FILE") {
+                if (readable_request_path(fields[2])) {
+                    request.payload = fields[2];
+                } else {
+                    request.error = "not a regular file: " + fields[2];
+                }
+            } else if (fields.size() == 3 && fields[0] == "TEXT") {
+                size_t length = 0;
+                if (!parse_text_length(fields[2], length) || length > config.max_text_bytes) {
+                    request.error = "invalid text length: " + fields[2];
+                    conn.broken = true;  // 无法确定正文边界，之后的数据都无法解析
+                } else if (conn.input.size() - next < length) {
+                    break;  // 正文未收全，下次从请求头重新解析
+                } else {
+                    request.inline_text = true;
+                    request.payload.assign(conn.input, next, length);
+                    next += length;
+                }
+            } else {
+                request.error = "malformed request";
+            }
+        }
+
+        if (request.error.empty()) {
+            auto found = reference_ids.find(fields[1]);
+            if (found == reference_ids.end()) {
+                request.error = "unknown reference: " + fields[1];
+            } else {
+                request.reference = found->second;
+            }
+        }
+
+        pos = std::min(next, conn.input.size());
+        conn.in_flight++;
+        pending.push_back(std::move(request));
+    }
+    conn.input.erase(0, pos);
+}
+
+void ScoringServer::score_pending() {
+    scheduler.parallel_for_workers(pending.size(), [this](size_t i, size_t worker) {
+        Request& request = pending[i];
+        if (!request.error.empty()) return;
+        try {
+            FingerprintWorkspace& workspace = workspaces[worker];
+            const std::vector<uint64_t>& set = request.inline_text
+                                                   ? workspace.fingerprint_bytes(string_span(request.payload))
+                                                   : workspace.fingerprint_file(request.payload);
+            const Fingerprint& reference = references[request.reference];
+            request.score = jaccard_similarity_sorted(reference.data(), reference.size(), set.data(), set.size());
+        } catch (const std::exception& e) {
+            request.error = e.what();
+        }
+    });
+
+    counters.batches++;
+    counters.largest_batch = std::max<uint64_t>(counters.largest_batch, pending.size());
+    counters.requests += pending.size();
+    for (Request& request : pending) {
+        if (!request.error.empty()) counters.errors++;
+        auto it = connections.find(request.connection);
+        if (it == connections.end()) continue;  // 连接已关闭，丢弃响应
+        Connection& conn = it->second;
+        conn.in_flight--;
+        if (request.error.empty()) {
+            char text[32];
+            std::snprintf(text, sizeof(text), "%.2f\n", request.score);
+            conn.output += text;
+        } else {
+            std::string message = request.error;
+            std::replace(message.begin(), message.end(), '\n', ' ');
+            std::replace(message.begin(), message.end(), '\t', ' ');
+            conn.output += "error\t" + message + "\n";
+        }
+    }
+    pending.clear();
+
+    std::vector<uint64_t> failed;
+    for (auto& entry : connections) {
+        if (!entry.second.output.empty() && !flush_connection(entry.second)) {
+            failed.push_back(entry.first);
+        }
+    }
+    for (uint64_t id : failed) {
+        close_connection(id);
+    }
+}
+
+bool ScoringServer::flush_connection(Connection& conn) {
+#ifdef _WIN32
+    (void)conn;
+    return false;
+#else
+    size_t sent = 0;
+    while (sent < conn.output.size()) {
+        ssize_t n = send(conn.fd, conn.output.data() + sent, conn.output.size() - sent, MSG_NOSIGNAL);
+        if (n > 0) {
+            sent += static_cast<size_t>(n);
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;  // 发送缓冲区已满，等待POLLOUT
+        } else {
+            return false;
+        }
+    }
+    conn.output.erase(0, sent);
+    return true;
+#endif
+}
+
+void ScoringServer::close_connection(uint64_t id) {
+    auto it = connections.find(id);
+    if (it == connections.end()) return;
+#ifndef _WIN32
+    close(it->second.fd);
+#endif
+    connections.erase(it);
+}
+
+ScoringClient::ScoringClient(const std::string& socket_path) {
+#ifdef _WIN32
+    (void)socket_path;
+    throw std::runtime_error("The scoring server needs Unix domain sockets and is not supported on Windows");
+#else
+    sockaddr_un addr = unix_address(socket_path);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        throw std::runtime_error(std::string("Failed to create socket: ") + std::strerror(errno));
+    }
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        int err = errno;
+        close(fd);
+        fd = -1;
+        throw std::runtime_error("Failed to connect to " + socket_path + ": " + std::strerror(err));
+    }
+    disable_sigpipe(fd);
+#endif
+}
+
+ScoringClient::~ScoringClient() {
+#ifndef _WIN32
+    if (fd >= 0) close(fd);
+#endif
+}
+
+void ScoringClient::send_all(const char* data, size_t size) {
+#ifdef _WIN32
+    (void)data;
+    (void)size;
+#else
+    while (size > 0) {
+        ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("Failed to send request: ") + std::strerror(errno));
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+#endif
+}
+
+void ScoringClient::send_file(const std::string& reference, const std::string& path) {
+    check_protocol_field(reference);
+    check_protocol_field(path);
+    std::string request = "FILE\t" + reference + "\t" + path + "\n";
+    send_all(request.data(), request.size());
+}
+
+void ScoringClient::send_text(const std::string& reference, ByteSpan text) {
+    check_protocol_field(reference);
+    std::string request = "TEXT\t" + reference + "\t" + std::to_string(text.size) + "\n";
+    request.append(reinterpret_cast<const char*>(text.data), text.size);
+    send_all(request.data(), request.size());
+}
+
+std::string ScoringClient::read_response() {
+#ifdef _WIN32
+    throw std::runtime_error("The scoring server needs Unix domain sockets and is not supported on Windows");
+#else
+    for (;;) {
+        size_t eol = input.find('\n');
+        if (eol != std::string::npos) {
+            std::string line = input.substr(0, eol);
+            input.erase(0, eol + 1);
+            return line;
+        }
+        char buffer[4096];
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n > 0) {
+            input.append(buffer, static_cast<size_t>(n));
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else {
+            throw std::runtime_error("Scoring server closed the connection");
+        }
+    }
+#endif
+}
+
+// 最近秩法的分位数，sorted为升序
+static double percentile(const std::vector<double>& sorted, double q) {
+    if (sorted.empty()) return 0.0;
+    size_t rank = static_cast<size_t>(std::ceil(q * static_cast<double>(sorted.size())));
+    return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+}
+
+LoadReport run_load_test(const std::string& socket_path, const std::vector<LoadRequest>& requests, size_t total,
+                         size_t connections, size_t depth) {
+    if (requests.empty() || connections == 0 || depth == 0) {
+        throw std::runtime_error("Load test needs at least one request, one connection and a depth of 1");
+    }
+
+    // 先在调用线程中建立全部连接，连接失败直接抛出
+    std::vector<std::unique_ptr<ScoringClient>> clients;
+    for (size_t c = 0; c < connections; ++c) {
+        clients.emplace_back(new ScoringClient(socket_path));
+    }
+
+    typedef std::chrono::steady_clock Clock;
+    std::vector<std::vector<double>> latencies(connections);
+    std::vector<size_t> errors(connections, 0);
+    WorkStealingScheduler scheduler(connections);  // 每个连接一个线程
+
+    Clock::time_point start = Clock::now();
+    scheduler.parallel_for(connections, [&](size_t c) {
+        ScoringClient& client = *clients[c];
+        size_t count = total / connections + (c < total % connections ? 1 : 0);
+        std::vector<Clock::time_point> sent_at(count);
+        latencies[c].reserve(count);
+
+        size_t sent = 0;
+        for (size_t received = 0; received < count; ++received) {
+            while (sent < count && sent - received < depth) {
+                const LoadRequest& request = requests[(sent * connections + c) % requests.size()];
+                sent_at[sent] = Clock::now();
+                if (request.text.empty()) {
+                    client.send_file(request.reference, request.path);
+                } else {
+                    client.send_text(request.reference, string_span(request.text));
+                }
+                sent++;
+            }
+            std::string response = client.read_response();
+            latencies[c].push_back(std::chrono::duration<double, std::micro>(Clock::now() - sent_at[received]).count());
+            if (response.compare(0, 5, "error") == 0) errors[c]++;
+        }
+    });
+
+    LoadReport report;
+    report.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    std::vector<double> all;
+    all.reserve(total);
+    for (size_t c = 0; c < connections; ++c) {
+        all.insert(all.end(), latencies[c].begin(), latencies[c].end());
+        report.errors += errors[c];
+    }
+    std::sort(all.begin(), all.end());
+    report.requests = all.size();
+    report.p50_us = percentile(all, 0.50);
+    report.p99_us = percentile(all, 0.99);
+    report.max_us = all.empty() ? 0.0 : all.back();
+    return report;
+}
+
+}  // namespace pd
+
+#ifdef _MSC_VER
+    #pragma warning(pop)
+#endif
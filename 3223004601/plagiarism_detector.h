@@ -0,0 +1,1619 @@
+// 文本查重核心库：UTF-8归一化、k-gram指纹、集合相似度、语料库索引、MinHash/LSH、指纹缓存与批量评分
+// 命令行程序、单元测试和性能测试都链接此库。接口以指针+长度的只读区间（ByteSpan）和
+// 可复用的指纹对象（Fingerprint、FingerprintWorkspace）为主，调用方可在进程内直接评分，
+// 无需写临时文件或启动子进程
+#ifndef PLAGIARISM_DETECTOR_H
+#define PLAGIARISM_DETECTOR_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// x86 SIMD支持：GCC/Clang按函数启用AVX2并在运行时检测CPU，MSVC可直接使用AVX2内建函数
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    #define PD_X86_SIMD 1
+    #define PD_TARGET_AVX2 __attribute__((target("avx2")))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    #define PD_X86_SIMD 1
+    #define PD_TARGET_AVX2
+#endif
+
+// 埋点：默认编译进库、运行时关闭；定义 PD_NO_INSTRUMENTATION（CMake -DPD_INSTRUMENTATION=OFF）时
+// 热路径上的计时与计数全部展开为空
+#ifndef PD_NO_INSTRUMENTATION
+    #define PD_INSTRUMENTATION 1
+#endif
+
+namespace pd {
+
+// ==================== 埋点统计与跟踪 ====================
+// 流水线各阶段的耗时与计数按线程累计（不加锁），线程结束时并入全局汇总
+// 埋点只放在按块、按文件或按一次比较执行的位置，运行时关闭时每处只多读一次开关
+
+// 流水线阶段；嵌套的阶段只计入内层，外层的耗时不含内层
+enum class Stage : uint32_t {
+    Read = 0,   // 打开并读取输入（映射文件的缺页开销发生在解码时，计入Decode）
+    Decode,     // UTF-8解码与归一化
+    Hash,       // k-gram哈希与Winnowing
+    Sort,       // 指纹排序去重
+    Intersect,  // 集合求交与相似度
+};
+
+const size_t STAGE_COUNT = 5;
+
+const char* stage_name(Stage stage);
+
+struct PipelineStats {
+    uint64_t stage_ns[STAGE_COUNT] = {};  // 各阶段累计墙钟时间（纳秒）
+    uint64_t bytes_in = 0;                // 读入的字节数
+    uint64_t codepoints_decoded = 0;      // 解码出的码点数（不含无效序列）
+    uint64_t codepoints_kept = 0;         // 归一化后保留的码点数，其余被丢弃
+    uint64_t invalid_sequences = 0;       // 跳过的无效UTF-8序列
+    uint64_t kgrams = 0;                  // 生成的k-gram数（Winnowing之前）
+    uint64_t unique_kgrams = 0;           // 去重后的指纹数
+    uint64_t compactions = 0;             // 排序去重的次数
+    uint64_t rehashes = 0;                // 哈希集合扩容重排的次数
+    uint64_t comparisons = 0;             // 集合比较次数
+
+    uint64_t codepoints_dropped() const {
+        return codepoints_decoded > codepoints_kept ? codepoints_decoded - codepoints_kept : 0;
+    }
+
+    void add(const PipelineStats& other);
+};
+
+// 运行时埋点模式，按位或
+const uint32_t INSTRUMENT_STATS = 1;  // 累计计数与各阶段耗时
+const uint32_t INSTRUMENT_TRACE = 2;  // 记录每个阶段区间，供导出Chrome跟踪事件
+
+// 设置埋点模式（0为关闭）；编译时关闭埋点的构建中模式始终为0
+void set_instrumentation(uint32_t mode);
+
+uint32_t instrumentation_mode();
+
+// 当前线程的计数，PD_COUNT直接累加到这里
+PipelineStats& thread_stats();
+
+// 已结束线程与当前线程的计数之和；其他线程仍在运行时其计数不可靠，应在工作线程结束后调用
+PipelineStats collect_stats();
+
+// 一个阶段区间，时间取自instrumentation_now_ns
+struct TraceEvent {
+    Stage stage = Stage::Read;
+    uint32_t tid = 0;  // 线程序号，按线程首次记录的顺序从0分配
+    uint64_t start_ns = 0;
+    uint64_t end_ns = 0;
+};
+
+// 已结束线程与当前线程的阶段区间，按开始时间排序
+std::vector<TraceEvent> collect_trace_events();
+
+// 清空所有线程的计数与阶段区间
+void reset_instrumentation();
+
+// 单行统计："stats read_ms=0.12 decode_ms=... bytes_in=... kept=... dropped=..."
+std::string format_stats_line(const PipelineStats& stats);
+
+// Chrome跟踪事件格式（JSON数组，"X"完整事件，时间单位为微秒），chrome://tracing 和 Perfetto 可直接打开
+std::string trace_events_json(const std::vector<TraceEvent>& events);
+
+// 埋点使用的单调时钟（纳秒）
+uint64_t instrumentation_now_ns();
+
+// StageTimer的实现：开始时返回当前线程已计入内层阶段的时间，结束时据此扣除内层耗时
+uint64_t stage_begin();
+
+void stage_end(Stage stage, uint64_t start_ns, uint64_t inner_before, uint32_t mode);
+
+#ifdef PD_INSTRUMENTATION
+// 作用域计时：构造时读取一次模式，关闭时不取时间
+class StageTimer {
+private:
+    Stage stage;
+    uint32_t mode;
+    uint64_t start_ns = 0;
+    uint64_t inner_before = 0;
+
+public:
+    explicit StageTimer(Stage stage) : stage(stage), mode(instrumentation_mode()) {
+        if (mode != 0) {
+            inner_before = stage_begin();
+            start_ns = instrumentation_now_ns();
+        }
+    }
+
+    ~StageTimer() {
+        if (mode != 0) stage_end(stage, start_ns, inner_before, mode);
+    }
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+};
+
+// 统计开启时把n累加到当前线程计数的field上
+#define PD_COUNT(field, n)                                                  \
+    do {                                                                    \
+        if (::pd::instrumentation_mode() & ::pd::INSTRUMENT_STATS) {        \
+            ::pd::thread_stats().field += static_cast<uint64_t>(n);         \
+        }                                                                   \
+    } while (0)
+#else
+class StageTimer {
+public:
+    explicit StageTimer(Stage) {}
+};
+
+// n不求值，只在sizeof中出现：仅供计数使用的局部变量在关闭埋点时也不会触发未使用警告
+#define PD_COUNT(field, n) ((void)sizeof(n))
+#endif
+
+// 判断是否为中日韩统一表意文字（CJK字符）
+bool is_cjk(uint32_t cp);
+
+// 判断ASCII字符是否应该保留（字母和数字）
+bool is_keep_ascii(char c);
+
+// 将ASCII大写字母转换为小写
+char to_lower_ascii(char c);
+
+// 运行时检测CPU是否支持AVX2（结果缓存）
+bool cpu_has_avx2();
+
+// UTF-8解码器：从字节区间 [data, data+size) 中读取下一个Unicode码点，并推进索引
+// 遇到无效字节时跳过（返回0表示跳过）
+uint32_t utf8_next(const unsigned char* data, size_t size, size_t& i);
+
+uint32_t utf8_next(const std::vector<unsigned char>& bytes, size_t& i);
+
+// 将文件内容读取到字节向量
+std::vector<unsigned char> read_file_to_bytes(const std::string& path);
+
+// 只读字节区间（零拷贝视图），数据由InputSource或调用方持有
+struct ByteSpan {
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+};
+
+// 将标准输入切换为二进制模式（Windows下避免换行符被转换，其他平台无需处理）
+void set_stdin_binary();
+
+// 从输入流读取全部内容（用于标准输入等无法预先得知大小的输入）
+std::vector<unsigned char> read_stream_to_bytes(std::istream& in);
+
+// 输入文件：普通文件通过内存映射直接暴露只读字节区间，省去读入缓冲区的一次完整拷贝；
+// 标准输入（路径为 "-"）、管道等无法映射的输入回退到缓冲读取
+class InputSource {
+private:
+    ByteSpan span;
+    void* mapped = nullptr;             // 映射区域起始地址，未映射时为空
+    size_t mapped_size = 0;
+    std::vector<unsigned char> buffer;  // 回退路径读入的内容
+
+    void open_file(const std::string& path);
+
+public:
+    explicit InputSource(const std::string& path);
+    ~InputSource();
+
+    InputSource(const InputSource&) = delete;
+    InputSource& operator=(const InputSource&) = delete;
+
+    ByteSpan bytes() const { return span; }
+    bool is_mapped() const { return mapped != nullptr; }
+};
+
+// 单个码点的归一化（默认配置的规则）：字母、数字转小写后保留，CJK字符原样保留，其余返回0表示丢弃
+inline uint32_t normalize_codepoint(uint32_t cp) {
+    if (cp < 128) {  // ASCII字符
+        if (is_keep_ascii(static_cast<char>(cp))) {  // 只保留字母和数字
+            return static_cast<uint32_t>(to_lower_ascii(static_cast<char>(cp)));  // 转换为小写
+        }
+        return 0;  // 其他ASCII字符（标点、空格等）直接丢弃
+    }
+    if (is_cjk(cp)) {  // 只保留CJK字符
+        return cp;
+    }
+    return 0;  // 其他非ASCII字符（如拉丁扩展字符）直接丢弃
+}
+
+// 归一化配置：决定保留哪些字符以及如何折叠，参与比较的双方必须使用相同配置
+// 每种配置对ASCII要么保留字母数字并转小写，要么全部丢弃
+enum class NormalizationProfile : uint32_t {
+    Default = 0,          // normalize_codepoint的规则：ASCII字母数字与CJK统一表意文字
+    CjkOnly = 1,          // 只保留CJK统一表意文字，忽略夹杂的英文与数字
+    UnicodeLetters = 2,   // 各文字的字母与数字：拉丁、希腊、西里尔、亚美尼亚、希伯来、阿拉伯、天城文、
+                          // 泰文、假名、谚文和CJK，大小写折叠为小写，其他文字的数字折叠为ASCII数字
+    FullWidthFolding = 3  // 在UnicodeLetters基础上，全角ASCII折叠为半角，半角片假名与谚文折叠为全角
+};
+
+// 配置名称（命令行与缓存文件名使用）：default、cjk-only、unicode-letters、full-width-folding
+const char* normalization_profile_name(NormalizationProfile profile);
+
+// 按名称解析归一化配置，名称未知时抛出异常
+NormalizationProfile parse_normalization_profile(const std::string& name);
+
+// 按配置归一化单个码点的参考实现（逐段区间比较），只用于生成CodepointClassifier的查找表
+// 0x40000及以上的码点在任何配置下都被丢弃
+uint32_t normalize_codepoint(uint32_t cp, NormalizationProfile profile);
+
+// 码点分类表：把归一化配置编译为两级查找表，分类与大小写折叠合成一次查表
+// 第一级按 cp >> 8 选出一个256项的块；块内每项的最低位表示是否保留，其余位为 归一化码点 - cp
+// 内容相同的块只存一份（整块丢弃、整块原样保留的块各自共用），每种配置约几十KB
+class CodepointClassifier {
+private:
+    std::vector<uint16_t> index;   // 覆盖21位码点空间（utf8_next可能解出 0x10FFFF 以上的值）
+    std::vector<uint32_t> blocks;
+
+public:
+    explicit CodepointClassifier(NormalizationProfile profile);
+
+    // 归一化后的码点，0表示丢弃；与 normalize_codepoint(cp, profile) 逐个相同
+    uint32_t normalize(uint32_t cp) const {
+        uint32_t entry = blocks[(static_cast<size_t>(index[(cp >> 8) & 0x1FFF]) << 8) | (cp & 0xFF)];
+        return (cp + static_cast<uint32_t>(static_cast<int32_t>(entry) >> 1)) & (0u - (entry & 1));
+    }
+
+    size_t table_bytes() const { return index.size() * sizeof(uint16_t) + blocks.size() * sizeof(uint32_t); }
+};
+
+// 配置对应的分类表，首次使用时生成，之后在进程内共享（可多线程同时使用）
+const CodepointClassifier& codepoint_classifier(NormalizationProfile profile);
+
+// 解码并归一化：从位置i开始逐个解码，直到i到达stop；归一化后保留的码点写入out，返回写入数量
+// 多字节序列可以读到stop之后（不超过size），out的容量不能少于 stop-i；每个码点查一次分类表
+size_t normalize_utf8_scalar(const unsigned char* data, size_t size, size_t& i, size_t stop, uint32_t* out,
+                             NormalizationProfile profile = NormalizationProfile::Default);
+
+#ifdef PD_X86_SIMD
+// AVX2版本，输出与标量版本逐个相同：
+// - 以ASCII字节开头时，一次分类并转换到下一个非ASCII字节为止（最多32字节）
+// - 否则把接下来24字节当作8个3字节序列（BMP内的中文）整体校验、解码，
+//   并按标量规则拒绝过长编码和代理码点；默认配置的CJK判断用向量区间比较，其他配置逐通道查分类表；
+//   只输出开头连续合法的序列，一个都不合法时退回utf8_next处理一个码点
+PD_TARGET_AVX2
+size_t normalize_utf8_avx2(const unsigned char* data, size_t size, size_t& i, size_t stop, uint32_t* out,
+                           NormalizationProfile profile = NormalizationProfile::Default);
+#endif
+
+// 解码并归一化，CPU支持时使用AVX2
+size_t normalize_utf8(const unsigned char* data, size_t size, size_t& i, size_t stop, uint32_t* out,
+                      NormalizationProfile profile = NormalizationProfile::Default);
+
+// 将UTF-8字节流转换为归一化的码点序列
+// 默认只保留字母、数字（转小写）和CJK字符，过滤标点符号和空白
+std::vector<uint32_t> normalize_to_codepoints(ByteSpan bytes,
+                                              NormalizationProfile profile = NormalizationProfile::Default);
+
+std::vector<uint32_t> normalize_to_codepoints(const std::vector<unsigned char>& bytes,
+                                              NormalizationProfile profile = NormalizationProfile::Default);
+
+// 增量UTF-8解码器：字节按块输入，解码并归一化；块尾不完整的多字节序列暂存到下一块再解码
+// 对任意分块方式，输出的码点序列都与对整段字节调用normalize_to_codepoints的结果完全相同
+class Utf8StreamDecoder {
+private:
+    NormalizationProfile profile;
+    const CodepointClassifier* classifier;
+    unsigned char carry[8];   // 上一块末尾不完整的序列（最多3字节）
+    size_t carry_size = 0;
+
+    // 从i开始的多字节序列是否被区间末尾截断
+    static bool is_truncated(const unsigned char* data, size_t size, size_t i);
+
+public:
+    explicit Utf8StreamDecoder(NormalizationProfile profile = NormalizationProfile::Default)
+        : profile(profile), classifier(&codepoint_classifier(profile)) {}
+
+    // 输入一块字节，归一化后保留的码点追加到out
+    void feed(const unsigned char* data, size_t size, std::vector<uint32_t>& out);
+
+    // 输入结束：末尾不完整的序列与utf8_next的处理方式一致，整体丢弃（计为一个无效序列）
+    void finish() {
+        PD_COUNT(invalid_sequences, carry_size != 0);
+        carry_size = 0;
+    }
+
+    // 丢弃末尾不完整的序列但不计为无效序列：输入只是在文档中间截断
+    void discard() { carry_size = 0; }
+};
+
+// 使用FNV-1a算法计算连续k个码点的64位哈希值
+uint64_t fnv1a64_hash_codepoints(const uint32_t* codepoints, size_t k);
+
+// 计算从start开始的k-gram的FNV-1a哈希值
+uint64_t fnv1a64_hash_kgram(const std::vector<uint32_t>& codepoints, size_t start, size_t k);
+
+// k-gram哈希算法选择
+// Fnv：逐窗口重新计算FNV-1a，每个窗口O(k)，与历史版本的结果完全一致
+// Rolling：多项式滚动哈希，每次滑动O(1)，适合较大的k
+enum class HashMode : uint32_t {
+    Fnv = 0,
+    Rolling = 1
+};
+
+// 多项式滚动哈希的基数（奇数，在模2^64下可逆）
+const uint64_t ROLLING_BASE = 0x9E3779B97F4A7C15ULL;
+
+// 64位混合函数（splitmix64的终结步骤），是双射，不会引入额外冲突
+// 用于打散多项式哈希低位的规律，使输出与FNV一样分布均匀
+inline uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+// 多项式滚动哈希：h = cp[0]*B^(k-1) + cp[1]*B^(k-2) + ... + cp[k-1] (mod 2^64)
+// 窗口右移一位时 h' = h*B + 新码点 - 旧码点*B^k，更新代价与k无关
+class RollingHash {
+private:
+    uint64_t base_pow_k = 1;  // B^k
+    uint64_t h = 0;
+
+public:
+    explicit RollingHash(size_t k) {
+        for (size_t i = 0; i < k; ++i) base_pow_k *= ROLLING_BASE;
+    }
+
+    // 窗口未满k个码点时追加一个码点
+    void append(uint32_t cp) { h = h * ROLLING_BASE + cp; }
+
+    // 窗口已满时滑动：移出out，移入in
+    void roll(uint32_t out, uint32_t in) { h = h * ROLLING_BASE + in - out * base_pow_k; }
+
+    // 当前窗口的64位指纹
+    uint64_t value() const { return mix64(h); }
+};
+
+// 直接计算从start开始的k-gram的滚动哈希值（O(k)），与RollingHash逐步滑动的结果相同
+uint64_t rolling_hash_kgram(const std::vector<uint32_t>& codepoints, size_t start, size_t k);
+
+// 按顺序计算所有k-gram的哈希值，每个哈希值交给sink处理
+template <typename Sink>
+void for_each_kgram_hash(const std::vector<uint32_t>& codepoints, size_t k, HashMode mode, Sink&& sink) {
+    if (k == 0 || codepoints.size() < k) return;  // 参数无效或文本太短
+
+    size_t num = codepoints.size() - k + 1;  // k-gram的总数量
+    if (mode == HashMode::Fnv) {
+        for (size_t i = 0; i < num; ++i) {
+            sink(fnv1a64_hash_kgram(codepoints, i, k));
+        }
+        return;
+    }
+
+    // 滚动哈希：先装满第一个窗口，之后每步O(1)滑动
+    RollingHash rh(k);
+    for (size_t i = 0; i < k; ++i) {
+        rh.append(codepoints[i]);
+    }
+    sink(rh.value());
+    for (size_t i = k; i < codepoints.size(); ++i) {
+        rh.roll(codepoints[i - k], codepoints[i]);
+        sink(rh.value());
+    }
+}
+
+// 逐码点增量计算k-gram哈希，只保留最近k个码点
+// 环形缓冲区每个码点写两份（slot和slot+k），当前窗口因此总是连续的k个元素
+// 对同一码点序列输出的哈希序列与for_each_kgram_hash完全相同
+class KGramHasher {
+private:
+    size_t k;
+    HashMode mode;
+    RollingHash rolling;
+    std::vector<uint32_t> ring;  // 长度2k
+    size_t count = 0;            // 已输入的码点数
+
+public:
+    KGramHasher(size_t k, HashMode mode) : k(k), mode(mode), rolling(k), ring(2 * k) {}
+
+    // 清空状态以处理下一篇文本，保留环形缓冲区
+    void reset() {
+        count = 0;
+        rolling = RollingHash(k);
+    }
+
+    // 输入下一个码点，凑满k个码点后每次输出一个k-gram哈希
+    template <typename Sink>
+    void push(uint32_t cp, Sink&& sink) {
+        if (k == 0) return;
+        size_t slot = count % k;
+        uint32_t out = ring[slot];  // 滑出窗口的码点
+        ring[slot] = cp;
+        ring[slot + k] = cp;
+        count++;
+
+        if (mode == HashMode::Rolling) {
+            if (count <= k) rolling.append(cp);
+            else rolling.roll(out, cp);
+        }
+        if (count < k) return;
+
+        if (mode == HashMode::Fnv) {
+            sink(fnv1a64_hash_codepoints(&ring[count % k], k));
+        } else {
+            sink(rolling.value());
+        }
+    }
+};
+
+// 默认k-gram长度（3-gram是文本相似度计算的常用方法）
+constexpr size_t DEFAULT_K = 3;
+
+// 构建k-gram哈希集合，生成所有k-gram的哈希值并去重
+std::unordered_set<uint64_t> build_kgram_set(const std::vector<uint32_t>& codepoints, size_t k,
+                                             HashMode mode = HashMode::Fnv);
+
+// 取窗口最小值的指纹选择（Winnowing，MOSS使用的算法）
+// 在每个由连续w个k-gram哈希组成的窗口中选出最小值（并列时取最右），相邻窗口选中同一位置时只输出一次
+// 保证：两篇文本只要有长度 >= w+k-1 个码点的公共片段，就至少共享一个被选中的指纹
+// 期望选中比例约为 2/(w+1)
+class Winnower {
+private:
+    size_t window;
+    size_t pos = 0;                   // 下一个哈希的位置
+    size_t last_selected = SIZE_MAX;  // 上一次选中的位置
+    // 单调队列：(哈希值, 位置)，哈希值严格递增；队列中的位置都在窗口内，最多window+1个元素，
+    // 因此用固定大小的环形缓冲区存放，reset后可直接复用
+    std::vector<std::pair<uint64_t, size_t>> ring;
+    size_t head = 0;
+    size_t count = 0;
+
+    std::pair<uint64_t, size_t>& front() { return ring[head]; }
+    std::pair<uint64_t, size_t>& back() { return ring[(head + count - 1) % ring.size()]; }
+
+public:
+    explicit Winnower(size_t w) : window(w == 0 ? 1 : w), ring(window + 1) {}
+
+    // 清空状态以处理下一篇文本，保留缓冲区
+    void reset() {
+        pos = 0;
+        last_selected = SIZE_MAX;
+        head = 0;
+        count = 0;
+    }
+
+    // 输入下一个k-gram哈希，窗口满时若选中了新的位置则交给sink
+    template <typename Sink>
+    void push(uint64_t hash, Sink&& sink) {
+        // 队尾不小于新值的元素不可能再成为最小值（并列时保留更靠右的新值）
+        while (count > 0 && back().first >= hash) count--;
+        count++;
+        back() = std::make_pair(hash, pos);
+        // 移除已离开窗口的元素
+        if (front().second + window <= pos) {
+            head = (head + 1) % ring.size();
+            count--;
+        }
+
+        if (pos + 1 >= window) select(sink);
+        pos++;
+    }
+
+    // 输入结束：哈希总数不足一个窗口时，仍选出其中的最小值，避免短文本没有指纹
+    template <typename Sink>
+    void finish(Sink&& sink) {
+        if (pos > 0 && pos < window) select(sink);
+    }
+
+private:
+    template <typename Sink>
+    void select(Sink&& sink) {
+        if (front().second != last_selected) {
+            last_selected = front().second;
+            sink(front().first);
+        }
+    }
+};
+
+// 指纹参数：决定文档如何转换为k-gram哈希集合，参与比较的双方必须使用相同参数
+struct FingerprintOptions {
+    size_t k = DEFAULT_K;                // k-gram长度
+    HashMode hash_mode = HashMode::Fnv;  // k-gram哈希算法
+    size_t winnow_window = 0;            // Winnowing窗口大小，0表示保留全部k-gram
+    NormalizationProfile normalization = NormalizationProfile::Default;  // 归一化配置
+};
+
+// Winnowing保证能检测到的最短公共片段长度（码点数）
+size_t winnow_guarantee(size_t k, size_t window);
+
+// 计算Jaccard相似度：交集大小 / 并集大小
+double jaccard_similarity(const std::unordered_set<uint64_t>& set1, const std::unordered_set<uint64_t>& set2);
+
+// ==================== 开放寻址指纹集合 ====================
+// 专为64位指纹设计的扁平哈希集合（Swiss table式）：槽位连续存放，每16个槽位为一组，
+// 每个槽位另有1字节控制字（空或哈希的7位标签），查找时一次比较整组16个控制字（SSE2），
+// 标签相同才读取槽位。k-gram哈希本身已经充分混合，直接取最高几位作组号、其后7位作标签，不再二次哈希
+// 只支持插入与查找（指纹集合构建后不删除），负载不超过7/8，每个元素约10~21字节（std::unordered_set约40字节）
+class FlatHashSet {
+private:
+    static const uint8_t EMPTY = 0x80;
+
+    std::vector<uint8_t> ctrl;    // 每个槽位的控制字节：EMPTY或标签（0~127）
+    std::vector<uint64_t> slots;
+    size_t count = 0;
+    size_t group_mask = 0;        // 组数-1（组数为2的幂）
+    unsigned shift = 64;          // 组号 = hash >> shift
+
+    size_t group_of(uint64_t hash) const { return static_cast<size_t>(hash >> shift); }
+    uint8_t tag_of(uint64_t hash) const { return static_cast<uint8_t>((hash >> (shift - 7)) & 0x7F); }
+
+    // 重新分配为groups组并插入原有元素
+    void rehash(size_t groups);
+
+public:
+    static const size_t GROUP_SIZE = 16;
+
+    FlatHashSet() {}
+
+    // 预留至少容纳expected个元素的空间，此后插入不再扩容
+    explicit FlatHashSet(size_t expected) { reserve(expected); }
+
+    void reserve(size_t expected);
+
+    // 插入哈希值，原先不存在时返回true
+    bool insert(uint64_t hash);
+
+    bool contains(uint64_t hash) const;
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    // 槽位数
+    size_t capacity() const { return slots.size(); }
+
+    // 槽位与控制字节占用的字节数
+    size_t memory_bytes() const { return slots.size() * (sizeof(uint64_t) + 1); }
+
+    // 按槽位顺序对每个元素调用f(hash)
+    template <typename F>
+    void for_each(F&& f) const {
+        for (size_t i = 0; i < slots.size(); ++i) {
+            if (ctrl[i] != EMPTY) f(slots[i]);
+        }
+    }
+};
+
+// 构建开放寻址形式的k-gram集合，元素与build_kgram_set完全相同
+FlatHashSet build_kgram_flat_set(const std::vector<uint32_t>& codepoints, size_t k, HashMode mode = HashMode::Fnv);
+
+// 开放寻址集合的Jaccard相似度，与jaccard_similarity(unordered_set)逐位一致
+double jaccard_similarity(const FlatHashSet& set1, const FlatHashSet& set2);
+
+// ==================== 有序向量集合 ====================
+// k-gram集合的另一种表示：升序、去重的 std::vector<uint64_t>
+// 每个元素只占8字节且连续存放，求交集是顺序归并，比逐个 find 更省内存、缓存更友好
+
+// LSD基数排序：8轮，每轮按一个字节分配；一次遍历统计全部8个字节的直方图，
+// 某个字节在所有元素上都相同时跳过该轮。scratch为可复用的临时缓冲区
+void radix_sort_u64(std::vector<uint64_t>& values, std::vector<uint64_t>& scratch);
+
+void radix_sort_u64(std::vector<uint64_t>& values);
+
+// 使用调用方提供的临时区排序并去重，不释放容量，供可复用的缓冲区使用
+void sort_unique_hashes(std::vector<uint64_t>& hashes, std::vector<uint64_t>& scratch);
+
+// 排序并去重，得到有序向量集合；重复较多时释放多余容量，使集合只占 8字节/元素
+void sort_unique_hashes(std::vector<uint64_t>& hashes);
+
+// 构建有序向量形式的k-gram集合，元素与build_kgram_set完全相同
+std::vector<uint64_t> build_kgram_vector(const std::vector<uint32_t>& codepoints, size_t k,
+                                         HashMode mode = HashMode::Fnv);
+
+// 无分支归并求交集大小：每步根据比较结果推进一侧或两侧
+size_t intersection_count_scalar(const uint64_t* a, size_t na, const uint64_t* b, size_t nb);
+
+#ifdef PD_X86_SIMD
+// AVX2分块归并：每次取两边各4个元素，与另一边的4种循环移位逐一比较，
+// 然后推进最大元素较小的一块（相等则都推进），剩余部分交给标量归并
+PD_TARGET_AVX2
+size_t intersection_count_avx2(const uint64_t* a, size_t na, const uint64_t* b, size_t nb);
+#endif
+
+// 两个有序向量集合的交集大小，CPU支持时使用AVX2
+size_t intersection_count_sorted(const uint64_t* a, size_t na, const uint64_t* b, size_t nb);
+
+// 有序向量集合的Jaccard相似度，计算方式与jaccard_similarity相同，结果逐位一致
+double jaccard_similarity_sorted(const uint64_t* a, size_t na, const uint64_t* b, size_t nb);
+
+double jaccard_similarity_sorted(const std::vector<uint64_t>& set1, const std::vector<uint64_t>& set2);
+
+// 一次归并同时得到的几种相似度
+struct SimilarityMetrics {
+    double jaccard = 0.0;           // |A∩B| / |A∪B|
+    double containment_a = 0.0;     // |A∩B| / |A|：A有多大比例出现在B中
+    double containment_b = 0.0;     // |A∩B| / |B|：B有多大比例出现在A中，短文摘抄自长文时接近1
+    double weighted_jaccard = 0.0;  // 按出现次数的多重集合Jaccard：Σmin(ca, cb) / Σmax(ca, cb)
+};
+
+// 在一次归并中计算全部相似度；ca/cb为每个元素的出现次数，为空时按每个元素出现一次计算
+// （此时weighted_jaccard等于jaccard）。jaccard与jaccard_similarity_sorted逐位一致
+SimilarityMetrics similarity_metrics(const uint64_t* a, const uint32_t* ca, size_t na,
+                                     const uint64_t* b, const uint32_t* cb, size_t nb);
+
+// 按指纹参数构建有序向量形式的指纹集合：在哈希与去重之间可选地进行Winnowing筛选
+std::vector<uint64_t> build_fingerprint_vector(const std::vector<uint32_t>& codepoints,
+                                               const FingerprintOptions& options);
+
+// 流式读取时每块的字节数
+const size_t STREAM_CHUNK_SIZE = 1 << 16;
+
+// 流式指纹：字节按块输入，依次经过增量UTF-8解码、归一化、k-gram哈希和可选的Winnowing
+// 不保存完整的字节或码点序列，内存占用只取决于块大小、k、窗口大小和指纹集合本身
+// 结果与 build_fingerprint_vector(normalize_to_codepoints(全部字节)) 完全相同
+// reset后可处理下一篇文本，所有缓冲区保留容量，同一对象反复使用时不再分配内存
+class StreamingFingerprinter {
+private:
+    FingerprintOptions options;
+    bool with_counts;                  // 是否统计每个指纹的出现次数
+    Utf8StreamDecoder decoder;
+    KGramHasher hasher;
+    Winnower winnower;
+    std::vector<uint32_t> codepoints;  // 当前块归一化后的码点（复用缓冲区）
+    std::vector<uint64_t> hashes;
+    std::vector<uint64_t> scratch;     // 基数排序的临时区
+    size_t compact_at = STREAM_CHUNK_SIZE;  // 累积到此数量时排序去重一次，避免重复哈希无限增长
+    uint64_t fed = 0;                  // 已输入的码点数，用于统计k-gram数
+
+    // 计数模式：hashes的前counted个元素有序去重，counts[i]为其次数，之后是尚未合并的新哈希
+    std::vector<uint32_t> counts;
+    size_t counted = 0;
+    std::vector<uint64_t> tail;             // 合并时排序新哈希的缓冲区
+    std::vector<uint64_t> merged;
+    std::vector<uint32_t> merged_counts;
+
+    void add_hash(uint64_t hash);
+
+    // 排序去重；计数模式下把新哈希按游程计数后与已计数的前缀归并
+    void compact();
+
+public:
+    explicit StreamingFingerprinter(const FingerprintOptions& options, bool with_counts = false)
+        : options(options), with_counts(with_counts), decoder(options.normalization),
+          hasher(options.k, options.hash_mode), winnower(options.winnow_window) {}
+
+    // 清空状态以处理下一篇文本（指纹参数不变）
+    void reset();
+
+    // 输入一块字节
+    void feed(const unsigned char* data, size_t size);
+
+    // 输入结束，在内部缓冲区中得到有序去重的指纹集合，引用在下一次reset之前有效
+    // document_end为false表示输入只是文档中间的一段：不把不足一个窗口的哈希当作短文本选出，
+    // 末尾被截断的UTF-8序列也不计为无效序列
+    const std::vector<uint64_t>& finish_in_place(bool document_end = true);
+
+    // 输入结束，返回有序去重的指纹集合
+    std::vector<uint64_t> finish();
+
+    // 计数模式下finish_in_place之后有效：与指纹集合逐个对应的出现次数；非计数模式为空
+    const std::vector<uint32_t>& counts_in_place() const { return counts; }
+
+    // 自上次reset以来输入的（归一化后保留的）码点数
+    uint64_t codepoints_fed() const { return fed; }
+};
+
+// 从输入流按块读取并生成指纹集合
+std::vector<uint64_t> fingerprint_stream(std::istream& in, const FingerprintOptions& options);
+
+// 将内存中的字节区间分块送入流式流水线，生成指纹集合
+std::vector<uint64_t> fingerprint_bytes(ByteSpan bytes, const FingerprintOptions& options);
+
+// 读取文件并生成其指纹集合（有序向量）
+// 标准输入（"-"）按块流式读取；普通文件映射到内存后分块送入流水线，不生成完整的码点序列
+std::vector<uint64_t> fingerprint_file(const std::string& path, const FingerprintOptions& options);
+
+// 可复用的指纹工作区：持有一次指纹计算用到的全部缓冲区（码点块、哈希、排序临时区、
+// k-gram与Winnowing窗口、标准输入读取块），每次计算前重置状态但保留容量
+// 缓冲区增长到所处理文档的规模后，同一工作区继续计算不再分配堆内存（文件映射路径）
+// 返回的指纹集合在下一次计算之前有效；一个工作区同一时间只能由一个线程使用
+class FingerprintWorkspace {
+private:
+    StreamingFingerprinter fingerprinter;
+    std::vector<char> chunk;  // 读取标准输入时的块缓冲区，首次使用时分配
+
+public:
+    explicit FingerprintWorkspace(const FingerprintOptions& options, bool with_counts = false)
+        : fingerprinter(options, with_counts) {}
+
+    // 内存中的字节区间
+    const std::vector<uint64_t>& fingerprint_bytes(ByteSpan bytes);
+
+    // 输入流，按块读取
+    const std::vector<uint64_t>& fingerprint_stream(std::istream& in);
+
+    // 文件路径，"-" 表示标准输入
+    const std::vector<uint64_t>& fingerprint_file(const std::string& path);
+
+    // 以计数模式构造时，上一次计算的指纹集合中每个元素的出现次数
+    const std::vector<uint32_t>& counts() const { return fingerprinter.counts_in_place(); }
+};
+
+// 带出现次数的指纹集合：hashes有序去重，counts[i]为hashes[i]在文本中被选中的次数
+struct CountedFingerprint {
+    std::vector<uint64_t> hashes;
+    std::vector<uint32_t> counts;
+};
+
+// 读取文件并生成带出现次数的指纹集合，hashes与fingerprint_file的结果相同
+CountedFingerprint fingerprint_file_counted(const std::string& path, const FingerprintOptions& options);
+
+SimilarityMetrics similarity_metrics(const CountedFingerprint& a, const CountedFingerprint& b);
+
+// ==================== 增量评分（修订稿） ====================
+
+// 增量评分中文档分块的目标字节数
+const size_t INCREMENTAL_BLOCK_SIZE = 8192;
+
+// 增量评分：保存一份待测文档、它的k-gram多重集合（哈希 -> 次数），以及与每份原文的交集计数
+// （共有的不同指纹数、共有指纹的Σmin次数）
+// 文档按约INCREMENTAL_BLOCK_SIZE字节切块，块边界都在UTF-8同步点上，每块保存自己的字节和解码后的码点，
+// 各块可以独立解码。修改时只重新解码修改处所在的块，只增删新旧码点序列中不同的一段所涉及的k-gram，
+// 并就地调整各原文的计数：每次修改的解码和哈希工作量与修改大小加一个块的大小成正比，与文档长度无关
+// 按字节位置找块是对各块结束偏移的二分查找；块列表的插入删除、其后各块偏移的平移仍与块数成正比，
+// 但每块只移动一个块对象、加一个整数（8 MiB的文档约1000块），远小于重新解码一个块
+// metrics的结果与对修改后的全文重新计算 similarity_metrics(原文计数指纹, 文档计数指纹) 逐位一致
+// 只支持不做Winnowing的k-gram指纹
+class IncrementalScorer {
+private:
+    struct Block {
+        std::vector<unsigned char> bytes;
+        std::vector<uint32_t> codepoints;  // 本块解码、归一化后保留的码点
+    };
+
+    struct Original {
+        std::unordered_map<uint64_t, uint32_t> counts;
+        uint64_t total = 0;    // 次数之和
+        size_t shared = 0;     // 与文档共有的不同指纹数
+        uint64_t min_sum = 0;  // 共有指纹的 Σmin(原文次数, 文档次数)
+    };
+
+    FingerprintOptions options;
+    std::vector<Block> blocks;
+    std::vector<size_t> block_ends;                  // 各块结束处在文档中的字节偏移（前缀和）
+    size_t size = 0;                                 // 文档字节数
+    std::unordered_map<uint64_t, uint32_t> kgrams;   // 文档的k-gram多重集合
+    uint64_t total = 0;                              // 文档的k-gram总数
+    std::vector<Original> originals;
+
+    // 文档中hash的次数加delta（±1），同时调整各原文的计数
+    void adjust(uint64_t hash, int delta);
+
+    // 对seq中起点在 [begin, end) 的每个完整k-gram调用adjust(hash, delta)
+    void adjust_range(const std::vector<uint32_t>& seq, size_t begin, size_t end, int delta);
+
+    // 把一段起点在同步点上的字节切块并解码；lookahead为紧接其后的最多3个字节，这段到文档末尾时为空
+    std::vector<Block> make_blocks(const std::vector<unsigned char>& bytes, ByteSpan lookahead) const;
+
+    // 包含字节位置pos的块的编号，block_start为该块的起始字节（二分查找）
+    size_t block_at(size_t pos, size_t& block_start) const;
+
+public:
+    // winnow_window不为0或k为0时抛出异常
+    IncrementalScorer(const FingerprintOptions& options, ByteSpan document);
+
+    // 加入一份原文（须用相同的指纹参数计算），返回其编号
+    size_t add_original(const CountedFingerprint& original);
+
+    size_t original_count() const { return originals.size(); }
+
+    // 把字节区间 [offset, offset+erase) 替换为replacement，区间越界时抛出异常
+    void replace(size_t offset, size_t erase, ByteSpan replacement);
+
+    // 换成新的修订稿：跳过与当前文本相同的前缀和后缀，把中间不同的一段作为一次replace
+    // 返回被替换的字节数与新写入的字节数中较大的一个
+    // 比较前后缀要扫描整份修订稿，耗时与文档长度成正比；已知修改的字节区间时应直接调用replace
+    size_t update(ByteSpan revision);
+
+    // 原文（a）与当前文档（b）的各项相似度
+    SimilarityMetrics metrics(size_t original) const;
+
+    size_t document_size() const { return size; }
+
+    // 当前文档的全部字节
+    std::vector<unsigned char> contents() const;
+
+    // 当前文档的计数指纹（有序），与对全文调用fingerprint_file_counted的结果相同
+    CountedFingerprint fingerprint() const;
+};
+
+// ==================== 匹配片段定位 ====================
+
+// 归一化后的码点序列，以及每个码点在原始字节中的区间 [starts[i], ends[i])
+// 偏移为32位，输入不能超过4 GiB
+struct LocatedText {
+    std::vector<uint32_t> codepoints;
+    std::vector<uint32_t> starts;
+    std::vector<uint32_t> ends;
+};
+
+// 解码并归一化，同时记录码点的字节位置；codepoints与normalize_to_codepoints的结果相同
+// 输入超过4 GiB时抛出异常
+LocatedText normalize_with_offsets(ByteSpan bytes, NormalizationProfile profile = NormalizationProfile::Default);
+
+// 两份文本中归一化后完全相同的一段，区间为原始字节偏移 [start, end)
+struct MatchedSpan {
+    size_t a_start = 0;
+    size_t a_end = 0;
+    size_t b_start = 0;
+    size_t b_end = 0;
+    size_t codepoints = 0;  // 片段的归一化码点数
+};
+
+// 每个种子最多尝试的A中出现位置，限制高度重复文本上的工作量
+const size_t MAX_SPAN_CANDIDATES = 16;
+// 查表种子的最大长度（码点），种子越长哈希越慢，超过此长度已几乎不会重复
+const size_t MAX_SPAN_SEED = 32;
+
+// 定位B中抄自A的片段：A的全部种子（长min(min_codepoints, max(k, MAX_SPAN_SEED))的窗口）放入哈希表，
+// 顺序扫描B，每个共有的种子逐码点核对（排除哈希冲突），取A中能向后延伸最长的出现位置，
+// 再向前延伸到上一段的末尾，得到最长的连续匹配
+// 片段在B中互不重叠、按位置升序，在A中可以重叠（B多次抄同一段）；短于min_codepoints（至少为k）的不输出
+// B中每个位置查一次表、至多核对MAX_SPAN_CANDIDATES个位置；只有高度重复的文本才会用满候选数，
+// 普通文本的吞吐量大致不随长度变化，表超出缓存后每次查表是一次缓存未命中
+std::vector<MatchedSpan> find_matched_spans(const LocatedText& a, const LocatedText& b, size_t k, HashMode mode,
+                                            size_t min_codepoints);
+
+// ==================== 精确公共子串（后缀数组） ====================
+
+// 后缀数组：按字典序排列的全部后缀起点。倍增法，每轮对 (rank[i], rank[i+h]) 做两趟计数排序，
+// 所有后缀的名次互不相同时停止，复杂度O(n log n)；长度必须小于 2^32 - 1
+std::vector<uint32_t> build_suffix_array(const std::vector<uint32_t>& text);
+
+// LCP数组（Kasai算法，O(n)）：lcp[r] 为后缀 sa[r-1] 与 sa[r] 的最长公共前缀长度，lcp[0] = 0
+std::vector<uint32_t> build_lcp_array(const std::vector<uint32_t>& text, const std::vector<uint32_t>& sa);
+
+// A与B共有的一段子串，位置与长度均以归一化码点计
+struct CommonSubstring {
+    size_t a_start = 0;
+    size_t b_start = 0;
+    size_t length = 0;
+};
+
+// 精确匹配的结果：达到长度阈值的公共子串，以及两边被其覆盖的码点数
+struct CommonSubstringReport {
+    std::vector<CommonSubstring> substrings;
+    size_t length_a = 0;
+    size_t length_b = 0;
+    size_t covered_a = 0;
+    size_t covered_b = 0;
+    double coverage_a = 0.0;  // covered_a / length_a：原文有多大比例出现在抄袭版中
+    double coverage_b = 0.0;  // covered_b / length_b：抄袭版有多大比例出现在原文中
+    double similarity = 0.0;  // (covered_a + covered_b) / (length_a + length_b)
+};
+
+// 精确的公共子串检测：对 A + 分隔符 + B 建后缀数组与LCP数组，沿后缀数组正反各扫描一遍，
+// 得到每个位置在另一份文本中的最长匹配。没有哈希冲突，一段长的抄袭也不会被拆成零散的k-gram
+// substrings 对B中的每个位置给出从该处开始、长度不小于min_length的最长匹配，已被前一个位置的匹配包含的省略，
+// 按b_start升序；覆盖率只统计长度不小于min_length的匹配。码点不能为 UINT32_MAX（用作分隔符）
+CommonSubstringReport find_common_substrings(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b,
+                                             size_t min_length);
+
+// ==================== 语料库模式（倒排索引） ====================
+
+// 倒排索引：k-gram哈希值 -> 包含该哈希的文档ID列表
+// terms升序排列，第t个哈希的倒排表为 postings[offsets[t], offsets[t+1])
+// 建索引时可以去掉一组停用k-gram（模板文本），它们不进入倒排表也不计入集合大小，查询时同样从查询集合中去掉
+struct CorpusIndex {
+    FingerprintOptions options;            // 建索引时使用的指纹参数，查询时必须一致
+    double max_df = 0.0;                   // 停用k-gram的文档频率上限（见stop_grams），0表示未去除
+    std::vector<uint64_t> stop_grams;      // 从每个文档和查询中去掉的k-gram（升序）
+    std::vector<std::string> doc_paths;    // 文档路径（文档ID即下标）
+    std::vector<uint64_t> doc_set_sizes;   // 每个文档的k-gram集合大小
+    std::vector<uint64_t> terms;           // 去重后的k-gram哈希值（升序）
+    std::vector<uint64_t> offsets;         // 倒排表偏移，长度为terms.size()+1
+    std::vector<uint32_t> postings;        // 所有倒排表拼接（每个表内文档ID升序）
+};
+
+// 读取文档列表文件：每行一个文档路径，忽略空行
+std::vector<std::string> read_path_list(const std::string& list_path);
+
+// 倒排索引构建器：逐个加入文档的k-gram集合，最后一次性生成倒排表
+class CorpusIndexBuilder {
+private:
+    CorpusIndex index;
+    std::vector<std::pair<uint64_t, uint32_t>> pairs;  // (哈希值, 文档ID)
+
+public:
+    explicit CorpusIndexBuilder(const FingerprintOptions& options) { index.options = options; }
+
+    // 加入的每个文档先去掉stop_grams（升序，通常为 stop_grams(文档频率表, max_df)），两者记录在索引中
+    CorpusIndexBuilder(const FingerprintOptions& options, std::vector<uint64_t> stop_grams, double max_df) {
+        index.options = options;
+        index.stop_grams = std::move(stop_grams);
+        index.max_df = max_df;
+    }
+
+    // 加入一个文档（有序向量集合），返回其文档ID
+    uint32_t add_document(const std::string& doc_path, const std::vector<uint64_t>& hashes);
+
+    // 排序后即按哈希分组、组内按文档ID升序，据此生成倒排表
+    CorpusIndex finish();
+};
+
+// 为一组文档构建倒排索引：每个文档只读取、归一化、哈希一次
+CorpusIndex build_corpus_index(const std::vector<std::string>& doc_paths, const FingerprintOptions& options);
+
+// 同上，但每个文档先去掉停用k-gram
+CorpusIndex build_corpus_index(const std::vector<std::string>& doc_paths, const FingerprintOptions& options,
+                               const std::vector<uint64_t>& stop_grams, double max_df);
+
+// 将倒排索引保存到磁盘
+void save_corpus_index(const CorpusIndex& index, const std::string& path);
+
+// 从磁盘加载倒排索引
+CorpusIndex load_corpus_index(const std::string& path);
+
+// 用倒排表计数一次性计算查询集合与所有文档的Jaccard相似度
+// 交集大小 = 查询的k-gram在该文档倒排表中出现的次数，并集 = |A| + |B| - 交集
+// 查询集合先去掉索引的停用k-gram，结果与两边都去掉停用k-gram后的Jaccard相同
+std::vector<double> query_corpus_index(const CorpusIndex& index, const std::vector<uint64_t>& query_set);
+
+// 前K个最相似文档中的一项
+struct RankedDocument {
+    uint32_t doc = 0;     // 文档ID
+    double score = 0.0;   // Jaccard相似度，与query_corpus_index的结果相同
+};
+
+// 前K查询的剪枝统计：未出现在扫描过的倒排表中的文档（documents - candidates）都被前缀过滤剪掉
+struct TopKStats {
+    size_t documents = 0;      // 语料库文档数
+    size_t terms = 0;          // 查询中语料库里有的k-gram数
+    size_t scanned_terms = 0;  // 前缀：从最稀有的开始完整扫描了倒排表的k-gram数
+    size_t candidates = 0;     // 在扫描过的倒排表中出现过的不同文档数
+    size_t size_pruned = 0;    // 集合大小决定其相似度不可能进入前K，未计数
+    size_t bound_pruned = 0;   // 计数途中相似度上界已低于第K名的下界，提前放弃
+    size_t verified = 0;       // 交集完整计数
+};
+
+// 前K查询放弃剪枝的界限：k占文档数的比例达到 1/TOP_K_FULL_SCAN_SHARE 时第K名得分通常很低，
+// 几乎读完所有倒排表，剪枝的额外开销反而使查询慢于全量计数
+const size_t TOP_K_FULL_SCAN_SHARE = 64;
+
+// 查询与语料库中最相似的前k个文档（相似度大于0），按相似度降序、相同时按文档ID升序，
+// 结果与对query_corpus_index的全部得分排序后取前k个相同（查询集合同样先去掉停用k-gram）
+// 查询的k-gram按倒排表长度从短到长处理，文档在已处理的倒排表中出现c次，其交集在 [c, c+剩余词项数] 内；
+// 各文档相似度下界中第K大的记为t，据此剪枝：
+//   集合大小：交集不超过 min(|A|,|B|)，min/max < t 的文档不计数
+//   前缀过滤：只剩r个k-gram未处理时，此后才出现的文档相似度不超过 r/|A|，低于t即不再扫描整个倒排表
+//   上界：此后只为上界不低于t的文档计数，候选少时在倒排表中二分查找，不必读完常见k-gram的长倒排表
+// k不小于文档数的1/TOP_K_FULL_SCAN_SHARE时不剪枝，所有倒排表各读一遍，开销与query_corpus_index相当
+std::vector<RankedDocument> query_corpus_top_k(const CorpusIndex& index, const std::vector<uint64_t>& query_set,
+                                               size_t k, TopKStats* stats = nullptr);
+
+// ==================== MinHash签名与LSH候选检索 ====================
+
+// 默认签名长度：128个64位最小哈希值
+const size_t MINHASH_SIZE = 128;
+
+// 计算集合的MinHash签名：对每个哈希函数取集合元素在其下的最小值
+// 两个签名对应位置相等的概率等于两个集合的Jaccard相似度；空集合的签名全为UINT64_MAX
+std::vector<uint64_t> minhash_signature(const std::vector<uint64_t>& hash_set, size_t num_hashes = MINHASH_SIZE);
+
+// 用两个签名相等位置的比例估计Jaccard相似度
+double minhash_similarity(const uint64_t* sig1, const uint64_t* sig2, size_t num_hashes);
+
+// LSH分带参数：签名被切成bands段，每段rows个值；某一段完全相同的文档成为候选
+// 相似度为s的文档对成为候选的概率为 1 - (1 - s^rows)^bands，阈值约为 (1/bands)^(1/rows)
+struct LshParams {
+    size_t bands = 0;
+    size_t rows = 0;
+};
+
+// 为给定签名长度和相似度阈值选择分带参数：在 bands*rows = num_hashes 的方案中，
+// 取近似阈值不超过目标阈值的最大者，宁可多出候选也不漏掉相似文档
+LshParams choose_lsh_params(size_t num_hashes, double threshold);
+
+// LSH分带索引：每段一张按桶键排序的 (桶键, 文档ID) 表，查询时二分查找
+class LshIndex {
+private:
+    LshParams params;
+    std::vector<std::vector<std::pair<uint64_t, uint32_t>>> tables;  // 每段一张表
+
+public:
+    // signatures按文档顺序拼接，每个文档num_hashes个值
+    LshIndex(const std::vector<uint64_t>& signatures, size_t num_hashes, LshParams p);
+
+    // 返回与查询签名至少有一段完全相同的文档ID（升序、去重）
+    std::vector<uint32_t> candidates(const uint64_t* signature) const;
+};
+
+// 签名库：一组文档的MinHash签名，保存到磁盘供后续筛查
+struct SignatureStore {
+    FingerprintOptions options;           // 生成签名时的指纹参数
+    uint32_t num_hashes = MINHASH_SIZE;   // 每个签名的长度
+    std::vector<std::string> doc_paths;   // 文档路径（文档ID即下标）
+    std::vector<uint64_t> signatures;     // 按文档顺序拼接的签名
+};
+
+// 为一组文档计算签名
+SignatureStore build_signature_store(const std::vector<std::string>& doc_paths, const FingerprintOptions& options);
+
+// 将签名库保存到磁盘
+void save_signature_store(const SignatureStore& store, const std::string& path);
+
+// 从磁盘加载签名库
+SignatureStore load_signature_store(const std::string& path);
+
+// ==================== 文档频率表（模板文本降权） ====================
+
+// 语料库级的k-gram文档频率：每个哈希出现在多少个文档中（一个文档里出现多次只计一次）
+// 课程页眉、引用格式之类的模板文本出现在大量文档中，抬高所有得分，也让倒排表变长；
+// 据此可以去掉高频的停用k-gram，或按IDF加权计算相似度。精确计数，大小与语料中不同k-gram的个数成正比
+struct DocumentFrequencyTable {
+    FingerprintOptions options;     // 统计时使用的指纹参数，使用时必须一致
+    uint64_t documents = 0;         // 文档数
+    std::vector<uint64_t> hashes;   // 出现过的k-gram哈希值（升序）
+    std::vector<uint32_t> counts;   // counts[i]为hashes[i]的文档频率
+
+    // 哈希的文档频率，不在表中时为0
+    uint32_t frequency(uint64_t hash) const;
+};
+
+// 文档频率表构建器：逐个加入文档的k-gram集合，流式统计，不保留文档本身
+// 新加入的哈希先攒在缓冲区中，攒够一批排序后与已有的表归并，内存为表本身加一个缓冲区
+class DocumentFrequencyBuilder {
+private:
+    DocumentFrequencyTable table;
+    std::vector<uint64_t> pending;  // 尚未并入表中的哈希
+
+    // 把缓冲区排序后并入表中
+    void flush();
+
+public:
+    explicit DocumentFrequencyBuilder(const FingerprintOptions& options) { table.options = options; }
+
+    // 加入一个文档的k-gram集合（元素不重复）
+    void add_document(const std::vector<uint64_t>& hash_set);
+
+    // 按哈希排序，生成文档频率表
+    DocumentFrequencyTable finish();
+};
+
+// 依次读取一组文档并统计文档频率：每个文档只读取、归一化、哈希一次
+DocumentFrequencyTable build_document_frequencies(const std::vector<std::string>& doc_paths,
+                                                  const FingerprintOptions& options);
+
+// 倒排索引中已有文档频率：每个词项的倒排表长度（建索引时去掉的停用k-gram不在其中）
+DocumentFrequencyTable document_frequencies(const CorpusIndex& index);
+
+// 将文档频率表保存到磁盘
+void save_document_frequencies(const DocumentFrequencyTable& table, const std::string& path);
+
+// 从磁盘加载文档频率表
+DocumentFrequencyTable load_document_frequencies(const std::string& path);
+
+// 停用k-gram：文档频率超过 max_ratio * 文档数 的哈希（升序）
+std::vector<uint64_t> stop_grams(const DocumentFrequencyTable& table, double max_ratio);
+
+// 从有序的指纹集合中去掉停用k-gram（两个有序向量求差），集合变小，之后的交集和存储都随之变快变小
+void remove_stop_grams(std::vector<uint64_t>& hash_set, const std::vector<uint64_t>& stop);
+void remove_stop_grams(CountedFingerprint& fingerprint, const std::vector<uint64_t>& stop);
+
+// k-gram的IDF权重 ln((N + 1) / (df + 1))：出现在所有文档中的为0，语料中没有的为 ln(N + 1)
+double inverse_document_frequency(const DocumentFrequencyTable& table, uint64_t hash);
+
+// TF-IDF加权的Jaccard相似度：每个k-gram的权重为 出现次数 * IDF，
+// 结果为 Σ min(权重a, 权重b) / Σ max(权重a, 权重b)；模板文本的权重接近0，几乎不影响得分
+double tfidf_similarity(const CountedFingerprint& a, const CountedFingerprint& b, const DocumentFrequencyTable& table);
+
+// ==================== 指纹缓存 ====================
+// 参考原文会与成千上万份提交比较：按文件内容哈希缓存每个文档的指纹集合，
+// 内容未变时直接映射缓存文件，跳过归一化和k-gram构建。每个文档一个缓存文件，
+// 文件名由内容哈希、指纹参数（含归一化配置）和归一化版本组成，任何一项变化都会使用新的缓存文件
+
+// 归一化规则的版本号：修改任一配置的归一化逻辑（保留哪些字符、如何转换）时必须递增，使旧缓存失效
+const uint32_t NORMALIZATION_VERSION = 1;
+
+// 文件头长度（8字节对齐，映射后哈希数组可以直接按uint64_t访问）：
+// 标识8 + 版本4 + 指纹参数16（k、哈希算法、窗口、归一化配置） + 归一化版本4 + 内容哈希16 + 元素数8
+const size_t FINGERPRINT_CACHE_HEADER_SIZE = 56;
+
+// 文件内容的128位哈希：两路独立的64位哈希每次吸收8字节，长度参与初始化
+struct ContentHash {
+    uint64_t lo = 0;
+    uint64_t hi = 0;
+};
+
+ContentHash content_hash(ByteSpan bytes);
+
+// 有序去重的指纹集合：自己持有的向量，或者缓存文件映射到内存后的只读数组（不拷贝）
+class Fingerprint {
+private:
+    std::vector<uint64_t> owned;
+    std::unique_ptr<InputSource> mapping;
+    const uint64_t* hashes = nullptr;
+    size_t count = 0;
+
+public:
+    Fingerprint() = default;
+
+    explicit Fingerprint(std::vector<uint64_t> values)
+        : owned(std::move(values)), hashes(owned.data()), count(owned.size()) {}
+
+    Fingerprint(std::unique_ptr<InputSource> source, const uint64_t* data, size_t n)
+        : mapping(std::move(source)), hashes(data), count(n) {}
+
+    // 移动后向量缓冲区和映射区域都不变，指针仍然有效；拷贝会使指针悬空，因此禁止
+    Fingerprint(Fingerprint&&) = default;
+    Fingerprint& operator=(Fingerprint&&) = default;
+    Fingerprint(const Fingerprint&) = delete;
+    Fingerprint& operator=(const Fingerprint&) = delete;
+
+    const uint64_t* data() const { return hashes; }
+    size_t size() const { return count; }
+    bool is_mapped() const { return mapping != nullptr; }
+};
+
+double jaccard_similarity_sorted(const Fingerprint& set1, const Fingerprint& set2);
+
+// 缓存统计
+struct FingerprintCacheStats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t evictions = 0;
+    uint64_t bytes_in_use = 0;
+};
+
+// 指纹缓存目录：条目的大小与最近使用时间记录在目录下的 index.txt 中，
+// 总大小超过上限时按最近最少使用的顺序删除条目。可被多个线程同时使用
+class FingerprintCache {
+private:
+    struct Entry {
+        uint64_t size = 0;
+        uint64_t last_used = 0;  // 逻辑时钟，越大越新
+    };
+
+    std::string dir;
+    uint64_t max_bytes;
+    std::mutex mutex;  // 保护以下所有成员
+    std::unordered_map<std::string, Entry> entries;  // 缓存文件名 -> 条目
+    uint64_t total_bytes = 0;
+    uint64_t clock = 0;
+    size_t temp_counter = 0;
+    FingerprintCacheStats counters;
+
+    std::string index_path() const { return dir + "/index.txt"; }
+
+    static std::string to_hex(uint64_t value);
+
+    static std::string entry_name(const ContentHash& key, const FingerprintOptions& options);
+
+    // 读取缓存文件并校验文件头，任何不一致都视为未命中
+    static bool load_entry(const std::string& path, const ContentHash& key, const FingerprintOptions& options,
+                           Fingerprint& result);
+
+    // 写入缓存文件：先写临时文件再重命名，并发写同一条目时读者不会看到写了一半的文件
+    // 写入失败时放弃缓存该条目，不影响评分
+    bool store_entry(const std::string& name, const ContentHash& key, const FingerprintOptions& options,
+                     const std::vector<uint64_t>& hashes);
+
+    // 记录一次使用（调用方持有锁）
+    void touch_locked(const std::string& name, uint64_t size);
+
+    // 总大小超过上限时删除最久未使用的条目（调用方持有锁）
+    void evict_locked(const std::string& keep);
+
+    // 读取索引文件；文件不存在或格式不对时从空索引开始
+    void load_index();
+
+public:
+    // 打开（必要时创建）缓存目录，max_bytes为缓存文件总大小的上限
+    FingerprintCache(const std::string& directory, uint64_t max_bytes);
+
+    ~FingerprintCache();
+
+    FingerprintCache(const FingerprintCache&) = delete;
+    FingerprintCache& operator=(const FingerprintCache&) = delete;
+
+    // 获取文件的指纹集合：内容哈希命中时直接映射缓存文件，否则计算并写入缓存
+    // 标准输入（"-"）不经过缓存
+    Fingerprint fingerprint(const std::string& path, const FingerprintOptions& options);
+
+    FingerprintCacheStats stats();
+
+    // 写回索引文件（先写临时文件再重命名）
+    void save_index();
+};
+
+// ==================== 压缩指纹（Elias–Fano） ====================
+// 归档整个历史语料的指纹：有序集合按Elias–Fano编码，每个元素拆成低l位与高位，
+// 低位定长顺序拼接，高位的差值用一元码存入位向量（第i个元素置位于 (x_i >> l) + i）
+// 哈希在 [0, 2^b) 内均匀分布，每个元素约占 2 + log2(2^b / n) 位，接近有序集合的信息量下限；
+// 64位哈希本身的熵决定了无损存储仍需约 6~7 字节/元素，归档时可只保留哈希的高b位（b=32时约2字节/元素），
+// 代价是不同k-gram截断后相同的概率变为约 n / 2^b。求交集时两边各用一个读取器顺序解码，
+// 落后较多的一侧按高位位向量整字跳过，不展开成完整数组
+
+// 压缩指纹文件头长度：标识8 + 版本4 + 指纹参数16 + 归一化版本4 + 哈希位数4 + 低位位数4 + 元素数8 +
+// 高位位向量长度8，之后依次是低位与高位两段uint64_t数组
+const size_t COMPRESSED_FINGERPRINT_HEADER_SIZE = 56;
+
+struct CompressedFingerprint {
+    FingerprintOptions options;    // 生成指纹时的参数，只有参数相同的指纹才能比较
+    uint32_t normalization_version = NORMALIZATION_VERSION;
+    uint32_t hash_bits = 64;       // 每个哈希保留的高位数，64为无损
+    uint32_t low_bits = 0;         // 每个元素低位部分的位数
+    uint64_t count = 0;            // 元素个数（截断后去重）
+    uint64_t high_bit_count = 0;   // 高位位向量的有效位数
+    std::vector<uint64_t> low;     // 低位部分，第i个元素占 [i*low_bits, (i+1)*low_bits) 位，末尾多一个0字
+    std::vector<uint64_t> high;    // 高位部分的一元编码
+
+    // 编码后的字节数（不含文件头）
+    size_t payload_bytes() const { return (low.size() + high.size()) * sizeof(uint64_t); }
+
+    // 解码为有序向量集合（元素为截断后的哈希值）
+    std::vector<uint64_t> decode() const;
+};
+
+// 压缩有序去重的指纹集合；hash_bits < 64 时先把每个哈希右移到只剩高hash_bits位再去重
+CompressedFingerprint compress_fingerprint(const std::vector<uint64_t>& hashes, const FingerprintOptions& options,
+                                           uint32_t hash_bits = 64);
+
+// 顺序读取压缩指纹的元素，构造后位于第一个元素
+class EliasFanoReader {
+private:
+    const uint64_t* low;
+    const uint64_t* high;
+    size_t high_words;
+    uint64_t count;
+    uint32_t low_bits;
+    uint64_t low_mask;
+    uint64_t index = 0;      // 当前元素的序号
+    size_t word = 0;         // 当前元素所在的高位字
+    uint64_t bits = 0;       // 该字中当前元素及之后的1
+    uint64_t current = 0;
+
+    // 由当前元素在高位位向量中的位置与低位部分得到其值
+    void decode_current();
+
+    // 从位置from起找下一个置位，设为当前元素的位置并解码；超出位向量时结束
+    void seek_high(uint64_t from);
+
+public:
+    explicit EliasFanoReader(const CompressedFingerprint& fingerprint);
+
+    bool valid() const { return index < count; }
+
+    uint64_t value() const { return current; }
+
+    void next();
+
+    // 从当前元素起连续解码至多max个元素写入out，返回个数，之后位于下一个未读元素
+    size_t read(uint64_t* out, size_t max);
+
+    // 前进到第一个不小于target的元素：目标桶较远时按位向量中的0（每个0代表一个高位桶）整字跳过，
+    // 再逐个比较
+    void skip_to(uint64_t target);
+};
+
+// 直接在两个压缩流上求交集大小：两边各解码一小块做无分支归并，一块用完再解码下一块，
+// 下一块的起点先跳到另一侧当前元素处；大小相差16倍以上时逐个取小的一侧，在大的一侧跳转查找
+// 两边的指纹参数与哈希位数必须相同，否则抛出异常
+size_t intersection_count_compressed(const CompressedFingerprint& a, const CompressedFingerprint& b);
+
+// 压缩指纹的Jaccard相似度，hash_bits为64时与jaccard_similarity_sorted逐位一致
+double jaccard_similarity_compressed(const CompressedFingerprint& a, const CompressedFingerprint& b);
+
+// 保存、加载压缩指纹文件；加载时校验文件头与各段长度，不一致时抛出异常
+void save_compressed_fingerprint(const CompressedFingerprint& fingerprint, const std::string& path);
+
+CompressedFingerprint load_compressed_fingerprint(const std::string& path);
+
+// ==================== 批量模式（多线程） ====================
+
+// 工作窃取调度器：任务编号 [0, n) 先按线程数均分为连续区间，每个线程从自己区间的前端逐个领取；
+// 自己的区间取完后，从其他线程剩余区间的后端窃取一半，直到所有区间都为空
+// 文件大小差异很大时，先做完的线程自动分担慢线程的剩余任务，调用线程本身也是工作线程之一
+// 其余工作线程在第一次并行执行时创建，之后常驻、在条件变量上等待下一次调用，直到调度器析构；
+// 每次调用只需唤醒它们，不再创建和回收线程（评分服务每批一次、单对并行每对数次调用）
+// 不同线程同时调用时逐个执行；任务中不能再调用同一个调度器（抛出异常）
+class WorkStealingScheduler {
+private:
+    struct WorkRange {
+        std::mutex mutex;
+        size_t begin = 0;
+        size_t end = 0;
+        char padding[64];  // 隔开相邻线程的区间，避免伪共享
+    };
+
+    size_t num_threads;
+    std::vector<std::thread> pool;      // 常驻工作线程，pool[i]的线程编号为i+1（0号为调用线程）
+    std::mutex dispatch_mutex;          // 同一时间只执行一次调用
+    std::mutex mutex;                   // 保护以下分派状态
+    std::condition_variable wake;       // 有新的调用或调度器析构
+    std::condition_variable done;       // 参与的工作线程都已返回
+    const std::function<void(size_t)>* job = nullptr;  // 当前调用中每个线程执行的函数，参数为线程编号
+    size_t job_workers = 0;             // 参与当前调用的线程数（含调用线程）
+    uint64_t generation = 0;            // 每次分派加一，工作线程据此识别新的调用
+    size_t busy = 0;                    // 尚未返回的工作线程数
+    bool stopping = false;
+
+    // 领取下一个任务：先取自己区间的前端，取完后窃取其他线程区间的后一半
+    static bool next_task(WorkRange* ranges, size_t workers, size_t self, size_t& index);
+
+    // 常驻工作线程的主循环，seen为创建时已分派过的调用次数
+    void worker_loop(size_t self, uint64_t seen);
+
+    // 在编号 [0, workers) 的线程上各调用一次body(编号)，调用线程自己执行0号，全部返回后返回
+    void run_workers(size_t workers, const std::function<void(size_t)>& body);
+
+public:
+    explicit WorkStealingScheduler(size_t threads) : num_threads(std::max<size_t>(threads, 1)) {}
+    ~WorkStealingScheduler();
+
+    WorkStealingScheduler(const WorkStealingScheduler&) = delete;
+    WorkStealingScheduler& operator=(const WorkStealingScheduler&) = delete;
+
+    size_t threads() const { return num_threads; }
+
+    // 对 [0, n) 中的每个编号调用一次 task(index)，全部完成后返回
+    // 任一任务抛出异常时其余线程停止领取新任务，异常在调用线程中重新抛出
+    template <typename Task>
+    void parallel_for(size_t n, Task&& task) {
+        parallel_for_workers(n, [&task](size_t index, size_t) { task(index); });
+    }
+
+    // 同parallel_for，但调用 task(index, worker)，worker < threads() 为执行该任务的线程编号，
+    // 同一编号的任务不会并发执行，可用于索引每线程独占的工作区
+    template <typename Task>
+    void parallel_for_workers(size_t n, Task&& task) {
+        if (n == 0) return;
+        size_t workers = std::min(num_threads, n);
+        std::unique_ptr<WorkRange[]> ranges(new WorkRange[workers]);
+        for (size_t w = 0; w < workers; ++w) {
+            ranges[w].begin = n * w / workers;
+            ranges[w].end = n * (w + 1) / workers;
+        }
+
+        std::atomic<bool> failed(false);
+        std::exception_ptr error;
+        std::mutex error_mutex;
+        auto worker = [&](size_t self) {
+            try {
+                size_t index;
+                while (!failed.load(std::memory_order_relaxed) && next_task(ranges.get(), workers, self, index)) {
+                    task(index, self);
+                }
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error) error = std::current_exception();
+                failed = true;
+            }
+        };
+
+        run_workers(workers, worker);
+        if (error) std::rethrow_exception(error);
+    }
+};
+
+// 默认线程数：全部硬件线程，无法获取时为1
+size_t default_thread_count();
+
+// 读取批量清单：每行一对 "<原文路径>\t<抄袭版路径>"，忽略空行；路径不能是标准输入（"-"）
+std::vector<std::pair<std::string, std::string>> read_pair_manifest(const std::string& manifest_path);
+
+// 批量评分结果，与清单逐行对应
+struct BatchResult {
+    std::vector<double> scores;
+    std::vector<std::string> errors;  // 该行出错时的错误信息，成功时为空
+    size_t distinct_originals = 0;
+};
+
+// 批量评分：先并行计算每个不同原文的指纹（每个原文只算一次），之后各线程只读共享；
+// 再并行处理每一对：计算抄袭版指纹并与对应原文比较。单个文件出错只影响相关的行
+// 每个线程持有一个指纹工作区，抄袭版的指纹在工作区中计算后直接比较，稳定后每次比较不再分配堆内存
+// cache不为空时，原文和抄袭版的指纹都经过缓存；任何一行含标准输入（"-"）时抛出异常，不开始评分
+BatchResult score_batch(const std::vector<std::pair<std::string, std::string>>& pairs,
+                        const FingerprintOptions& options, WorkStealingScheduler& scheduler,
+                        FingerprintCache* cache = nullptr);
+
+// ==================== 单文档并行指纹 ====================
+
+// 并行指纹时每段的最小字节数，小于两段的文档仍按串行路径处理
+const size_t PARALLEL_MIN_SEGMENT = 1 << 20;
+
+// 从pos开始向后找到第一个不是UTF-8后续字节（10xxxxxx）的位置，没有则返回bytes.size
+// utf8_next遇到无效字节只前进一个字节，因此串行解码必然在每个这样的位置开始一个新序列；
+// 唯一的例外是最后3个字节：末尾被截断的多字节首字节会吞掉其后的全部字节
+size_t utf8_sync_point(ByteSpan bytes, size_t pos);
+
+// 同步点之后至少有这么多字节时，之前不可能有被末尾截断的序列
+const size_t UTF8_TAIL_GUARD = 4;
+
+// 把字节区间切成最多parts段，每段至少min_segment字节，切分点都在UTF-8同步点上
+// 返回各段起点（第一个为0），最后一段到区间末尾
+std::vector<size_t> split_utf8_segments(ByteSpan bytes, size_t parts, size_t min_segment = PARALLEL_MIN_SEGMENT);
+
+// 多个有序去重集合的并集：按哈希最高位把值域分片，每片由一个任务独立合并，结果按分片顺序拼接
+std::vector<uint64_t> parallel_union(const std::vector<std::vector<uint64_t>>& sets, WorkStealingScheduler& scheduler);
+
+// 两个有序向量集合的交集大小：按哈希前缀把值域分片，各片的交集并行计算后求和
+size_t intersection_count_parallel(const uint64_t* a, size_t na, const uint64_t* b, size_t nb,
+                                   WorkStealingScheduler& scheduler);
+
+// 同similarity_metrics(a, nullptr, na, b, nullptr, nb)，交集按哈希前缀分片并行计算，结果逐位一致
+SimilarityMetrics similarity_metrics_parallel(const uint64_t* a, size_t na, const uint64_t* b, size_t nb,
+                                              WorkStealingScheduler& scheduler);
+
+// 并行计算多篇文档的指纹集合，结果与逐篇调用fingerprint_bytes完全相同
+// 每篇文档在UTF-8同步点上切段，所有文档的所有段放进同一次parallel_for，因此两篇大文件同时处理；
+// 每段从起点独立解码、哈希、筛选，并越过段尾再多读 k-1+w-1 个码点，使跨段的k-gram与窗口都完整出现，
+// 重复的哈希在并集中去掉。只有第一段在文档末尾按短文本规则选出不足一个窗口的哈希
+// 各段的局部集合最后用parallel_union合并
+std::vector<std::vector<uint64_t>> fingerprint_documents_parallel(const std::vector<ByteSpan>& documents,
+                                                                  const FingerprintOptions& options,
+                                                                  WorkStealingScheduler& scheduler,
+                                                                  size_t min_segment = PARALLEL_MIN_SEGMENT);
+
+// 读取文件（映射到内存）并行计算它们的指纹集合；标准输入（"-"）不能切段，按串行流式读取
+std::vector<std::vector<uint64_t>> fingerprint_files_parallel(const std::vector<std::string>& paths,
+                                                              const FingerprintOptions& options,
+                                                              WorkStealingScheduler& scheduler);
+
+// ==================== 常驻评分服务（Unix域套接字） ====================
+
+// 服务协议：客户端在一个连接上可以连续发送多个请求（不必等待响应），响应按请求顺序逐行返回
+//   FILE\t<参考文档>\t<待测文件路径>\n        与服务端可读的文件比较（须为普通文件，不能是 "-"）
+//   TEXT\t<参考文档>\t<字节数>\n<UTF-8正文>    与请求中内联的文本比较
+// 参考文档为服务启动时文档列表中的路径（原样书写）
+// 响应为两位小数的相似度，或 "error\t<原因>"；TEXT的字节数无效或请求头过长时无法继续解析，返回错误后关闭连接
+
+// 评分服务配置
+struct ScoringServerConfig {
+    size_t threads = 1;                // 每批请求的评分线程数
+    size_t batch_window_us = 1000;     // 第一个请求到达后最多等待多久凑成一批（微秒，按毫秒向上取整）
+    size_t max_text_bytes = 16 << 20;  // TEXT请求正文的上限
+};
+
+// 服务统计
+struct ScoringServerStats {
+    uint64_t requests = 0;
+    uint64_t errors = 0;
+    uint64_t batches = 0;
+    uint64_t largest_batch = 0;
+    uint64_t connections = 0;
+};
+
+// 常驻评分服务：启动时计算参考文档的指纹并常驻内存；事件循环在一个线程中收发所有连接的数据，
+// 在批处理窗口内到达的请求合成一批，由工作窃取调度器并行评分（每个线程一个指纹工作区）
+// 待评分的请求数达到评分线程数时不再等待窗口结束，单线程时每轮收到的请求立即评分
+// 仅支持POSIX平台，Windows下listen()抛出异常
+class ScoringServer {
+private:
+    struct Connection {
+        int fd = -1;
+        std::string input;       // 已收到但尚未解析的字节
+        std::string output;      // 待发送的响应
+        size_t in_flight = 0;    // 已解析、尚未返回响应的请求数
+        bool peer_closed = false;
+        bool broken = false;     // 协议错误或写入失败，发完已有响应后关闭
+    };
+
+    struct Request {
+        uint64_t connection = 0;
+        size_t reference = 0;
+        bool inline_text = false;
+        std::string payload;     // 文件路径或内联文本
+        std::string error;       // 解析阶段已确定的错误
+        double score = 0.0;
+    };
+
+    FingerprintOptions options;
+    ScoringServerConfig config;
+    WorkStealingScheduler scheduler;
+    std::vector<FingerprintWorkspace> workspaces;  // 每个评分线程一个
+    std::vector<Fingerprint> references;
+    std::unordered_map<std::string, size_t> reference_ids;
+
+    int listen_fd = -1;
+    int wake_fds[2] = {-1, -1};  // 自管道：stop()写入一个字节唤醒事件循环
+    std::string socket_path;
+    std::atomic<bool> stopping;
+
+    std::unordered_map<uint64_t, Connection> connections;
+    uint64_t next_connection = 0;
+    std::vector<Request> pending;
+    ScoringServerStats counters;
+
+    void accept_connections();
+
+    // 读取连接上的全部可读数据并解析出完整的请求；返回false表示连接应立即关闭
+    bool read_connection(uint64_t id, Connection& conn);
+
+    // 从输入缓冲区解析请求，加入待评分队列
+    void parse_requests(uint64_t id, Connection& conn);
+
+    // 并行评分当前批次，并把响应按顺序追加到各连接的输出缓冲区
+    void score_pending();
+
+    // 尽量发送输出缓冲区；返回false表示写入失败
+    bool flush_connection(Connection& conn);
+
+    void close_connection(uint64_t id);
+
+public:
+    // 计算参考文档的指纹；任一参考文档无法读取时抛出异常
+    ScoringServer(const std::vector<std::string>& reference_paths, const FingerprintOptions& options,
+                  const ScoringServerConfig& config);
+
+    ~ScoringServer();
+
+    ScoringServer(const ScoringServer&) = delete;
+    ScoringServer& operator=(const ScoringServer&) = delete;
+
+    size_t reference_count() const { return references.size(); }
+
+    // 在path上创建并监听套接字；已存在的同名套接字文件（上次未清理）会被替换
+    void listen(const std::string& path);
+
+    // 事件循环，直到stop()后返回；返回前处理完已收到的请求，关闭所有连接并删除套接字文件
+    void run();
+
+    // 通知run()返回；只写原子变量和管道，可以在其他线程或信号处理函数中调用
+    void stop();
+
+    // run()返回后调用
+    ScoringServerStats stats() const { return counters; }
+};
+
+// 评分服务的客户端连接：请求可以连续发送，响应按发送顺序读取
+class ScoringClient {
+private:
+    int fd = -1;
+    std::string input;  // 已收到但尚未返回的响应字节
+
+    void send_all(const char* data, size_t size);
+
+public:
+    explicit ScoringClient(const std::string& socket_path);
+    ~ScoringClient();
+
+    ScoringClient(const ScoringClient&) = delete;
+    ScoringClient& operator=(const ScoringClient&) = delete;
+
+    void send_file(const std::string& reference, const std::string& path);
+    void send_text(const std::string& reference, ByteSpan text);
+
+    // 读取下一行响应（不含换行符）；服务端关闭连接时抛出异常
+    std::string read_response();
+};
+
+// 负载测试的一个请求：text不为空时以TEXT请求发送内联文本，否则以FILE请求发送路径
+struct LoadRequest {
+    std::string reference;
+    std::string path;
+    std::string text;
+};
+
+// 负载测试结果，延迟为请求发出到收到响应的时间
+struct LoadReport {
+    size_t requests = 0;
+    size_t errors = 0;
+    double seconds = 0.0;
+    double p50_us = 0.0;
+    double p99_us = 0.0;
+    double max_us = 0.0;
+};
+
+// 负载测试：connections个连接并发，每个连接最多保持depth个未返回的请求（流水线），
+// 共发送total个请求，依次循环使用requests中的请求
+LoadReport run_load_test(const std::string& socket_path, const std::vector<LoadRequest>& requests, size_t total,
+                         size_t connections, size_t depth);
+
+}  // namespace pd
+
+#endif  // PLAGIARISM_DETECTOR_H
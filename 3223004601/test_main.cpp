@@ -12,6 +12,18 @@
 #include <cassert>
 #include <sstream>
 #include <chrono>
+#include <utility>
+#include <cmath>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <exception>
+#include <unordered_map>
+#include <iterator>
+
+#include "plagiarism_detector.h"
+
+using namespace pd;
 
 // 测试框架宏定义
 #define ASSERT_EQ(expected, actual) \
@@ -97,135 +109,6 @@ public:
         return failed == 0;
     }
 };
-
-// 包含主程序的核心函数（复制过来用于测试）
-bool is_cjk(uint32_t cp) {
-    if ((cp >= 0x4E00 && cp <= 0x9FFF) ||
-        (cp >= 0x3400 && cp <= 0x4DBF) ||
-        (cp >= 0xF900 && cp <= 0xFAFF) ||
-        (cp >= 0x20000 && cp <= 0x2A6DF) ||
-        (cp >= 0x2A700 && cp <= 0x2B73F) ||
-        (cp >= 0x2B740 && cp <= 0x2B81F) ||
-        (cp >= 0x2B820 && cp <= 0x2CEAF) ||
-        (cp >= 0x2CEB0 && cp <= 0x2EBEF)) return true;
-    return false;
-}
-
-bool is_keep_ascii(char c) {
-    if (c >= 'A' && c <= 'Z') return true;
-    if (c >= 'a' && c <= 'z') return true;
-    if (c >= '0' && c <= '9') return true;
-    return false;
-}
-
-char to_lower_ascii(char c) {
-    if (c >= 'A' && c <= 'Z') return c - 'A' + 'a';
-    return c;
-}
-
-uint32_t utf8_next(const std::vector<unsigned char>& bytes, size_t& i) {
-    if (i >= bytes.size()) return 0;
-    unsigned char b0 = bytes[i];
-    
-    if (b0 < 0x80) {
-        i++;
-        return b0;
-    }
-    
-    int seqlen = 0;
-    uint32_t cp = 0;
-    if ((b0 & 0xE0) == 0xC0) { seqlen = 2; cp = b0 & 0x1F; }
-    else if ((b0 & 0xF0) == 0xE0) { seqlen = 3; cp = b0 & 0x0F; }
-    else if ((b0 & 0xF8) == 0xF0) { seqlen = 4; cp = b0 & 0x07; }
-    else { i++; return 0; }
-    
-    if (i + seqlen > bytes.size()) { i = bytes.size(); return 0; }
-    
-    for (int k = 1; k < seqlen; ++k) {
-        unsigned char bx = bytes[i + k];
-        if ((bx & 0xC0) != 0x80) { i++; return 0; }
-        cp = (cp << 6) | (uint32_t)(bx & 0x3F);
-    }
-    
-    if (seqlen == 2 && cp < 0x80) { i++; return 0; }
-    if (seqlen == 3 && cp < 0x800) { i++; return 0; }
-    if (seqlen == 4 && cp < 0x10000) { i++; return 0; }
-    
-    if (cp >= 0xD800 && cp <= 0xDFFF) { i++; return 0; }
-    
-    i += seqlen;
-    return cp;
-}
-
-std::vector<uint32_t> normalize_to_codepoints(const std::vector<unsigned char>& bytes) {
-    std::vector<uint32_t> codepoints;
-    size_t i = 0;
-    
-    while (i < bytes.size()) {
-        uint32_t cp = utf8_next(bytes, i);
-        if (cp == 0) continue;
-        
-        if (cp < 128) {
-            if (is_keep_ascii(static_cast<char>(cp))) {
-                cp = to_lower_ascii(static_cast<char>(cp));
-                codepoints.push_back(cp);
-            }
-        } else {
-            if (is_cjk(cp)) {
-                codepoints.push_back(cp);
-            }
-        }
-    }
-    
-    return codepoints;
-}
-
-uint64_t fnv1a64_hash_kgram(const std::vector<uint32_t>& codepoints, size_t start, size_t k) {
-    const uint64_t FNV_OFFSET = 1469598103934665603ULL;
-    const uint64_t FNV_PRIME = 1099511628211ULL;
-    uint64_t h = FNV_OFFSET;
-    
-    for (size_t i = 0; i < k; ++i) {
-        uint32_t cp = codepoints[start + i];
-        for (int b = 0; b < 4; ++b) {
-            unsigned char x = static_cast<unsigned char>((cp >> (b * 8)) & 0xFFu);
-            h ^= static_cast<uint64_t>(x);
-            h *= FNV_PRIME;
-        }
-    }
-    return h;
-}
-
-std::unordered_set<uint64_t> build_kgram_set(const std::vector<uint32_t>& codepoints, size_t k) {
-    std::unordered_set<uint64_t> hash_set;
-    if (k == 0 || codepoints.size() < k) return hash_set;
-    
-    size_t num = codepoints.size() - k + 1;
-    
-    for (size_t i = 0; i < num; ++i) {
-        uint64_t hash = fnv1a64_hash_kgram(codepoints, i, k);
-        hash_set.insert(hash);
-    }
-    
-    return hash_set;
-}
-
-double jaccard_similarity(const std::unordered_set<uint64_t>& set1, const std::unordered_set<uint64_t>& set2) {
-    if (set1.empty() && set2.empty()) return 0.0;
-    
-    size_t intersection = 0;
-    for (const auto& hash : set1) {
-        if (set2.find(hash) != set2.end()) {
-            intersection++;
-        }
-    }
-    
-    size_t union_size = set1.size() + set2.size() - intersection;
-    if (union_size == 0) return 0.0;
-    
-    return static_cast<double>(intersection) / static_cast<double>(union_size);
-}
-
 // 测试用例1：CJK字符识别
 class TestCJKRecognition : public TestCase {
 public:
@@ -497,6 +380,1986 @@ public:
     }
 };
 
+// 测试用例11：语料库倒排索引
+class TestCorpusIndex : public TestCase {
+public:
+    std::string getName() const override { return "语料库倒排索引测试"; }
+    
+    bool run() override {
+        std::vector<std::string> texts = {"今天天气很好我们去公园散步", "今天天气很好适合出门", "completely different text"};
+        std::vector<std::vector<uint64_t>> sets;
+        
+        CorpusIndexBuilder builder(FingerprintOptions{});
+        for (size_t i = 0; i < texts.size(); ++i) {
+            std::vector<unsigned char> bytes(texts[i].begin(), texts[i].end());
+            sets.push_back(build_kgram_vector(normalize_to_codepoints(bytes), 3));
+            ASSERT_EQ(i, builder.add_document("doc" + std::to_string(i), sets.back()));
+        }
+        CorpusIndex index = builder.finish();
+        ASSERT_EQ(3, index.doc_paths.size());
+        ASSERT_EQ(index.terms.size() + 1, index.offsets.size());
+        ASSERT_TRUE(std::is_sorted(index.terms.begin(), index.terms.end()));
+        
+        // 倒排表计数得到的相似度应与逐对计算完全一致
+        std::string query_text = "今天天气很好我们去散步";
+        std::vector<unsigned char> query_bytes(query_text.begin(), query_text.end());
+        std::vector<uint64_t> query_set = build_kgram_vector(normalize_to_codepoints(query_bytes), 3);
+        std::vector<double> scores = query_corpus_index(index, query_set);
+        ASSERT_EQ(3, scores.size());
+        for (size_t i = 0; i < sets.size(); ++i) {
+            ASSERT_EQ(jaccard_similarity_sorted(query_set, sets[i]), scores[i]);
+        }
+        ASSERT_TRUE(scores[0] > scores[1]);
+        ASSERT_EQ(0.0, scores[2]);
+        
+        // 保存后加载结果不变；倒排表中的文档ID越界、截断或多出字节的文件拒绝加载
+        const std::string path = "test_corpus_index.idx";
+        save_corpus_index(index, path);
+        ASSERT_TRUE(query_corpus_index(load_corpus_index(path), query_set) == scores);
+        std::string good;
+        {
+            std::ifstream in(path, std::ios::binary);
+            good.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+        std::string bad_doc = good;
+        const uint32_t bad_id = 0x7ffffff0;
+        std::memcpy(&bad_doc[bad_doc.size() - sizeof(bad_id)], &bad_id, sizeof(bad_id));  // 最后一个倒排表项
+        for (const std::string& corrupt : {bad_doc, good.substr(0, good.size() - 1), good + '\0'}) {
+            {
+                std::ofstream out(path, std::ios::binary);
+                out << corrupt;
+            }
+            bool threw = false;
+            try {
+                load_corpus_index(path);
+            } catch (const std::runtime_error&) {
+                threw = true;
+            }
+            ASSERT_TRUE(threw);
+        }
+        std::remove(path.c_str());
+        
+        return true;
+    }
+};
+
+// 测试用例12：滚动哈希
+class TestRollingHash : public TestCase {
+public:
+    std::string getName() const override { return "滚动哈希测试"; }
+    
+    bool run() override {
+        std::string text = "滚动哈希与逐窗口重新计算的结果必须一致 Rolling hash must match 123";
+        std::vector<unsigned char> bytes(text.begin(), text.end());
+        std::vector<uint32_t> codepoints = normalize_to_codepoints(bytes);
+        
+        for (size_t k = 1; k <= 8; ++k) {
+            // 逐步滑动的结果应与直接计算每个窗口的结果相同
+            std::vector<uint64_t> rolled;
+            for_each_kgram_hash(codepoints, k, HashMode::Rolling, [&rolled](uint64_t h) { rolled.push_back(h); });
+            ASSERT_EQ(codepoints.size() - k + 1, rolled.size());
+            for (size_t i = 0; i < rolled.size(); ++i) {
+                ASSERT_EQ(rolling_hash_kgram(codepoints, i, k), rolled[i]);
+            }
+            
+            // 去重后的集合大小应与FNV一致（无冲突）
+            ASSERT_EQ(build_kgram_set(codepoints, k, HashMode::Fnv).size(),
+                      build_kgram_set(codepoints, k, HashMode::Rolling).size());
+        }
+        
+        // 相同的k-gram无论出现在哪里，哈希值都相同
+        std::vector<uint32_t> repeated = {'a', 'b', 'c', 'x', 'a', 'b', 'c'};
+        ASSERT_EQ(rolling_hash_kgram(repeated, 0, 3), rolling_hash_kgram(repeated, 4, 3));
+        ASSERT_TRUE(rolling_hash_kgram(repeated, 0, 3) != rolling_hash_kgram(repeated, 1, 3));
+        ASSERT_EQ(4, build_kgram_set(repeated, 3, HashMode::Rolling).size()); // abc, bcx, cxa, xab
+        
+        return true;
+    }
+};
+
+// 测试用例13：Winnowing指纹选择
+class TestWinnowing : public TestCase {
+public:
+    std::string getName() const override { return "Winnowing指纹选择测试"; }
+    
+    bool run() override {
+        std::string text = "床前明月光疑是地上霜举头望明月低头思故乡 The quick brown fox jumps over the lazy dog 0123456789";
+        std::vector<unsigned char> bytes(text.begin(), text.end());
+        std::vector<uint32_t> codepoints = normalize_to_codepoints(bytes);
+        
+        // 窗口为1时等价于保留全部k-gram
+        FingerprintOptions options;
+        options.winnow_window = 1;
+        std::vector<uint64_t> full = build_kgram_vector(codepoints, options.k);
+        ASSERT_TRUE(build_fingerprint_vector(codepoints, options) == full);
+        
+        // 选中的指纹是全部k-gram的子集，且数量明显减少
+        options.winnow_window = 8;
+        std::vector<uint64_t> winnowed = build_fingerprint_vector(codepoints, options);
+        ASSERT_TRUE(!winnowed.empty());
+        ASSERT_TRUE(winnowed.size() < full.size() / 2);
+        ASSERT_TRUE(std::includes(full.begin(), full.end(), winnowed.begin(), winnowed.end()));
+        
+        // 长度达到保证值的公共片段一定能被检测到
+        size_t t = winnow_guarantee(options.k, options.winnow_window);
+        ASSERT_EQ(10, t);
+        std::string shared = "abcdefghij";
+        std::string doc1 = "前缀内容完全不同" + shared + "后缀一";
+        std::string doc2 = "zzzz另一篇文章" + shared + "结尾不同的部分";
+        std::vector<unsigned char> bytes1(doc1.begin(), doc1.end());
+        std::vector<unsigned char> bytes2(doc2.begin(), doc2.end());
+        std::vector<uint64_t> set1 = build_fingerprint_vector(normalize_to_codepoints(bytes1), options);
+        std::vector<uint64_t> set2 = build_fingerprint_vector(normalize_to_codepoints(bytes2), options);
+        ASSERT_TRUE(jaccard_similarity_sorted(set1, set2) > 0.0);
+        
+        // k-gram数量不足一个窗口的短文本也至少保留一个指纹
+        std::vector<uint32_t> short_text = {'a', 'b', 'c', 'd'};
+        ASSERT_EQ(1, build_fingerprint_vector(short_text, options).size());
+        
+        return true;
+    }
+};
+
+// 测试用例14：MinHash签名与LSH候选检索
+class TestMinHashLsh : public TestCase {
+public:
+    std::string getName() const override { return "MinHash与LSH测试"; }
+    
+    bool run() override {
+        // 构造Jaccard约为0.5的两个集合和一个无关集合
+        std::vector<uint64_t> set1, set2, set3;
+        for (uint64_t i = 0; i < 3000; ++i) set1.push_back(mix64(i));
+        for (uint64_t i = 1000; i < 4000; ++i) set2.push_back(mix64(i));
+        for (uint64_t i = 100000; i < 103000; ++i) set3.push_back(mix64(i));
+        sort_unique_hashes(set1);
+        sort_unique_hashes(set2);
+        sort_unique_hashes(set3);
+        
+        std::vector<uint64_t> sig1 = minhash_signature(set1);
+        std::vector<uint64_t> sig2 = minhash_signature(set2);
+        std::vector<uint64_t> sig3 = minhash_signature(set3);
+        ASSERT_EQ(MINHASH_SIZE, sig1.size());
+        
+        // 估计值应接近精确值
+        ASSERT_NEAR(1.0, minhash_similarity(sig1.data(), sig1.data(), MINHASH_SIZE), 1e-9);
+        ASSERT_NEAR(jaccard_similarity_sorted(set1, set2), minhash_similarity(sig1.data(), sig2.data(), MINHASH_SIZE), 0.15);
+        ASSERT_TRUE(minhash_similarity(sig1.data(), sig3.data(), MINHASH_SIZE) < 0.1);
+        
+        // 空集合与jaccard_similarity一致记为0
+        std::vector<uint64_t> empty_sig = minhash_signature(std::vector<uint64_t>());
+        ASSERT_NEAR(0.0, minhash_similarity(empty_sig.data(), empty_sig.data(), MINHASH_SIZE), 1e-9);
+        
+        // 分带参数满足 bands*rows = 签名长度，且阈值不高于目标
+        LshParams params = choose_lsh_params(MINHASH_SIZE, 0.4);
+        ASSERT_EQ(MINHASH_SIZE, params.bands * params.rows);
+        ASSERT_TRUE(std::pow(1.0 / params.bands, 1.0 / params.rows) <= 0.4);
+        
+        // LSH应把相似文档作为候选，排除无关文档
+        std::vector<uint64_t> all;
+        all.insert(all.end(), sig2.begin(), sig2.end());
+        all.insert(all.end(), sig3.begin(), sig3.end());
+        all.insert(all.end(), empty_sig.begin(), empty_sig.end());
+        LshIndex lsh(all, MINHASH_SIZE, params);
+        std::vector<uint32_t> candidates = lsh.candidates(sig1.data());
+        ASSERT_EQ(1, candidates.size());
+        ASSERT_EQ(0, candidates[0]);
+        
+        return true;
+    }
+};
+
+// 测试用例15：有序向量集合
+class TestSortedVectorSet : public TestCase {
+public:
+    std::string getName() const override { return "有序向量集合测试"; }
+    
+    bool run() override {
+        // 基数排序结果应与std::sort一致（包括重复值和小数组）
+        uint64_t state = 42;
+        for (size_t n : {0, 1, 7, 255, 256, 1000, 50000}) {
+            std::vector<uint64_t> values(n);
+            for (auto& v : values) {
+                state = mix64(state);
+                v = (state % 3 == 0) ? (state & 0xFFFF) : state;  // 混入大量高位相同的值
+            }
+            std::vector<uint64_t> expected = values;
+            std::sort(expected.begin(), expected.end());
+            radix_sort_u64(values);
+            ASSERT_TRUE(values == expected);
+        }
+        
+        // 有序向量集合与哈希集合的元素完全相同
+        std::string text = "有序向量集合与哈希集合必须包含完全相同的元素 sorted vectors 有序向量集合";
+        std::vector<unsigned char> bytes(text.begin(), text.end());
+        std::vector<uint32_t> codepoints = normalize_to_codepoints(bytes);
+        std::unordered_set<uint64_t> hash_set = build_kgram_set(codepoints, 3);
+        std::vector<uint64_t> sorted_set = build_kgram_vector(codepoints, 3);
+        ASSERT_EQ(hash_set.size(), sorted_set.size());
+        for (uint64_t h : sorted_set) {
+            ASSERT_TRUE(hash_set.count(h) == 1);
+        }
+        
+        // 各种大小（覆盖SIMD分块的尾部）下，交集大小与Jaccard相似度与哈希集合版本逐位一致
+        for (size_t n1 : {0, 3, 4, 5, 17, 1000}) {
+            for (size_t n2 : {0, 1, 4, 9, 800}) {
+                std::vector<uint64_t> a, b;
+                for (size_t i = 0; i < n1; ++i) a.push_back(mix64(i * 2));
+                for (size_t i = 0; i < n2; ++i) b.push_back(mix64(i * 3));
+                sort_unique_hashes(a);
+                sort_unique_hashes(b);
+                std::unordered_set<uint64_t> sa(a.begin(), a.end()), sb(b.begin(), b.end());
+                
+                size_t scalar = intersection_count_scalar(a.data(), a.size(), b.data(), b.size());
+                ASSERT_EQ(scalar, intersection_count_sorted(a.data(), a.size(), b.data(), b.size()));
+#ifdef PD_X86_SIMD
+                if (cpu_has_avx2()) {
+                    ASSERT_EQ(scalar, intersection_count_avx2(a.data(), a.size(), b.data(), b.size()));
+                }
+#endif
+                ASSERT_EQ(jaccard_similarity(sa, sb), jaccard_similarity_sorted(a, b));
+            }
+        }
+        
+        return true;
+    }
+};
+
+// 测试用例16：内存映射输入
+class TestInputSource : public TestCase {
+public:
+    std::string getName() const override { return "内存映射输入测试"; }
+    
+    bool run() override {
+        // 普通文件被映射，字节内容与缓冲读取完全一致
+        std::string text = "内存映射输入 Memory mapped input 零拷贝\n\xFF\xC3残缺字节";
+        const std::string path = "test_input_source.txt";
+        {
+            std::ofstream out(path, std::ios::binary);
+            out << text;
+        }
+        {
+            InputSource input(path);
+            ByteSpan span = input.bytes();
+            ASSERT_EQ(text.size(), span.size);
+            ASSERT_TRUE(std::memcmp(span.data, text.data(), text.size()) == 0);
+#ifndef _WIN32
+            ASSERT_TRUE(input.is_mapped());
+#endif
+            
+            // 直接在映射区间上归一化，结果与向量版本一致
+            std::vector<unsigned char> bytes(text.begin(), text.end());
+            ASSERT_TRUE(normalize_to_codepoints(span) == normalize_to_codepoints(bytes));
+        }
+        
+        // 空文件：不映射，返回空区间
+        {
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        }
+        {
+            InputSource input(path);
+            ASSERT_EQ(0u, input.bytes().size);
+            ASSERT_FALSE(input.is_mapped());
+            ASSERT_TRUE(normalize_to_codepoints(input.bytes()).empty());
+        }
+        std::remove(path.c_str());
+        
+        // 不存在的文件抛出异常
+        bool threw = false;
+        try {
+            InputSource input("nonexistent_input_source.txt");
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        ASSERT_TRUE(threw);
+        
+        // 流读取回退路径（标准输入、管道使用）
+        std::istringstream stream(text);
+        std::vector<unsigned char> streamed = read_stream_to_bytes(stream);
+        ASSERT_TRUE(streamed == std::vector<unsigned char>(text.begin(), text.end()));
+        
+        return true;
+    }
+};
+
+// 测试用例17：流式指纹
+class TestStreamingPipeline : public TestCase {
+public:
+    std::string getName() const override { return "流式指纹测试"; }
+    
+    bool run() override {
+        // 随机混合ASCII、中文、标点和非法字节，末尾附加被截断的多字节序列
+        std::vector<unsigned char> bytes;
+        uint64_t state = 7;
+        const std::string pieces[] = {"抄袭", "检测", "流式", "Stream", " ", "，", "\xFF", "\xE4\xB8", "a1", "\xF0\x9F\x98\x80"};
+        for (int i = 0; i < 3000; ++i) {
+            state = mix64(state + i);
+            const std::string& piece = pieces[state % 10];
+            bytes.insert(bytes.end(), piece.begin(), piece.end());
+        }
+        bytes.push_back(0xE6);
+        bytes.push_back(0x96);
+        
+        std::vector<uint32_t> codepoints = normalize_to_codepoints(bytes);
+        for (HashMode mode : {HashMode::Fnv, HashMode::Rolling}) {
+            for (size_t k : {1, 3, 7}) {
+                for (size_t window : {0, 4}) {
+                    FingerprintOptions options;
+                    options.k = k;
+                    options.hash_mode = mode;
+                    options.winnow_window = window;
+                    std::vector<uint64_t> expected = build_fingerprint_vector(codepoints, options);
+                    
+                    // 任意分块方式（包括把多字节序列切开）结果都与整体处理一致
+                    for (size_t chunk : {1, 2, 3, 5, 7, 64, 4096}) {
+                        StreamingFingerprinter fingerprinter(options);
+                        for (size_t offset = 0; offset < bytes.size(); offset += chunk) {
+                            fingerprinter.feed(bytes.data() + offset, std::min(chunk, bytes.size() - offset));
+                        }
+                        ASSERT_TRUE(fingerprinter.finish() == expected);
+                    }
+                    
+                    std::istringstream stream(std::string(bytes.begin(), bytes.end()));
+                    ASSERT_TRUE(fingerprint_stream(stream, options) == expected);
+                }
+            }
+        }
+        
+        // 空输入和不足k个码点的输入
+        FingerprintOptions options;
+        StreamingFingerprinter empty(options);
+        ASSERT_TRUE(empty.finish().empty());
+        StreamingFingerprinter short_text(options);
+        short_text.feed(reinterpret_cast<const unsigned char*>("ab"), 2);
+        ASSERT_TRUE(short_text.finish().empty());
+        
+        return true;
+    }
+};
+
+// 测试用例18：向量化归一化
+class TestSimdNormalize : public TestCase {
+public:
+    std::string getName() const override { return "向量化归一化测试"; }
+    
+    bool run() override {
+        // 随机拼接各类片段：ASCII、中文、非CJK的3字节字符、2/4字节字符，
+        // 以及过长编码、代理码点、孤立的后续字节、非法起始字节和被截断的序列
+        const std::string pieces[] = {
+            "Hello, World 123", "中文文本查重", "。，、", "\xC3\xA9", "\xF0\xA0\x80\x80", "\xF0\x9F\x98\x80",
+            "\xE0\x80\x80", "\xE0\x9F\xBF", "\xC0\x80", "\xED\xA0\x80", "\xED\xBF\xBF", "\x80", "\xBF\xBF",
+            "\xFF", "\xF8", "\xE4\xB8", "\xE4", "\n", "\xEF\xA4\x80", "\xE3\x90\x80", "ZZzz09@[`{", "\0",
+            // CJK区间边界：U+33FF U+3400 U+4DBF U+4DC0 U+4DFF U+4E00 U+9FFF U+A000 U+F8FF U+F900 U+FAFF U+FB00
+            "\xE3\x8F\xBF\xE3\x90\x80\xE4\xB6\xBF\xE4\xB7\x80\xE4\xB7\xBF\xE4\xB8\x80",
+            "\xE9\xBF\xBF\xEA\x80\x80\xEF\xA3\xBF\xEF\xA4\x80\xEF\xAB\xBF\xEF\xAC\x80"
+        };
+        const size_t num_pieces = sizeof(pieces) / sizeof(pieces[0]);
+        uint64_t state = 2024;
+        for (int round = 0; round < 2000; ++round) {
+            std::string text;
+            state = mix64(state + round);
+            size_t length = state % 200;
+            for (size_t j = 0; j < length; ++j) {
+                state = mix64(state);
+                // 偏向长串中文和ASCII，覆盖向量快速路径
+                size_t kind = state % (num_pieces + 4);
+                text += kind < num_pieces ? pieces[kind] : (kind % 2 ? "抄袭检测算法实现" : "plagiarism");
+            }
+            std::vector<unsigned char> bytes(text.begin(), text.end());
+            
+            std::vector<uint32_t> expected(bytes.size()), actual(bytes.size());
+            size_t i = 0;
+            expected.resize(normalize_utf8_scalar(bytes.data(), bytes.size(), i, bytes.size(), expected.data()));
+            ASSERT_EQ(bytes.size(), i);
+            
+            i = 0;
+            actual.resize(normalize_utf8(bytes.data(), bytes.size(), i, bytes.size(), actual.data()));
+            ASSERT_TRUE(actual == expected);
+#ifdef PD_X86_SIMD
+            if (cpu_has_avx2()) {
+                actual.assign(bytes.size(), 0);
+                i = 0;
+                actual.resize(normalize_utf8_avx2(bytes.data(), bytes.size(), i, bytes.size(), actual.data()));
+                ASSERT_TRUE(actual == expected);
+            }
+#endif
+            ASSERT_TRUE(normalize_to_codepoints(bytes) == expected);
+        }
+        
+        // 过长编码和代理码点即使出现在整块中文中间也必须被拒绝
+        std::string block = "中中中\xE0\x80\x80中中\xED\xA0\x80中中中中中中中中中中中";
+        std::vector<unsigned char> bytes(block.begin(), block.end());
+        ASSERT_EQ(16u, normalize_to_codepoints(bytes).size());
+        
+        return true;
+    }
+};
+
+// 测试用例19：工作窃取调度器
+class TestWorkStealingScheduler : public TestCase {
+public:
+    std::string getName() const override { return "工作窃取调度器测试"; }
+    
+    bool run() override {
+        // 每个任务恰好执行一次，与线程数和任务耗时分布无关；同一调度器反复使用，参与的线程数时多时少
+        for (size_t threads : {1, 2, 4, 7, 16}) {
+            WorkStealingScheduler scheduler(threads);
+            for (size_t n : {0, 1, 3, 100, 5000, 2}) {
+                std::vector<std::atomic<int>> visits(n);
+                for (auto& v : visits) v = 0;
+                std::atomic<uint64_t> checksum(0);
+                scheduler.parallel_for(n, [&](size_t index) {
+                    visits[index]++;
+                    // 前面的任务明显更慢，迫使其他线程来窃取
+                    uint64_t x = index;
+                    for (size_t r = 0; r < (index < n / 8 ? 2000u : 10u); ++r) x = mix64(x);
+                    checksum += x & 1;
+                });
+                for (auto& v : visits) {
+                    ASSERT_EQ(1, v.load());
+                }
+            }
+        }
+        
+        // 任务抛出的异常在调用线程中重新抛出
+        WorkStealingScheduler scheduler(4);
+        bool threw = false;
+        try {
+            scheduler.parallel_for(1000, [](size_t index) {
+                if (index == 500) throw std::runtime_error("task failed");
+            });
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        ASSERT_TRUE(threw);
+        ASSERT_EQ(1u, WorkStealingScheduler(0).threads());
+        
+        // 工作线程常驻：多次调用只用到固定的几个线程，出错之后仍可继续使用
+        std::mutex ids_mutex;
+        std::unordered_set<std::thread::id> ids;
+        for (int call = 0; call < 20; ++call) {
+            scheduler.parallel_for(64, [&](size_t) {
+                std::lock_guard<std::mutex> lock(ids_mutex);
+                ids.insert(std::this_thread::get_id());
+            });
+        }
+        ASSERT_TRUE(ids.size() <= 4);
+        
+        // 任务中再调用同一调度器会死锁，改为抛出异常
+        threw = false;
+        try {
+            scheduler.parallel_for(8, [&scheduler](size_t) { scheduler.parallel_for(2, [](size_t) {}); });
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        ASSERT_TRUE(threw);
+        std::atomic<size_t> after(0);
+        scheduler.parallel_for(100, [&after](size_t) { after++; });
+        ASSERT_EQ(100u, after.load());
+        
+        return true;
+    }
+};
+
+// 测试用例20：批量评分
+class TestBatchScoring : public TestCase {
+public:
+    std::string getName() const override { return "批量评分测试"; }
+    
+    bool run() override {
+        const std::vector<std::string> texts = {
+            "今天是星期天，天气晴，今天晚上我要去看电影。",
+            "今天是周天，天气晴朗，我晚上要去看电影。",
+            "机器学习是人工智能的一个分支 machine learning",
+            "机器学习属于人工智能领域的一个分支 machine learning"
+        };
+        std::vector<std::string> paths;
+        for (size_t i = 0; i < texts.size(); ++i) {
+            paths.push_back("test_batch_" + std::to_string(i) + ".txt");
+            std::ofstream out(paths.back(), std::ios::binary);
+            out << texts[i];
+        }
+        
+        // 同一原文出现多次，另有一个不存在的文件
+        std::vector<std::pair<std::string, std::string>> pairs = {
+            {paths[0], paths[1]}, {paths[2], paths[3]}, {paths[0], paths[3]},
+            {paths[0], paths[0]}, {paths[2], "nonexistent_batch.txt"}, {"nonexistent_batch.txt", paths[1]}
+        };
+        FingerprintOptions options;
+        for (size_t threads : {1, 3, 8}) {
+            WorkStealingScheduler scheduler(threads);
+            BatchResult result = score_batch(pairs, options, scheduler);
+            ASSERT_EQ(3u, result.distinct_originals);
+            for (size_t p = 0; p < 4; ++p) {
+                ASSERT_TRUE(result.errors[p].empty());
+                double expected = jaccard_similarity_sorted(fingerprint_file(pairs[p].first, options),
+                                                            fingerprint_file(pairs[p].second, options));
+                ASSERT_EQ(expected, result.scores[p]);
+            }
+            ASSERT_NEAR(1.0, result.scores[3], 1e-12);
+            ASSERT_FALSE(result.errors[4].empty());
+            ASSERT_FALSE(result.errors[5].empty());
+        }
+        
+        // 清单解析：制表符分隔，忽略空行，缺少制表符时报错
+        const std::string manifest = "test_batch_manifest.txt";
+        {
+            std::ofstream out(manifest, std::ios::binary);
+            out << "a b.txt\tc.txt\r\n\n" << "d.txt\te f.txt\n";
+        }
+        std::vector<std::pair<std::string, std::string>> parsed = read_pair_manifest(manifest);
+        ASSERT_EQ(2u, parsed.size());
+        ASSERT_TRUE(parsed[0].first == "a b.txt" && parsed[0].second == "c.txt");
+        ASSERT_TRUE(parsed[1].first == "d.txt" && parsed[1].second == "e f.txt");
+        {
+            std::ofstream out(manifest, std::ios::binary);
+            out << "only_one_path.txt\n";
+        }
+        bool threw = false;
+        try {
+            read_pair_manifest(manifest);
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        ASSERT_TRUE(threw);
+        
+        // 标准输入不能出现在清单或批量评分中：多个线程会同时读取它
+        for (const char* line : {"-\tc.txt\n", "a.txt\t-\n"}) {
+            {
+                std::ofstream out(manifest, std::ios::binary);
+                out << line;
+            }
+            threw = false;
+            try {
+                read_pair_manifest(manifest);
+            } catch (const std::runtime_error&) {
+                threw = true;
+            }
+            ASSERT_TRUE(threw);
+        }
+        threw = false;
+        try {
+            WorkStealingScheduler scheduler(2);
+            score_batch({{"-", paths[0]}, {paths[0], "-"}}, options, scheduler);
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        ASSERT_TRUE(threw);
+        
+        std::remove(manifest.c_str());
+        for (const std::string& path : paths) std::remove(path.c_str());
+        return true;
+    }
+};
+
+// 测试用例21：指纹缓存
+class TestFingerprintCache : public TestCase {
+public:
+    std::string getName() const override { return "指纹缓存测试"; }
+    
+    bool run() override {
+        const std::string dir = "test_fingerprint_cache";
+        const std::vector<std::string> texts = {
+            "今天是星期天，天气晴，今天晚上我要去看电影。",
+            "机器学习是人工智能的一个分支 machine learning",
+            "第三份文档用于测试缓存淘汰 eviction order"
+        };
+        std::vector<std::string> paths;
+        for (size_t i = 0; i < texts.size(); ++i) {
+            paths.push_back("test_cache_doc_" + std::to_string(i) + ".txt");
+            writeFile(paths.back(), texts[i]);
+        }
+        FingerprintOptions options;
+        
+        {
+            FingerprintCache cache(dir, 1 << 20);
+            Fingerprint first = cache.fingerprint(paths[0], options);
+            ASSERT_FALSE(first.is_mapped());
+            Fingerprint second = cache.fingerprint(paths[0], options);
+            ASSERT_TRUE(second.is_mapped());
+            ASSERT_TRUE(sameSet(second, fingerprint_file(paths[0], options)));
+            ASSERT_EQ(1u, cache.stats().hits);
+            ASSERT_EQ(1u, cache.stats().misses);
+            
+            // 指纹参数不同、内容改变都不能命中；内容相同的其他文件可以命中
+            FingerprintOptions k5 = options;
+            k5.k = 5;
+            ASSERT_TRUE(sameSet(cache.fingerprint(paths[0], k5), fingerprint_file(paths[0], k5)));
+            writeFile("test_cache_copy.txt", texts[0]);
+            ASSERT_TRUE(cache.fingerprint("test_cache_copy.txt", options).is_mapped());
+            writeFile("test_cache_copy.txt", texts[0] + "新增内容");
+            ASSERT_TRUE(sameSet(cache.fingerprint("test_cache_copy.txt", options),
+                                fingerprint_file("test_cache_copy.txt", options)));
+            ASSERT_EQ(2u, cache.stats().hits);
+            ASSERT_EQ(3u, cache.stats().misses);
+        }
+        
+        // 重新打开后索引仍然有效；损坏的缓存文件视为未命中并被重写
+        {
+            FingerprintCache cache(dir, 1 << 20);
+            ASSERT_TRUE(cache.fingerprint(paths[0], options).is_mapped());
+            ASSERT_EQ(3u, indexEntries(dir).size());
+            for (const std::string& name : indexEntries(dir)) {
+                std::ofstream(dir + "/" + name, std::ios::binary | std::ios::trunc) << "PDFP1";
+            }
+            Fingerprint rebuilt = cache.fingerprint(paths[0], options);
+            ASSERT_FALSE(rebuilt.is_mapped());
+            ASSERT_TRUE(sameSet(rebuilt, fingerprint_file(paths[0], options)));
+            ASSERT_TRUE(cache.fingerprint(paths[0], options).is_mapped());
+        }
+        clearCache(dir);
+        
+        // 超过大小上限时淘汰最久未使用的条目
+        {
+            uint64_t limit = 0;
+            for (const std::string& path : paths) {
+                limit += FINGERPRINT_CACHE_HEADER_SIZE + 8 * fingerprint_file(path, options).size();
+            }
+            limit -= 1;
+            FingerprintCache cache(dir, limit);
+            cache.fingerprint(paths[0], options);
+            cache.fingerprint(paths[1], options);
+            cache.fingerprint(paths[0], options);  // paths[1]成为最久未使用
+            cache.fingerprint(paths[2], options);
+            FingerprintCacheStats stats = cache.stats();
+            ASSERT_TRUE(stats.evictions >= 1);
+            ASSERT_TRUE(stats.bytes_in_use <= limit);
+            ASSERT_TRUE(cache.fingerprint(paths[0], options).is_mapped());
+            ASSERT_FALSE(cache.fingerprint(paths[1], options).is_mapped());
+        }
+        clearCache(dir);
+        
+        // 索引中不是条目名的行（改坏的索引、指向缓存目录之外的路径）被忽略，淘汰时不会删除对应文件
+        writeFile("test_cache_victim.txt", "keep me");
+        {
+            FingerprintCache cache(dir, 1 << 20);
+            cache.fingerprint(paths[0], options);
+        }
+        {
+            std::ofstream index(dir + "/index.txt", std::ios::binary | std::ios::app);
+            index << "../test_cache_victim.txt 999999999 1\n" << "index.txt 999999999 1\n";
+        }
+        {
+            FingerprintCache cache(dir, 1);  // 上限极小，加载后立即淘汰
+            ASSERT_TRUE(cache.stats().evictions >= 1);
+        }
+        ASSERT_TRUE(std::ifstream("test_cache_victim.txt").is_open());
+        ASSERT_TRUE(std::ifstream(dir + "/index.txt").is_open());
+        std::remove("test_cache_victim.txt");
+        clearCache(dir);
+        
+        // 内容哈希区分长度和尾部字节
+        std::string a = "abcdefgh", b = std::string("abcdefgh\0", 9);
+        ContentHash ha = content_hash(spanOf(a)), hb = content_hash(spanOf(b));
+        ASSERT_TRUE(ha.lo != hb.lo || ha.hi != hb.hi);
+        
+        // 空文件没有映射，字节区间的data为空指针
+        ContentHash empty = content_hash(ByteSpan());
+        ASSERT_TRUE(empty.lo == content_hash(spanOf("")).lo && empty.hi == content_hash(spanOf("")).hi);
+        writeFile("test_cache_empty.txt", "");
+        {
+            FingerprintCache cache(dir, 1 << 20);
+            ASSERT_EQ(0u, cache.fingerprint("test_cache_empty.txt", options).size());
+            ASSERT_EQ(0u, cache.fingerprint("test_cache_empty.txt", options).size());
+        }
+        clearCache(dir);
+        std::remove("test_cache_empty.txt");
+        
+        for (const std::string& path : paths) std::remove(path.c_str());
+        std::remove("test_cache_copy.txt");
+        return true;
+    }
+
+private:
+    static void writeFile(const std::string& path, const std::string& text) {
+        std::ofstream out(path, std::ios::binary);
+        out << text;
+    }
+    
+    static ByteSpan spanOf(const std::string& text) {
+        ByteSpan span;
+        span.data = reinterpret_cast<const unsigned char*>(text.data());
+        span.size = text.size();
+        return span;
+    }
+    
+    static bool sameSet(const Fingerprint& fingerprint, const std::vector<uint64_t>& expected) {
+        return fingerprint.size() == expected.size() &&
+               std::equal(expected.begin(), expected.end(), fingerprint.data());
+    }
+    
+    static std::vector<std::string> indexEntries(const std::string& dir) {
+        std::vector<std::string> names;
+        std::ifstream index(dir + "/index.txt");
+        std::string line;
+        std::getline(index, line);
+        while (std::getline(index, line)) names.push_back(line.substr(0, line.find(' ')));
+        return names;
+    }
+    
+    static void clearCache(const std::string& dir) {
+        for (const std::string& name : indexEntries(dir)) std::remove((dir + "/" + name).c_str());
+        std::remove((dir + "/index.txt").c_str());
+        std::remove(dir.c_str());
+    }
+};
+
+// 测试用例22：可复用的指纹工作区
+class TestFingerprintWorkspace : public TestCase {
+public:
+    std::string getName() const override { return "指纹工作区测试"; }
+    
+    bool run() override {
+        // 长短不一的文档：空文本、不足k个码点、普通文本，以及超过一个读取块、重复较多的长文本
+        const std::string pieces[] = {"抄袭", "检测", "工作区", "Arena", " ", "，", "\xFF", "a1", "复用"};
+        std::vector<std::string> docs = {"", "ab", "今天是星期天，天气晴，今天晚上我要去看电影。"};
+        uint64_t state = 11;
+        for (size_t length : {500, 40000}) {
+            std::string text;
+            for (size_t i = 0; i < length; ++i) {
+                state = mix64(state + i);
+                text += pieces[state % 9];
+            }
+            docs.push_back(text);
+        }
+        
+        for (HashMode mode : {HashMode::Fnv, HashMode::Rolling}) {
+            for (size_t k : {1, 3, 5}) {
+                for (size_t window : {0, 1, 4, 9}) {
+                    FingerprintOptions options;
+                    options.k = k;
+                    options.hash_mode = mode;
+                    options.winnow_window = window;
+                    
+                    // 同一工作区按不同顺序反复处理，每次结果都与一次性计算相同
+                    FingerprintWorkspace workspace(options);
+                    for (size_t round = 0; round < 2 * docs.size(); ++round) {
+                        const std::string& doc = docs[(round * 3) % docs.size()];
+                        ASSERT_TRUE(workspace.fingerprint_bytes(spanOf(doc)) == fingerprint_bytes(spanOf(doc), options));
+                    }
+                    std::istringstream stream(docs[3]);
+                    ASSERT_TRUE(workspace.fingerprint_stream(stream) == fingerprint_bytes(spanOf(docs[3]), options));
+                }
+            }
+        }
+        
+        // 处理过最长的文档后，再处理任何文档都不再重新分配结果缓冲区
+        FingerprintWorkspace workspace((FingerprintOptions()));
+        const std::vector<uint64_t>& largest = workspace.fingerprint_bytes(spanOf(docs.back()));
+        const uint64_t* data = largest.data();
+        size_t capacity = largest.capacity();
+        for (const std::string& doc : docs) {
+            const std::vector<uint64_t>& result = workspace.fingerprint_bytes(spanOf(doc));
+            ASSERT_TRUE(result.capacity() == capacity);
+            ASSERT_TRUE(result.empty() || result.data() == data);
+        }
+        
+        // 调度器提供的线程编号：小于线程数，且同一编号的任务不会并发执行
+        WorkStealingScheduler scheduler(4);
+        std::vector<size_t> busy(scheduler.threads(), 0), visits(5000, 0);
+        std::atomic<bool> overlapped(false);
+        scheduler.parallel_for_workers(visits.size(), [&](size_t index, size_t worker) {
+            if (worker >= busy.size() || busy[worker]++ != 0) overlapped = true;
+            visits[index]++;
+            if (worker < busy.size()) busy[worker]--;
+        });
+        ASSERT_FALSE(overlapped.load());
+        for (size_t count : visits) ASSERT_EQ(1u, count);
+        
+        return true;
+    }
+
+private:
+    static ByteSpan spanOf(const std::string& text) {
+        ByteSpan span;
+        span.data = reinterpret_cast<const unsigned char*>(text.data());
+        span.size = text.size();
+        return span;
+    }
+};
+
+// 测试用例23：常驻评分服务
+class TestScoringServer : public TestCase {
+private:
+    // 在运行中的服务上检查流水线请求、内联文本、错误请求和负载测试
+    bool exercise(const std::string& socket_path, const std::vector<std::string>& paths, double expected,
+                  const std::string& inline_text) {
+        ScoringClient client(socket_path);
+        client.send_file(paths[0], paths[1]);
+        ByteSpan text_span;
+        text_span.data = reinterpret_cast<const unsigned char*>(inline_text.data());
+        text_span.size = inline_text.size();
+        client.send_text(paths[0], text_span);
+        client.send_file("unknown_reference.txt", paths[1]);
+        client.send_file(paths[0], "nonexistent_server.txt");
+        client.send_file(paths[1], paths[1]);
+        client.send_file(paths[0], "-");  // 不能读取服务进程的标准输入
+        client.send_file(paths[0], ".");  // 目录等非普通文件
+
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.2f", expected);
+        ASSERT_EQ(std::string(text), client.read_response());
+        ASSERT_EQ(std::string(text), client.read_response());
+        ASSERT_TRUE(client.read_response().compare(0, 6, "error\t") == 0);
+        ASSERT_TRUE(client.read_response().compare(0, 6, "error\t") == 0);
+        ASSERT_EQ(std::string("1.00"), client.read_response());
+        ASSERT_TRUE(client.read_response().compare(0, 6, "error\t") == 0);
+        ASSERT_TRUE(client.read_response().compare(0, 6, "error\t") == 0);
+
+        std::vector<LoadRequest> requests(2);
+        requests[0].reference = paths[0];
+        requests[0].path = paths[1];
+        requests[1].reference = paths[0];
+        requests[1].text = inline_text;
+        LoadReport report = run_load_test(socket_path, requests, 50, 3, 4);
+        ASSERT_EQ(50u, report.requests);
+        ASSERT_EQ(0u, report.errors);
+        ASSERT_TRUE(report.p50_us <= report.p99_us && report.p99_us <= report.max_us);
+        return true;
+    }
+
+public:
+    std::string getName() const override { return "评分服务测试"; }
+    
+    bool run() override {
+#ifdef _WIN32
+        return true;  // Unix域套接字只在POSIX平台上支持
+#else
+        const std::vector<std::string> texts = {
+            "今天是星期天，天气晴，今天晚上我要去看电影。",
+            "今天是周天，天气晴朗，我晚上要去看电影。"
+        };
+        std::vector<std::string> paths;
+        for (size_t i = 0; i < texts.size(); ++i) {
+            paths.push_back("test_server_" + std::to_string(i) + ".txt");
+            std::ofstream out(paths.back(), std::ios::binary);
+            out << texts[i];
+        }
+        FingerprintOptions options;
+        double expected = jaccard_similarity_sorted(fingerprint_file(paths[0], options),
+                                                    fingerprint_file(paths[1], options));
+        
+        ScoringServerConfig config;
+        config.threads = 2;
+        config.batch_window_us = 200;
+        ScoringServer server(paths, options, config);
+        ASSERT_EQ(2u, server.reference_count());
+        
+        const std::string socket_path = "test_server.sock";
+        server.listen(socket_path);
+        std::thread loop([&server]() { server.run(); });
+        bool ok = false;
+        try {
+            ok = exercise(socket_path, paths, expected, texts[1]);
+        } catch (const std::exception& e) {
+            std::cerr << "Server exchange failed: " << e.what() << std::endl;
+        }
+        server.stop();
+        loop.join();
+        ASSERT_TRUE(ok);
+        
+        ScoringServerStats stats = server.stats();
+        ASSERT_EQ(57u, stats.requests);
+        ASSERT_EQ(4u, stats.errors);
+        ASSERT_EQ(4u, stats.connections);
+        ASSERT_TRUE(stats.batches >= 1 && stats.largest_batch <= 57);
+        
+        // run()返回后套接字文件已删除，参考文档不可读时构造失败
+        std::ifstream gone(socket_path);
+        ASSERT_FALSE(gone.is_open());
+        bool threw = false;
+        try {
+            ScoringServer missing({"nonexistent_server.txt"}, options, config);
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        ASSERT_TRUE(threw);
+        
+        for (const std::string& path : paths) std::remove(path.c_str());
+        return true;
+#endif
+    }
+};
+
+// 测试用例24：多种相似度与出现次数
+class TestSimilarityMetrics : public TestCase {
+public:
+    std::string getName() const override { return "相似度指标测试"; }
+    
+    bool run() override {
+        // 手工构造：A = {1×2, 2×1}，B = {1×1, 3×1}
+        const uint64_t a[] = {1, 2}, b[] = {1, 3};
+        const uint32_t ca[] = {2, 1}, cb[] = {1, 1};
+        SimilarityMetrics m = similarity_metrics(a, ca, 2, b, cb, 2);
+        ASSERT_NEAR(1.0 / 3.0, m.jaccard, 1e-12);
+        ASSERT_NEAR(0.5, m.containment_a, 1e-12);
+        ASSERT_NEAR(0.5, m.containment_b, 1e-12);
+        ASSERT_NEAR(0.25, m.weighted_jaccard, 1e-12);  // Σmin=1，Σmax=2+1+1
+        m = similarity_metrics(a, nullptr, 2, b, nullptr, 2);
+        ASSERT_EQ(m.jaccard, m.weighted_jaccard);
+        m = similarity_metrics(a, ca, 0, b, cb, 0);
+        ASSERT_EQ(0.0, m.jaccard);
+        ASSERT_EQ(0.0, m.weighted_jaccard);
+        
+        // 少量字符随机组合，k-gram大量重复，总数超过一个压缩周期，覆盖计数的归并
+        std::vector<unsigned char> bytes;
+        uint64_t state = 11;
+        const std::string pieces[] = {"抄", "袭", "检", "测", "a", "b", "，", " "};
+        for (int i = 0; i < 200000; ++i) {
+            state = mix64(state + i);
+            const std::string& piece = pieces[state % 8];
+            bytes.insert(bytes.end(), piece.begin(), piece.end());
+        }
+        std::vector<uint32_t> codepoints = normalize_to_codepoints(bytes);
+        for (size_t window : {0, 4}) {
+            FingerprintOptions options;
+            options.k = 5;
+            options.winnow_window = window;
+            std::unordered_map<uint64_t, uint32_t> expected;
+            Winnower winnower(window);
+            auto count = [&expected](uint64_t hash) { expected[hash]++; };
+            for_each_kgram_hash(codepoints, options.k, options.hash_mode, [&](uint64_t hash) {
+                if (window == 0) {
+                    count(hash);
+                } else {
+                    winnower.push(hash, count);
+                }
+            });
+            if (window != 0) winnower.finish(count);
+            
+            FingerprintWorkspace workspace(options, true);
+            ByteSpan span;
+            span.data = bytes.data();
+            span.size = bytes.size();
+            const std::vector<uint64_t>& hashes = workspace.fingerprint_bytes(span);
+            ASSERT_TRUE(hashes == build_fingerprint_vector(codepoints, options));
+            ASSERT_EQ(hashes.size(), workspace.counts().size());
+            ASSERT_EQ(expected.size(), hashes.size());
+            for (size_t i = 0; i < hashes.size(); ++i) {
+                ASSERT_EQ(expected[hashes[i]], workspace.counts()[i]);
+            }
+        }
+        
+        // 文件接口：摘抄的短文完全包含在原文中，containment为1而Jaccard较低
+        const std::string orig = "test_metrics_orig.txt", part = "test_metrics_part.txt";
+        {
+            std::ofstream out(orig, std::ios::binary);
+            out << "今天是星期天，天气晴，今天晚上我要去看电影。明天是星期一，我要去上学，放学后去图书馆。";
+        }
+        {
+            std::ofstream out(part, std::ios::binary);
+            out << "明天是星期一，我要去上学";
+        }
+        FingerprintOptions options;
+        CountedFingerprint fa = fingerprint_file_counted(orig, options);
+        CountedFingerprint fb = fingerprint_file_counted(part, options);
+        ASSERT_TRUE(fa.hashes == fingerprint_file(orig, options));
+        m = similarity_metrics(fa, fb);
+        ASSERT_EQ(jaccard_similarity_sorted(fa.hashes, fb.hashes), m.jaccard);
+        ASSERT_NEAR(1.0, m.containment_b, 1e-12);
+        ASSERT_TRUE(m.containment_a < 0.5 && m.jaccard < 0.5);
+        m = similarity_metrics(fa, fa);
+        ASSERT_NEAR(1.0, m.weighted_jaccard, 1e-12);
+        
+        std::remove(orig.c_str());
+        std::remove(part.c_str());
+        return true;
+    }
+};
+
+// 测试用例25：匹配片段定位
+class TestMatchedSpans : public TestCase {
+private:
+    static LocatedText locate(const std::string& text) {
+        ByteSpan span;
+        span.data = reinterpret_cast<const unsigned char*>(text.data());
+        span.size = text.size();
+        return normalize_with_offsets(span);
+    }
+
+public:
+    std::string getName() const override { return "匹配片段定位测试"; }
+    
+    bool run() override {
+        // 码点与normalize_to_codepoints一致，每个区间恰好解码出对应的码点
+        std::string mixed;
+        uint64_t state = 5;
+        const std::string pieces[] = {"抄袭", "检测", "，", "Ab", " ", "\xFF", "\xE4\xB8", "9", "\xF0\x9F\x98\x80"};
+        for (int i = 0; i < 2000; ++i) {
+            state = mix64(state + i);
+            mixed += pieces[state % 9];
+        }
+        LocatedText located = locate(mixed);
+        std::vector<unsigned char> bytes(mixed.begin(), mixed.end());
+        ASSERT_TRUE(located.codepoints == normalize_to_codepoints(bytes));
+        ASSERT_EQ(located.codepoints.size(), located.starts.size());
+        for (size_t i = 0; i < located.codepoints.size(); ++i) {
+            size_t pos = located.starts[i];
+            ASSERT_EQ(located.codepoints[i], normalize_codepoint(utf8_next(bytes, pos)));
+            ASSERT_EQ(located.ends[i], pos);
+        }
+        
+        // 抄袭版开头另起一句，中间抄了原文的一段（标点不同），两段调换了顺序
+        const std::string first = "今天是星期天，天气晴，今天晚上我要去看电影。";
+        const std::string second = "机器学习是人工智能的一个分支，Machine Learning很重要。";
+        const std::string orig = "前言：" + first + "中间的话。" + second;
+        const std::string plag = "完全不同的开头，" + second + "然后" + "今天是星期天天气晴今天晚上我要去看电影";
+        LocatedText a = locate(orig), b = locate(plag);
+        std::vector<MatchedSpan> spans = find_matched_spans(a, b, 3, HashMode::Fnv, 8);
+        ASSERT_EQ(2u, spans.size());
+        ASSERT_EQ(orig.find(second), spans[0].a_start);
+        ASSERT_EQ(orig.find(second) + second.size() - std::string("。").size(), spans[0].a_end);
+        ASSERT_EQ(plag.find(second), spans[0].b_start);
+        ASSERT_EQ(orig.find(first), spans[1].a_start);
+        ASSERT_EQ(plag.find("今天是星期天天气晴"), spans[1].b_start);
+        ASSERT_EQ(plag.size(), spans[1].b_end);
+        ASSERT_TRUE(spans[0].b_end <= spans[1].b_start);
+        
+        // 最短长度过滤；rolling哈希结果相同
+        ASSERT_EQ(1u, find_matched_spans(a, b, 3, HashMode::Fnv, 20).size());
+        std::vector<MatchedSpan> rolling = find_matched_spans(a, b, 3, HashMode::Rolling, 8);
+        ASSERT_EQ(spans.size(), rolling.size());
+        ASSERT_EQ(spans[1].a_end, rolling[1].a_end);
+        
+        // 高度重复的文本：一段覆盖全部，不会退化为平方时间
+        LocatedText repeated_a = locate(std::string(200000, 'a')), repeated_b = locate(std::string(100000, 'a'));
+        std::vector<MatchedSpan> repeated = find_matched_spans(repeated_a, repeated_b, 3, HashMode::Fnv, 8);
+        ASSERT_EQ(1u, repeated.size());
+        ASSERT_EQ(100000u, repeated[0].codepoints);
+        
+        // 没有共同内容或文本短于k
+        ASSERT_TRUE(find_matched_spans(locate("abcdefghij"), locate("klmnopqrst"), 3, HashMode::Fnv, 3).empty());
+        ASSERT_TRUE(find_matched_spans(locate("ab"), locate("ab"), 3, HashMode::Fnv, 3).empty());
+        
+        return true;
+    }
+};
+
+// 测试用例26：后缀数组与精确公共子串
+class TestCommonSubstrings : public TestCase {
+public:
+    std::string getName() const override { return "精确公共子串测试"; }
+    
+    bool run() override {
+        // 三个符号的随机短文本，与朴素算法比较后缀数组、每个位置的最长匹配和覆盖
+        uint64_t state = 17;
+        for (int round = 0; round < 300; ++round) {
+            std::vector<uint32_t> a, b;
+            state = mix64(state + round);
+            size_t na = 1 + state % 50, nb = 1 + (state >> 8) % 50;
+            for (size_t i = 0; i < na + nb; ++i) {
+                state = mix64(state + i);
+                (i < na ? a : b).push_back(static_cast<uint32_t>(state % 3));
+            }
+            
+            std::vector<uint32_t> expected_sa(na);
+            for (size_t i = 0; i < na; ++i) expected_sa[i] = static_cast<uint32_t>(i);
+            std::sort(expected_sa.begin(), expected_sa.end(), [&a](uint32_t p, uint32_t q) {
+                return std::lexicographical_compare(a.begin() + p, a.end(), a.begin() + q, a.end());
+            });
+            std::vector<uint32_t> sa = build_suffix_array(a);
+            ASSERT_TRUE(sa == expected_sa);
+            std::vector<uint32_t> lcp = build_lcp_array(a, sa);
+            for (size_t r = 1; r < na; ++r) {
+                size_t h = 0;
+                while (sa[r - 1] + h < na && sa[r] + h < na && a[sa[r - 1] + h] == a[sa[r] + h]) ++h;
+                ASSERT_EQ(h, lcp[r]);
+            }
+            
+            const size_t min_length = 2;
+            std::vector<size_t> longest(nb, 0);
+            std::vector<bool> covered(nb, false);
+            for (size_t j = 0; j < nb; ++j) {
+                for (size_t i = 0; i < na; ++i) {
+                    size_t h = 0;
+                    while (i + h < na && j + h < nb && a[i + h] == b[j + h]) ++h;
+                    longest[j] = std::max(longest[j], h);
+                }
+                if (longest[j] < min_length) continue;
+                for (size_t h = 0; h < longest[j]; ++h) covered[j + h] = true;
+            }
+            CommonSubstringReport report = find_common_substrings(a, b, min_length);
+            ASSERT_EQ(static_cast<size_t>(std::count(covered.begin(), covered.end(), true)), report.covered_b);
+            size_t reported = 0;
+            for (size_t j = 0; j < nb; ++j) {
+                if (longest[j] >= min_length && (j == 0 || longest[j - 1] <= longest[j])) ++reported;
+            }
+            ASSERT_EQ(reported, report.substrings.size());
+            for (const CommonSubstring& s : report.substrings) {
+                ASSERT_EQ(longest[s.b_start], s.length);
+                ASSERT_TRUE(std::equal(a.begin() + s.a_start, a.begin() + s.a_start + s.length, b.begin() + s.b_start));
+            }
+        }
+        
+        // 一段长的抄袭只报告一次；覆盖率与哈希无关
+        std::string first = "今天是星期天，天气晴，今天晚上我要去看电影。";
+        std::string second = "机器学习是人工智能的一个分支，Machine Learning很重要。";
+        std::string orig = "前言：" + first + "中间的话。" + second;
+        std::string plag = "完全不同的开头，" + second + "然后" + first;
+        std::vector<uint32_t> a = normalize_to_codepoints(std::vector<unsigned char>(orig.begin(), orig.end()));
+        std::vector<uint32_t> b = normalize_to_codepoints(std::vector<unsigned char>(plag.begin(), plag.end()));
+        std::vector<uint32_t> cp_first = normalize_to_codepoints(std::vector<unsigned char>(first.begin(), first.end()));
+        std::vector<uint32_t> cp_second = normalize_to_codepoints(std::vector<unsigned char>(second.begin(), second.end()));
+        CommonSubstringReport report = find_common_substrings(a, b, 8);
+        ASSERT_EQ(2u, report.substrings.size());
+        ASSERT_EQ(cp_second.size(), report.substrings[0].length);
+        ASSERT_EQ(cp_first.size(), report.substrings[1].length);
+        ASSERT_EQ(cp_first.size() + cp_second.size(), report.covered_a);
+        ASSERT_EQ(report.covered_a, report.covered_b);
+        ASSERT_NEAR(static_cast<double>(report.covered_b) / b.size(), report.coverage_b, 1e-12);
+        ASSERT_NEAR(1.0, find_common_substrings(a, a, 8).similarity, 1e-12);
+        
+        // 高度重复的文本仍在倍增的轮数内完成
+        std::vector<uint32_t> repeated(200000, 'a');
+        report = find_common_substrings(repeated, std::vector<uint32_t>(100000, 'a'), 8);
+        ASSERT_EQ(1u, report.substrings.size());
+        ASSERT_EQ(100000u, report.substrings[0].length);
+        ASSERT_EQ(200000u, report.covered_a);
+        
+        // 空文本
+        ASSERT_TRUE(build_suffix_array(std::vector<uint32_t>()).empty());
+        ASSERT_EQ(0.0, find_common_substrings(a, std::vector<uint32_t>(), 8).similarity);
+        
+        return true;
+    }
+};
+
+// 测试用例27：归一化配置与码点分类表
+class TestNormalizationProfiles : public TestCase {
+public:
+    std::string getName() const override { return "归一化配置测试"; }
+    
+    bool run() override {
+        const NormalizationProfile profiles[] = {NormalizationProfile::Default, NormalizationProfile::CjkOnly,
+                                                 NormalizationProfile::UnicodeLetters,
+                                                 NormalizationProfile::FullWidthFolding};
+        for (NormalizationProfile profile : profiles) {
+            ASSERT_TRUE(parse_normalization_profile(normalization_profile_name(profile)) == profile);
+            // 查找表与参考实现在整个21位码点空间上逐个相同
+            const CodepointClassifier& classifier = codepoint_classifier(profile);
+            for (uint32_t cp = 0; cp < 0x200000; ++cp) {
+                if (classifier.normalize(cp) != normalize_codepoint(cp, profile)) {
+                    std::cerr << normalization_profile_name(profile) << " differs at U+" << std::hex << cp
+                              << std::dec << std::endl;
+                    return false;
+                }
+            }
+            ASSERT_TRUE(classifier.table_bytes() < (256u << 10));
+        }
+        for (uint32_t cp = 0; cp < 0x110000; ++cp) {
+            ASSERT_EQ(normalize_codepoint(cp), normalize_codepoint(cp, NormalizationProfile::Default));
+        }
+        bool rejected = false;
+        try {
+            parse_normalization_profile("latin");
+        } catch (const std::runtime_error&) {
+            rejected = true;
+        }
+        ASSERT_TRUE(rejected);
+        
+        // 默认配置丢弃的文字在unicode-letters下保留并折叠大小写，全角与半角形式在full-width-folding下统一
+        ASSERT_TRUE(normalized("Привет, Мир!", NormalizationProfile::Default).empty());
+        ASSERT_TRUE(normalized("Привет, Мир!", NormalizationProfile::UnicodeLetters) ==
+                    normalized("приветмир", NormalizationProfile::UnicodeLetters));
+        ASSERT_TRUE(normalized("Ελληνικά ΣΟΦΙΑ", NormalizationProfile::UnicodeLetters) ==
+                    normalized("ελληνικάσοφια", NormalizationProfile::UnicodeLetters));
+        ASSERT_TRUE(normalized("Ärger ÉCOLE", NormalizationProfile::UnicodeLetters) ==
+                    normalized("ärgerécole", NormalizationProfile::UnicodeLetters));
+        ASSERT_EQ(8u, normalized("ひらがな、カタカナ", NormalizationProfile::UnicodeLetters).size());
+        ASSERT_EQ(3u, normalized("한국어", NormalizationProfile::UnicodeLetters).size());
+        ASSERT_TRUE(normalized("٣ ३ ๓", NormalizationProfile::UnicodeLetters) ==
+                    normalized("333", NormalizationProfile::Default));
+        ASSERT_TRUE(normalized("ＡＢＣ１２３", NormalizationProfile::Default).empty());
+        ASSERT_TRUE(normalized("ＡＢＣ１２３", NormalizationProfile::UnicodeLetters) ==
+                    normalized("ａｂｃ１２３", NormalizationProfile::UnicodeLetters));
+        ASSERT_TRUE(normalized("ＡＢＣ１２３", NormalizationProfile::FullWidthFolding) ==
+                    normalized("abc123", NormalizationProfile::Default));
+        ASSERT_TRUE(normalized("ｶﾀｶﾅ ﾊﾟﾝ", NormalizationProfile::FullWidthFolding) ==
+                    normalized("カタカナハ゜ン", NormalizationProfile::FullWidthFolding));
+        ASSERT_TRUE(normalized("ﾡﾤￂ", NormalizationProfile::FullWidthFolding) ==
+                    normalized("ㄱㄴㅏ", NormalizationProfile::FullWidthFolding));
+        ASSERT_TRUE(normalized("Hello 你好 123", NormalizationProfile::CjkOnly) ==
+                    normalized("你好", NormalizationProfile::Default));
+        
+        // 标量、AVX2、流式分块与带偏移的归一化在每种配置下结果相同
+        const std::string pieces[] = {
+            "Hello, World 123", "中文文本查重", "Привет", "ΣΟΦΙΑ", "ひらがなカタカナ", "한국어", "ＡＢＣ１２３",
+            "ｶﾀｶﾅ", "\xC3\x89", "\xF0\xA0\x80\x80", "\xE0\x80\x80", "\xED\xA0\x80", "\x80", "\xE4\xB8", "\0"
+        };
+        const size_t num_pieces = sizeof(pieces) / sizeof(pieces[0]);
+        uint64_t state = 7;
+        for (int round = 0; round < 400; ++round) {
+            std::string text;
+            state = mix64(state + round);
+            size_t length = state % 100;
+            for (size_t j = 0; j < length; ++j) {
+                state = mix64(state);
+                text += pieces[state % num_pieces];
+            }
+            std::vector<unsigned char> bytes(text.begin(), text.end());
+            for (NormalizationProfile profile : profiles) {
+                std::vector<uint32_t> expected(bytes.size());
+                size_t i = 0;
+                expected.resize(normalize_utf8_scalar(bytes.data(), bytes.size(), i, bytes.size(), expected.data(),
+                                                      profile));
+                ASSERT_TRUE(normalize_to_codepoints(bytes, profile) == expected);
+#ifdef PD_X86_SIMD
+                if (cpu_has_avx2()) {
+                    std::vector<uint32_t> actual(bytes.size());
+                    i = 0;
+                    actual.resize(normalize_utf8_avx2(bytes.data(), bytes.size(), i, bytes.size(), actual.data(),
+                                                      profile));
+                    ASSERT_TRUE(actual == expected);
+                }
+#endif
+                Utf8StreamDecoder decoder(profile);
+                std::vector<uint32_t> streamed;
+                for (size_t pos = 0; pos < bytes.size(); pos += 5) {
+                    decoder.feed(bytes.data() + pos, std::min<size_t>(5, bytes.size() - pos), streamed);
+                }
+                ASSERT_TRUE(streamed == expected);
+                ByteSpan span;
+                span.data = bytes.data();
+                span.size = bytes.size();
+                ASSERT_TRUE(normalize_with_offsets(span, profile).codepoints == expected);
+            }
+        }
+        
+        // 配置是指纹参数的一部分：写入倒排索引并随之加载，缓存按配置区分条目
+        const std::string doc = "test_profile_doc.txt", index_path = "test_profile.idx", dir = "test_profile_cache";
+        {
+            std::ofstream out(doc, std::ios::binary);
+            out << "Съешь же ещё этих мягких французских булок, да выпей чаю. 日本語のテキスト";
+        }
+        FingerprintOptions letters;
+        letters.normalization = NormalizationProfile::UnicodeLetters;
+        ASSERT_TRUE(fingerprint_file(doc, letters).size() > fingerprint_file(doc, FingerprintOptions()).size());
+        save_corpus_index(build_corpus_index(std::vector<std::string>(1, doc), letters), index_path);
+        CorpusIndex index = load_corpus_index(index_path);
+        ASSERT_TRUE(index.options.normalization == NormalizationProfile::UnicodeLetters);
+        ASSERT_NEAR(1.0, query_corpus_index(index, fingerprint_file(doc, index.options))[0], 1e-12);
+        {
+            FingerprintCache cache(dir, 1 << 20);
+            cache.fingerprint(doc, FingerprintOptions());
+            Fingerprint cached = cache.fingerprint(doc, letters);
+            ASSERT_FALSE(cached.is_mapped());
+            ASSERT_TRUE(cache.fingerprint(doc, letters).is_mapped());
+            ASSERT_EQ(fingerprint_file(doc, letters).size(), cached.size());
+            ASSERT_EQ(2u, cache.stats().misses);
+        }
+        {
+            std::ifstream entries(dir + "/index.txt");
+            std::string line;
+            std::getline(entries, line);
+            while (std::getline(entries, line)) std::remove((dir + "/" + line.substr(0, line.find(' '))).c_str());
+        }
+        std::remove((dir + "/index.txt").c_str());
+        std::remove(dir.c_str());
+        std::remove(index_path.c_str());
+        std::remove(doc.c_str());
+        
+        return true;
+    }
+
+private:
+    static std::vector<uint32_t> normalized(const std::string& text, NormalizationProfile profile) {
+        return normalize_to_codepoints(std::vector<unsigned char>(text.begin(), text.end()), profile);
+    }
+};
+
+// 测试用例28：埋点计数与跟踪事件
+class TestInstrumentation : public TestCase {
+public:
+    std::string getName() const override { return "埋点统计测试"; }
+    
+    bool run() override {
+        // 有效码点 A b c 空格 中 文 U+0000 x，无效序列为孤立的续字节和末尾被截断的序列
+        std::string text = "Ab\x80" "c 中文";
+        text.push_back('\0');
+        text += "x\xE4\xB8";
+        std::vector<unsigned char> bytes(text.begin(), text.end());
+        ByteSpan span;
+        span.data = bytes.data();
+        span.size = bytes.size();
+        FingerprintOptions options;
+        options.k = 2;
+
+        reset_instrumentation();
+        std::vector<uint64_t> fingerprint = fingerprint_bytes(span, options);
+        ASSERT_EQ(0u, collect_stats().codepoints_kept);  // 默认关闭
+
+#ifdef PD_INSTRUMENTATION
+        set_instrumentation(INSTRUMENT_STATS | INSTRUMENT_TRACE);
+        ASSERT_TRUE(fingerprint_bytes(span, options) == fingerprint);
+        ASSERT_NEAR(1.0, jaccard_similarity_sorted(fingerprint, fingerprint), 1e-12);
+        PipelineStats stats = collect_stats();
+        ASSERT_EQ(8u, stats.codepoints_decoded);
+        ASSERT_EQ(6u, stats.codepoints_kept);
+        ASSERT_EQ(2u, stats.codepoints_dropped());
+        ASSERT_EQ(2u, stats.invalid_sequences);
+        ASSERT_EQ(5u, stats.kgrams);
+        ASSERT_EQ(5u, stats.unique_kgrams);
+        ASSERT_EQ(1u, stats.compactions);
+        ASSERT_EQ(1u, stats.comparisons);
+
+        // 预分配后插入不再重排，预分配本身不计入rehashes
+        std::vector<uint32_t> distinct(1000);
+        for (size_t i = 0; i < distinct.size(); ++i) distinct[i] = static_cast<uint32_t>(i + 1);
+        ASSERT_EQ(999u, build_kgram_set(distinct, 2, HashMode::Fnv).size());
+        ASSERT_EQ(stats.rehashes, collect_stats().rehashes);
+
+        // 每个阶段都有区间，嵌套阶段的区间落在外层之内
+        std::vector<TraceEvent> events = collect_trace_events();
+        bool seen[STAGE_COUNT] = {};
+        for (const TraceEvent& event : events) {
+            ASSERT_TRUE(event.end_ns >= event.start_ns);
+            seen[static_cast<size_t>(event.stage)] = true;
+        }
+        ASSERT_TRUE(seen[static_cast<size_t>(Stage::Decode)] && seen[static_cast<size_t>(Stage::Hash)] &&
+                    seen[static_cast<size_t>(Stage::Sort)] && seen[static_cast<size_t>(Stage::Intersect)]);
+        std::string json = trace_events_json(events);
+        ASSERT_TRUE(json.compare(0, 16, "{\"traceEvents\":[") == 0);
+        ASSERT_TRUE(json.find("\"name\":\"decode\",\"cat\":\"pd\",\"ph\":\"X\"") != std::string::npos);
+        ASSERT_TRUE(format_stats_line(stats).find(" kept=6 dropped=2 invalid=2 ") != std::string::npos);
+
+        // 读入的字节计入Read阶段；已结束线程的计数并入汇总
+        const std::string path = "test_instrumentation.txt";
+        {
+            std::ofstream out(path, std::ios::binary);
+            out.write(text.data(), static_cast<std::streamsize>(text.size()));
+        }
+        std::thread worker([&path, &options]() { fingerprint_file(path, options); });
+        worker.join();
+        std::remove(path.c_str());
+        stats = collect_stats();
+        ASSERT_EQ(static_cast<uint64_t>(text.size()), stats.bytes_in);
+        ASSERT_EQ(12u, stats.codepoints_kept);
+        ASSERT_EQ(4u, stats.invalid_sequences);
+        uint32_t max_tid = 0;
+        for (const TraceEvent& event : collect_trace_events()) max_tid = std::max(max_tid, event.tid);
+        ASSERT_TRUE(max_tid > 0);
+
+        // 标量与AVX2解码的计数相同
+#ifdef PD_X86_SIMD
+        if (cpu_has_avx2()) {
+            std::string mixed;
+            for (int i = 0; i < 200; ++i) mixed += i % 7 == 0 ? "\xE4\xB8" : i % 3 == 0 ? "中文查重" : "Text 123 ";
+            std::vector<unsigned char> input(mixed.begin(), mixed.end());
+            std::vector<uint32_t> out(input.size());
+            size_t i = 0;
+            reset_instrumentation();
+            normalize_utf8_scalar(input.data(), input.size(), i, input.size(), out.data());
+            PipelineStats scalar = collect_stats();
+            i = 0;
+            reset_instrumentation();
+            normalize_utf8_avx2(input.data(), input.size(), i, input.size(), out.data());
+            PipelineStats simd = collect_stats();
+            ASSERT_EQ(scalar.codepoints_decoded, simd.codepoints_decoded);
+            ASSERT_EQ(scalar.codepoints_kept, simd.codepoints_kept);
+            ASSERT_EQ(scalar.invalid_sequences, simd.invalid_sequences);
+            ASSERT_TRUE(scalar.invalid_sequences > 0);
+        }
+#endif
+        set_instrumentation(0);
+        reset_instrumentation();
+#else
+        set_instrumentation(INSTRUMENT_STATS);
+        ASSERT_EQ(0u, instrumentation_mode());  // 编译时关闭埋点
+#endif
+        return true;
+    }
+};
+
+// 测试用例29：Elias–Fano压缩指纹
+class TestCompressedFingerprint : public TestCase {
+public:
+    std::string getName() const override { return "压缩指纹测试"; }
+    
+    // 截断到高hash_bits位后去重，与compress_fingerprint的处理相同
+    static std::vector<uint64_t> truncate(const std::vector<uint64_t>& hashes, uint32_t hash_bits) {
+        std::vector<uint64_t> values;
+        for (uint64_t hash : hashes) values.push_back(hash_bits == 64 ? hash : hash >> (64 - hash_bits));
+        values.erase(std::unique(values.begin(), values.end()), values.end());
+        return values;
+    }
+    
+    bool run() override {
+        FingerprintOptions options;
+        const size_t sizes[][2] = {{0, 0}, {0, 5}, {1, 1}, {7, 3}, {1000, 3000}, {50, 200000}, {100000, 100000}};
+        const uint32_t widths[] = {64, 40, 32, 12};
+        uint64_t state = 11;
+        for (const auto& size : sizes) {
+            // 两个集合共享约一半元素
+            std::vector<uint64_t> a, b;
+            for (size_t i = 0; i < size[0]; ++i) a.push_back(mix64(state + i));
+            for (size_t i = 0; i < size[1]; ++i) b.push_back(mix64(state + size[0] / 2 + i));
+            state += 1000003;
+            sort_unique_hashes(a);
+            sort_unique_hashes(b);
+            for (uint32_t bits : widths) {
+                CompressedFingerprint ca = compress_fingerprint(a, options, bits);
+                CompressedFingerprint cb = compress_fingerprint(b, options, bits);
+                std::vector<uint64_t> ta = truncate(a, bits), tb = truncate(b, bits);
+                ASSERT_TRUE(ca.decode() == ta);
+                ASSERT_TRUE(cb.decode() == tb);
+                ASSERT_EQ(intersection_count_sorted(ta.data(), ta.size(), tb.data(), tb.size()),
+                          intersection_count_compressed(ca, cb));
+                ASSERT_EQ(jaccard_similarity_sorted(ta, tb), jaccard_similarity_compressed(ca, cb));
+                
+                // 跳转结果与lower_bound一致
+                for (int probe = 0; probe < 200 && !tb.empty(); ++probe) {
+                    EliasFanoReader reader(cb);
+                    state = mix64(state);
+                    uint64_t first = tb[state % tb.size()];
+                    reader.skip_to(first);
+                    uint64_t target = bits == 64 ? mix64(state) : mix64(state) >> (64 - bits);
+                    reader.skip_to(target);
+                    auto expected = std::lower_bound(tb.begin(), tb.end(), std::max(first, target));
+                    ASSERT_EQ(expected != tb.end(), reader.valid());
+                    if (reader.valid()) ASSERT_EQ(*expected, reader.value());
+                }
+            }
+        }
+        
+        // 无损编码约为 2 + log2(2^64 / n) 位/元素，截断到32位后约2字节/元素
+        std::vector<uint64_t> hashes;
+        for (uint64_t i = 0; i < 100000; ++i) hashes.push_back(mix64(i));
+        sort_unique_hashes(hashes);
+        CompressedFingerprint lossless = compress_fingerprint(hashes, options);
+        ASSERT_TRUE(lossless.payload_bytes() * 8.0 / hashes.size() < 64 - 16.6 + 2.1);
+        ASSERT_TRUE(compress_fingerprint(hashes, options, 32).payload_bytes() * 8.0 / hashes.size() < 17.5);
+        
+        // 文件往返，参数不同或文件损坏时报错
+        const std::string path = "test_fingerprint.pdz";
+        options.k = 5;
+        options.normalization = NormalizationProfile::UnicodeLetters;
+        save_compressed_fingerprint(compress_fingerprint(hashes, options, 40), path);
+        CompressedFingerprint loaded = load_compressed_fingerprint(path);
+        ASSERT_EQ(5u, loaded.options.k);
+        ASSERT_TRUE(loaded.options.normalization == NormalizationProfile::UnicodeLetters);
+        ASSERT_EQ(40u, loaded.hash_bits);
+        ASSERT_TRUE(loaded.decode() == truncate(hashes, 40));
+        
+        // 空指纹（如全部字符都被过滤的文档）同样能往返
+        save_compressed_fingerprint(compress_fingerprint(std::vector<uint64_t>(), options), path);
+        CompressedFingerprint empty = load_compressed_fingerprint(path);
+        ASSERT_EQ(0u, empty.count);
+        ASSERT_TRUE(empty.decode().empty());
+        ASSERT_EQ(0u, intersection_count_compressed(empty, compress_fingerprint(hashes, options)));
+        save_compressed_fingerprint(compress_fingerprint(hashes, options, 40), path);
+        
+        bool rejected = false;
+        try {
+            intersection_count_compressed(loaded, compress_fingerprint(hashes, options, 32));
+        } catch (const std::runtime_error&) {
+            rejected = true;
+        }
+        ASSERT_TRUE(rejected);
+        
+        std::vector<unsigned char> bytes = read_file_to_bytes(path);
+        const size_t corruptions[] = {bytes.size() - 1, 36, 40, 48};
+        for (size_t offset : corruptions) {
+            std::vector<unsigned char> damaged = bytes;
+            if (offset == bytes.size() - 1) damaged.pop_back();
+            else damaged[offset] ^= 0x01;
+            {
+                std::ofstream out(path, std::ios::binary);
+                out.write(reinterpret_cast<const char*>(damaged.data()), static_cast<std::streamsize>(damaged.size()));
+            }
+            rejected = false;
+            try {
+                load_compressed_fingerprint(path);
+            } catch (const std::runtime_error&) {
+                rejected = true;
+            }
+            ASSERT_TRUE(rejected);
+        }
+        std::remove(path.c_str());
+        return true;
+    }
+};
+
+// 测试用例30：单文档并行指纹与串行路径结果一致
+class TestParallelFingerprint : public TestCase {
+public:
+    std::string getName() const override { return "单文档并行指纹测试"; }
+    
+    // 混合ASCII、标点、CJK、4字节字符和无效字节的随机文本，切分点会落在多字节序列中间
+    static std::string random_text(size_t size, uint64_t seed) {
+        static const char* pieces[] = {"abc", "Hello", " ", "  ", ",", "\n", "\xE4\xB8\xAD", "\xE6\x96\x87",
+                                       "\xF0\x9F\x98\x80", "\xC3\xA9", "\x80", "\xE4\xB8", "\xFF", "42", "\xF0"};
+        std::string text;
+        uint64_t state = seed;
+        while (text.size() < size) {
+            state = mix64(state);
+            // 偏向少数几个片段，使文本中有重复的k-gram
+            text += pieces[(state >> 8) % 4 == 0 ? state % 15 : state % 3];
+        }
+        text.resize(size);
+        return text;
+    }
+    
+    static ByteSpan spanOf(const std::string& text) {
+        ByteSpan span;
+        span.data = reinterpret_cast<const unsigned char*>(text.data());
+        span.size = text.size();
+        return span;
+    }
+    
+    bool run() override {
+        std::vector<std::string> texts;
+        const size_t sizes[] = {0, 1, 5, 40, 300, 5000, 40000};
+        for (size_t size : sizes) texts.push_back(random_text(size, texts.size() + 1));
+        texts.push_back(random_text(3000, 99) + std::string(2000, ' '));  // 最后几段只有空白
+        texts.push_back(std::string(2000, ' ') + "abcdefg");               // 只有最后一段有内容
+        texts.push_back("abcdefg\xF0" + std::string("ij"));                // 末尾截断的首字节吞掉其后的字节
+        texts.push_back("abcdefg\xF0" + std::string("hijklmn"));           // 段尾的不完整序列中含有ASCII字符
+        // 恰好 k+w-2 个码点、前后是长空白：第一段越过段尾后仍未到文档末尾，而全文不足一个窗口
+        for (size_t letters : {3, 7, 11, 13, 15}) {
+            texts.push_back(std::string(300, ' ') + std::string("abcdefghijklmnop").substr(0, letters) +
+                            std::string(700, ' '));
+        }
+        
+        // 切分点都在UTF-8同步点上且严格递增
+        std::vector<size_t> starts = split_utf8_segments(spanOf(texts[6]), 16, 100);
+        ASSERT_EQ(16u, starts.size());
+        for (size_t i = 1; i < starts.size(); ++i) {
+            ASSERT_TRUE(starts[i] > starts[i - 1]);
+            ASSERT_TRUE((static_cast<unsigned char>(texts[6][starts[i]]) & 0xC0) != 0x80);
+        }
+        ASSERT_EQ(1u, split_utf8_segments(spanOf(texts[6]), 16).size());  // 小于最小段长的文档不切分
+        
+        std::vector<ByteSpan> documents;
+        for (const std::string& text : texts) documents.push_back(spanOf(text));
+        
+        FingerprintOptions options;
+        const size_t ks[] = {1, 3, 5};
+        const size_t windows[] = {0, 1, 4, 12};
+        const size_t min_segments[] = {1, 7, 64};
+        for (size_t k : ks) {
+            for (size_t window : windows) {
+                for (int variant = 0; variant < 2; ++variant) {
+                    options.k = k;
+                    options.winnow_window = window;
+                    options.hash_mode = variant == 0 ? HashMode::Fnv : HashMode::Rolling;
+                    options.normalization = variant == 0 ? NormalizationProfile::Default
+                                                         : NormalizationProfile::UnicodeLetters;
+                    std::vector<std::vector<uint64_t>> expected;
+                    for (ByteSpan document : documents) expected.push_back(fingerprint_bytes(document, options));
+                    
+                    for (size_t min_segment : min_segments) {
+                        WorkStealingScheduler scheduler(min_segment == 1 ? 5 : 3);
+                        std::vector<std::vector<uint64_t>> actual =
+                            fingerprint_documents_parallel(documents, options, scheduler, min_segment);
+                        ASSERT_EQ(expected.size(), actual.size());
+                        for (size_t d = 0; d < expected.size(); ++d) {
+                            ASSERT_TRUE(expected[d] == actual[d]);
+                        }
+                    }
+                }
+            }
+        }
+        
+        // 并集与交集按哈希前缀分片，结果与串行计算一致
+        std::vector<std::vector<uint64_t>> sets(5);
+        for (size_t i = 0; i < sets.size(); ++i) {
+            for (uint64_t j = 0; j < 3000 * i; ++j) sets[i].push_back(mix64(j * (i + 1)));
+            sort_unique_hashes(sets[i]);
+        }
+        std::vector<uint64_t> all;
+        for (const std::vector<uint64_t>& set : sets) all.insert(all.end(), set.begin(), set.end());
+        sort_unique_hashes(all);
+        for (size_t threads = 1; threads <= 8; threads += 7) {
+            WorkStealingScheduler scheduler(threads);
+            ASSERT_TRUE(parallel_union(sets, scheduler) == all);
+            for (size_t i = 0; i + 1 < sets.size(); ++i) {
+                const std::vector<uint64_t>& a = sets[i];
+                const std::vector<uint64_t>& b = sets[i + 1];
+                ASSERT_EQ(intersection_count_sorted(a.data(), a.size(), b.data(), b.size()),
+                          intersection_count_parallel(a.data(), a.size(), b.data(), b.size(), scheduler));
+                SimilarityMetrics serial = similarity_metrics(a.data(), nullptr, a.size(), b.data(), nullptr, b.size());
+                SimilarityMetrics parallel = similarity_metrics_parallel(a.data(), a.size(), b.data(), b.size(), scheduler);
+                ASSERT_EQ(serial.jaccard, parallel.jaccard);
+                ASSERT_EQ(serial.containment_a, parallel.containment_a);
+                ASSERT_EQ(serial.containment_b, parallel.containment_b);
+                ASSERT_EQ(serial.weighted_jaccard, parallel.weighted_jaccard);
+            }
+        }
+        return true;
+    }
+};
+
+// 测试用例31：开放寻址指纹集合与std::unordered_set行为一致
+class TestFlatHashSet : public TestCase {
+public:
+    std::string getName() const override { return "开放寻址指纹集合测试"; }
+    
+    bool run() override {
+        // 随机哈希、最高位全相同的小整数（全部落在同一组，考验探测）和重复插入
+        uint64_t state = 5;
+        for (int pattern = 0; pattern < 3; ++pattern) {
+            FlatHashSet flat;
+            std::unordered_set<uint64_t> reference;
+            for (uint64_t i = 0; i < 20000; ++i) {
+                state = mix64(state);
+                uint64_t value = pattern == 0 ? state : pattern == 1 ? i % 3000 : state % 5000 * 0x9E3779B97F4A7C15ULL;
+                ASSERT_EQ(reference.insert(value).second, flat.insert(value));
+            }
+            ASSERT_EQ(reference.size(), flat.size());
+            ASSERT_TRUE(flat.size() * 8 <= flat.capacity() * 7);
+            for (uint64_t i = 0; i < 20000; ++i) {
+                uint64_t probe = pattern == 1 ? i : mix64(i + 1) % 5000 * 0x9E3779B97F4A7C15ULL;
+                ASSERT_EQ(reference.count(probe) != 0, flat.contains(probe));
+            }
+            std::unordered_set<uint64_t> visited;
+            flat.for_each([&visited](uint64_t hash) { visited.insert(hash); });
+            ASSERT_TRUE(visited == reference);
+        }
+        
+        FlatHashSet empty;
+        ASSERT_FALSE(empty.contains(0));
+        ASSERT_EQ(0u, empty.capacity());
+        FlatHashSet reserved(1000);
+        size_t capacity = reserved.capacity();
+        for (uint64_t i = 0; i < 1000; ++i) reserved.insert(mix64(i));
+        ASSERT_EQ(capacity, reserved.capacity());  // 预留后插入不再扩容
+        
+        // k-gram集合与Jaccard相似度与std::unordered_set的结果逐位一致
+        std::vector<uint32_t> codepoints1, codepoints2;
+        for (uint32_t i = 0; i < 5000; ++i) {
+            codepoints1.push_back('a' + mix64(i) % 6);
+            codepoints2.push_back(i % 3 == 0 ? 'a' + mix64(i + 7) % 6 : codepoints1[i]);
+        }
+        for (HashMode mode : {HashMode::Fnv, HashMode::Rolling}) {
+            for (size_t k : {1, 3, 8}) {
+                std::unordered_set<uint64_t> set1 = build_kgram_set(codepoints1, k, mode);
+                std::unordered_set<uint64_t> set2 = build_kgram_set(codepoints2, k, mode);
+                FlatHashSet flat1 = build_kgram_flat_set(codepoints1, k, mode);
+                FlatHashSet flat2 = build_kgram_flat_set(codepoints2, k, mode);
+                std::unordered_set<uint64_t> elements;
+                flat1.for_each([&elements](uint64_t hash) { elements.insert(hash); });
+                ASSERT_TRUE(elements == set1);
+                ASSERT_EQ(jaccard_similarity(set1, set2), jaccard_similarity(flat1, flat2));
+            }
+        }
+        ASSERT_EQ(0.0, jaccard_similarity(FlatHashSet(), FlatHashSet()));
+        ASSERT_TRUE(build_kgram_flat_set(codepoints1, 6000).empty());
+        return true;
+    }
+};
+
+// 测试用例32：增量评分在每次修改后与全文重新计算的结果一致
+class TestIncrementalScorer : public TestCase {
+public:
+    std::string getName() const override { return "增量评分测试"; }
+    
+    static ByteSpan spanOf(const std::string& text) {
+        ByteSpan span;
+        span.data = reinterpret_cast<const unsigned char*>(text.data());
+        span.size = text.size();
+        return span;
+    }
+    
+    // 全文重新计算的计数指纹
+    static CountedFingerprint fullFingerprint(const std::string& text, const FingerprintOptions& options) {
+        StreamingFingerprinter fingerprinter(options, true);
+        fingerprinter.feed(reinterpret_cast<const unsigned char*>(text.data()), text.size());
+        CountedFingerprint result;
+        result.hashes = fingerprinter.finish_in_place();
+        result.counts = fingerprinter.counts_in_place();
+        return result;
+    }
+    
+    static bool sameMetrics(const SimilarityMetrics& a, const SimilarityMetrics& b) {
+        return a.jaccard == b.jaccard && a.containment_a == b.containment_a && a.containment_b == b.containment_b &&
+               a.weighted_jaccard == b.weighted_jaccard;
+    }
+    
+    bool run() override {
+        // 修改片段包含多字节字符、被截断的序列和单独的后续字节，修改位置也会落在多字节字符中间
+        static const char* pieces[] = {"ab", "c", " ", "\xE4\xB8\xAD", "\xE6\x96\x87", "\xC3\xA9", "\x80",
+                                       "\xE4\xB8", "\xB8", "Xy", "\xF0\x9F\x98\x80", "\xF0"};
+        uint64_t state = 17;
+        auto next = [&state](uint64_t bound) {
+            state = mix64(state);
+            return bound == 0 ? 0 : state % bound;
+        };
+        auto random_text = [&](size_t pieces_count) {
+            std::string text;
+            for (size_t i = 0; i < pieces_count; ++i) text += pieces[next(next(3) == 0 ? 12 : 4)];
+            return text;
+        };
+        
+        FingerprintOptions options;
+        const size_t ks[] = {1, 3, 5};
+        for (size_t k : ks) {
+            for (int variant = 0; variant < 2; ++variant) {
+                options.k = k;
+                options.hash_mode = variant == 0 ? HashMode::Fnv : HashMode::Rolling;
+                options.normalization = variant == 0 ? NormalizationProfile::Default : NormalizationProfile::UnicodeLetters;
+                std::string original1 = random_text(300), original2 = random_text(50);
+                std::string document = original1.substr(0, 400) + random_text(100);
+                CountedFingerprint counted1 = fullFingerprint(original1, options);
+                CountedFingerprint counted2 = fullFingerprint(original2, options);
+                
+                IncrementalScorer scorer(options, spanOf(document));
+                ASSERT_EQ(0u, scorer.add_original(counted1));
+                ASSERT_EQ(1u, scorer.add_original(counted2));
+                for (int step = 0; step < 150; ++step) {
+                    if (step % 10 == 9) {
+                        // 整篇修订稿：在随机位置插入并删除一段
+                        std::string revision = document;
+                        size_t at = next(revision.size() + 1);
+                        revision.insert(at, random_text(next(6)));
+                        size_t cut = next(revision.size() + 1);
+                        revision.erase(cut, next(8));
+                        scorer.update(spanOf(revision));
+                        document = revision;
+                    } else {
+                        size_t offset = next(document.size() + 1);
+                        size_t erase = next(std::min<size_t>(document.size() - offset, 12) + 1);
+                        std::string replacement = random_text(next(4));
+                        scorer.replace(offset, erase, spanOf(replacement));
+                        document.replace(offset, erase, replacement);
+                    }
+                    ASSERT_EQ(document.size(), scorer.document_size());
+                    ASSERT_TRUE(scorer.contents() == std::vector<unsigned char>(document.begin(), document.end()));
+                    CountedFingerprint expected = fullFingerprint(document, options);
+                    CountedFingerprint actual = scorer.fingerprint();
+                    ASSERT_TRUE(expected.hashes == actual.hashes);
+                    ASSERT_TRUE(expected.counts == actual.counts);
+                    ASSERT_TRUE(sameMetrics(similarity_metrics(counted1, expected), scorer.metrics(0)));
+                    ASSERT_TRUE(sameMetrics(similarity_metrics(counted2, expected), scorer.metrics(1)));
+                }
+                
+                // 删空后重新写入
+                scorer.update(spanOf(""));
+                ASSERT_TRUE(scorer.fingerprint().hashes.empty());
+                ASSERT_EQ(0.0, scorer.metrics(0).jaccard);
+                scorer.update(spanOf(original1));
+                ASSERT_EQ(1.0, scorer.metrics(0).weighted_jaccard);
+            }
+        }
+        
+        // 跨多个块的文档：修改落在块边界附近，大段插入会切出新块，大段删除会合并块
+        options = FingerprintOptions();
+        options.k = 4;
+        std::string document = random_text(5 * INCREMENTAL_BLOCK_SIZE / 2);
+        CountedFingerprint counted = fullFingerprint(document, options);
+        IncrementalScorer scorer(options, spanOf(document));
+        scorer.add_original(counted);
+        for (int step = 0; step < 60; ++step) {
+            size_t offset = next(document.size() / INCREMENTAL_BLOCK_SIZE + 1) * INCREMENTAL_BLOCK_SIZE;
+            offset = std::min(document.size(), offset + next(16) - std::min<size_t>(offset, 8));
+            size_t erase = next(std::min<size_t>(document.size() - offset, step % 7 == 3 ? 3 * INCREMENTAL_BLOCK_SIZE : 10) + 1);
+            std::string replacement = random_text(step % 7 == 5 ? next(INCREMENTAL_BLOCK_SIZE) : next(5));
+            scorer.replace(offset, erase, spanOf(replacement));
+            document.replace(offset, erase, replacement);
+            ASSERT_TRUE(scorer.contents() == std::vector<unsigned char>(document.begin(), document.end()));
+            CountedFingerprint expected = fullFingerprint(document, options);
+            ASSERT_TRUE(expected.hashes == scorer.fingerprint().hashes);
+            ASSERT_TRUE(expected.counts == scorer.fingerprint().counts);
+            ASSERT_TRUE(sameMetrics(similarity_metrics(counted, expected), scorer.metrics(0)));
+        }
+        
+        // 参数与区间检查
+        options = FingerprintOptions();
+        options.winnow_window = 4;
+        bool rejected = false;
+        try {
+            IncrementalScorer winnowed(options, spanOf("abcdef"));
+        } catch (const std::runtime_error&) {
+            rejected = true;
+        }
+        ASSERT_TRUE(rejected);
+        IncrementalScorer small(FingerprintOptions(), spanOf("abcdef"));
+        rejected = false;
+        try {
+            small.replace(4, 3, spanOf("x"));
+        } catch (const std::runtime_error&) {
+            rejected = true;
+        }
+        ASSERT_TRUE(rejected);
+        ASSERT_EQ(0u, small.update(spanOf("abcdef")));
+        ASSERT_EQ(2u, small.update(spanOf("abXYef")));
+        return true;
+    }
+};
+
+// 测试用例33：前K查询与对全部得分排序后取前K的结果一致
+class TestTopKQuery : public TestCase {
+public:
+    std::string getName() const override { return "前K查询测试"; }
+    
+    bool run() override {
+        // 若干篇基础文本及其不同程度改写的变体，外加长度差别很大的文档，相似度有大量并列
+        uint64_t state = 5;
+        auto next = [&state](uint64_t bound) {
+            state = mix64(state);
+            return state % bound;
+        };
+        std::vector<std::vector<uint64_t>> sets;
+        CorpusIndexBuilder builder(FingerprintOptions{});
+        for (size_t base = 0; base < 80; ++base) {
+            std::vector<uint32_t> text(50 + next(300));
+            for (auto& cp : text) cp = 0x4E00 + static_cast<uint32_t>(next(200));
+            for (size_t variant = 0; variant < 8; ++variant) {
+                std::vector<uint32_t> doc = text;
+                for (auto& cp : doc) {
+                    if (next(16) < variant) cp = 0x4E00 + static_cast<uint32_t>(next(200));
+                }
+                if (variant == 7) doc.resize(doc.size() / 4);
+                sets.push_back(build_kgram_vector(doc, 3));
+                builder.add_document("doc" + std::to_string(sets.size() - 1), sets.back());
+            }
+        }
+        sets.push_back(std::vector<uint64_t>());
+        builder.add_document("empty", sets.back());
+        CorpusIndex index = builder.finish();
+        
+        for (size_t q = 0; q < sets.size(); q += 25) {
+            std::vector<uint64_t> query = sets[q];
+            if (q % 50 == 25 && !query.empty()) query.resize(query.size() / 2);
+            std::vector<double> scores = query_corpus_index(index, query);
+            std::vector<size_t> order;
+            for (size_t doc = 0; doc < scores.size(); ++doc) {
+                if (scores[doc] > 0.0) order.push_back(doc);
+            }
+            std::stable_sort(order.begin(), order.end(), [&scores](size_t a, size_t b) { return scores[a] > scores[b]; });
+            
+            for (size_t k : {1u, 3u, 10u, 200u}) {
+                TopKStats stats;
+                std::vector<RankedDocument> top = query_corpus_top_k(index, query, k, &stats);
+                ASSERT_EQ(std::min(k, order.size()), top.size());
+                for (size_t r = 0; r < top.size(); ++r) {
+                    ASSERT_EQ(order[r], top[r].doc);
+                    ASSERT_EQ(scores[order[r]], top[r].score);
+                }
+                ASSERT_EQ(sets.size(), stats.documents);
+                ASSERT_EQ(stats.candidates, stats.size_pruned + stats.bound_pruned + stats.verified);
+                ASSERT_TRUE(stats.scanned_terms <= stats.terms);
+                if (k == 1 && q % 50 == 0 && !query.empty()) {
+                    // 查询语料中的原文：自身得分为1，扫描到一半多一点就能停止前缀扫描
+                    ASSERT_EQ(1.0, top[0].score);
+                    ASSERT_TRUE(stats.scanned_terms < stats.terms);
+                }
+                if (k * TOP_K_FULL_SCAN_SHARE >= sets.size()) {
+                    // K占文档的比例大：不剪枝，所有倒排表都完整扫描
+                    ASSERT_EQ(stats.terms, stats.scanned_terms);
+                    ASSERT_EQ(stats.candidates, stats.verified);
+                }
+            }
+        }
+        ASSERT_TRUE(query_corpus_top_k(index, sets[0], 0).empty());
+        return true;
+    }
+};
+
+// 测试用例34：文档频率表、停用k-gram与TF-IDF加权相似度
+class TestDocumentFrequency : public TestCase {
+public:
+    std::string getName() const override { return "文档频率表测试"; }
+    
+    static CountedFingerprint countedOf(const std::string& text) {
+        StreamingFingerprinter fingerprinter(FingerprintOptions(), true);
+        fingerprinter.feed(reinterpret_cast<const unsigned char*>(text.data()), text.size());
+        CountedFingerprint result;
+        result.hashes = fingerprinter.finish_in_place();
+        result.counts = fingerprinter.counts_in_place();
+        return result;
+    }
+    
+    bool run() override {
+        // 四篇文档共用同一段课程页眉
+        const std::string header = "软件工程课程作业提交模板";
+        std::vector<std::string> texts = {header + "今天天气很好我们去公园散步", header + "明天可能下雨记得带伞出门",
+                                          header + "图书馆周末开放到晚上十点", header + "食堂新开了一个面食窗口"};
+        std::vector<std::vector<uint64_t>> sets;
+        DocumentFrequencyBuilder builder(FingerprintOptions{});
+        CorpusIndexBuilder index_builder(FingerprintOptions{});
+        for (const std::string& text : texts) {
+            std::vector<unsigned char> bytes(text.begin(), text.end());
+            sets.push_back(build_kgram_vector(normalize_to_codepoints(bytes), 3));
+            builder.add_document(sets.back());
+            index_builder.add_document("doc", sets.back());
+        }
+        DocumentFrequencyTable table = builder.finish();
+        ASSERT_EQ(4u, table.documents);
+        ASSERT_TRUE(std::is_sorted(table.hashes.begin(), table.hashes.end()));
+        
+        std::vector<unsigned char> header_bytes(header.begin(), header.end());
+        std::vector<uint64_t> header_set = build_kgram_vector(normalize_to_codepoints(header_bytes), 3);
+        for (uint64_t hash : header_set) ASSERT_EQ(4u, table.frequency(hash));
+        for (uint64_t hash : sets[0]) {
+            if (!std::binary_search(header_set.begin(), header_set.end(), hash)) ASSERT_TRUE(table.frequency(hash) <= 2);
+        }
+        ASSERT_EQ(0u, table.frequency(0x123456789ULL));
+        
+        // 倒排表长度就是文档频率
+        DocumentFrequencyTable from_index = document_frequencies(index_builder.finish());
+        ASSERT_EQ(table.documents, from_index.documents);
+        ASSERT_TRUE(table.hashes == from_index.hashes);
+        ASSERT_TRUE(table.counts == from_index.counts);
+        
+        // 停用k-gram恰好是页眉：去掉后集合变小，只共享页眉的两篇不再相似
+        std::vector<uint64_t> stop = stop_grams(table, 0.5);
+        ASSERT_TRUE(stop == header_set);
+        std::vector<uint64_t> set0 = sets[0], set1 = sets[1];
+        ASSERT_TRUE(jaccard_similarity_sorted(set0, set1) > 0.2);
+        remove_stop_grams(set0, stop);
+        remove_stop_grams(set1, stop);
+        ASSERT_EQ(sets[0].size() - header_set.size(), set0.size());
+        ASSERT_EQ(0.0, jaccard_similarity_sorted(set0, set1));
+        CountedFingerprint counted = countedOf(texts[0] + texts[0]);
+        remove_stop_grams(counted, stop);
+        ASSERT_EQ(counted.hashes.size(), counted.counts.size());
+        for (uint64_t hash : header_set) {
+            ASSERT_FALSE(std::binary_search(counted.hashes.begin(), counted.hashes.end(), hash));
+        }
+        
+        // 建索引时去掉停用k-gram：页眉不进入倒排表，查询同样去掉，只共享页眉的文档得分为0；过滤条件随索引保存
+        CorpusIndexBuilder filtered_builder(FingerprintOptions{}, stop, 0.5);
+        for (const std::vector<uint64_t>& set : sets) filtered_builder.add_document("doc", set);
+        CorpusIndex filtered = filtered_builder.finish();
+        for (uint64_t hash : header_set) {
+            ASSERT_FALSE(std::binary_search(filtered.terms.begin(), filtered.terms.end(), hash));
+        }
+        ASSERT_EQ(set0.size(), filtered.doc_set_sizes[0]);
+        const std::string index_path = "test_document_frequency.idx";
+        save_corpus_index(filtered, index_path);
+        CorpusIndex loaded_index = load_corpus_index(index_path);
+        std::remove(index_path.c_str());
+        ASSERT_TRUE(loaded_index.stop_grams == stop);
+        ASSERT_EQ(0.5, loaded_index.max_df);
+        std::vector<double> scores = query_corpus_index(loaded_index, sets[0]);
+        ASSERT_NEAR(1.0, scores[0], 1e-12);
+        for (size_t doc = 1; doc < scores.size(); ++doc) ASSERT_EQ(0.0, scores[doc]);
+        std::vector<RankedDocument> top = query_corpus_top_k(loaded_index, sets[0], 4);
+        ASSERT_EQ(1u, top.size());
+        ASSERT_EQ(0u, top[0].doc);
+        
+        // TF-IDF：页眉出现在所有文档中，权重为0；相同文档为1，与集合Jaccard相比不再被页眉抬高
+        ASSERT_EQ(0.0, inverse_document_frequency(table, header_set[0]));
+        ASSERT_NEAR(std::log(5.0), inverse_document_frequency(table, 0x123456789ULL), 1e-12);
+        CountedFingerprint a = countedOf(texts[0]), b = countedOf(texts[1]);
+        ASSERT_NEAR(1.0, tfidf_similarity(a, a, table), 1e-12);
+        ASSERT_EQ(0.0, tfidf_similarity(a, b, table));
+        CountedFingerprint revised = countedOf(header + "今天天气很好我们去公园跑步");
+        ASSERT_TRUE(tfidf_similarity(a, revised, table) > 0.0);
+        ASSERT_TRUE(tfidf_similarity(a, revised, table) < similarity_metrics(a, revised).weighted_jaccard);
+        
+        // 保存后加载
+        const std::string path = "test_document_frequency.df";
+        save_document_frequencies(table, path);
+        DocumentFrequencyTable loaded = load_document_frequencies(path);
+        std::remove(path.c_str());
+        ASSERT_EQ(table.documents, loaded.documents);
+        ASSERT_TRUE(table.hashes == loaded.hashes);
+        ASSERT_TRUE(table.counts == loaded.counts);
+        ASSERT_EQ(3u, loaded.options.k);
+        return true;
+    }
+};
+
 int main() {
     TestRunner runner;
     
@@ -511,6 +2374,30 @@ int main() {
     runner.addTest(std::make_unique<TestEndToEnd>());
     runner.addTest(std::make_unique<TestBoundaryConditions>());
     runner.addTest(std::make_unique<TestPerformance>());
+    runner.addTest(std::make_unique<TestCorpusIndex>());
+    runner.addTest(std::make_unique<TestRollingHash>());
+    runner.addTest(std::make_unique<TestWinnowing>());
+    runner.addTest(std::make_unique<TestMinHashLsh>());
+    runner.addTest(std::make_unique<TestSortedVectorSet>());
+    runner.addTest(std::make_unique<TestInputSource>());
+    runner.addTest(std::make_unique<TestStreamingPipeline>());
+    runner.addTest(std::make_unique<TestSimdNormalize>());
+    runner.addTest(std::make_unique<TestWorkStealingScheduler>());
+    runner.addTest(std::make_unique<TestBatchScoring>());
+    runner.addTest(std::make_unique<TestFingerprintCache>());
+    runner.addTest(std::make_unique<TestFingerprintWorkspace>());
+    runner.addTest(std::make_unique<TestScoringServer>());
+    runner.addTest(std::make_unique<TestSimilarityMetrics>());
+    runner.addTest(std::make_unique<TestMatchedSpans>());
+    runner.addTest(std::make_unique<TestCommonSubstrings>());
+    runner.addTest(std::make_unique<TestNormalizationProfiles>());
+    runner.addTest(std::make_unique<TestInstrumentation>());
+    runner.addTest(std::make_unique<TestCompressedFingerprint>());
+    runner.addTest(std::make_unique<TestParallelFingerprint>());
+    runner.addTest(std::make_unique<TestFlatHashSet>());
+    runner.addTest(std::make_unique<TestIncrementalScorer>());
+    runner.addTest(std::make_unique<TestTopKQuery>());
+    runner.addTest(std::make_unique<TestDocumentFrequency>());
     
     // 运行所有测试
     bool success = runner.runAll();